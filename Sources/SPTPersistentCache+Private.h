@@ -5,9 +5,21 @@
 #import <SPTPersistentCache/SPTPersistentCacheResponse.h>
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
 
+#import "SPTPersistentCacheScheduler.h"
+
+@class SPTPersistentCacheAccessHistory;
+@class SPTPersistentCacheBlobStore;
+@class SPTPersistentCacheCancellationToken;
 @class SPTPersistentCacheFileManager;
 @class SPTPersistentCacheGarbageCollector;
+@class SPTPersistentCacheKeyFilter;
+@class SPTPersistentCacheKeyIndex;
+@class SPTPersistentCacheLockJournal;
+@class SPTPersistentCachePartitionTable;
 @class SPTPersistentCachePosixWrapper;
+@class SPTPersistentCacheSharedIndex;
+@class SPTPersistentCacheTagIndex;
+@class SPTPersistentCacheTraceRecorder;
 
 void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull dispatch_block_t block);
 
@@ -20,8 +32,8 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
 
-/// Serial queue used to run all internal stuff
-@property (nonatomic, strong, readonly) NSOperationQueue *workQueue;
+/// Runs all internal stuff on separate lanes for reads, writes and maintenance
+@property (nonatomic, strong, readonly) SPTPersistentCacheScheduler *scheduler;
 
 @property (nonatomic, strong, readonly) NSFileManager *fileManager;
 @property (nonatomic, strong, readonly) SPTPersistentCacheFileManager *dataCacheFileManager;
@@ -31,6 +43,70 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, assign, readonly) NSTimeInterval currentDateTimeInterval;
 @property (nonatomic, strong, readonly) SPTPersistentCachePosixWrapper *posixWrapper;
 
+/// Maps keys to the partitions configured in the options
+@property (nonatomic, strong, readonly) SPTPersistentCachePartitionTable *partitionTable;
+
+/// Filter of the keys on disk, used to answer definite misses, when `keyFilterCapacity` is set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheKeyFilter *keyFilter;
+
+/// Sorted keys and the metadata of their records, used for prefix queries, when `useKeyIndex` is set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheKeyIndex *keyIndex;
+
+/// Records of the cache directory shared with other processes, used to answer misses, when both
+/// `useMultiProcessCoordination` and `keyFilterCapacity` are set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheSharedIndex *sharedIndex;
+
+/// Keys of the records loaded most often and most recently, kept across runs, when `accessHistoryCapacity` is set in
+/// the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheAccessHistory *accessHistory;
+
+/// Holds the refCounts of records instead of their headers when `useLockJournal` is set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheLockJournal *lockJournal;
+
+/// Keys of the records each tag was attached to when `useTagIndex` is set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheTagIndex *tagIndex;
+
+/// Payloads shared by deduplicated records when `deduplicationThresholdBytes` is set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheBlobStore *blobStore;
+
+/// Callbacks waiting for a running loader, by key. Guarded by synchronizing on the dictionary.
+@property (nonatomic, strong, readonly) NSMutableDictionary<NSString *, NSMutableArray<SPTPersistentCacheResponseCallback> *> *pendingLoads;
+
+/// Keys with open file handles, each counted once per handle. Guarded by synchronizing on the set.
+@property (nonatomic, strong, readonly) NSCountedSet<NSString *> *pinnedKeys;
+/// Pinned keys to remove once their last file handle is closed. Guarded by synchronizing on `pinnedKeys`.
+@property (nonatomic, strong, readonly) NSMutableSet<NSString *> *deferredRemovals;
+
+/// Records the public API calls when `traceFilePath` is set in the options
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheTraceRecorder *traceRecorder;
+
+/// Reads the record for key, flagged as stale when expired if allowStale is set. Called on the read lane.
+- (SPTPersistentCacheResponse *)loadResponseForKeySync:(NSString *)key allowStale:(BOOL)allowStale;
+
+/// Removes the record for key, or defers the removal if the key is pinned. Returns YES if the record was removed.
+- (BOOL)removeDataForKeySync:(NSString *)key;
+
+/// Removes the records for keys like `removeDataForKeySync:`, committing the lock journal and tag index once for all
+/// of them. Returns the keys whose records were removed.
+- (NSArray<NSString *> *)removeDataForKeysSync:(NSArray<NSString *> *)keys;
+
+/// Schedules unlinking of the removed files on the maintenance lane, unless that is already scheduled.
+- (void)scheduleTrashReaper;
+
+/// Schedules moving records stored under an earlier directory layout on the maintenance lane.
+- (void)scheduleLayoutMigration;
+
+/// Fills the key filter from the files on disk. Called on the maintenance lane.
+- (void)populateKeyFilter;
+/// Fills the key index from the record headers on disk. Called on the maintenance lane.
+- (void)populateKeyIndex;
+/// Fills the shared index from the record headers on disk unless another process does. Called on the maintenance lane.
+- (void)populateSharedIndex;
+
+/// Asks the system to read the records for keys into its page cache, stopping early for foreground work. Returns NO
+/// if it stopped early. Called on the maintenance lane.
+- (BOOL)prefetchRecordsForKeys:(NSArray<NSString *> *)keys prefetchedCount:(NSUInteger *)prefetchedCount;
+
 - (void)runRegularGC;
 - (BOOL)pruneBySize;
 
@@ -49,7 +125,15 @@ NS_ASSUME_NONNULL_BEGIN
              callback:(SPTPersistentCacheResponseCallback _Nullable)callback
               onQueue:(dispatch_queue_t _Nullable)queue;
 
-- (void)doWork:(void (^)(void))block priority:(NSOperationQueuePriority)priority qos:(NSQualityOfService)qos;
+- (void)doWork:(void (^)(void))block
+          lane:(SPTPersistentCacheSchedulerLane)lane
+      priority:(NSOperationQueuePriority)priority
+           qos:(NSQualityOfService)qos;
+- (void)doWork:(void (^)(void))block
+          lane:(SPTPersistentCacheSchedulerLane)lane
+      priority:(NSOperationQueuePriority)priority
+           qos:(NSQualityOfService)qos
+cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken;
 
 - (void)logTimingForKey:(NSString *)key method:(SPTPersistentCacheDebugMethodType)method type:(SPTPersistentCacheDebugTimingType)type;
 
@@ -6,6 +6,7 @@
 #import <SPTPersistentCache/SPTPersistentCacheImplementation.h>
 #import <SPTPersistentCache/SPTPersistentCacheResponse.h>
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
 #import <SPTPersistentCache/SPTPersistentCacheHeader.h>
 
 #import "SPTPersistentCacheRecord+Private.h"
@@ -16,8 +17,24 @@
 #import "SPTPersistentCacheTypeUtilities.h"
 #import "SPTPersistentCacheDebugUtilities.h"
 #import "SPTPersistentCachePosixWrapper.h"
-
+#import "SPTPersistentCacheTraceRecorder.h"
+#import "SPTPersistentCacheCancellationToken+Private.h"
+#import "SPTPersistentCacheScheduler.h"
+#import "SPTPersistentCacheKeyFilter.h"
+#import "SPTPersistentCacheKeyIndex.h"
+#import "SPTPersistentCachePartitionTable.h"
+#import "SPTPersistentCacheRecordMetadata+Private.h"
+#import "SPTPersistentCacheLockJournal.h"
+#import "SPTPersistentCacheSharedIndex.h"
+#import "SPTPersistentCacheAccessHistory.h"
+#import "SPTPersistentCacheTagIndex.h"
+#import "SPTPersistentCacheBlobStore.h"
+#import "SPTPersistentCacheUpdateJournal.h"
+#import "SPTPersistentCacheFileHandle+Private.h"
+
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <stdatomic.h>
 #import <mach/mach_time.h>
 
 #include "crc32iso3309.h"
@@ -27,12 +44,57 @@
 
 typedef SPTPersistentCacheResponse* (^SPTPersistentCacheFileProcessingBlockType)(int filedes);
 typedef void (^SPTPersistentCacheRecordHeaderGetCallbackType)(SPTPersistentCacheRecordHeader *header);
+typedef void (^SPTPersistentCacheRecordKeyHeaderCallbackType)(NSString *key, SPTPersistentCacheRecordHeader *header);
 
 NSString *const SPTPersistentCacheErrorDomain = @"persistent.cache.error";
 static NSString * const SPTDataCacheFileNameKey = @"SPTDataCacheFileNameKey";
 static NSString * const SPTDataCacheFileAttributesKey = @"SPTDataCacheFileAttributesKey";
 
 static const uint64_t SPTPersistentCacheTTLUpperBoundInSec = 86400 * 31 * 2;
+// Number of files unlinked by the trash reaper before it lets foreground work go first
+static const NSUInteger SPTPersistentCacheTrashReapBatchSize = 64;
+// Number of records moved to another directory layout before foreground work may go first
+static const NSUInteger SPTPersistentCacheLayoutMigrationBatchSize = 64;
+// Size of the buffer used to copy files into the cache
+static const size_t SPTPersistentCacheFileCopyChunkSize = 256 * 1024;
+// Number of record headers read with one batch of reads when scanning the cache
+static const NSUInteger SPTPersistentCacheHeaderReadBatchSize = 32;
+
+// Number of records evicted by size between letting foreground work go first
+static const NSUInteger SPTPersistentCacheEvictionBatchSize = 32;
+
+static NSError *SPTPersistentCachePosixError(int errorNumber)
+{
+    NSString *errorDescription = @(strerror(errorNumber));
+    return [NSError errorWithDomain:NSPOSIXErrorDomain
+                               code:errorNumber
+                           userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+}
+
+// Misses carry nothing specific to the key, so the hot path hands out one shared response for them
+static SPTPersistentCacheResponse *SPTPersistentCacheNotFoundResponse(void)
+{
+    static SPTPersistentCacheResponse *response;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound error:nil record:nil];
+    });
+    return response;
+}
+
+// The journal of an in-place update sits hidden next to its record, on the same file system and skipped by walks
+static NSString *SPTPersistentCacheUpdateJournalPath(NSString *recordPath)
+{
+    NSString *fileName = [NSString stringWithFormat:@".%@.update", recordPath.lastPathComponent];
+    return [[recordPath stringByDeletingLastPathComponent] stringByAppendingPathComponent:fileName];
+}
+
+// Resolves the range of an update against the payload, a location of NSNotFound appending to it
+static BOOL SPTPersistentCacheResolveUpdateRange(NSRange range, uint64_t payloadSize, uint64_t *location)
+{
+    *location = (range.location == NSNotFound ? payloadSize : range.location);
+    return *location <= payloadSize && range.length <= payloadSize - *location;
+}
 
 void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull dispatch_block_t block)
 {
@@ -48,14 +110,70 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 @property (nonatomic, strong, readonly) NSString *fileName;
 @property (nonatomic, strong, readonly) NSDate *mdate;
 @property (nonatomic, assign, readonly) off_t fileSize;
-- (instancetype)initWithFileName:(NSString *)fileName mdate:(NSDate *)mdate fileSize:(off_t)fileSize;
+// What keeping a byte of the record is worth, see SPTPersistentCacheEvictionValuePerByte
+@property (nonatomic, assign, readonly) double valuePerByte;
+- (instancetype)initWithFileName:(NSString *)fileName
+                           mdate:(NSDate *)mdate
+                        fileSize:(off_t)fileSize
+                    valuePerByte:(double)valuePerByte;
+@end
+
+/// Where a metadata enumeration continues once its caller is done with the last batch
+@interface SPTPersistentCacheMetadataCursor : NSObject
+@property (nonatomic, copy, readonly) NSString *prefix;
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheMetadataPredicate predicate;
+@property (nonatomic, assign, readonly) NSUInteger batchSize;
+@property (nonatomic, strong, readonly, nullable) SPTPersistentCacheCancellationToken *cancellationToken;
+@property (nonatomic, copy, readonly) SPTPersistentCacheMetadataBatchCallback callback;
+@property (nonatomic, strong, readonly) dispatch_queue_t queue;
+// Set by the first batch if the key index wasn’t ready, the walk then continues in the directory
+@property (nonatomic, strong, nullable) NSDirectoryEnumerator<NSURL *> *directoryEnumerator;
+// The last key read from the key index, the walk continues after it
+@property (nonatomic, copy, nullable) NSString *lastKey;
+@property (nonatomic, assign) BOOL started;
+- (instancetype)initWithPrefix:(NSString *)prefix
+                     predicate:(nullable SPTPersistentCacheMetadataPredicate)predicate
+                     batchSize:(NSUInteger)batchSize
+             cancellationToken:(nullable SPTPersistentCacheCancellationToken *)cancellationToken
+                      callback:(SPTPersistentCacheMetadataBatchCallback)callback
+                         queue:(dispatch_queue_t)queue;
 @end
 
+/**
+ What keeping a byte of a record is worth, its cost of being fetched again per byte weighted by its priority. Records
+ without a cost hint are worth one per byte.
+ */
+static double SPTPersistentCacheEvictionValuePerByte(uint32_t priority, uint64_t refetchCost, off_t fileSize)
+{
+    double weight = 1.0;
+    switch ((SPTPersistentCacheRecordPriority)priority) {
+        case SPTPersistentCacheRecordPriorityLow:
+            weight = 0.25;
+            break;
+        case SPTPersistentCacheRecordPriorityHigh:
+            weight = 4.0;
+            break;
+        case SPTPersistentCacheRecordPriorityNormal:
+            break;
+    }
+
+    if (refetchCost == 0 || fileSize <= 0) {
+        return weight;
+    }
+    return weight * (double)refetchCost / (double)fileSize;
+}
+
 // Class extension exists in SPTPersistentCache+Private.h
 
 #pragma mark - SPTPersistentCache
 
 @implementation SPTPersistentCache
+{
+    atomic_bool _trashReaperScheduled;
+    atomic_bool _sharedIndexPopulationScheduled;
+    // Set by the first in-place update, from then on writers of a header lock the record and check it is unchanged
+    atomic_bool _recordsUpdatedInPlace;
+}
 
 - (instancetype)init
 {
@@ -66,24 +184,109 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 {
     self = [super init];
     if (self) {
-        _workQueue = [[NSOperationQueue alloc] init];
-        _workQueue.name = options.identifierForQueue;
-        _workQueue.maxConcurrentOperationCount = options.maxConcurrentOperations;
-        NSAssert(_workQueue, @"The work queue couldn’t be created using the given options: %@", options);
-
         _options = [options copy];
+        _scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:_options];
+        NSAssert(_scheduler, @"The scheduler couldn’t be created using the given options: %@", options);
+
         _fileManager = [NSFileManager defaultManager];
         _debugOutput = [self.options.debugOutput copy];
         _dataCacheFileManager = [[SPTPersistentCacheFileManager alloc] initWithOptions:_options];
         _posixWrapper = [SPTPersistentCachePosixWrapper new];
+        _pendingLoads = [NSMutableDictionary dictionary];
+        _pinnedKeys = [NSCountedSet set];
+        _deferredRemovals = [NSMutableSet set];
+        _partitionTable = [[SPTPersistentCachePartitionTable alloc] initWithOptions:_options];
         _garbageCollector = [[SPTPersistentCacheGarbageCollector alloc] initWithCache:self
                                                                               options:_options
-                                                                                queue:_workQueue];
+                                                                                queue:_scheduler.maintenanceQueue];
 
+        if (_options.traceFilePath != nil) {
+            _traceRecorder = [[SPTPersistentCacheTraceRecorder alloc] initWithPath:_options.traceFilePath
+                                                                       debugOutput:_debugOutput];
+        }
 
         if (![_dataCacheFileManager createCacheDirectory]) {
             return nil;
         }
+
+        if (_options.useLockJournal && _options.useMultiProcessCoordination) {
+            // Each process would replay its own copy of the journal
+            [self debugOutput:@"PersistentDataCache: The lock journal isn’t used by multiple processes"];
+        }
+        if (_options.useLockJournal && !_options.useMultiProcessCoordination) {
+            [self openLockJournal];
+        } else if ([_fileManager fileExistsAtPath:_dataCacheFileManager.lockJournalPath]) {
+            [self closeLockJournal];
+        }
+
+        // Files removed by an earlier instance may not have been reaped yet
+        if ([_fileManager fileExistsAtPath:_dataCacheFileManager.trashPath]) {
+            [self scheduleTrashReaper];
+        }
+
+        // Records stored under another directory layout are found in either place until they have been moved
+        if (_dataCacheFileManager.isMigratingLayout) {
+            [self scheduleLayoutMigration];
+        }
+
+        if (_options.useKeyIndex) {
+            _keyIndex = [[SPTPersistentCacheKeyIndex alloc] initWithPartitionTable:_partitionTable];
+            [self doWork:^{
+                [self populateKeyIndex];
+            } lane:SPTPersistentCacheSchedulerLaneMaintenance
+                priority:self.options.garbageCollectionPriority
+                     qos:self.options.garbageCollectionQualityOfService];
+        }
+
+        if (_options.useTagIndex && _options.useMultiProcessCoordination) {
+            // Tags stored by other processes would be missing from the index of this one
+            [self debugOutput:@"PersistentDataCache: The tag index isn’t used by multiple processes"];
+        } else if (_options.useTagIndex) {
+            _tagIndex = [[SPTPersistentCacheTagIndex alloc] initWithPath:_dataCacheFileManager.tagIndexPath
+                                                             debugOutput:_debugOutput];
+        }
+
+        if (_options.deduplicationThresholdBytes > 0 && _options.useMultiProcessCoordination) {
+            // Blobs referenced only by records of other processes would look unreferenced to this one
+            [self debugOutput:@"PersistentDataCache: Deduplication isn’t used by multiple processes"];
+        } else if (_options.deduplicationThresholdBytes > 0 || [_fileManager fileExistsAtPath:_dataCacheFileManager.blobsPath]) {
+            // Blobs of records stored before deduplication was turned off are still read and removed with them
+            _blobStore = [[SPTPersistentCacheBlobStore alloc] initWithPath:_dataCacheFileManager.blobsPath
+                                                              fileManager:_fileManager
+                                                              debugOutput:_debugOutput];
+            [self doWork:^{
+                [self populateBlobStore];
+            } lane:SPTPersistentCacheSchedulerLaneMaintenance
+                priority:self.options.garbageCollectionPriority
+                     qos:self.options.garbageCollectionQualityOfService];
+        }
+
+        if (_options.accessHistoryCapacity > 0) {
+            _accessHistory = [[SPTPersistentCacheAccessHistory alloc] initWithPath:_dataCacheFileManager.accessHistoryPath
+                                                                          capacity:_options.accessHistoryCapacity
+                                                                       debugOutput:_debugOutput];
+        }
+
+        if (_options.keyFilterCapacity > 0 && _options.useMultiProcessCoordination) {
+            _sharedIndex = [[SPTPersistentCacheSharedIndex alloc] initWithPath:_dataCacheFileManager.sharedIndexPath
+                                                                      capacity:_options.keyFilterCapacity
+                                                                   debugOutput:_debugOutput];
+            if (_sharedIndex != nil && !_sharedIndex.isReady) {
+                [self schedulePopulatingSharedIndex];
+            }
+        } else if (_options.keyFilterCapacity > 0) {
+            _keyFilter = [[SPTPersistentCacheKeyFilter alloc] initWithCapacity:_options.keyFilterCapacity
+                                                              falsePositiveRate:_options.keyFilterFalsePositiveRate];
+            if (_keyFilter == nil) {
+                [self debugOutput:@"PersistentDataCache: Unable to create key filter with capacity: %@", @(_options.keyFilterCapacity)];
+            } else {
+                [self doWork:^{
+                    [self populateKeyFilter];
+                } lane:SPTPersistentCacheSchedulerLaneMaintenance
+                    priority:self.options.garbageCollectionPriority
+                         qos:self.options.garbageCollectionQualityOfService];
+            }
+        }
     }
     return self;
 }
@@ -91,18 +294,83 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 - (BOOL)loadDataForKey:(NSString *)key
           withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                onQueue:(dispatch_queue_t _Nullable)queue
+{
+    return [self loadDataForKey:key cancellationToken:nil withCallback:callback onQueue:queue];
+}
+
+- (BOOL)loadDataForKey:(NSString *)key
+     cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
+          withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+               onQueue:(dispatch_queue_t _Nullable)queue
 {
     if (callback == nil || queue == nil) {
         return NO;
     }
 
-    callback = [callback copy];
+    callback = SPTPersistentCacheCancellableCallback([callback copy], cancellationToken);
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationLoad key:key payloadSize:0 ttl:0 locked:NO];
+
+    // Definite miss, no need to queue any work
+    if ((self.keyFilter != nil && ![self.keyFilter mightContainKey:key]) || [self isDefiniteMissInSharedIndexForKey:key allowStale:NO]) {
+        [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeNotFound callback:callback onQueue:queue];
+        return YES;
+    }
+
     [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
+        // The token may have been cancelled between the queue starting the operation and now
+        if (cancellationToken.isCancelled) {
+            return;
+        }
         [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeStarting];
         [self loadDataForKeySync:key withCallback:callback onQueue:queue];
         [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.readPriority qos:self.options.readQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneRead priority:self.options.readPriority qos:self.options.readQualityOfService cancellationToken:cancellationToken];
+    return YES;
+}
+
+- (BOOL)loadDataForKey:(NSString *)key
+                loader:(SPTPersistentCacheLoader _Nullable)loader
+                   ttl:(NSUInteger)ttl
+            serveStale:(BOOL)serveStale
+          withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+               onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (callback == nil || queue == nil || loader == nil) {
+        return NO;
+    }
+
+    callback = [callback copy];
+    loader = [loader copy];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationFetch key:key payloadSize:0 ttl:ttl locked:NO];
+
+    // Definite miss, go straight to the loader
+    if ((self.keyFilter != nil && ![self.keyFilter mightContainKey:key]) || [self isDefiniteMissInSharedIndexForKey:key allowStale:serveStale]) {
+        [self fetchDataForKey:key loader:loader ttl:ttl callback:callback onQueue:queue];
+        return YES;
+    }
+
+    [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeStarting];
+        SPTPersistentCacheResponse *response = [self loadResponseForKeySync:key allowStale:serveStale];
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeFinished];
+
+        if (response.result == SPTPersistentCacheResponseCodeOperationSucceeded) {
+            SPTPersistentCacheSafeDispatch(queue, ^{
+                callback(response);
+            });
+            if (response.isStale) {
+                [self fetchDataForKey:key loader:loader ttl:ttl callback:nil onQueue:nil];
+            }
+            return;
+        }
+
+        if (response.result == SPTPersistentCacheResponseCodeOperationError) {
+            [self debugOutput:@"PersistentDataCache: Reloading unreadable record for key:%@, error:%@", key, response.error];
+        }
+        [self fetchDataForKey:key loader:loader ttl:ttl callback:callback onQueue:queue];
+    } lane:SPTPersistentCacheSchedulerLaneRead priority:self.options.readPriority qos:self.options.readQualityOfService];
     return YES;
 }
 
@@ -110,68 +378,69 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
                 chooseKeyCallback:(SPTPersistentCacheChooseKeyCallback _Nullable)chooseKeyCallback
                      withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                           onQueue:(dispatch_queue_t _Nullable)queue
+{
+    return [self loadDataForKeysWithPrefix:prefix
+                         chooseKeyCallback:chooseKeyCallback
+                         cancellationToken:nil
+                              withCallback:callback
+                                   onQueue:queue];
+}
+
+- (BOOL)loadDataForKeysWithPrefix:(NSString *)prefix
+                chooseKeyCallback:(SPTPersistentCacheChooseKeyCallback _Nullable)chooseKeyCallback
+                cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
+                     withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                          onQueue:(dispatch_queue_t _Nullable)queue
 {
     if (callback == nil || queue == nil || chooseKeyCallback == nil) {
         return NO;
     }
+    callback = SPTPersistentCacheCancellableCallback([callback copy], cancellationToken);
+    // Written once the key to open is known, with the time of the call
+    SPTPersistentCacheTraceRecorder * const traceRecorder = self.traceRecorder;
+    SPTPersistentCacheTraceRecord traceRecord;
+    memset(&traceRecord, 0, sizeof(traceRecord));
+    if (traceRecorder != nil) {
+        traceRecord = [traceRecorder recordOfOperation:SPTPersistentCacheTraceOperationLoadWithPrefix key:prefix];
+    }
     [self logTimingForKey:prefix method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
+        if (cancellationToken.isCancelled) {
+            return;
+        }
         [self logTimingForKey:prefix method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeStarting];
-        NSString *path = [self.dataCacheFileManager subDirectoryPathForKey:prefix];
-        NSMutableArray * __block keys = [NSMutableArray array];
-
-        // WARNING: Do not use enumeratorAtURL never ever. Its unsafe bcuz gets locked forever
         NSError *error = nil;
-        NSArray *content = [self.fileManager contentsOfDirectoryAtPath:path error:&error];
-
-        if (content == nil) {
-            // If no directory is exist its fine, say not found to user
-            if (error.code == NSFileReadNoSuchFileError || error.code == NSFileNoSuchFileError) {
-                [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeNotFound
-                                             callback:callback
-                                              onQueue:queue];
-            } else {
-                [self debugOutput:@"PersistentDataCache: Unable to get dir contents: %@, error: %@", path, [error localizedDescription]];
-                [self dispatchError:error
-                             result:SPTPersistentCacheResponseCodeOperationError
-                           callback:callback
-                            onQueue:queue];
-            }
+        NSArray<SPTPersistentCacheRecordMetadata *> *liveMetadata = [self liveMetadataForKeysWithPrefix:prefix error:&error];
+        if (liveMetadata == nil) {
+            [traceRecorder writeRecord:traceRecord keys:nil];
+            [self dispatchError:error
+                         result:SPTPersistentCacheResponseCodeOperationError
+                       callback:callback
+                        onQueue:queue];
             return;
         }
 
-        [content enumerateObjectsUsingBlock:^(NSString *key, NSUInteger idx, BOOL *stop) {
-            NSString *file = key;
-            if ([file hasPrefix:prefix]) {
-                [keys addObject:file];
-            }
-        }];
-
-        NSMutableArray * __block keysToConsider = [NSMutableArray array];
-
-        // Validate keys for expiration before giving it back to caller. Its important since giving expired keys
-        // is wrong since caller can miss data that are no expired by picking expired key.
-        for (NSString *key in keys) {
-            NSString *filePath = [self.dataCacheFileManager pathForKey:key];
-
-            // WARNING: We may skip return result here bcuz in that case we will skip the key as invalid
-            [self alterHeaderForFileAtPath:filePath withBlock:^(SPTPersistentCacheRecordHeader *header) {
-                // Satisfy Req.#1.2
-                if ([self isDataCanBeReturnedWithHeader:header]) {
-                    [keysToConsider addObject:key];
-                }
-            } writeBack:NO complain:YES];
-        }
-
         // If not keys left after validation we are done with not found callback
-        if (keysToConsider.count == 0) {
+        if (liveMetadata.count == 0) {
+            [traceRecorder writeRecord:traceRecord keys:nil];
             [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeNotFound
                                          callback:callback
                                           onQueue:queue];
             return;
         }
 
+        // Validating the candidates can take a while, skip the rest if nobody is waiting for the result anymore
+        if (cancellationToken.isCancelled) {
+            return;
+        }
+
+        NSArray<NSString *> *keysToConsider = [liveMetadata valueForKey:NSStringFromSelector(@selector(key))];
         NSString *keyToOpen = chooseKeyCallback(keysToConsider);
+        if (traceRecorder != nil) {
+            SPTPersistentCacheTraceRecord openingTraceRecord = traceRecord;
+            openingTraceRecord.recordKeyHash = SPTPersistentCacheTraceKeyHash(keyToOpen);
+            [traceRecorder writeRecord:openingTraceRecord keys:nil];
+        }
 
         // If user told us 'nil' he didnt found abything interesting in keys so we are done wiht not found
         if (keyToOpen == nil) {
@@ -183,11 +452,273 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
         
         [self loadDataForKeySync:keyToOpen withCallback:callback onQueue:queue];
         [self logTimingForKey:prefix method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.readPriority qos:self.options.readQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneRead priority:self.options.readPriority qos:self.options.readQualityOfService cancellationToken:cancellationToken];
+
+    return YES;
+}
+
+- (BOOL)loadMetadataForKeysWithPrefix:(NSString *)prefix
+                             callback:(SPTPersistentCacheMetadataCallback _Nullable)callback
+                              onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (callback == nil || queue == nil) {
+        return NO;
+    }
+
+    callback = [callback copy];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationLoadMetadataWithPrefix key:prefix payloadSize:0 ttl:0 locked:NO];
+    [self logTimingForKey:prefix method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:prefix method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeStarting];
+        NSError *error = nil;
+        NSArray<SPTPersistentCacheRecordMetadata *> *liveMetadata = [self liveMetadataForKeysWithPrefix:prefix error:&error];
+
+        SPTPersistentCacheResponseCode result = SPTPersistentCacheResponseCodeOperationSucceeded;
+        if (liveMetadata == nil) {
+            result = SPTPersistentCacheResponseCodeOperationError;
+            liveMetadata = @[];
+        } else if (liveMetadata.count == 0) {
+            result = SPTPersistentCacheResponseCodeNotFound;
+        }
+
+        SPTPersistentCacheResponse *response = [[SPTPersistentCacheResponse alloc] initWithResult:result error:error record:nil];
+        SPTPersistentCacheSafeDispatch(queue, ^{
+            callback(response, liveMetadata);
+        });
+        [self logTimingForKey:prefix method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneRead priority:self.options.readPriority qos:self.options.readQualityOfService];
+    return YES;
+}
+
+/**
+ Returns the metadata of the records with a key starting with prefix that can be returned to the caller, sorted by
+ key. Answered from the key index once it has been populated, otherwise by reading the header of every match.
+ @return The metadata or nil if the directory of the prefix couldn’t be listed.
+ */
+- (nullable NSArray<SPTPersistentCacheRecordMetadata *> *)liveMetadataForKeysWithPrefix:(NSString *)prefix error:(NSError **)error
+{
+    NSMutableArray<SPTPersistentCacheRecordMetadata *> *liveMetadata = [NSMutableArray array];
+
+    SPTPersistentCacheKeyIndex * const keyIndex = self.keyIndex;
+    if (keyIndex.isReady) {
+        const uint64_t currentTime = spt_uint64rint(self.currentDateTimeInterval);
+        for (SPTPersistentCacheRecordMetadata *metadata in [keyIndex metadataForKeysWithPrefix:prefix]) {
+            // The refCounts in the headers aren’t kept up to date while the lock journal is in use
+            SPTPersistentCacheRecordMetadata *currentMetadata = (self.lockJournal != nil ?
+                                                                 [metadata metadataWithRefCount:[self.lockJournal refCountForKey:metadata.key]] :
+                                                                 metadata);
+            // Satisfy Req.#1.2
+            if (currentMetadata.refCount > 0 || currentTime <= currentMetadata.expirationTime) {
+                [liveMetadata addObject:currentMetadata];
+            }
+        }
+        return liveMetadata;
+    }
+
+    NSMutableArray<NSString *> *keys = [NSMutableArray array];
+
+    if (self.dataCacheFileManager.subDirectoriesGroupKeysByPrefix) {
+        NSString *path = [self.dataCacheFileManager subDirectoryPathForKey:prefix];
+
+        // WARNING: Do not use enumeratorAtURL never ever. Its unsafe bcuz gets locked forever
+        NSError *contentsError = nil;
+        NSArray *content = [self.fileManager contentsOfDirectoryAtPath:path error:&contentsError];
+
+        if (content == nil) {
+            // If no directory is exist its fine, say not found to user
+            if (contentsError.code == NSFileReadNoSuchFileError || contentsError.code == NSFileNoSuchFileError) {
+                return liveMetadata;
+            }
+            [self debugOutput:@"PersistentDataCache: Unable to get dir contents: %@, error: %@", path, [contentsError localizedDescription]];
+            if (error != NULL) {
+                *error = contentsError;
+            }
+            return nil;
+        }
+
+        for (NSString *file in content) {
+            if ([file hasPrefix:prefix]) {
+                [keys addObject:file];
+            }
+        }
+    } else {
+        // Keys sharing the prefix are spread over all sub directories
+        [keys addObjectsFromArray:[self.dataCacheFileManager keysWithPrefix:prefix]];
+    }
+
+    [keys sortUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+        return [key1 compare:key2 options:NSLiteralSearch];
+    }];
+
+    // Validate keys for expiration before giving it back to caller. Its important since giving expired keys
+    // is wrong since caller can miss data that are no expired by picking expired key.
+    for (NSString *key in keys) {
+        NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+
+        // WARNING: We may skip return result here bcuz in that case we will skip the key as invalid
+        [self alterHeaderForFileAtPath:filePath withBlock:^(SPTPersistentCacheRecordHeader *header) {
+            // Satisfy Req.#1.2
+            if ([self isDataCanBeReturnedWithHeader:header forKey:key]) {
+                [liveMetadata addObject:[[SPTPersistentCacheRecordMetadata alloc] initWithKey:key
+                                                                                      header:header
+                                                                     defaultExpirationPeriod:[self.partitionTable expirationPeriodForKey:key]]];
+            }
+        } writeBack:NO complain:YES];
+    }
+
+    return liveMetadata;
+}
+
+- (BOOL)enumerateMetadataForKeysWithPrefix:(NSString * _Nullable)prefix
+                                 predicate:(SPTPersistentCacheMetadataPredicate _Nullable)predicate
+                                 batchSize:(NSUInteger)batchSize
+                         cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
+                                  callback:(SPTPersistentCacheMetadataBatchCallback _Nullable)callback
+                                   onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (callback == nil || queue == nil) {
+        return NO;
+    }
 
+    SPTPersistentCacheMetadataCursor * const cursor = [[SPTPersistentCacheMetadataCursor alloc] initWithPrefix:prefix ?: @""
+                                                                                                     predicate:predicate
+                                                                                                     batchSize:MAX(batchSize, 1u)
+                                                                                             cancellationToken:cancellationToken
+                                                                                                      callback:callback
+                                                                                                         queue:queue];
+    if (self.traceRecorder != nil) {
+        SPTPersistentCacheTraceRecord record = [self.traceRecorder recordOfOperation:SPTPersistentCacheTraceOperationEnumerateMetadata key:cursor.prefix];
+        record.batchSize = (uint32_t)MIN(cursor.batchSize, (NSUInteger)UINT32_MAX);
+        [self.traceRecorder writeRecord:record keys:nil];
+    }
+    [self scheduleReadingMetadataBatchOfCursor:cursor];
     return YES;
 }
 
+/**
+ Reads the next batch of a metadata enumeration on the maintenance lane and passes it to the callback. The batch after
+ it is only scheduled once the callback returned, so the enumeration never reads ahead of its caller and no thread
+ waits for the caller meanwhile.
+ */
+- (void)scheduleReadingMetadataBatchOfCursor:(SPTPersistentCacheMetadataCursor *)cursor
+{
+    SPTPersistentCacheCancellationToken * const cancellationToken = cursor.cancellationToken;
+    [self doWork:^{
+        if (cancellationToken.isCancelled) {
+            return;
+        }
+        BOOL finished = NO;
+        NSArray<SPTPersistentCacheRecordMetadata *> * const batch = [self readMetadataBatchOfCursor:cursor finished:&finished];
+        if (cancellationToken.isCancelled) {
+            return;
+        }
+        SPTPersistentCacheSafeDispatch(cursor.queue, ^{
+            if (cancellationToken.isCancelled) {
+                return;
+            }
+            cursor.callback(batch, finished);
+            if (!finished && !cancellationToken.isCancelled) {
+                [self scheduleReadingMetadataBatchOfCursor:cursor];
+            }
+        });
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.garbageCollectionPriority qos:self.options.garbageCollectionQualityOfService cancellationToken:cancellationToken];
+}
+
+/**
+ Returns the next batch of at most batchSize records of the cursor chosen by its predicate. Read from the key index
+ page by page after the last key if it was ready when the enumeration started, otherwise by walking the directory
+ and reading as many headers as there are slots left in the batch. The refCounts of the lock journal are applied.
+ @param finished Set to YES if no records are left after the batch.
+ */
+- (NSArray<SPTPersistentCacheRecordMetadata *> *)readMetadataBatchOfCursor:(SPTPersistentCacheMetadataCursor *)cursor
+                                                                   finished:(BOOL *)finished
+{
+    SPTPersistentCacheKeyIndex * const keyIndex = self.keyIndex;
+    if (!cursor.started) {
+        cursor.started = YES;
+        if (!keyIndex.isReady) {
+            // Without a layout grouping keys by prefix the matches may be in any sub directory
+            NSString * const path = (self.dataCacheFileManager.subDirectoriesGroupKeysByPrefix ?
+                                     [self.dataCacheFileManager subDirectoryPathForKey:cursor.prefix] :
+                                     self.options.cachePath);
+            cursor.directoryEnumerator = [self.fileManager enumeratorAtURL:[NSURL fileURLWithPath:path]
+                                                includingPropertiesForKeys:@[NSURLIsDirectoryKey]
+                                                                   options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                              errorHandler:nil];
+        }
+    }
+
+    const NSUInteger batchSize = cursor.batchSize;
+    SPTPersistentCacheMetadataPredicate const predicate = cursor.predicate;
+    NSMutableArray<SPTPersistentCacheRecordMetadata *> * const batch = [NSMutableArray arrayWithCapacity:batchSize];
+    BOOL exhausted = NO;
+
+    if (cursor.directoryEnumerator == nil) {
+        while (batch.count < batchSize && !exhausted) {
+            @autoreleasepool {
+                NSArray<SPTPersistentCacheRecordMetadata *> * const page = [keyIndex metadataForKeysWithPrefix:cursor.prefix
+                                                                                                      afterKey:cursor.lastKey
+                                                                                                         limit:batchSize];
+                exhausted = (page.count < batchSize);
+                for (SPTPersistentCacheRecordMetadata *metadata in page) {
+                    cursor.lastKey = metadata.key;
+                    // The refCounts in the headers aren’t kept up to date while the lock journal is in use
+                    SPTPersistentCacheRecordMetadata *currentMetadata = (self.lockJournal != nil ?
+                                                                         [metadata metadataWithRefCount:[self.lockJournal refCountForKey:metadata.key]] :
+                                                                         metadata);
+                    if (predicate == nil || predicate(currentMetadata)) {
+                        [batch addObject:currentMetadata];
+                    }
+                    if (batch.count == batchSize) {
+                        exhausted = (exhausted && metadata == page.lastObject);
+                        break;
+                    }
+                }
+            }
+        }
+        *finished = exhausted;
+        return batch;
+    }
+
+    SPTPersistentCacheRecordKeyHeaderCallbackType headerBlock = ^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+        SPTPersistentCacheRecordMetadata *metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:key
+                                                                                                    header:header
+                                                                                   defaultExpirationPeriod:[self.partitionTable expirationPeriodForKey:key]];
+        if (predicate == nil || predicate(metadata)) {
+            [batch addObject:metadata];
+        }
+    };
+
+    // Never more headers are read than there are slots left, so no record read is held over to the next batch
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:MIN(batchSize, SPTPersistentCacheHeaderReadBatchSize)];
+    while (batch.count < batchSize && !exhausted) {
+        @autoreleasepool {
+            NSURL *theURL = [cursor.directoryEnumerator nextObject];
+            if (theURL == nil) {
+                exhausted = YES;
+            } else {
+                NSNumber *isDirectory;
+                if (![theURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]) {
+                    [self debugOutput:@"Unable to fetch isDir#8 attribute:%@", theURL];
+                    continue;
+                }
+                NSString *key = theURL.lastPathComponent;
+                if ([isDirectory boolValue] || ![key hasPrefix:cursor.prefix]) {
+                    continue;
+                }
+                [keys addObject:key];
+            }
+            if (keys.count > 0 && (exhausted || keys.count == MIN(batchSize - batch.count, SPTPersistentCacheHeaderReadBatchSize))) {
+                [self readHeadersOfRecordsForKeys:keys withBlock:headerBlock];
+                [keys removeAllObjects];
+            }
+        }
+    }
+
+    *finished = exhausted;
+    return batch;
+}
+
 - (BOOL)storeData:(NSData *)data
            forKey:(NSString *)key
            locked:(BOOL)locked
@@ -205,59 +736,165 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
      withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
           onQueue:(dispatch_queue_t _Nullable)queue
 
+{
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.ttl = ttl;
+    options.locked = locked;
+    return [self storeData:data forKey:key options:options withCallback:callback onQueue:queue];
+}
+
+- (BOOL)storeData:(NSData *)data
+           forKey:(NSString *)key
+          options:(SPTPersistentCacheStoreOptions * _Nullable)options
+     withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+          onQueue:(dispatch_queue_t _Nullable)queue
 {
     if (data == nil || key == nil || (callback != nil && queue == nil)) {
         return NO;
     }
 
-    callback = [callback copy];
+    // Read once, the caller may change its options after the store was queued
+    options = [options copy] ?: [SPTPersistentCacheStoreOptions new];
+    if (options.tags.count > 0 && self.tagIndex == nil) {
+        return NO;
+    }
+
+    SPTPersistentCacheCancellationToken * const cancellationToken = options.cancellationToken;
+    callback = SPTPersistentCacheCancellableCallback([callback copy], cancellationToken);
+    [self recordTraceOfTags:options.tags forKey:key];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationStore key:key payloadSize:data.length ttl:options.ttl locked:options.isLocked];
     [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
+        if (cancellationToken.isCancelled) {
+            return;
+        }
         [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
-        [self storeDataSync:data forKey:key ttl:ttl locked:locked withCallback:callback onQueue:queue];
+        [self storeDataSync:data
+                     forKey:key
+                        ttl:options.ttl
+                     locked:options.isLocked
+                       tags:options.tags
+                   priority:options.priority
+                refetchCost:options.refetchCost
+               withCallback:callback
+                    onQueue:queue];
         [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.writePriority qos:self.options.writeQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService cancellationToken:cancellationToken];
     return YES;
 }
 
+- (BOOL)storeFileAtPath:(NSString *)filePath
+                 forKey:(NSString *)key
+                    ttl:(NSUInteger)ttl
+                 locked:(BOOL)locked
+           withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                onQueue:(dispatch_queue_t _Nullable)queue
+{
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.ttl = ttl;
+    options.locked = locked;
+    return [self storeFileAtPath:filePath forKey:key options:options withCallback:callback onQueue:queue];
+}
 
-// TODO: return NOT_PERMITTED on try to touch TLL>0
-- (void)touchDataForKey:(NSString *)key
-               callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+- (BOOL)storeFileAtPath:(NSString *)filePath
+                 forKey:(NSString *)key
+                options:(SPTPersistentCacheStoreOptions * _Nullable)options
+           withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                 onQueue:(dispatch_queue_t _Nullable)queue
 {
-    if (callback != nil) {
-        NSAssert(queue, @"You must specify the queue");
+    if (filePath == nil || key == nil || (callback != nil && queue == nil)) {
+        return NO;
     }
 
-    [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeQueued];
-    [self doWork:^{
+    options = [options copy] ?: [SPTPersistentCacheStoreOptions new];
+    if (options.tags.count > 0 && self.tagIndex == nil) {
+        return NO;
+    }
+
+    SPTPersistentCacheCancellationToken * const cancellationToken = options.cancellationToken;
+    callback = SPTPersistentCacheCancellableCallback([callback copy], cancellationToken);
+    if (self.traceRecorder != nil) {
+        const unsigned long long fileSize = [self.fileManager attributesOfItemAtPath:filePath error:nil].fileSize;
+        [self recordTraceOfTags:options.tags forKey:key];
+        [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationStore key:key payloadSize:fileSize ttl:options.ttl locked:options.isLocked];
+    }
+    [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        if (cancellationToken.isCancelled) {
+            return;
+        }
         [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
-        NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+        [self storeFileSync:filePath
+                     forKey:key
+                        ttl:options.ttl
+                     locked:options.isLocked
+                       tags:options.tags
+                   priority:options.priority
+                refetchCost:options.refetchCost
+               withCallback:callback
+                    onQueue:queue];
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService cancellationToken:cancellationToken];
+    return YES;
+}
 
-        BOOL __block expired = NO;
+- (BOOL)appendData:(NSData *)data
+             toKey:(NSString *)key
+          callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+           onQueue:(dispatch_queue_t _Nullable)queue
+{
+    return [self replaceRange:NSMakeRange(NSNotFound, 0) withData:data forKey:key callback:callback onQueue:queue];
+}
 
-        SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
-                                                                    withBlock:^(SPTPersistentCacheRecordHeader *header) {
-                                                                        // Satisfy Req.#1.2 and Req.#1.3
-                                                                        if (![self isDataCanBeReturnedWithHeader:header]) {
-                                                                            expired = YES;
-                                                                            return;
-                                                                        }
-                                                                        // Touch files that have default expiration policy
-                                                                        if (header->ttl == 0) {
-                                                                            header->updateTimeSec = spt_uint64rint(self.currentDateTimeInterval);
-                                                                        }
-                                                                    }
-                                                                    writeBack:YES
-                                                                     complain:NO];
+- (BOOL)replaceRange:(NSRange)range
+            withData:(NSData *)data
+              forKey:(NSString *)key
+            callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+             onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (data == nil || key == nil || (callback != nil && queue == nil)) {
+        return NO;
+    }
 
-        // Satisfy Req.#1.2
-        if (expired) {
-            response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound
-                                                                    error:nil
-                                                                   record:nil];
+    data = [data copy];
+    callback = [callback copy];
+    if (range.location == NSNotFound) {
+        [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationAppend key:key payloadSize:data.length ttl:0 locked:NO];
+    } else if (self.traceRecorder != nil) {
+        SPTPersistentCacheTraceRecord record = [self.traceRecorder recordOfOperation:SPTPersistentCacheTraceOperationReplaceRange key:key];
+        record.payloadSize = data.length;
+        record.rangeLength = range.length;
+        [self.traceRecorder writeRecord:record keys:nil];
+    }
+    [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
+        SPTPersistentCacheResponse *response = [self replaceRangeSync:range withData:data forKey:key];
+        if (callback != nil) {
+            SPTPersistentCacheSafeDispatch(queue, ^{
+                callback(response);
+            });
         }
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService];
+    return YES;
+}
+
+
+// TODO: return NOT_PERMITTED on try to touch TLL>0
+- (void)touchDataForKey:(NSString *)key
+               callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (callback != nil) {
+        NSAssert(queue, @"You must specify the queue");
+    }
+
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationTouch key:key payloadSize:0 ttl:0 locked:NO];
+    [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
+        SPTPersistentCacheResponse *response = [self touchDataForKeySync:key];
 
         if (callback) {
             SPTPersistentCacheSafeDispatch(queue, ^{
@@ -265,20 +902,125 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
             });
         }
         [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.writePriority qos:self.options.writeQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService];
+}
+
+- (BOOL)openFileHandleForKey:(NSString *)key
+                withCallback:(SPTPersistentCacheFileHandleCallback _Nullable)callback
+                     onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (callback == nil || queue == nil) {
+        return NO;
+    }
+
+    callback = [callback copy];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationLoad key:key payloadSize:0 ttl:0 locked:NO];
+    [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeStarting];
+        SPTPersistentCacheFileHandle *fileHandle = nil;
+        SPTPersistentCacheResponse *response = [self openFileHandleForKeySync:key fileHandle:&fileHandle];
+        SPTPersistentCacheSafeDispatch(queue, ^{
+            callback(response, fileHandle);
+        });
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneRead priority:self.options.readPriority qos:self.options.readQualityOfService];
+    return YES;
+}
+
+- (NSArray<NSString *> *)removeDataForKeysSync:(NSArray<NSString *> *)keys
+{
+    NSMutableArray<NSString *> * const removedKeys = [NSMutableArray arrayWithCapacity:keys.count];
+    for (NSString *key in keys) {
+        if ([self removeRecordForKeySync:key]) {
+            [removedKeys addObject:key];
+        }
+    }
+    [self commitRemovalOfKeys:removedKeys];
+    return removedKeys;
+}
+
+- (BOOL)removeDataForKeySync:(NSString *)key
+{
+    return [self removeDataForKeysSync:@[key]].count > 0;
+}
+
+/**
+ Removes the record for key and drops it from the in-memory indexes, or defers the removal if the key is pinned. The
+ journaled side tables are left to `commitRemovalOfKeys:`, so removing many records commits them once.
+ @return YES if the record was removed.
+ */
+- (BOOL)removeRecordForKeySync:(NSString *)key
+{
+    @synchronized (self.pinnedKeys) {
+        if ([self.pinnedKeys countForObject:key] > 0) {
+            [self.deferredRemovals addObject:key];
+            return NO;
+        }
+    }
+
+    // The journal of an interrupted update sits next to the record, resolve it before the record is gone
+    NSString * const updateJournalPath = SPTPersistentCacheUpdateJournalPath([self.dataCacheFileManager pathForKey:key]);
+    if (![self.dataCacheFileManager removeDataForKey:key]) {
+        return NO;
+    }
+    unlink(updateJournalPath.fileSystemRepresentation);
+    [self.keyFilter removeKey:key];
+    [self.keyIndex removeKey:key];
+    [self.sharedIndex removeKey:key];
+    [self.blobStore removeKey:key];
+    return YES;
 }
 
-- (void)removeDataForKeysSync:(NSArray<NSString *> *)keys
+/**
+ Drops removed records from the lock journal and tag index in one batch each, and has their files reaped.
+ */
+- (void)commitRemovalOfKeys:(NSArray<NSString *> *)keys
 {
+    if (keys.count == 0) {
+        return;
+    }
+
+    NSMutableDictionary<NSString *, NSNumber *> * const refCounts = [NSMutableDictionary dictionaryWithCapacity:keys.count];
     for (NSString *key in keys) {
-        [self.dataCacheFileManager removeDataForKey:key];
+        refCounts[key] = @0;
+    }
+    [self.lockJournal setRefCounts:refCounts];
+    [self.tagIndex removeKeys:keys];
+    [self scheduleTrashReaper];
+}
+
+- (void)scheduleTrashReaper
+{
+    // One reaper at a time is enough, it empties everything trashed up to when it starts
+    if (atomic_exchange(&_trashReaperScheduled, true)) {
+        return;
     }
+
+    [self doWork:^{
+        atomic_store(&self->_trashReaperScheduled, false);
+        [self.dataCacheFileManager emptyTrashInBatchesOfSize:SPTPersistentCacheTrashReapBatchSize betweenBatches:^{
+            [self.scheduler yieldToForegroundWork];
+        }];
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.garbageCollectionPriority qos:self.options.garbageCollectionQualityOfService];
+}
+
+- (void)scheduleLayoutMigration
+{
+    [self doWork:^{
+        [self.dataCacheFileManager migrateLayoutInBatchesOfSize:SPTPersistentCacheLayoutMigrationBatchSize betweenBatches:^{
+            [self.scheduler yieldToForegroundWork];
+        }];
+        // Copies outdated by a newer store were trashed
+        [self scheduleTrashReaper];
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.garbageCollectionPriority qos:self.options.garbageCollectionQualityOfService];
 }
 
 - (void)removeDataForKeys:(NSArray<NSString *> *)keys
                  callback:(SPTPersistentCacheResponseCallback _Nullable)callback
                   onQueue:(dispatch_queue_t _Nullable)queue
 {
+    [self recordTraceOperation:SPTPersistentCacheTraceOperationRemove keys:keys];
     [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
         [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeStarting];
@@ -293,8 +1035,86 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
                     });
                 }
         [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+
+}
+
+- (SPTPersistentCacheResponse *)synchronouslyLoadDataForKey:(NSString *)key
+{
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationLoad key:key payloadSize:0 ttl:0 locked:NO];
+
+    // Definite miss, no need to touch the disk
+    if ((self.keyFilter != nil && ![self.keyFilter mightContainKey:key]) || [self isDefiniteMissInSharedIndexForKey:key allowStale:NO]) {
+        return SPTPersistentCacheNotFoundResponse();
+    }
+
+    __block SPTPersistentCacheResponse *response = nil;
+    [self.scheduler performForegroundBlock:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeStarting];
+        response = [self loadResponseForKeySync:key allowStale:NO];
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeRead type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneRead];
+    return response;
+}
+
+- (SPTPersistentCacheResponse *)synchronouslyStoreData:(NSData *)data
+                                                forKey:(NSString *)key
+                                                   ttl:(NSUInteger)ttl
+                                                locked:(BOOL)locked
+{
+    if (data == nil || key == nil) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(EINVAL)
+                                                           record:nil];
+    }
+
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationStore key:key payloadSize:data.length ttl:ttl locked:locked];
+    __block NSError *error = nil;
+    [self.scheduler performForegroundBlock:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
+        error = [self storeDataSync:data
+                             forKey:key
+                                ttl:ttl
+                             locked:locked
+                               tags:nil
+                           priority:SPTPersistentCacheRecordPriorityNormal
+                        refetchCost:0
+                       withCallback:nil
+                            onQueue:nil];
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite];
+
+    return [[SPTPersistentCacheResponse alloc] initWithResult:(error != nil ?
+                                                               SPTPersistentCacheResponseCodeOperationError :
+                                                               SPTPersistentCacheResponseCodeOperationSucceeded)
+                                                        error:error
+                                                       record:nil];
+}
+
+- (SPTPersistentCacheResponse *)synchronouslyTouchDataForKey:(NSString *)key
+{
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationTouch key:key payloadSize:0 ttl:0 locked:NO];
+    __block SPTPersistentCacheResponse *response = nil;
+    [self.scheduler performForegroundBlock:^{
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
+        response = [self touchDataForKeySync:key];
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite];
+    return response;
+}
+
+- (SPTPersistentCacheResponse *)synchronouslyRemoveDataForKeys:(NSArray<NSString *> *)keys
+{
+    [self recordTraceOperation:SPTPersistentCacheTraceOperationRemove keys:keys];
+    [self.scheduler performForegroundBlock:^{
+        [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeStarting];
+        [self removeDataForKeysSync:keys];
+        [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite];
 
+    return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                        error:nil
+                                                       record:nil];
 }
 
 - (BOOL)lockDataForKeys:(NSArray<NSString *> *)keys
@@ -304,39 +1124,60 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
     if ((callback != nil && queue == nil) || keys.count == 0) {
         return NO;
     }
+    [self recordTraceOperation:SPTPersistentCacheTraceOperationLock keys:keys];
     [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeLock type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
         [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeLock type:SPTPersistentCacheDebugTimingTypeStarting];
-        for (NSString *key in keys) {
-            NSString *filePath = [self.dataCacheFileManager pathForKey:key];
-            BOOL __block expired = NO;
-            SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
-                                                                        withBlock:^(SPTPersistentCacheRecordHeader *header) {
-                                                                            // Satisfy Req.#1.2
-                                                                            if ([self isDataExpiredWithHeader:header]) {
-                                                                                expired = YES;
-                                                                                return;
-                                                                            }
-                                                                            ++header->refCount;
-                                                                            // Do not update access time since file is locked
-                                                                        }
-                                                                        writeBack:YES
-                                                                         complain:YES];
-            // Satisfy Req.#1.2
-            if (expired) {
-                response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound
-                                                                        error:nil
-                                                                       record:nil];
-            }
-            if (callback) {
-                SPTPersistentCacheSafeDispatch(queue, ^{
-                    callback(response);
-                });
-            }
-            
-        } // for
+        [self lockDataForKeysSync:keys callback:callback onQueue:queue];
         [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeLock type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.writePriority qos:self.options.writeQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService];
+    return YES;
+}
+
+- (BOOL)removeDataForTag:(NSString *)tag
+                callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                 onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (tag == nil || self.tagIndex == nil || (callback != nil && queue == nil)) {
+        return NO;
+    }
+
+    callback = [callback copy];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationRemoveTag key:tag payloadSize:0 ttl:0 locked:NO];
+    [self logTimingForKey:tag method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:tag method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeStarting];
+        NSArray<NSString *> * const keys = [self.tagIndex keysForTag:tag];
+        [self removeDataForKeysSync:keys];
+        [self dispatchEmptyResponseWithResult:(keys.count > 0 ? SPTPersistentCacheResponseCodeOperationSucceeded : SPTPersistentCacheResponseCodeNotFound)
+                                     callback:callback
+                                      onQueue:queue];
+        [self logTimingForKey:tag method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    return YES;
+}
+
+- (BOOL)lockDataForTag:(NSString *)tag
+              callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+               onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (tag == nil || self.tagIndex == nil || (callback != nil && queue == nil)) {
+        return NO;
+    }
+
+    callback = [callback copy];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationLockTag key:tag payloadSize:0 ttl:0 locked:NO];
+    [self logTimingForKey:tag method:SPTPersistentCacheDebugMethodTypeLock type:SPTPersistentCacheDebugTimingTypeQueued];
+    [self doWork:^{
+        [self logTimingForKey:tag method:SPTPersistentCacheDebugMethodTypeLock type:SPTPersistentCacheDebugTimingTypeStarting];
+        NSArray<NSString *> * const keys = [self.tagIndex keysForTag:tag];
+        if (keys.count == 0) {
+            [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeNotFound callback:callback onQueue:queue];
+        } else {
+            [self lockDataForKeysSync:keys callback:callback onQueue:queue];
+        }
+        [self logTimingForKey:tag method:SPTPersistentCacheDebugMethodTypeLock type:SPTPersistentCacheDebugTimingTypeFinished];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService];
     return YES;
 }
 
@@ -347,29 +1188,55 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
     if ((callback != nil && queue == nil) || keys.count == 0) {
         return NO;
     }
+    [self recordTraceOperation:SPTPersistentCacheTraceOperationUnlock keys:keys];
     [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeUnlock type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
         [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeUnlock type:SPTPersistentCacheDebugTimingTypeStarting];
-        for (NSString *key in keys) {
-            NSString *filePath = [self.dataCacheFileManager pathForKey:key];
-            SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
-                                                                        withBlock:^(SPTPersistentCacheRecordHeader *header){
-                                                                            if (header->refCount > 0) {
-                                                                                --header->refCount;
-                                                                            } else {
-                                                                                [self debugOutput:@"PersistentDataCache: Error trying to decrement refCount below 0 for file at path:%@", filePath];
+        if (self.lockJournal != nil) {
+            [self changeRefCountsOfKeys:keys delta:-1 callback:callback onQueue:queue];
+        } else {
+            for (NSString *key in keys) {
+                NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+                SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
+                                                                            withBlock:^(SPTPersistentCacheRecordHeader *header){
+                                                                                if (header->refCount > 0) {
+                                                                                    --header->refCount;
+                                                                                } else {
+                                                                                    [self debugOutput:@"PersistentDataCache: Error trying to decrement refCount below 0 for file at path:%@", filePath];
+                                                                                }
                                                                             }
-                                                                        }
-                                                                        writeBack:YES
-                                                                         complain:YES];
-            if (callback) {
-                SPTPersistentCacheSafeDispatch(queue, ^{
-                    callback(response);
-                });
-            }
-        } // for
+                                                                            writeBack:YES
+                                                                             complain:YES];
+                if (callback) {
+                    SPTPersistentCacheSafeDispatch(queue, ^{
+                        callback(response);
+                    });
+                }
+            } // for
+        }
         [self logTimingForKey:[keys description] method:SPTPersistentCacheDebugMethodTypeUnlock type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    return YES;
+}
+
+- (BOOL)warmUpWithCallback:(SPTPersistentCacheWarmUpCallback _Nullable)callback
+                   onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (self.accessHistory == nil) {
+        return NO;
+    }
+
+    callback = [callback copy];
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationWarmUp key:nil payloadSize:0 ttl:0 locked:NO];
+    [self doWork:^{
+        NSUInteger prefetchedCount = 0;
+        const BOOL completed = [self prefetchRecordsForKeys:self.accessHistory.hottestKeys prefetchedCount:&prefetchedCount];
+        if (callback) {
+            SPTPersistentCacheSafeDispatch(queue, ^{
+                callback(prefetchedCount, completed);
+            });
+        }
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.garbageCollectionPriority qos:self.options.garbageCollectionQualityOfService];
     return YES;
 }
 
@@ -386,10 +1253,23 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 - (void)pruneWithCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                   onQueue:(dispatch_queue_t _Nullable)queue
 {
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationPrune key:nil payloadSize:0 ttl:0 locked:NO];
     [self logTimingForKey:@"prune" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
         [self logTimingForKey:@"prune" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeStarting];
-        [self.dataCacheFileManager removeAllData];
+        NSSet<NSString *> *pinnedKeys = nil;
+        @synchronized (self.pinnedKeys) {
+            pinnedKeys = [NSSet setWithSet:self.pinnedKeys];
+            [self.deferredRemovals unionSet:pinnedKeys];
+        }
+        [self.dataCacheFileManager removeAllDataExceptKeys:pinnedKeys];
+        [self.lockJournal removeAllRefCountsExceptKeys:pinnedKeys];
+        [self.tagIndex removeAllKeysExceptKeys:pinnedKeys];
+        [self scheduleTrashReaper];
+        // Files that couldn’t be removed are still on disk, so start over instead of clearing the filter
+        [self populateKeyFilter];
+        [self populateKeyIndex];
+        [self populateBlobStore];
         if (callback) {
             SPTPersistentCacheResponse *response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
                                                                                                 error:nil
@@ -399,12 +1279,13 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
             });
         }
         [self logTimingForKey:@"prune" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
 }
 
 - (void)wipeLockedFilesWithCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                             onQueue:(dispatch_queue_t _Nullable)queue
 {
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationWipeLocked key:nil payloadSize:0 ttl:0 locked:NO];
     [self logTimingForKey:@"wipeLocked" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
         [self logTimingForKey:@"wipeLocked" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeStarting];
@@ -418,13 +1299,14 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
             });
         }
         [self logTimingForKey:@"wipeLocked" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
 
 }
 
 - (void)wipeNonLockedFilesWithCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                                onQueue:(dispatch_queue_t _Nullable)queue
 {
+    [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationWipeNonLocked key:nil payloadSize:0 ttl:0 locked:NO];
     [self logTimingForKey:@"wipeNonLocked" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeQueued];
     [self doWork:^{
         [self logTimingForKey:@"wipeNonLocked" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeStarting];
@@ -438,17 +1320,35 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
             });
         }
         [self logTimingForKey:@"wipeNonLocked" method:SPTPersistentCacheDebugMethodTypeRemove type:SPTPersistentCacheDebugTimingTypeFinished];
-    } priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
 }
 
 - (NSUInteger)totalUsedSizeInBytes
 {
-    return self.dataCacheFileManager.totalUsedSizeInBytes;
+    // Blobs are counted once, however many records share them
+    return self.dataCacheFileManager.totalUsedSizeInBytes + self.blobStore.usedSizeInBytes;
 }
 
 - (NSUInteger)lockedItemsSizeInBytes
 {
     NSUInteger size = 0;
+    for (NSNumber *partitionSize in [self lockedItemsSizesInBytesByPartition]) {
+        size += partitionSize.unsignedIntegerValue;
+    }
+    return size;
+}
+
+/**
+ Returns the size of the locked records of each partition, in the order of the partitions of the partition table.
+ */
+- (NSArray<NSNumber *> *)lockedItemsSizesInBytesByPartition
+{
+    SPTPersistentCachePartitionTable * const partitionTable = self.partitionTable;
+    NSMutableArray<NSNumber *> *sizes = [NSMutableArray arrayWithCapacity:partitionTable.partitions.count];
+    for (NSUInteger index = 0; index < partitionTable.partitions.count; ++index) {
+        [sizes addObject:@0];
+    }
+
     NSURL *urlPath = [NSURL fileURLWithPath:self.options.cachePath];
     NSDirectoryEnumerator *dirEnumerator = [self.fileManager enumeratorAtURL:urlPath
                                                   includingPropertiesForKeys:@[NSURLIsDirectoryKey]
@@ -471,10 +1371,13 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
                 BOOL __block locked = NO;
                 // WARNING: We may skip return result here bcuz in that case we will not count file as locked
                 [self alterHeaderForFileAtPath:filePath withBlock:^(SPTPersistentCacheRecordHeader *header) {
-                    locked = header->refCount > 0;
+                    locked = [self applyLockJournalToHeader:header forKey:key]->refCount > 0;
                 } writeBack:NO complain:YES];
                 if (locked) {
-                    size += [self.dataCacheFileManager getFileSizeAtPath:filePath];
+                    const NSUInteger index = [partitionTable indexOfPartitionForKey:key];
+                    sizes[index] = @(sizes[index].unsignedIntegerValue +
+                                     [self.dataCacheFileManager getFileSizeAtPath:filePath] +
+                                     [self.blobStore sizeShareForKey:key]);
                 }
             }
         } else {
@@ -482,7 +1385,7 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
         }
     }
 
-    return size;
+    return sizes;
 }
 
 - (void)dealloc
@@ -497,147 +1400,440 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
               withCallback:(SPTPersistentCacheResponseCallback)callback
                    onQueue:(dispatch_queue_t)queue
 {
-    NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+    SPTPersistentCacheResponse *response = [self loadResponseForKeySync:key allowStale:NO];
 
-    // File not exist -> inform user
-    if (![self.fileManager fileExistsAtPath:filePath]) {
-        [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeNotFound callback:callback onQueue:queue];
-        return;
-    } else {
-        // File exist
-        NSError *error = nil;
-        NSMutableData *rawData = [NSMutableData dataWithContentsOfFile:filePath
-                                                               options:NSDataReadingMappedIfSafe
-                                                                 error:&error];
-        if (rawData == nil) {
-            // File read with error -> inform user
-            [self dispatchError:error
-                         result:SPTPersistentCacheResponseCodeOperationError
-                       callback:callback
-                        onQueue:queue];
-        } else {
-            SPTPersistentCacheRecordHeader *header = SPTPersistentCacheGetHeaderFromData(rawData.mutableBytes, rawData.length);
-
-            // If not enough data to cast to header, its not the file we can process
-            if (header == NULL) {
-                NSError *headerError = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader];
-                [self dispatchError:headerError
-                             result:SPTPersistentCacheResponseCodeOperationError
-                           callback:callback
-                            onQueue:queue];
-                return;
-            }
+    // Callback only after we finished everyhing to avoid situation when user gets notified and we are still writting
+    SPTPersistentCacheSafeDispatch(queue, ^{
+        callback(response);
+    });
+}
 
-            SPTPersistentCacheRecordHeader localHeader;
-            memcpy(&localHeader, header, sizeof(localHeader));
+/**
+ Reads the record for key. With allowStale an expired record is returned flagged as stale instead of not found.
+ Called on work queue.
+ @discussion This is the hot path of the cache, so the path is built on the stack and the payload is read straight
+ into the buffer handed to the record, without intermediate objects.
+ */
+- (SPTPersistentCacheResponse *)loadResponseForKeySync:(NSString *)key allowStale:(BOOL)allowStale
+{
+    char filePath[PATH_MAX];
+    if (![self getFileSystemPath:filePath maxLength:sizeof(filePath) forKey:key]) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(ENAMETOOLONG)
+                                                           record:nil];
+    }
 
-            // Check header is valid
-            NSError *headerError = SPTPersistentCacheCheckValidHeader(&localHeader);
-            if (headerError != nil) {
-                [self dispatchError:headerError
-                             result:SPTPersistentCacheResponseCodeOperationError
-                           callback:callback
-                            onQueue:queue];
-                return;
-            }
+    const int SPTPersistentCacheInvalidResult = -1;
+    // Opened for writing too, the access time is written back to the file that was read and not to one renamed over it
+    int filedes = open(filePath, O_RDWR);
+    if (filedes == SPTPersistentCacheInvalidResult && (errno == EACCES || errno == EROFS)) {
+        filedes = open(filePath, O_RDONLY);
+    }
+    if (filedes == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        // File not exist -> inform user
+        if (errorNumber == ENOENT || errorNumber == ENOTDIR) {
+            return SPTPersistentCacheNotFoundResponse();
+        }
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errorNumber)
+                                                           record:nil];
+    }
 
-            const NSUInteger refCount = localHeader.refCount;
+    // A record being updated is read once the update is done, closing the file releases the lock
+    if ([self isCoordinatingRecordAccess] && [self.posixWrapper flock:filedes operation:LOCK_SH] == SPTPersistentCacheInvalidResult) {
+        [self debugOutput:@"PersistentDataCache: Error locking record:%@ , error:%@", key, @(strerror(errno))];
+    }
 
-            // We return locked files even if they expired, GC doesnt collect them too so they valuable to user
-            // Satisfy Req.#1.2
-            if (![self isDataCanBeReturnedWithHeader:&localHeader]) {
+    SPTPersistentCacheResponse *response = [self loadResponseForKey:key
+                                                     fromDescriptor:filedes
+                                                         allowStale:allowStale];
+    if (response.result == SPTPersistentCacheResponseCodeOperationSucceeded) {
+        [self.accessHistory recordAccessToKey:key];
+    }
+
+    // Everything was read already, so a failing close costs nothing but the descriptor
+    if ([self.posixWrapper close:filedes] == SPTPersistentCacheInvalidResult) {
+        [self debugOutput:@"PersistentDataCache: Error closing record:%@ , error:%@", key, @(strerror(errno))];
+    }
+
+    return response;
+}
+
+/**
+ Writes the path of the record for key into a buffer, taking the string path only for keys the C one can't handle.
+ */
+- (BOOL)getFileSystemPath:(char *)buffer maxLength:(size_t)maxLength forKey:(NSString *)key
+{
+    return ([self.dataCacheFileManager getFileSystemPath:buffer maxLength:maxLength forKey:key] ||
+            [[self.dataCacheFileManager pathForKey:key] getFileSystemRepresentation:buffer maxLength:maxLength]);
+}
+
+- (SPTPersistentCacheResponse *)loadResponseForKey:(NSString *)key
+                                    fromDescriptor:(int)filedes
+                                        allowStale:(BOOL)allowStale
+{
+    struct stat fileStat;
+    if (fstat(filedes, &fileStat) == -1) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errno)
+                                                           record:nil];
+    }
+
+    SPTPersistentCacheRecordHeader header;
+    const ssize_t readBytes = [self.posixWrapper read:filedes buffer:&header bufferSize:SPTPersistentCacheRecordHeaderSize];
+    if (readBytes == -1) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errno)
+                                                           record:nil];
+    }
+
+    // If not enough data to cast to header, its not the file we can process
+    if (readBytes != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+        NSError *headerError = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:headerError
+                                                           record:nil];
+    }
+
+    // Check header is valid
+    NSError *headerError = SPTPersistentCacheCheckValidHeader(&header);
+    if (headerError != nil) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:headerError
+                                                           record:nil];
+    }
+
+    // The update of the record was interrupted, it is finished before the payload is read
+    if ((header.flags & SPTPersistentCacheRecordHeaderFlagsUpdatePending) != 0) {
+        [self.posixWrapper flock:filedes operation:LOCK_UN];
+        SPTPersistentCacheResponse *finishResponse = [self finishUpdateOfRecordForKey:key];
+        return finishResponse ?: [self loadResponseForKeySync:key allowStale:allowStale];
+    }
+
+    const SPTPersistentCacheRecordHeader readHeader = header;
+    [self applyLockJournalToHeader:&header forKey:key];
+    const NSUInteger refCount = header.refCount;
+
+    // We return locked files even if they expired, GC doesnt collect them too so they valuable to user
+    // Satisfy Req.#1.2
+    const BOOL stale = ![self isDataCanBeReturnedWithHeader:&header forKey:key];
+    if (stale) {
 #ifdef DEBUG_OUTPUT_ENABLED
-                [self debugOutput:@"PersistentDataCache: Record with key: %@ expired, t:%llu, TTL:%llu", key, localHeader.updateTimeSec, localHeader.ttl];
+        [self debugOutput:@"PersistentDataCache: Record with key: %@ expired, t:%llu, TTL:%llu", key, header.updateTimeSec, header.ttl];
 #endif
-                [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeNotFound
-                                             callback:callback
-                                              onQueue:queue];
-                return;
-            }
+        if (!allowStale) {
+            return SPTPersistentCacheNotFoundResponse();
+        }
+    }
 
-            // Check that payload is correct size
-            if (localHeader.payloadSizeBytes != [rawData length] - SPTPersistentCacheRecordHeaderSize) {
-                [self debugOutput:@"PersistentDataCache: Error: Wrong payload size for key:%@ , will return error", key];
-                [self dispatchError:[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize]
-                             result:SPTPersistentCacheResponseCodeOperationError
-                           callback:callback onQueue:queue];
-                return;
+    // A deduplicated record holds the digest of its payload, which is read from the blob instead
+    int payloadDescriptor = filedes;
+    if ((header.flags & SPTPersistentCacheRecordHeaderFlagsDeduplicated) != 0) {
+        NSError *blobError = nil;
+        payloadDescriptor = [self openBlobOfRecordWithDescriptor:filedes recordSize:fileStat.st_size header:&header error:&blobError];
+        if (payloadDescriptor == -1) {
+            [self debugOutput:@"PersistentDataCache: Error opening payload of deduplicated key:%@ , error:%@", key, blobError];
+            if ([blobError.domain isEqualToString:NSPOSIXErrorDomain] && blobError.code == ENOENT) {
+                return SPTPersistentCacheNotFoundResponse();
             }
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                error:blobError
+                                                               record:nil];
+        }
+    } else if (header.payloadSizeBytes != (uint64_t)fileStat.st_size - header.headerSize) {
+        // Check that payload is correct size
+        [self debugOutput:@"PersistentDataCache: Error: Wrong payload size for key:%@ , will return error", key];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize]
+                                                           record:nil];
+    } else if (header.headerSize != SPTPersistentCacheRecordHeaderSize) {
+        // The payload of a large record starts after the padding of its header and is read around the page cache
+        [self.posixWrapper adviseNoCache:filedes];
+        if ([self.posixWrapper lseek:filedes seekType:(off_t)header.headerSize seekAmount:SEEK_SET] != (off_t)header.headerSize) {
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                error:SPTPersistentCachePosixError(errno)
+                                                               record:nil];
+        }
+    }
 
-            NSRange payloadRange = NSMakeRange(SPTPersistentCacheRecordHeaderSize, (NSUInteger)localHeader.payloadSizeBytes);
-            NSData *payload = [rawData subdataWithRange:payloadRange];
-            const NSUInteger ttl = (NSUInteger)localHeader.ttl;
+    NSError *payloadError = nil;
+    NSData *payload = [self readPayloadOfSize:(size_t)header.payloadSizeBytes fromDescriptor:payloadDescriptor error:&payloadError];
+    if (payloadDescriptor != filedes) {
+        [self.posixWrapper close:payloadDescriptor];
+    } else if (header.headerSize != SPTPersistentCacheRecordHeaderSize) {
+        [self.posixWrapper adviseNoCache:filedes];
+    }
+    if (payload == nil) {
+        [self debugOutput:@"PersistentDataCache: Error reading payload for key:%@ , error:%@", key, payloadError];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:payloadError
+                                                           record:nil];
+    }
+    const NSUInteger ttl = (NSUInteger)header.ttl;
+
+    SPTPersistentCacheRecord *record = [[SPTPersistentCacheRecord alloc] initWithData:payload
+                                                                                  key:key
+                                                                             refCount:refCount
+                                                                                  ttl:ttl];
+
+    SPTPersistentCacheResponse *response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                                                        error:nil
+                                                                                       record:record
+                                                                                        stale:stale];
+    // If data ttl == 0 we update access time. Stale data is left alone, touching it would make it fresh again.
+    if (ttl == 0 && !stale) {
+        [self writeBackAccessTimeOfHeader:&readHeader toDescriptor:filedes forKey:key];
+    }
 
+    return response;
+}
 
-            SPTPersistentCacheRecord *record = [[SPTPersistentCacheRecord alloc] initWithData:payload
-                                                                                          key:key
-                                                                                     refCount:refCount
-                                                                                          ttl:ttl];
+/**
+ Reads the payload following the header into a buffer owned by the returned data.
+ */
+- (nullable NSData *)readPayloadOfSize:(size_t)payloadSize fromDescriptor:(int)filedes error:(NSError **)error
+{
+    if (payloadSize == 0) {
+        return [NSData data];
+    }
 
-            SPTPersistentCacheResponse *response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
-                                                                                                error:nil
-                                                                                               record:record];
-            // If data ttl == 0 we update access time
-            if (ttl == 0) {
-                localHeader.updateTimeSec = spt_uint64rint(self.currentDateTimeInterval);
-                localHeader.crc = SPTPersistentCacheCalculateHeaderCRC(&localHeader);
-                memcpy(header, &localHeader, sizeof(localHeader));
-
-                // Write back with updated access attributes
-                NSError *werror = nil;
-                if (![rawData writeToFile:filePath options:NSDataWritingAtomic error:&werror]) {
-                    [self debugOutput:@"PersistentDataCache: Error writing back record:%@, error:%@", filePath.lastPathComponent, werror];
-                } else {
+    // Buffers of a page or more are page aligned, so reads around the page cache go straight into them
+    void *bytes = NULL;
+    if (payloadSize < SPTPersistentCacheRecordAlignedHeaderSize) {
+        bytes = malloc(payloadSize);
+    } else if (posix_memalign(&bytes, SPTPersistentCacheRecordAlignedHeaderSize, payloadSize) != 0) {
+        bytes = NULL;
+    }
+    if (bytes == NULL) {
+        *error = SPTPersistentCachePosixError(ENOMEM);
+        return nil;
+    }
+
+    size_t offset = 0;
+    while (offset < payloadSize) {
+        const ssize_t readBytes = [self.posixWrapper read:filedes buffer:(uint8_t *)bytes + offset bufferSize:payloadSize - offset];
+        if (readBytes <= 0) {
+            // The file shrunk since it was looked at
+            *error = (readBytes == -1 ?
+                      SPTPersistentCachePosixError(errno) :
+                      [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize]);
+            free(bytes);
+            return nil;
+        }
+        offset += (size_t)readBytes;
+    }
+
+    return [[NSData alloc] initWithBytesNoCopy:bytes length:payloadSize freeWhenDone:YES];
+}
+
+/**
+ Writes the header read from the record open at a descriptor back with a new access time. Not synced, losing an access
+ time in a crash is harmless.
+ @discussion The header is only written if it is still the one that was read, checked with the record locked, so a lock,
+ unlock or update in between keeps its header. Writing through the descriptor the header was read from means a record
+ stored over it meanwhile is never touched.
+ */
+- (void)writeBackAccessTimeOfHeader:(const SPTPersistentCacheRecordHeader *)readHeader
+                       toDescriptor:(int)filedes
+                             forKey:(NSString *)key
+{
+    const int SPTPersistentCacheInvalidResult = -1;
+    if ((fcntl(filedes, F_GETFL) & O_ACCMODE) == O_RDONLY) {
+        return;
+    }
+
+    // Converts a shared lock held for the read, other writers of the header take the lock exclusively as well
+    if ([self.posixWrapper flock:filedes operation:LOCK_EX] == SPTPersistentCacheInvalidResult) {
+        [self debugOutput:@"PersistentDataCache: Error locking record:%@ , error:%@", key, @(strerror(errno))];
+        return;
+    }
+
+    // The access time is only a hint, a header changed since it was read is left alone
+    SPTPersistentCacheRecordHeader header;
+    if (pread(filedes, &header, SPTPersistentCacheRecordHeaderSize, 0) != (ssize_t)SPTPersistentCacheRecordHeaderSize ||
+        memcmp(&header, readHeader, SPTPersistentCacheRecordHeaderSize) != 0) {
+        return;
+    }
+
+    header.updateTimeSec = spt_uint64rint(self.currentDateTimeInterval);
+    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+    if (pwrite(filedes, &header, SPTPersistentCacheRecordHeaderSize, 0) != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+        [self debugOutput:@"PersistentDataCache: Error writing back record:%@, error:%@", key, @(strerror(errno))];
+        return;
+    }
+
+    [self applyLockJournalToHeader:&header forKey:key];
+    [self.keyIndex setMetadataWithHeader:&header forKey:key];
+    [self.sharedIndex setHeader:&header forKey:key];
 #ifdef DEBUG_OUTPUT_ENABLED
-                    [self debugOutput:@"PersistentDataCache: Writing back record:%@ OK", filePath.lastPathComponent];
+    [self debugOutput:@"PersistentDataCache: Writing back record:%@ OK", key];
 #endif
-                }
-            }
+}
 
-            // Callback only after we finished everyhing to avoid situation when user gets notified and we are still writting
-            SPTPersistentCacheSafeDispatch(queue, ^{
-                callback(response);
-            });
+/**
+ Runs the loader for key, or joins the run already in progress, then stores the data and passes it to the callback.
+ A nil callback starts a refresh that nobody waits for.
+ */
+- (void)fetchDataForKey:(NSString *)key
+                 loader:(SPTPersistentCacheLoader)loader
+                    ttl:(NSUInteger)ttl
+               callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                onQueue:(dispatch_queue_t _Nullable)queue
+{
+    BOOL alreadyLoading = NO;
+    @synchronized (self.pendingLoads) {
+        NSMutableArray<SPTPersistentCacheResponseCallback> *waiters = self.pendingLoads[key];
+        alreadyLoading = (waiters != nil);
+        if (!alreadyLoading) {
+            waiters = [NSMutableArray array];
+            self.pendingLoads[key] = waiters;
+        }
+        if (callback != nil) {
+            [waiters addObject:^(SPTPersistentCacheResponse *response) {
+                SPTPersistentCacheSafeDispatch(queue, ^{
+                    callback(response);
+                });
+            }];
+        }
+    }
+
+    if (alreadyLoading) {
+        return;
+    }
+
+    loader(key, ^(NSData * _Nullable data, NSError * _Nullable error) {
+        if (data == nil) {
+            [self debugOutput:@"PersistentDataCache: Loader failed for key:%@, error:%@", key, error];
+            NSError *loaderError = error ?: [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorInternalInconsistency];
+            [self finishFetchForKey:key
+                           response:[[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                                 error:loaderError
+                                                                                record:nil]];
+            return;
+        }
+
+        [self.traceRecorder recordOperation:SPTPersistentCacheTraceOperationStore key:key payloadSize:data.length ttl:ttl locked:NO];
+        [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeQueued];
+        [self doWork:^{
+            [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeStarting];
+            // The data is still handed out if it couldn’t be stored, the next load simply runs the loader again
+            [self storeDataSync:data
+                         forKey:key
+                            ttl:ttl
+                         locked:NO
+                           tags:nil
+                       priority:SPTPersistentCacheRecordPriorityNormal
+                    refetchCost:0
+                   withCallback:nil
+                        onQueue:nil];
+            SPTPersistentCacheRecord *record = [[SPTPersistentCacheRecord alloc] initWithData:data
+                                                                                          key:key
+                                                                                     refCount:0
+                                                                                          ttl:ttl];
+            [self finishFetchForKey:key
+                           response:[[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                                                 error:nil
+                                                                                record:record]];
+            [self logTimingForKey:key method:SPTPersistentCacheDebugMethodTypeStore type:SPTPersistentCacheDebugTimingTypeFinished];
+        } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.writePriority qos:self.options.writeQualityOfService];
+    });
+}
 
-        } // if rawData
-    } // file exist
+- (void)finishFetchForKey:(NSString *)key response:(SPTPersistentCacheResponse *)response
+{
+    NSArray<SPTPersistentCacheResponseCallback> *waiters = nil;
+    @synchronized (self.pendingLoads) {
+        waiters = self.pendingLoads[key];
+        [self.pendingLoads removeObjectForKey:key];
+    }
+
+    for (SPTPersistentCacheResponseCallback waiter in waiters) {
+        waiter(response);
+    }
 }
 
 /**
- Store method used internaly. Called on work queue.
+ Store method used internaly. The tags replace the ones of an earlier record for key. Called on work queue.
  */
 - (NSError *)storeDataSync:(NSData *)data
                     forKey:(NSString *)key
                        ttl:(NSUInteger)ttl
                     locked:(BOOL)isLocked
+                      tags:(nullable NSSet<NSString *> *)tags
+                  priority:(SPTPersistentCacheRecordPriority)priority
+               refetchCost:(uint64_t)refetchCost
               withCallback:(SPTPersistentCacheResponseCallback)callback
                    onQueue:(dispatch_queue_t)queue
 {
-    NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+    NSString *filePath = [self.dataCacheFileManager pathForStoringKey:key];
 
     NSString *subDir = [self.dataCacheFileManager subDirectoryPathForKey:key];
     [self.fileManager createDirectoryAtPath:subDir withIntermediateDirectories:YES attributes:nil error:nil];
 
     const NSUInteger payloadLength = [data length];
-    const NSUInteger rawDataLength = SPTPersistentCacheRecordHeaderSize + payloadLength;
 
-    NSMutableData *rawData = [NSMutableData dataWithCapacity:rawDataLength];
+    // Large payloads are kept once per content, the record then holds only their digest
+    SPTPersistentCacheBlobStore * const blobStore = self.blobStore;
+    NSData *digest = nil;
+    if (blobStore != nil && self.options.deduplicationThresholdBytes > 0 && payloadLength >= self.options.deduplicationThresholdBytes) {
+        NSError *blobError = nil;
+        digest = [blobStore storeBlobWithData:data error:&blobError];
+        if (digest == nil) {
+            [self debugOutput:@"PersistentDataCache: Error storing blob for key:%@ , storing payload in record, error:%@", key, blobError];
+        }
+    }
+
+    // A large payload starts at a page aligned offset and is written around the page cache
+    const BOOL large = (digest == nil && [self isLargePayloadOfSize:payloadLength]);
+    const size_t headerSize = (large ? SPTPersistentCacheRecordAlignedHeaderSize : SPTPersistentCacheRecordHeaderSize);
+    const NSUInteger rawDataLength = headerSize + (digest != nil ? digest.length : payloadLength);
 
     SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(ttl,
                                                                                payloadLength,
                                                                                spt_uint64rint(self.currentDateTimeInterval),
                                                                                isLocked);
-
-    [rawData appendBytes:&header length:SPTPersistentCacheRecordHeaderSize];
-    [rawData appendData:data];
+    if (digest != nil) {
+        header.flags |= SPTPersistentCacheRecordHeaderFlagsDeduplicated;
+    }
+    header.headerSize = (uint32_t)headerSize;
+    header.priority = priority;
+    header.refetchCost = refetchCost;
+    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
 
     NSError *error = nil;
+    BOOL written = NO;
+    if (large) {
+        written = [self writeLargeRecordWithHeader:&header payload:data toPath:filePath error:&error];
+    } else {
+        NSMutableData *rawData = [NSMutableData dataWithCapacity:rawDataLength];
+        [rawData appendBytes:&header length:SPTPersistentCacheRecordHeaderSize];
+        [rawData appendData:digest ?: data];
+        written = [rawData writeToFile:filePath options:NSDataWritingAtomic error:&error];
+    }
 
-    if (![rawData writeToFile:filePath options:NSDataWritingAtomic error:&error]) {
+    if (!written) {
         [self debugOutput:@"PersistentDataCache: Error writting to file:%@ , for key:%@. Removing it...", filePath, key];
+        if (digest != nil) {
+            [blobStore abandonBlobWithDigest:digest];
+        }
         [self removeDataForKeysSync:@[key]];
         [self dispatchError:error result:SPTPersistentCacheResponseCodeOperationError callback:callback onQueue:queue];
     } else {
+        // Releases the blob of an earlier record for key
+        if (digest != nil) {
+            [blobStore commitBlobWithDigest:digest forKey:key];
+        } else {
+            [blobStore removeKey:key];
+        }
+        // Added on every store, skipping keys seen on disk would race with a concurrent remove of the key
+        [self.keyFilter addKey:key];
+        [self.keyIndex setMetadataWithHeader:&header forKey:key];
+        [self.sharedIndex setHeader:&header forKey:key];
+        [self.lockJournal setRefCounts:@{ key: @(isLocked ? 1 : 0) }];
+        [self.tagIndex setTags:tags ?: [NSSet set] forKey:key];
+        [self cancelDeferredRemovalOfKey:key];
+        [self.garbageCollector recordStoredBytes:rawDataLength];
 
         if (callback != nil) {
             SPTPersistentCacheResponse *response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
@@ -654,190 +1850,1511 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 }
 
 /**
- Method to work safely with opened file referenced by file descriptor. 
- Method handles file closing properly in case of errors.
- Descriptor is passed to a jobBlock for further usage.
+ Store method used internally to copy a file into the cache. Called on work queue.
  */
-- (SPTPersistentCacheResponse *)guardOpenFileWithPath:(NSString *)filePath
-                                             jobBlock:(SPTPersistentCacheFileProcessingBlockType)jobBlock
-                                             complain:(BOOL)needComplains
-                                            writeBack:(BOOL)writeBack
+- (void)storeFileSync:(NSString *)sourcePath
+               forKey:(NSString *)key
+                  ttl:(NSUInteger)ttl
+               locked:(BOOL)isLocked
+                 tags:(NSSet<NSString *> * _Nullable)tags
+             priority:(SPTPersistentCacheRecordPriority)priority
+          refetchCost:(uint64_t)refetchCost
+         withCallback:(SPTPersistentCacheResponseCallback)callback
+              onQueue:(dispatch_queue_t)queue
 {
-    if (![self.fileManager fileExistsAtPath:filePath]) {
-        if (needComplains) {
-            [self debugOutput:@"PersistentDataCache: Record not exist at path:%@", filePath];
+    NSString *filePath = [self.dataCacheFileManager pathForStoringKey:key];
+
+    NSString *subDir = [self.dataCacheFileManager subDirectoryPathForKey:key];
+    [self.fileManager createDirectoryAtPath:subDir withIntermediateDirectories:YES attributes:nil error:nil];
+
+    // Hidden, so GC and size calculations skip it, and next to the record so the final rename is atomic
+    NSString *tempFileName = [NSString stringWithFormat:@".%@.%@", key, [NSUUID UUID].UUIDString];
+    NSString *tempPath = [subDir stringByAppendingPathComponent:tempFileName];
+
+    const int SPTPersistentCacheInvalidResult = -1;
+    int sourceFd = open(sourcePath.fileSystemRepresentation, O_RDONLY);
+    if (sourceFd == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        [self debugOutput:@"PersistentDataCache: Error opening file to store:%@ , error:%@", sourcePath, @(strerror(errorNumber))];
+        [self dispatchError:SPTPersistentCachePosixError(errorNumber) result:SPTPersistentCacheResponseCodeOperationError callback:callback onQueue:queue];
+        return;
+    }
+
+    struct stat sourceStat;
+    if (fstat(sourceFd, &sourceStat) == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        [self.posixWrapper close:sourceFd];
+        [self debugOutput:@"PersistentDataCache: Error getting size of file to store:%@ , error:%@", sourcePath, @(strerror(errorNumber))];
+        [self dispatchError:SPTPersistentCachePosixError(errorNumber) result:SPTPersistentCacheResponseCodeOperationError callback:callback onQueue:queue];
+        return;
+    }
+
+    int tempFd = open(tempPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (tempFd == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        [self.posixWrapper close:sourceFd];
+        [self debugOutput:@"PersistentDataCache: Error creating file:%@ , error:%@", tempPath, @(strerror(errorNumber))];
+        [self dispatchError:SPTPersistentCachePosixError(errorNumber) result:SPTPersistentCacheResponseCodeOperationError callback:callback onQueue:queue];
+        return;
+    }
+
+    const uint64_t payloadLength = (uint64_t)sourceStat.st_size;
+    SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(ttl,
+                                                                               payloadLength,
+                                                                               spt_uint64rint(self.currentDateTimeInterval),
+                                                                               isLocked);
+    header.priority = priority;
+    header.refetchCost = refetchCost;
+
+    // A large payload starts at a page aligned offset and is copied around the page cache
+    const BOOL large = [self isLargePayloadOfSize:payloadLength];
+    if (large) {
+        header.headerSize = (uint32_t)SPTPersistentCacheRecordAlignedHeaderSize;
+    }
+    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+    if (large) {
+        [self.posixWrapper adviseNoCache:sourceFd];
+        [self.posixWrapper adviseNoCache:tempFd];
+    }
+
+    NSError *error = nil;
+    NSData * const paddedHeader = [self paddedDataWithHeader:&header];
+    if ([self.posixWrapper write:tempFd buffer:paddedHeader.bytes bufferSize:paddedHeader.length] != (ssize_t)paddedHeader.length) {
+        error = SPTPersistentCachePosixError(errno ?: EIO);
+    }
+
+    // Only one chunk is ever in memory, whatever the size of the file. Page aligned, as reads and writes around the
+    // page cache go straight from and to it.
+    uint64_t copiedLength = 0;
+    void *buffer = NULL;
+    if (error == nil && posix_memalign(&buffer, SPTPersistentCacheRecordAlignedHeaderSize, SPTPersistentCacheFileCopyChunkSize) != 0) {
+        buffer = NULL;
+        error = SPTPersistentCachePosixError(ENOMEM);
+    }
+    while (error == nil) {
+        const ssize_t readBytes = [self.posixWrapper read:sourceFd buffer:buffer bufferSize:SPTPersistentCacheFileCopyChunkSize];
+        if (readBytes == 0) {
+            break;
         }
-        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound error:nil record:nil];
+        if (readBytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = SPTPersistentCachePosixError(errno);
+            break;
+        }
+        if ([self.posixWrapper write:tempFd buffer:buffer bufferSize:(size_t)readBytes] != readBytes) {
+            error = SPTPersistentCachePosixError(errno ?: EIO);
+            break;
+        }
+        copiedLength += (uint64_t)readBytes;
+    }
+    free(buffer);
 
-    } else {
-        const int SPTPersistentCacheInvalidResult = -1;
-        const int flags = (writeBack ? O_RDWR : O_RDONLY);
+    // The file changed while it was copied, the header would be wrong
+    if (error == nil && copiedLength != payloadLength) {
+        error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize];
+    }
+    if (error == nil && [self.posixWrapper fsync:tempFd] == SPTPersistentCacheInvalidResult) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+    if (large) {
+        [self.posixWrapper adviseNoCache:sourceFd];
+        [self.posixWrapper adviseNoCache:tempFd];
+    }
 
-        int fd = open([filePath UTF8String], flags);
-        if (fd == SPTPersistentCacheInvalidResult) {
-            const int errorNumber = errno;
-            NSString *errorDescription = @(strerror(errorNumber));
-            [self debugOutput:@"PersistentDataCache: Error opening file:%@ , error:%@", filePath, errorDescription];
-            NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                                 code:errorNumber
-                                             userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
-            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
-                                                                error:error
+    [self.posixWrapper close:sourceFd];
+    if ([self.posixWrapper close:tempFd] == SPTPersistentCacheInvalidResult && error == nil) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+
+    if (error == nil && rename(tempPath.fileSystemRepresentation, filePath.fileSystemRepresentation) == SPTPersistentCacheInvalidResult) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+
+    if (error != nil) {
+        [self debugOutput:@"PersistentDataCache: Error storing file:%@ , for key:%@, error:%@", sourcePath, key, error];
+        unlink(tempPath.fileSystemRepresentation);
+        [self dispatchError:error result:SPTPersistentCacheResponseCodeOperationError callback:callback onQueue:queue];
+        return;
+    }
+
+    [self.keyFilter addKey:key];
+    [self.keyIndex setMetadataWithHeader:&header forKey:key];
+    [self.sharedIndex setHeader:&header forKey:key];
+    [self.lockJournal setRefCounts:@{ key: @(isLocked ? 1 : 0) }];
+    [self.tagIndex setTags:tags ?: [NSSet set] forKey:key];
+    [self.blobStore removeKey:key];
+    [self cancelDeferredRemovalOfKey:key];
+    [self.garbageCollector recordStoredBytes:header.headerSize + payloadLength];
+
+    [self dispatchEmptyResponseWithResult:SPTPersistentCacheResponseCodeOperationSucceeded callback:callback onQueue:queue];
+}
+
+/**
+ Touches the record for key, see touchDataForKey:callback:onQueue:. Called on work queue.
+ */
+- (SPTPersistentCacheResponse *)touchDataForKeySync:(NSString *)key
+{
+    NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+
+    BOOL __block expired = NO;
+
+    SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
+                                                                withBlock:^(SPTPersistentCacheRecordHeader *header) {
+                                                                    // Satisfy Req.#1.2 and Req.#1.3
+                                                                    if (![self isDataCanBeReturnedWithHeader:header forKey:key]) {
+                                                                        expired = YES;
+                                                                        return;
+                                                                    }
+                                                                    // Touch files that have default expiration policy
+                                                                    if (header->ttl == 0) {
+                                                                        header->updateTimeSec = spt_uint64rint(self.currentDateTimeInterval);
+                                                                    }
+                                                                }
+                                                                writeBack:YES
+                                                                 complain:NO];
+
+    // Satisfy Req.#1.2
+    if (expired) {
+        response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound
+                                                                error:nil
                                                                record:nil];
+    }
+    return response;
+}
+
+/**
+ Replaces a range of the payload of the record for key in place, a location of NSNotFound appends. Called on work queue.
+ @discussion The bytes are journaled and the header is flagged before the payload is touched. Loads of a flagged record
+ lock it, so they wait for an update in progress and finish one interrupted by a crash.
+ */
+- (SPTPersistentCacheResponse *)replaceRangeSync:(NSRange)range withData:(NSData *)data forKey:(NSString *)key
+{
+    if ([self isKeyPinned:key]) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorRecordIsStreamAndBusy]
+                                                           record:nil];
+    }
+    atomic_store(&_recordsUpdatedInPlace, true);
+
+    NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+    const int SPTPersistentCacheInvalidResult = -1;
+    const int filedes = open(filePath.fileSystemRepresentation, O_RDWR);
+    if (filedes == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        if (errorNumber == ENOENT || errorNumber == ENOTDIR) {
+            return SPTPersistentCacheNotFoundResponse();
         }
+        [self debugOutput:@"PersistentDataCache: Error opening file:%@ , error:%@", filePath, @(strerror(errorNumber))];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errorNumber)
+                                                           record:nil];
+    }
 
-        SPTPersistentCacheResponse *response = jobBlock(fd);
+    // Closing the file releases the lock
+    if ([self.posixWrapper flock:filedes operation:LOCK_EX] == SPTPersistentCacheInvalidResult) {
+        [self debugOutput:@"PersistentDataCache: Error locking file:%@ , error:%@", filePath, @(strerror(errno))];
+    }
 
-        fd = [self.posixWrapper close:fd];
-        if (fd == SPTPersistentCacheInvalidResult) {
-            const int errorNumber = errno;
-            NSString *errorDescription = @(strerror(errorNumber));
-            [self debugOutput:@"PersistentDataCache: Error closing file:%@ , error:%@", filePath, errorDescription];
-            NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                                 code:errorNumber
-                                             userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+    SPTPersistentCacheRecordHeader currentHeader;
+    BOOL deduplicated = NO;
+    SPTPersistentCacheResponse *response = [self replaceRange:range
+                                                     withData:data
+                                       inRecordWithDescriptor:filedes
+                                                         path:filePath
+                                                          key:key
+                                                currentHeader:&currentHeader
+                                                 deduplicated:&deduplicated];
+    [self.posixWrapper close:filedes];
+
+    // The payload of a deduplicated record is shared with other records, so it is stored anew instead
+    if (deduplicated) {
+        response = [self replaceRange:range withData:data inDeduplicatedRecordForKey:key currentHeader:&currentHeader];
+    }
+
+    if (response.result == SPTPersistentCacheResponseCodeOperationError) {
+        [self debugOutput:@"PersistentDataCache: Error updating key:%@ , error:%@", key, response.error];
+    }
+    return response;
+}
+
+/**
+ Updates the record open at a descriptor. Called with the record locked.
+ @param currentHeader Set to the header of the record with the lock journal applied.
+ @param deduplicated Set to YES if the record is deduplicated, it is then left for the caller to store anew.
+ */
+- (nullable SPTPersistentCacheResponse *)replaceRange:(NSRange)range
+                                             withData:(NSData *)data
+                               inRecordWithDescriptor:(int)filedes
+                                                 path:(NSString *)filePath
+                                                  key:(NSString *)key
+                                        currentHeader:(SPTPersistentCacheRecordHeader *)currentHeader
+                                         deduplicated:(BOOL *)deduplicated
+{
+    SPTPersistentCacheRecordHeader header;
+    if ([self.posixWrapper read:filedes buffer:&header bufferSize:SPTPersistentCacheRecordHeaderSize] != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader]
+                                                           record:nil];
+    }
+
+    NSError *error = SPTPersistentCacheCheckValidHeader(&header);
+    if (error != nil) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+
+    // An interrupted update is finished before this one builds on the payload
+    if ((header.flags & SPTPersistentCacheRecordHeaderFlagsUpdatePending) != 0) {
+        SPTPersistentCacheResponse *finishResponse = [self finishUpdateOfRecordWithDescriptor:filedes header:&header path:filePath key:key];
+        if (finishResponse != nil) {
+            return finishResponse;
+        }
+    }
+
+    *currentHeader = header;
+    [self applyLockJournalToHeader:currentHeader forKey:key];
+    // Satisfy Req.#1.2
+    if (![self isDataCanBeReturnedWithHeader:currentHeader forKey:key]) {
+        return SPTPersistentCacheNotFoundResponse();
+    }
+
+    if ((header.flags & SPTPersistentCacheRecordHeaderFlagsDeduplicated) != 0) {
+        *deduplicated = YES;
+        return nil;
+    }
+
+    struct stat fileStat;
+    if (fstat(filedes, &fileStat) == -1) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errno)
+                                                           record:nil];
+    }
+    if (header.payloadSizeBytes != (uint64_t)fileStat.st_size - header.headerSize) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize]
+                                                           record:nil];
+    }
+
+    const uint64_t payloadSize = header.payloadSizeBytes;
+    uint64_t location = 0;
+    if (!SPTPersistentCacheResolveUpdateRange(range, payloadSize, &location)) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(EINVAL)
+                                                           record:nil];
+    }
+
+    // A change of length moves the rest of the payload, which is then written along with the new bytes
+    NSData *bytes = data;
+    const uint64_t tailOffset = location + range.length;
+    if (range.length != data.length && tailOffset < payloadSize) {
+        const off_t tailFileOffset = (off_t)(header.headerSize + tailOffset);
+        NSData *tail = nil;
+        if ([self.posixWrapper lseek:filedes seekType:tailFileOffset seekAmount:SEEK_SET] != tailFileOffset) {
+            error = SPTPersistentCachePosixError(errno);
+        } else {
+            tail = [self readPayloadOfSize:(size_t)(payloadSize - tailOffset) fromDescriptor:filedes error:&error];
+        }
+        if (tail == nil) {
             return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
                                                                 error:error
                                                                record:nil];
         }
-
-        return response;
+        NSMutableData *joinedBytes = [data mutableCopy];
+        [joinedBytes appendData:tail];
+        bytes = joinedBytes;
+    }
+
+    SPTPersistentCacheRecordHeader updatedHeader = header;
+    updatedHeader.payloadSizeBytes = payloadSize - range.length + data.length;
+    updatedHeader.updateTimeSec = spt_uint64rint(self.currentDateTimeInterval);
+    updatedHeader.crc = SPTPersistentCacheCalculateHeaderCRC(&updatedHeader);
+
+    NSString *journalPath = SPTPersistentCacheUpdateJournalPath(filePath);
+    error = [self writeUpdateJournal:SPTPersistentCacheUpdateJournalEncode(&updatedHeader, location, bytes) toPath:journalPath];
+    if (error != nil) {
+        unlink(journalPath.fileSystemRepresentation);
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+
+    // Once the flag is on disk the next load finishes the update from the journal, whatever becomes of the payload
+    SPTPersistentCacheRecordHeader pendingHeader = header;
+    pendingHeader.flags |= SPTPersistentCacheRecordHeaderFlagsUpdatePending;
+    pendingHeader.crc = SPTPersistentCacheCalculateHeaderCRC(&pendingHeader);
+    error = [self writeBytes:&pendingHeader length:SPTPersistentCacheRecordHeaderSize atOffset:0 toDescriptor:filedes];
+    if (error == nil && [self.posixWrapper fsync:filedes] == -1) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+    if (error != nil) {
+        // The payload is untouched, so the record stays as it was. If the flag can’t be taken back the next load finds
+        // no journal and removes the record rather than trust it
+        if ([self writeBytes:&header length:SPTPersistentCacheRecordHeaderSize atOffset:0 toDescriptor:filedes] == nil) {
+            [self.posixWrapper fsync:filedes];
+        }
+        unlink(journalPath.fileSystemRepresentation);
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+
+    // A file handle reads the payload without taking the lock, one opened since the check above makes the update back out
+    if ([self isKeyPinned:key]) {
+        error = [self writeBytes:&header length:SPTPersistentCacheRecordHeaderSize atOffset:0 toDescriptor:filedes];
+        if (error == nil && [self.posixWrapper fsync:filedes] == -1) {
+            error = SPTPersistentCachePosixError(errno);
+        }
+        if (error == nil) {
+            unlink(journalPath.fileSystemRepresentation);
+        } else {
+            [self debugOutput:@"PersistentDataCache: Error backing out of update of key:%@ , error:%@", key, error];
+        }
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorRecordIsStreamAndBusy]
+                                                           record:nil];
+    }
+
+    error = [self applyUpdateWithBytes:bytes atOffset:location header:&updatedHeader toDescriptor:filedes];
+    if (error != nil) {
+        [self debugOutput:@"PersistentDataCache: Update of key:%@ left for the next load to finish", key];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+    unlink(journalPath.fileSystemRepresentation);
+
+    *currentHeader = updatedHeader;
+    [self applyLockJournalToHeader:currentHeader forKey:key];
+    [self.keyIndex setMetadataWithHeader:currentHeader forKey:key];
+    [self.sharedIndex setHeader:currentHeader forKey:key];
+    [self.garbageCollector recordStoredBytes:bytes.length];
+
+    return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                        error:nil
+                                                       record:nil];
+}
+
+/**
+ Updates a deduplicated record by loading its payload and storing the record anew. Called on work queue.
+ */
+- (SPTPersistentCacheResponse *)replaceRange:(NSRange)range
+                                    withData:(NSData *)data
+                  inDeduplicatedRecordForKey:(NSString *)key
+                               currentHeader:(const SPTPersistentCacheRecordHeader *)currentHeader
+{
+    SPTPersistentCacheResponse *response = [self loadResponseForKeySync:key allowStale:NO];
+    if (response.result != SPTPersistentCacheResponseCodeOperationSucceeded) {
+        return response;
+    }
+
+    NSMutableData *payload = [response.record.data mutableCopy];
+    uint64_t location = 0;
+    if (!SPTPersistentCacheResolveUpdateRange(range, payload.length, &location)) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(EINVAL)
+                                                           record:nil];
+    }
+    [payload replaceBytesInRange:NSMakeRange((NSUInteger)location, range.length) withBytes:data.bytes length:data.length];
+
+    NSError *error = [self storeDataSync:payload
+                                  forKey:key
+                                     ttl:(NSUInteger)currentHeader->ttl
+                                  locked:(currentHeader->refCount > 0)
+                                    tags:[self.tagIndex tagsForKey:key]
+                                priority:(SPTPersistentCacheRecordPriority)currentHeader->priority
+                             refetchCost:currentHeader->refetchCost
+                            withCallback:nil
+                                 onQueue:nil];
+    if (error != nil) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+    return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                        error:nil
+                                                       record:nil];
+}
+
+/**
+ Locks the record for key and finishes its update, if one is in progress or was interrupted. Called on work queue.
+ @return nil once the record isn’t flagged anymore, otherwise the response for it.
+ */
+- (nullable SPTPersistentCacheResponse *)finishUpdateOfRecordForKey:(NSString *)key
+{
+    NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+    const int SPTPersistentCacheInvalidResult = -1;
+    const int filedes = open(filePath.fileSystemRepresentation, O_RDWR);
+    if (filedes == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        if (errorNumber == ENOENT || errorNumber == ENOTDIR) {
+            return SPTPersistentCacheNotFoundResponse();
+        }
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errorNumber)
+                                                           record:nil];
+    }
+
+    // Waits for an update in progress, closing the file releases the lock
+    if ([self.posixWrapper flock:filedes operation:LOCK_EX] == SPTPersistentCacheInvalidResult) {
+        [self debugOutput:@"PersistentDataCache: Error locking file:%@ , error:%@", filePath, @(strerror(errno))];
+    }
+
+    SPTPersistentCacheResponse *response = nil;
+    SPTPersistentCacheRecordHeader header;
+    NSError *error = nil;
+    if ([self.posixWrapper read:filedes buffer:&header bufferSize:SPTPersistentCacheRecordHeaderSize] != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+        error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader];
+    } else if ((error = SPTPersistentCacheCheckValidHeader(&header)) == nil &&
+               (header.flags & SPTPersistentCacheRecordHeaderFlagsUpdatePending) != 0) {
+        response = [self finishUpdateOfRecordWithDescriptor:filedes header:&header path:filePath key:key];
+    }
+    [self.posixWrapper close:filedes];
+
+    if (error != nil) {
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+    return response;
+}
+
+/**
+ Finishes an update of the record open at a descriptor that was interrupted after its header was flagged, from the
+ journal next to it. Called with the record locked.
+ @param header The flagged header, set to the header of the updated record.
+ @return nil once the update is applied, otherwise the response for the record, which is removed if its journal is lost.
+ */
+- (nullable SPTPersistentCacheResponse *)finishUpdateOfRecordWithDescriptor:(int)filedes
+                                                                     header:(SPTPersistentCacheRecordHeader *)header
+                                                                       path:(NSString *)filePath
+                                                                        key:(NSString *)key
+{
+    NSString *journalPath = SPTPersistentCacheUpdateJournalPath(filePath);
+    NSData *journal = [NSData dataWithContentsOfFile:journalPath];
+    SPTPersistentCacheUpdateJournalHeader journalHeader = {0};
+    NSData *bytes = (journal != nil ? SPTPersistentCacheUpdateJournalDecode(journal, &journalHeader) : nil);
+    const uint64_t payloadSize = journalHeader.recordHeader.payloadSizeBytes;
+    if (bytes == nil || journalHeader.offset > payloadSize || bytes.length > payloadSize - journalHeader.offset) {
+        // Without the journal there is no telling which bytes of the payload were written
+        [self debugOutput:@"PersistentDataCache: Lost journal of interrupted update of key:%@ , removing record", key];
+        [self removeDataForKeySync:key];
+        return SPTPersistentCacheNotFoundResponse();
+    }
+
+    // The lock and TTL may have changed since the update began, it only brings the size and update time
+    SPTPersistentCacheRecordHeader updatedHeader = *header;
+    updatedHeader.payloadSizeBytes = payloadSize;
+    updatedHeader.updateTimeSec = journalHeader.recordHeader.updateTimeSec;
+    updatedHeader.flags &= ~(uint32_t)SPTPersistentCacheRecordHeaderFlagsUpdatePending;
+    updatedHeader.crc = SPTPersistentCacheCalculateHeaderCRC(&updatedHeader);
+
+    NSError *error = [self applyUpdateWithBytes:bytes atOffset:journalHeader.offset header:&updatedHeader toDescriptor:filedes];
+    if (error != nil) {
+        [self debugOutput:@"PersistentDataCache: Error finishing update of key:%@ , error:%@", key, error];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:error
+                                                           record:nil];
+    }
+    unlink(journalPath.fileSystemRepresentation);
+    [self debugOutput:@"PersistentDataCache: Finished interrupted update of key:%@", key];
+
+    *header = updatedHeader;
+    SPTPersistentCacheRecordHeader indexedHeader = updatedHeader;
+    [self applyLockJournalToHeader:&indexedHeader forKey:key];
+    [self.keyIndex setMetadataWithHeader:&indexedHeader forKey:key];
+    [self.sharedIndex setHeader:&indexedHeader forKey:key];
+    return nil;
+}
+
+/**
+ Writes the bytes of an update into the payload, then the header of the updated record, and syncs them. Called with
+ the record locked.
+ */
+- (nullable NSError *)applyUpdateWithBytes:(NSData *)bytes
+                                  atOffset:(uint64_t)offset
+                                    header:(const SPTPersistentCacheRecordHeader *)header
+                              toDescriptor:(int)filedes
+{
+    NSError *error = [self writeBytes:bytes.bytes
+                               length:bytes.length
+                             atOffset:(off_t)(header->headerSize + offset)
+                         toDescriptor:filedes];
+    // A payload that shrunk leaves its old end behind
+    if (error == nil && ftruncate(filedes, (off_t)(header->headerSize + header->payloadSizeBytes)) == -1) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+    if (error == nil) {
+        error = [self writeBytes:header length:SPTPersistentCacheRecordHeaderSize atOffset:0 toDescriptor:filedes];
+    }
+    if (error == nil && [self.posixWrapper fsync:filedes] == -1) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+    return error;
+}
+
+/**
+ Writes the journal of an update and syncs it.
+ */
+- (nullable NSError *)writeUpdateJournal:(NSData *)journal toPath:(NSString *)journalPath
+{
+    const int filedes = open(journalPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (filedes == -1) {
+        return SPTPersistentCachePosixError(errno);
+    }
+
+    NSError *error = [self writeBytes:journal.bytes length:journal.length atOffset:0 toDescriptor:filedes];
+    if (error == nil && [self.posixWrapper fsync:filedes] == -1) {
+        error = SPTPersistentCachePosixError(errno);
+    }
+    [self.posixWrapper close:filedes];
+    return error;
+}
+
+/**
+ Writes bytes at an offset of the file open at a descriptor.
+ */
+- (nullable NSError *)writeBytes:(const void *)bytes length:(size_t)length atOffset:(off_t)offset toDescriptor:(int)filedes
+{
+    if ([self.posixWrapper lseek:filedes seekType:offset seekAmount:SEEK_SET] != offset) {
+        return SPTPersistentCachePosixError(errno);
+    }
+
+    size_t writtenBytes = 0;
+    while (writtenBytes < length) {
+        const ssize_t result = [self.posixWrapper write:filedes
+                                                 buffer:(const uint8_t *)bytes + writtenBytes
+                                             bufferSize:length - writtenBytes];
+        if (result <= 0) {
+            return SPTPersistentCachePosixError(result == -1 ? errno : EIO);
+        }
+        writtenBytes += (size_t)result;
+    }
+    return nil;
+}
+
+/**
+ Whether a payload is stored as a large record, see `largeRecordThresholdBytes`.
+ */
+- (BOOL)isLargePayloadOfSize:(uint64_t)payloadSize
+{
+    const NSUInteger threshold = self.options.largeRecordThresholdBytes;
+    return threshold > 0 && payloadSize >= threshold;
+}
+
+/**
+ Returns a header padded with zeros to its `headerSize`.
+ */
+- (NSData *)paddedDataWithHeader:(const SPTPersistentCacheRecordHeader *)header
+{
+    NSMutableData * const data = [NSMutableData dataWithLength:header->headerSize];
+    memcpy(data.mutableBytes, header, SPTPersistentCacheRecordHeaderSize);
+    return data;
+}
+
+/**
+ Writes a large record around the page cache into a hidden file next to its path, then moves it into place.
+ */
+- (BOOL)writeLargeRecordWithHeader:(const SPTPersistentCacheRecordHeader *)header
+                           payload:(NSData *)payload
+                            toPath:(NSString *)filePath
+                             error:(NSError **)error
+{
+    NSString *tempFileName = [NSString stringWithFormat:@".%@.%@", filePath.lastPathComponent, [NSUUID UUID].UUIDString];
+    NSString *tempPath = [[filePath stringByDeletingLastPathComponent] stringByAppendingPathComponent:tempFileName];
+
+    const int filedes = open(tempPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (filedes == -1) {
+        *error = SPTPersistentCachePosixError(errno);
+        return NO;
+    }
+    [self.posixWrapper adviseNoCache:filedes];
+
+    NSData * const paddedHeader = [self paddedDataWithHeader:header];
+    NSError *writeError = [self writeBytes:paddedHeader.bytes length:paddedHeader.length atOffset:0 toDescriptor:filedes];
+    if (writeError == nil) {
+        writeError = [self writeBytes:payload.bytes length:payload.length atOffset:(off_t)header->headerSize toDescriptor:filedes];
+    }
+    if (writeError == nil && [self.posixWrapper fsync:filedes] == -1) {
+        writeError = SPTPersistentCachePosixError(errno);
+    }
+    [self.posixWrapper adviseNoCache:filedes];
+    if ([self.posixWrapper close:filedes] == -1 && writeError == nil) {
+        writeError = SPTPersistentCachePosixError(errno);
+    }
+    if (writeError == nil && rename(tempPath.fileSystemRepresentation, filePath.fileSystemRepresentation) == -1) {
+        writeError = SPTPersistentCachePosixError(errno);
+    }
+
+    if (writeError != nil) {
+        unlink(tempPath.fileSystemRepresentation);
+        *error = writeError;
+        return NO;
+    }
+    return YES;
+}
+
+/**
+ Whether records are locked while their headers are written and shared while they are read, which is needed once they
+ are updated in place or shared with other processes.
+ */
+- (BOOL)isCoordinatingRecordAccess
+{
+    return self.options.useMultiProcessCoordination || atomic_load(&_recordsUpdatedInPlace);
+}
+
+- (BOOL)isKeyPinned:(NSString *)key
+{
+    @synchronized (self.pinnedKeys) {
+        return [self.pinnedKeys countForObject:key] > 0;
+    }
+}
+
+/**
+ Opens and validates the record for key and pins it. Called on work queue.
+ */
+- (SPTPersistentCacheResponse *)openFileHandleForKeySync:(NSString *)key
+                                              fileHandle:(SPTPersistentCacheFileHandle * __autoreleasing *)fileHandle
+{
+    NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+
+    // Pin before opening so the record can’t be removed between validation and handing it out
+    [self pinKey:key];
+
+    const int SPTPersistentCacheInvalidResult = -1;
+    // Opened for writing too, the access time is written back the same way as on load
+    int fd = open(filePath.fileSystemRepresentation, O_RDWR);
+    if (fd == SPTPersistentCacheInvalidResult && (errno == EACCES || errno == EROFS)) {
+        fd = open(filePath.fileSystemRepresentation, O_RDONLY);
+    }
+    if (fd == SPTPersistentCacheInvalidResult) {
+        const int errorNumber = errno;
+        [self unpinKey:key];
+        if (errorNumber == ENOENT) {
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound error:nil record:nil];
+        }
+        [self debugOutput:@"PersistentDataCache: Error opening file:%@ , error:%@", filePath, @(strerror(errorNumber))];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                            error:SPTPersistentCachePosixError(errorNumber)
+                                                           record:nil];
+    }
+
+    SPTPersistentCacheResponseCode result = SPTPersistentCacheResponseCodeOperationSucceeded;
+    NSError *error = nil;
+    off_t payloadOffset = (off_t)SPTPersistentCacheRecordHeaderSize;
+
+    SPTPersistentCacheRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    const ssize_t readBytes = [self.posixWrapper read:fd buffer:&header bufferSize:SPTPersistentCacheRecordHeaderSize];
+    const SPTPersistentCacheRecordHeader readHeader = header;
+    // The record stays open until its access time is written back, the handle of a deduplicated one reads the blob
+    const int recordFd = fd;
+    struct stat fileStat;
+    if (readBytes != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+        result = SPTPersistentCacheResponseCodeOperationError;
+        error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader];
+    } else if ((error = SPTPersistentCacheCheckValidHeader(&header)) != nil) {
+        result = SPTPersistentCacheResponseCodeOperationError;
+    } else if ((header.flags & SPTPersistentCacheRecordHeaderFlagsUpdatePending) != 0) {
+        // The payload isn’t handed out before the update of the record is done, it is opened again then
+        [self.posixWrapper close:fd];
+        [self unpinKey:key];
+        SPTPersistentCacheResponse *finishResponse = [self finishUpdateOfRecordForKey:key];
+        return finishResponse ?: [self openFileHandleForKeySync:key fileHandle:fileHandle];
+    } else if (![self isDataCanBeReturnedWithHeader:[self applyLockJournalToHeader:&header forKey:key] forKey:key]) {
+        // Satisfy Req.#1.2
+        result = SPTPersistentCacheResponseCodeNotFound;
+    } else if (fstat(fd, &fileStat) == SPTPersistentCacheInvalidResult) {
+        result = SPTPersistentCacheResponseCodeOperationError;
+        error = SPTPersistentCachePosixError(errno);
+    } else if ((header.flags & SPTPersistentCacheRecordHeaderFlagsDeduplicated) != 0) {
+        // The handle reads the blob, which stays readable even if the last record referencing it is removed
+        const int blobFd = [self openBlobOfRecordWithDescriptor:fd recordSize:fileStat.st_size header:&header error:&error];
+        if (blobFd == SPTPersistentCacheInvalidResult) {
+            [self debugOutput:@"PersistentDataCache: Error opening payload of deduplicated key:%@ , error:%@", key, error];
+            const BOOL missing = [error.domain isEqualToString:NSPOSIXErrorDomain] && error.code == ENOENT;
+            result = (missing ? SPTPersistentCacheResponseCodeNotFound : SPTPersistentCacheResponseCodeOperationError);
+            error = (missing ? nil : error);
+        } else {
+            fd = blobFd;
+            payloadOffset = 0;
+        }
+    } else if (header.payloadSizeBytes != (uint64_t)fileStat.st_size - header.headerSize) {
+        [self debugOutput:@"PersistentDataCache: Error: Wrong payload size for key:%@ , will return error", key];
+        result = SPTPersistentCacheResponseCodeOperationError;
+        error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize];
+    } else if (header.headerSize != SPTPersistentCacheRecordHeaderSize) {
+        // The payload of a large record starts after the padding of its header and is read around the page cache
+        payloadOffset = (off_t)header.headerSize;
+        [self.posixWrapper adviseNoCache:fd];
+    }
+
+    if (result != SPTPersistentCacheResponseCodeOperationSucceeded) {
+        [self.posixWrapper close:fd];
+        [self unpinKey:key];
+        return [[SPTPersistentCacheResponse alloc] initWithResult:result error:error record:nil];
+    }
+
+    // Same as load, records with default expiration are kept alive by accessing them
+    if (header.ttl == 0) {
+        [self writeBackAccessTimeOfHeader:&readHeader toDescriptor:recordFd forKey:key];
+        // The lock taken for the write back would block every header write for as long as the handle is open
+        [self.posixWrapper flock:recordFd operation:LOCK_UN];
+    }
+    if (recordFd != fd) {
+        [self.posixWrapper close:recordFd];
+    }
+
+    __weak __typeof(self) const weakSelf = self;
+    *fileHandle = [[SPTPersistentCacheFileHandle alloc] initWithKey:key
+                                                     fileDescriptor:fd
+                                                      payloadOffset:payloadOffset
+                                                      payloadLength:header.payloadSizeBytes
+                                                       closeHandler:^{
+                                                           [weakSelf unpinKey:key];
+                                                       }];
+
+    return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded error:nil record:nil];
+}
+
+- (void)pinKey:(NSString *)key
+{
+    @synchronized (self.pinnedKeys) {
+        [self.pinnedKeys addObject:key];
+    }
+}
+
+- (void)unpinKey:(NSString *)key
+{
+    BOOL removeNow = NO;
+    @synchronized (self.pinnedKeys) {
+        [self.pinnedKeys removeObject:key];
+        if ([self.pinnedKeys countForObject:key] == 0 && [self.deferredRemovals containsObject:key]) {
+            [self.deferredRemovals removeObject:key];
+            removeNow = YES;
+        }
+    }
+
+    if (removeNow) {
+        [self doWork:^{
+            [self removeDataForKeySync:key];
+        } lane:SPTPersistentCacheSchedulerLaneWrite priority:self.options.deletePriority qos:self.options.deleteQualityOfService];
+    }
+}
+
+/// A record stored again after its removal was deferred must survive the handles being closed
+- (void)cancelDeferredRemovalOfKey:(NSString *)key
+{
+    @synchronized (self.pinnedKeys) {
+        [self.deferredRemovals removeObject:key];
+    }
+}
+
+/**
+ Method to work safely with opened file referenced by file descriptor. 
+ Method handles file closing properly in case of errors.
+ Descriptor is passed to a jobBlock for further usage.
+ */
+- (SPTPersistentCacheResponse *)guardOpenFileWithPath:(NSString *)filePath
+                                             jobBlock:(SPTPersistentCacheFileProcessingBlockType)jobBlock
+                                             complain:(BOOL)needComplains
+                                            writeBack:(BOOL)writeBack
+{
+    if (![self.fileManager fileExistsAtPath:filePath]) {
+        if (needComplains) {
+            [self debugOutput:@"PersistentDataCache: Record not exist at path:%@", filePath];
+        }
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound error:nil record:nil];
+
+    } else {
+        const int SPTPersistentCacheInvalidResult = -1;
+        const int flags = (writeBack ? O_RDWR : O_RDONLY);
+
+        int fd = open([filePath UTF8String], flags);
+        if (fd == SPTPersistentCacheInvalidResult) {
+            const int errorNumber = errno;
+            NSString *errorDescription = @(strerror(errorNumber));
+            [self debugOutput:@"PersistentDataCache: Error opening file:%@ , error:%@", filePath, errorDescription];
+            NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                 code:errorNumber
+                                             userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                error:error
+                                                               record:nil];
+        }
+
+        // Another process, an update or an access time write back may be rewriting the same header, closing the file
+        // releases the lock
+        if (writeBack && [self.posixWrapper flock:fd operation:LOCK_EX] == SPTPersistentCacheInvalidResult) {
+            [self debugOutput:@"PersistentDataCache: Error locking file:%@ , error:%@", filePath, @(strerror(errno))];
+        }
+
+        SPTPersistentCacheResponse *response = jobBlock(fd);
+
+        fd = [self.posixWrapper close:fd];
+        if (fd == SPTPersistentCacheInvalidResult) {
+            const int errorNumber = errno;
+            NSString *errorDescription = @(strerror(errorNumber));
+            [self debugOutput:@"PersistentDataCache: Error closing file:%@ , error:%@", filePath, errorDescription];
+            NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                 code:errorNumber
+                                             userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                error:error
+                                                               record:nil];
+        }
+
+        return response;
+    }
+}
+
+/**
+ Method used to read/write file header.
+ */
+- (SPTPersistentCacheResponse *)alterHeaderForFileAtPath:(NSString *)filePath
+                                               withBlock:(SPTPersistentCacheRecordHeaderGetCallbackType)modifyBlock
+                                               writeBack:(BOOL)needWriteBack
+                                                complain:(BOOL)needComplains
+{
+    return [self guardOpenFileWithPath:filePath jobBlock:^SPTPersistentCacheResponse*(int filedes) {
+
+        SPTPersistentCacheRecordHeader header;
+        ssize_t readBytes = [self.posixWrapper read:filedes
+                                             buffer:&header
+                                         bufferSize:SPTPersistentCacheRecordHeaderSize];
+        if (readBytes != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+            NSError *error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader];
+            if (readBytes == -1) {
+                const int errorNumber = errno;
+                NSString *errorDescription = @(strerror(errorNumber));
+                error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                            code:errorNumber
+                                        userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+            }
+
+            [self debugOutput:@"PersistentDataCache: Error not enough data to read the header of file path:%@ , error:%@",
+             filePath, [error localizedDescription]];
+
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                error:error
+                                                               record:nil];
+        }
+
+        NSError *nsError = SPTPersistentCacheCheckValidHeader(&header);
+        if (nsError != nil) {
+            [self debugOutput:@"PersistentDataCache: Error checking header at file path:%@ , error:%@", filePath, nsError];
+            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                error:nsError
+                                                               record:nil];
+        }
+
+        // A write back brings the refCount in the header up to date with the lock journal
+        [self applyLockJournalToHeader:&header forKey:filePath.lastPathComponent];
+
+        modifyBlock(&header);
+
+        if (needWriteBack) {
+
+            uint32_t oldCRC = header.crc;
+            header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+
+            // If nothing has changed we do nothing then
+            if (oldCRC == header.crc) {
+                return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                                    error:nil
+                                                                   record:nil];
+            }
+
+            // Set file pointer to the beginning of the file
+            off_t seekOffset = [self.posixWrapper lseek:filedes seekType:SEEK_SET seekAmount:0];
+            if (seekOffset != 0) {
+                const int errorNumber = errno;
+                NSString *errorDescription = @(strerror(errorNumber));
+                [self debugOutput:@"PersistentDataCache: Error seeking to begin of file path:%@ , error:%@", filePath, errorDescription];
+                NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                     code:errorNumber
+                                                 userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+                return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                    error:error
+                                                                   record:nil];
+
+            } else {
+                ssize_t writtenBytes = [self.posixWrapper write:filedes
+                                                         buffer:&header
+                                                     bufferSize:SPTPersistentCacheRecordHeaderSize];
+                if (writtenBytes != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+                    const int errorNumber = errno;
+                    NSString *errorDescription = @(strerror(errorNumber));
+                    [self debugOutput:@"PersistentDataCache: Error writting header at file path:%@ , error:%@", filePath, errorDescription];
+                    NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                         code:errorNumber
+                                                     userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+                    return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                        error:error
+                                                                       record:nil];
+
+                } else {
+                    int result = [self.posixWrapper fsync:filedes];
+                    if (result == -1) {
+                        const int errorNumber = errno;
+                        NSString *errorDescription = @(strerror(errorNumber));
+                        [self debugOutput:@"PersistentDataCache: Error flushing file:%@ , error:%@", filePath, errorDescription];
+                        NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                             code:errorNumber
+                                                         userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
+                        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                            error:error
+                                                                           record:nil];
+                    }
+                }
+            }
+
+            [self.keyIndex setMetadataWithHeader:&header forKey:filePath.lastPathComponent];
+            [self.sharedIndex setHeader:&header forKey:filePath.lastPathComponent];
+        }
+
+        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                            error:nil
+                                                           record:nil];
+    } complain:needComplains writeBack:needWriteBack];
+}
+
+/**
+ Only this method check data expiration. Past check is also supported.
+ */
+- (BOOL)isDataExpiredWithHeader:(SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    assert(header != nil);
+    uint64_t ttl = header->ttl;
+    uint64_t current = spt_uint64rint(self.currentDateTimeInterval);
+    int64_t threshold = (int64_t)((ttl > 0) ? ttl : [self.partitionTable expirationPeriodForKey:key]);
+
+    if (ttl > SPTPersistentCacheTTLUpperBoundInSec) {
+        [self debugOutput:@"PersistentDataCache: WARNING: TTL seems too big: %llu > %llu sec", ttl, SPTPersistentCacheTTLUpperBoundInSec];
+    }
+
+    return (int64_t)(current - header->updateTimeSec) > threshold;
+}
+
+/**
+ Methos checks whether data can be given to caller with accordance to API.
+ */
+- (BOOL)isDataCanBeReturnedWithHeader:(SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    return !([self isDataExpiredWithHeader:header forKey:key] && header->refCount == 0);
+}
+
+/**
+ Opens the lock journal, filling it from the record headers if it was just created. Called from init.
+ */
+- (void)openLockJournal
+{
+    SPTPersistentCacheLockJournal *lockJournal = [[SPTPersistentCacheLockJournal alloc] initWithPath:self.dataCacheFileManager.lockJournalPath
+                                                                                         debugOutput:self.debugOutput];
+    if (lockJournal == nil) {
+        // Locks keep working through the record headers
+        return;
+    }
+
+    if (lockJournal.isCreated) {
+        NSMutableDictionary<NSString *, NSNumber *> *refCounts = [NSMutableDictionary dictionary];
+        [self alterHeadersOfAllRecordsWithBlock:^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+            if (header->refCount > 0) {
+                refCounts[key] = @(header->refCount);
+            }
+        } writeBack:NO];
+
+        // An incomplete journal would unlock records, it’s created again on the next start
+        if (![lockJournal setRefCounts:refCounts]) {
+            [self.fileManager removeItemAtPath:self.dataCacheFileManager.lockJournalPath error:nil];
+            return;
+        }
+    }
+
+    _lockJournal = lockJournal;
+}
+
+/**
+ Writes the refCounts of a lock journal left by an earlier start back into the record headers and removes it.
+ Called from init.
+ */
+- (void)closeLockJournal
+{
+    SPTPersistentCacheLockJournal *lockJournal = [[SPTPersistentCacheLockJournal alloc] initWithPath:self.dataCacheFileManager.lockJournalPath
+                                                                                         debugOutput:self.debugOutput];
+    if (lockJournal == nil) {
+        return;
+    }
+
+    // Headers may be out of date in both directions, so every record is checked, but only changed ones are written
+    NSDictionary<NSString *, NSNumber *> *refCounts = lockJournal.allRefCounts;
+    [self alterHeadersOfAllRecordsWithBlock:^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+        header->refCount = (uint32_t)refCounts[key].unsignedIntegerValue;
+    } writeBack:YES];
+
+    [self.fileManager removeItemAtPath:self.dataCacheFileManager.lockJournalPath error:nil];
+}
+
+- (void)alterHeadersOfAllRecordsWithBlock:(SPTPersistentCacheRecordKeyHeaderCallbackType)block writeBack:(BOOL)writeBack
+{
+    NSURL *urlPath = [NSURL fileURLWithPath:self.options.cachePath];
+    NSDirectoryEnumerator *dirEnumerator = [self.fileManager enumeratorAtURL:urlPath
+                                                  includingPropertiesForKeys:@[NSURLIsDirectoryKey]
+                                                                     options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                errorHandler:nil];
+
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:SPTPersistentCacheHeaderReadBatchSize];
+    NSURL *theURL = nil;
+    while ((theURL = [dirEnumerator nextObject])) {
+        NSNumber *isDirectory;
+        if ([theURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]) {
+            if ([isDirectory boolValue] == NO) {
+                NSString *key = theURL.lastPathComponent;
+                if (writeBack) {
+                    [self alterHeaderForFileAtPath:[self.dataCacheFileManager pathForKey:key] withBlock:^(SPTPersistentCacheRecordHeader *header) {
+                        block(key, header);
+                    } writeBack:YES complain:YES];
+                    continue;
+                }
+                [keys addObject:key];
+                if (keys.count == SPTPersistentCacheHeaderReadBatchSize) {
+                    [self readHeadersOfRecordsForKeys:keys withBlock:block];
+                    [keys removeAllObjects];
+                }
+            }
+        } else {
+            [self debugOutput:@"Unable to fetch isDir#7 attribute:%@", theURL];
+        }
+    }
+
+    if (keys.count > 0) {
+        [self readHeadersOfRecordsForKeys:keys withBlock:block];
+    }
+}
+
+/**
+ Reads and validates the headers of the records for keys with one batch of reads and calls block with each valid one,
+ with the refCount of the lock journal applied. Records that can’t be read are skipped.
+ */
+- (void)readHeadersOfRecordsForKeys:(NSArray<NSString *> *)keys withBlock:(SPTPersistentCacheRecordKeyHeaderCallbackType)block
+{
+    const NSUInteger count = keys.count;
+    SPTPersistentCacheRecordHeader *headers = calloc(count, sizeof(SPTPersistentCacheRecordHeader));
+    SPTPersistentCachePosixReadRequest *requests = calloc(count, sizeof(SPTPersistentCachePosixReadRequest));
+    NSUInteger *keyIndexes = calloc(count, sizeof(NSUInteger));
+    if (headers == NULL || requests == NULL || keyIndexes == NULL) {
+        free(headers);
+        free(requests);
+        free(keyIndexes);
+        return;
+    }
+
+    size_t requestCount = 0;
+    for (NSUInteger i = 0; i < count; ++i) {
+        NSString *filePath = [self.dataCacheFileManager pathForKey:keys[i]];
+        const int fd = open(filePath.fileSystemRepresentation, O_RDONLY);
+        if (fd == -1) {
+            // The record may have been removed since the directory was listed
+            if (errno != ENOENT) {
+                [self debugOutput:@"PersistentDataCache: Error opening file:%@ , error:%@", filePath, @(strerror(errno))];
+            }
+            continue;
+        }
+        requests[requestCount] = (SPTPersistentCachePosixReadRequest){
+            .descriptor = fd,
+            .buffer = &headers[i],
+            .bufferSize = SPTPersistentCacheRecordHeaderSize,
+            .offset = 0,
+        };
+        keyIndexes[requestCount] = i;
+        ++requestCount;
+    }
+
+    [self.posixWrapper readBatch:requests count:requestCount];
+
+    for (size_t i = 0; i < requestCount; ++i) {
+        [self.posixWrapper close:requests[i].descriptor];
+
+        NSString *key = keys[keyIndexes[i]];
+        SPTPersistentCacheRecordHeader *header = &headers[keyIndexes[i]];
+        if (requests[i].result != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+            NSString *errorDescription = (requests[i].result == -1 ?
+                                          @(strerror(requests[i].error)) :
+                                          [[NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader] localizedDescription]);
+            [self debugOutput:@"PersistentDataCache: Error not enough data to read the header of key:%@ , error:%@", key, errorDescription];
+            continue;
+        }
+
+        NSError *nsError = SPTPersistentCacheCheckValidHeader(header);
+        if (nsError != nil) {
+            [self debugOutput:@"PersistentDataCache: Error checking header of key:%@ , error:%@", key, nsError];
+            continue;
+        }
+
+        block(key, [self applyLockJournalToHeader:header forKey:key]);
+    }
+
+    free(headers);
+    free(requests);
+    free(keyIndexes);
+}
+
+/**
+ Replaces the refCount of a header read from disk with the one in the lock journal, if the journal is used.
+ */
+- (SPTPersistentCacheRecordHeader *)applyLockJournalToHeader:(SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    SPTPersistentCacheLockJournal * const lockJournal = self.lockJournal;
+    if (lockJournal != nil) {
+        header->refCount = (uint32_t)[lockJournal refCountForKey:key];
+    }
+    return header;
+}
+
+/**
+ Increments the refCounts of the records for keys and calls back with the result for each key. Called on work queue.
+ */
+- (void)lockDataForKeysSync:(NSArray<NSString *> *)keys
+                   callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                    onQueue:(dispatch_queue_t _Nullable)queue
+{
+    if (self.lockJournal != nil) {
+        [self changeRefCountsOfKeys:keys delta:1 callback:callback onQueue:queue];
+    } else {
+        for (NSString *key in keys) {
+            NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+            BOOL __block expired = NO;
+            SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
+                                                                        withBlock:^(SPTPersistentCacheRecordHeader *header) {
+                                                                            // Satisfy Req.#1.2
+                                                                            if ([self isDataExpiredWithHeader:header forKey:key]) {
+                                                                                expired = YES;
+                                                                                return;
+                                                                            }
+                                                                            ++header->refCount;
+                                                                            // Do not update access time since file is locked
+                                                                        }
+                                                                        writeBack:YES
+                                                                         complain:YES];
+            // Satisfy Req.#1.2
+            if (expired) {
+                response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound
+                                                                        error:nil
+                                                                       record:nil];
+            }
+            if (callback) {
+                SPTPersistentCacheSafeDispatch(queue, ^{
+                    callback(response);
+                });
+            }
+        } // for
+    }
+}
+
+/**
+ Locks (delta 1) or unlocks (delta -1) records in one lock journal transaction. The headers are only read.
+ Called on work queue.
+ */
+- (void)changeRefCountsOfKeys:(NSArray<NSString *> *)keys
+                        delta:(NSInteger)delta
+                     callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                      onQueue:(dispatch_queue_t _Nullable)queue
+{
+    NSMutableArray<SPTPersistentCacheResponse *> *responses = [NSMutableArray arrayWithCapacity:keys.count];
+    NSMutableDictionary<NSString *, NSNumber *> *deltas = [NSMutableDictionary dictionary];
+
+    for (NSString *key in keys) {
+        NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+        // The same key may appear more than once in a batch
+        const NSInteger pendingDelta = deltas[key].integerValue;
+        BOOL __block expired = NO;
+        BOOL __block changed = NO;
+        SPTPersistentCacheResponse *response = [self alterHeaderForFileAtPath:filePath
+                                                                    withBlock:^(SPTPersistentCacheRecordHeader *header) {
+                                                                        if (delta > 0) {
+                                                                            // Satisfy Req.#1.2
+                                                                            expired = [self isDataExpiredWithHeader:header forKey:key];
+                                                                            changed = !expired;
+                                                                        } else if ((NSInteger)header->refCount + pendingDelta > 0) {
+                                                                            changed = YES;
+                                                                        } else {
+                                                                            [self debugOutput:@"PersistentDataCache: Error trying to decrement refCount below 0 for file at path:%@", filePath];
+                                                                        }
+                                                                    }
+                                                                    writeBack:NO
+                                                                     complain:YES];
+        // Satisfy Req.#1.2
+        if (expired) {
+            response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeNotFound
+                                                                    error:nil
+                                                                   record:nil];
+        }
+        if (changed) {
+            deltas[key] = @(pendingDelta + delta);
+        }
+        [responses addObject:response];
+    }
+
+    if (![self.lockJournal applyRefCountDeltas:deltas]) {
+        // Nothing of the batch was applied
+        NSError *error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorInternalInconsistency];
+        for (NSUInteger i = 0; i < responses.count; ++i) {
+            if (responses[i].result == SPTPersistentCacheResponseCodeOperationSucceeded) {
+                responses[i] = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
+                                                                            error:error
+                                                                           record:nil];
+            }
+        }
+    }
+
+    if (callback) {
+        for (SPTPersistentCacheResponse *response in responses) {
+            SPTPersistentCacheSafeDispatch(queue, ^{
+                callback(response);
+            });
+        }
     }
 }
 
-/**
- Method used to read/write file header.
- */
-- (SPTPersistentCacheResponse *)alterHeaderForFileAtPath:(NSString *)filePath
-                                               withBlock:(SPTPersistentCacheRecordHeaderGetCallbackType)modifyBlock
-                                               writeBack:(BOOL)needWriteBack
-                                                complain:(BOOL)needComplains
+- (void)populateKeyFilter
 {
-    return [self guardOpenFileWithPath:filePath jobBlock:^SPTPersistentCacheResponse*(int filedes) {
-
-        SPTPersistentCacheRecordHeader header;
-        ssize_t readBytes = [self.posixWrapper read:filedes
-                                             buffer:&header
-                                         bufferSize:SPTPersistentCacheRecordHeaderSize];
-        if (readBytes != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
-            NSError *error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader];
-            if (readBytes == -1) {
-                const int errorNumber = errno;
-                NSString *errorDescription = @(strerror(errorNumber));
-                error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                            code:errorNumber
-                                        userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
-            }
+    SPTPersistentCacheKeyFilter * const keyFilter = self.keyFilter;
+    if (keyFilter == nil) {
+        return;
+    }
 
-            [self debugOutput:@"PersistentDataCache: Error not enough data to read the header of file path:%@ , error:%@",
-             filePath, [error localizedDescription]];
+    [keyFilter beginPopulating];
 
-            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
-                                                                error:error
-                                                               record:nil];
-        }
+    NSURL *urlPath = [NSURL fileURLWithPath:self.options.cachePath];
+    NSDirectoryEnumerator *dirEnumerator = [self.fileManager enumeratorAtURL:urlPath
+                                                  includingPropertiesForKeys:@[NSURLIsDirectoryKey]
+                                                                     options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                errorHandler:nil];
 
-        NSError *nsError = SPTPersistentCacheCheckValidHeader(&header);
-        if (nsError != nil) {
-            [self debugOutput:@"PersistentDataCache: Error checking header at file path:%@ , error:%@", filePath, nsError];
-            return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
-                                                                error:nsError
-                                                               record:nil];
+    NSURL *theURL = nil;
+    while ((theURL = [dirEnumerator nextObject])) {
+        NSNumber *isDirectory;
+        if ([theURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]) {
+            if ([isDirectory boolValue] == NO) {
+                [keyFilter addKey:theURL.lastPathComponent];
+            }
+        } else {
+            // Unknown entries might be records, the filter can’t rule anything out
+            [self debugOutput:@"Unable to fetch isDir#6 attribute:%@", theURL];
+            return;
         }
+    }
 
-        modifyBlock(&header);
+    [keyFilter finishPopulating];
+}
 
-        if (needWriteBack) {
+- (void)populateKeyIndex
+{
+    SPTPersistentCacheKeyIndex * const keyIndex = self.keyIndex;
+    if (keyIndex == nil) {
+        return;
+    }
 
-            uint32_t oldCRC = header.crc;
-            header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+    [keyIndex beginPopulating];
+    [self alterHeadersOfAllRecordsWithBlock:^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+        [keyIndex addPopulatedMetadataWithHeader:header forKey:key];
+    } writeBack:NO];
+    [keyIndex finishPopulating];
+}
 
-            // If nothing has changed we do nothing then
-            if (oldCRC == header.crc) {
-                return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
-                                                                    error:nil
-                                                                   record:nil];
-            }
+- (void)populateBlobStore
+{
+    SPTPersistentCacheBlobStore * const blobStore = self.blobStore;
+    if (blobStore == nil) {
+        return;
+    }
 
-            // Set file pointer to the beginning of the file
-            off_t seekOffset = [self.posixWrapper lseek:filedes seekType:SEEK_SET seekAmount:0];
-            if (seekOffset != 0) {
-                const int errorNumber = errno;
-                NSString *errorDescription = @(strerror(errorNumber));
-                [self debugOutput:@"PersistentDataCache: Error seeking to begin of file path:%@ , error:%@", filePath, errorDescription];
-                NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                                     code:errorNumber
-                                                 userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
-                return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
-                                                                    error:error
-                                                                   record:nil];
+    [blobStore beginPopulating];
+    [self alterHeadersOfAllRecordsWithBlock:^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+        if ((header->flags & SPTPersistentCacheRecordHeaderFlagsDeduplicated) == 0) {
+            return;
+        }
+        NSData *digest = [self readDigestOfRecordForKey:key];
+        if (digest != nil) {
+            [blobStore addPopulatedDigest:digest forKey:key];
+        }
+    } writeBack:NO];
+    [blobStore finishPopulating];
+}
 
-            } else {
-                ssize_t writtenBytes = [self.posixWrapper write:filedes
-                                                         buffer:&header
-                                                     bufferSize:SPTPersistentCacheRecordHeaderSize];
-                if (writtenBytes != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
-                    const int errorNumber = errno;
-                    NSString *errorDescription = @(strerror(errorNumber));
-                    [self debugOutput:@"PersistentDataCache: Error writting header at file path:%@ , error:%@", filePath, errorDescription];
-                    NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                                         code:errorNumber
-                                                     userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
-                    return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
-                                                                        error:error
-                                                                       record:nil];
+/**
+ Reads the digest following the header of a deduplicated record.
+ */
+- (nullable NSData *)readDigestOfRecordForKey:(NSString *)key
+{
+    char filePath[PATH_MAX];
+    if (![self getFileSystemPath:filePath maxLength:sizeof(filePath) forKey:key]) {
+        return nil;
+    }
 
-                } else {
-                    int result = [self.posixWrapper fsync:filedes];
-                    if (result == -1) {
-                        const int errorNumber = errno;
-                        NSString *errorDescription = @(strerror(errorNumber));
-                        [self debugOutput:@"PersistentDataCache: Error flushing file:%@ , error:%@", filePath, errorDescription];
-                        NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain
-                                                             code:errorNumber
-                                                         userInfo:@{ NSLocalizedDescriptionKey: errorDescription }];
-                        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationError
-                                                                            error:error
-                                                                           record:nil];
-                    }
-                }
-            }
-        }
+    const int filedes = open(filePath, O_RDONLY);
+    if (filedes == -1) {
+        return nil;
+    }
 
-        return [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
-                                                            error:nil
-                                                           record:nil];
-    } complain:needComplains writeBack:needWriteBack];
+    uint8_t digest[SPTPersistentCacheBlobStoreDigestLength];
+    const ssize_t readBytes = pread(filedes, digest, sizeof(digest), (off_t)SPTPersistentCacheRecordHeaderSize);
+    [self.posixWrapper close:filedes];
+    if (readBytes != (ssize_t)sizeof(digest)) {
+        [self debugOutput:@"PersistentDataCache: Error reading digest of deduplicated key:%@", key];
+        return nil;
+    }
+    return [NSData dataWithBytes:digest length:sizeof(digest)];
 }
 
 /**
- Only this method check data expiration. Past check is also supported.
+ Opens the blob holding the payload of a deduplicated record, reading its digest from the record after the header.
+ A missing blob is reported as an `ENOENT` error, the record is then as good as gone.
+ @return The descriptor of the blob or -1 if it couldn’t be opened.
  */
-- (BOOL)isDataExpiredWithHeader:(SPTPersistentCacheRecordHeader *)header
+- (int)openBlobOfRecordWithDescriptor:(int)filedes
+                           recordSize:(off_t)recordSize
+                               header:(const SPTPersistentCacheRecordHeader *)header
+                                error:(NSError **)error
 {
-    assert(header != nil);
-    uint64_t ttl = header->ttl;
-    uint64_t current = spt_uint64rint(self.currentDateTimeInterval);
-    int64_t threshold = (int64_t)((ttl > 0) ? ttl : self.options.defaultExpirationPeriod);
+    uint8_t digest[SPTPersistentCacheBlobStoreDigestLength];
+    if (recordSize != (off_t)(SPTPersistentCacheRecordHeaderSize + sizeof(digest)) ||
+        [self.posixWrapper read:filedes buffer:digest bufferSize:sizeof(digest)] != (ssize_t)sizeof(digest)) {
+        *error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize];
+        return -1;
+    }
 
-    if (ttl > SPTPersistentCacheTTLUpperBoundInSec) {
-        [self debugOutput:@"PersistentDataCache: WARNING: TTL seems too big: %llu > %llu sec", ttl, SPTPersistentCacheTTLUpperBoundInSec];
+    // Without a blob store, e.g. with multiple processes, the blobs aren’t kept
+    char blobPath[PATH_MAX];
+    if (self.blobStore == nil || ![self.blobStore getFileSystemPath:blobPath maxLength:sizeof(blobPath) forDigest:digest]) {
+        *error = SPTPersistentCachePosixError(ENOENT);
+        return -1;
     }
 
-    return (int64_t)(current - header->updateTimeSec) > threshold;
+    const int blobDescriptor = open(blobPath, O_RDONLY);
+    if (blobDescriptor == -1) {
+        *error = SPTPersistentCachePosixError(errno);
+        return -1;
+    }
+
+    struct stat blobStat;
+    if (fstat(blobDescriptor, &blobStat) == -1 || (uint64_t)blobStat.st_size != header->payloadSizeBytes) {
+        *error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorWrongPayloadSize];
+        [self.posixWrapper close:blobDescriptor];
+        return -1;
+    }
+    return blobDescriptor;
+}
+
+- (void)schedulePopulatingSharedIndex
+{
+    // Whichever process claims the population fills the index, the others see it claimed and do nothing
+    if (atomic_exchange(&_sharedIndexPopulationScheduled, true)) {
+        return;
+    }
+
+    [self doWork:^{
+        [self populateSharedIndex];
+        atomic_store(&self->_sharedIndexPopulationScheduled, false);
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:self.options.garbageCollectionPriority qos:self.options.garbageCollectionQualityOfService];
+}
+
+- (void)populateSharedIndex
+{
+    SPTPersistentCacheSharedIndex * const sharedIndex = self.sharedIndex;
+    // Only one of the processes sharing the index fills it
+    if (sharedIndex == nil || ![sharedIndex beginPopulating]) {
+        return;
+    }
+
+    [self alterHeadersOfAllRecordsWithBlock:^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+        [sharedIndex addPopulatedHeader:header forKey:key];
+    } writeBack:NO];
+    [sharedIndex finishPopulating];
 }
 
 /**
- Methos checks whether data can be given to caller with accordance to API.
+ Whether the shared index knows there is no record for key, or unless allowStale, only one that can’t be returned.
  */
-- (BOOL)isDataCanBeReturnedWithHeader:(SPTPersistentCacheRecordHeader *)header
+- (BOOL)isDefiniteMissInSharedIndexForKey:(NSString *)key allowStale:(BOOL)allowStale
 {
-    return !([self isDataExpiredWithHeader:header] && header->refCount == 0);
+    SPTPersistentCacheSharedIndex * const sharedIndex = self.sharedIndex;
+    if (sharedIndex == nil) {
+        return NO;
+    }
+
+    SPTPersistentCacheRecordHeader header;
+    switch ([sharedIndex lookupKey:key header:&header]) {
+        case SPTPersistentCacheSharedIndexLookupResultAbsent:
+            return YES;
+        case SPTPersistentCacheSharedIndexLookupResultPresent:
+            return !allowStale && ![self isDataCanBeReturnedWithHeader:&header forKey:key];
+        case SPTPersistentCacheSharedIndexLookupResultUnknown:
+            // A process died while changing the index, it answers nothing until populated again
+            if (sharedIndex.needsPopulating && !atomic_load(&_sharedIndexPopulationScheduled)) {
+                [self debugOutput:@"PersistentDataCache: Shared index was left unpopulated, populating it again"];
+                [self schedulePopulatingSharedIndex];
+            }
+            return NO;
+    }
 }
 
 - (void)runRegularGC
 {
     [self collectGarbageForceExpire:NO forceLocked:NO];
+    [self.accessHistory save];
+}
+
+- (BOOL)prefetchRecordsForKeys:(NSArray<NSString *> *)keys prefetchedCount:(NSUInteger *)prefetchedCount
+{
+    for (NSString *key in keys) {
+        if (self.scheduler.hasForegroundWork) {
+            [self debugOutput:@"PersistentDataCache: Warm-up stopped for foreground work after %@ records", @(*prefetchedCount)];
+            return NO;
+        }
+
+        char filePath[PATH_MAX];
+        if (![self getFileSystemPath:filePath maxLength:sizeof(filePath) forKey:key]) {
+            continue;
+        }
+        // Records removed since they were accessed are skipped
+        const int filedes = open(filePath, O_RDONLY);
+        if (filedes == -1) {
+            continue;
+        }
+        // Large records, told by their size on disk, are read around the page cache and would only evict others
+        struct stat fileStat;
+        if (fstat(filedes, &fileStat) == 0 &&
+            ![self isLargePayloadOfSize:(uint64_t)fileStat.st_size] &&
+            [self.posixWrapper adviseWillNeed:filedes offset:0 length:fileStat.st_size] == 0) {
+            *prefetchedCount += 1;
+            // The payload of a deduplicated record is in its blob
+            if (self.blobStore != nil && fileStat.st_size == (off_t)(SPTPersistentCacheRecordHeaderSize + SPTPersistentCacheBlobStoreDigestLength)) {
+                [self prefetchBlobOfRecordWithDescriptor:filedes recordSize:fileStat.st_size];
+            }
+        }
+        [self.posixWrapper close:filedes];
+    }
+    return YES;
+}
+
+- (void)prefetchBlobOfRecordWithDescriptor:(int)filedes recordSize:(off_t)recordSize
+{
+    SPTPersistentCacheRecordHeader header;
+    if ([self.posixWrapper read:filedes buffer:&header bufferSize:SPTPersistentCacheRecordHeaderSize] != (ssize_t)SPTPersistentCacheRecordHeaderSize ||
+        SPTPersistentCacheCheckValidHeader(&header) != nil ||
+        (header.flags & SPTPersistentCacheRecordHeaderFlagsDeduplicated) == 0) {
+        return;
+    }
+
+    NSError *error = nil;
+    const int blobDescriptor = [self openBlobOfRecordWithDescriptor:filedes recordSize:recordSize header:&header error:&error];
+    if (blobDescriptor != -1) {
+        [self.posixWrapper adviseWillNeed:blobDescriptor offset:0 length:(off_t)header.payloadSizeBytes];
+        [self.posixWrapper close:blobDescriptor];
+    }
 }
 
 - (void)collectGarbageForceExpire:(BOOL)forceExpire forceLocked:(BOOL)forceLocked
@@ -850,49 +3367,82 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
                                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
                                                                 errorHandler:nil];
 
-    // Enumerate the dirEnumerator results, each value is stored in allURLs
+    // The headers of a batch of files are read at once, each batch is one slice
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:SPTPersistentCacheHeaderReadBatchSize];
     NSURL *theURL = nil;
     while ((theURL = [dirEnumerator nextObject])) {
-
         // Retrieve the file name. From cached during the enumeration.
         NSNumber *isDirectory;
         if ([theURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]) {
             if ([isDirectory boolValue] == NO) {
-
-                NSString *key = theURL.lastPathComponent;
-                // That satisfies Req.#1.3
-                NSString *filePath = [self.dataCacheFileManager pathForKey:key];
-                BOOL __block needRemove = NO;
-                int __block reason = 0;
-                // WARNING: We may skip return result here bcuz in that case we won't remove file we do not know what is it
-                [self alterHeaderForFileAtPath:filePath withBlock:^(SPTPersistentCacheRecordHeader *header) {
-                    if (forceExpire && forceLocked) {
-                        // delete all
-                        needRemove = YES;
-                        reason = 1;
-                    } else if (forceExpire && !forceLocked) {
-                        // delete those: header->refCount == 0
-                        needRemove = header->refCount == 0;
-                        reason = 2;
-                    } else if (!forceExpire && forceLocked) {
-                        // delete those: header->refCount > 0
-                        needRemove = header->refCount > 0;
-                        reason = 3;
-                    } else {
-                        // delete those: [self isDataExpiredWithHeader:header] && header->refCount == 0
-                        needRemove = ![self isDataCanBeReturnedWithHeader:header];
-                        reason = 4;
-                    }
-                } writeBack:NO complain:YES];
-                if (needRemove) {
-                    [self debugOutput:@"PersistentDataCache: gc removing record: %@, reason:%d", filePath.lastPathComponent, reason];
-                    [self.dataCacheFileManager removeDataForKey:key];
+                [keys addObject:theURL.lastPathComponent];
+                if (keys.count == SPTPersistentCacheHeaderReadBatchSize) {
+                    [self collectGarbageForKeys:keys forceExpire:forceExpire forceLocked:forceLocked];
+                    [keys removeAllObjects];
                 }
             } // is dir
         } else {
             [self debugOutput:@"Unable to fetch isDir#4 attribute:%@", theURL];
         }
     } // for
+
+    if (keys.count > 0) {
+        [self collectGarbageForKeys:keys forceExpire:forceExpire forceLocked:forceLocked];
+    }
+}
+
+- (void)collectGarbageForKeys:(NSArray<NSString *> *)keys forceExpire:(BOOL)forceExpire forceLocked:(BOOL)forceLocked
+{
+    // Waiting reads and writes go first
+    [self.scheduler yieldToForegroundWork];
+
+    // That satisfies Req.#1.3
+    NSMutableArray<NSString *> *keysToRemove = [NSMutableArray array];
+    NSMutableArray<NSNumber *> *reasons = [NSMutableArray array];
+    // WARNING: Records whose header can't be read are skipped, we won't remove a file we do not know what it is
+    [self readHeadersOfRecordsForKeys:keys withBlock:^(NSString *key, SPTPersistentCacheRecordHeader *header) {
+        BOOL needRemove = NO;
+        int reason = 0;
+        if (forceExpire && forceLocked) {
+            // delete all
+            needRemove = YES;
+            reason = 1;
+        } else if (forceExpire && !forceLocked) {
+            // delete those: header->refCount == 0
+            needRemove = header->refCount == 0;
+            reason = 2;
+        } else if (!forceExpire && forceLocked) {
+            // delete those: header->refCount > 0
+            needRemove = header->refCount > 0;
+            reason = 3;
+        } else {
+            // delete those: [self isDataExpiredWithHeader:header forKey:key] && header->refCount == 0
+            needRemove = ![self isDataCanBeReturnedWithHeader:header forKey:key];
+            reason = 4;
+        }
+        if (needRemove) {
+            [keysToRemove addObject:key];
+            [reasons addObject:@(reason)];
+        }
+    }];
+
+    NSMutableArray<NSString *> * const removedKeys = [NSMutableArray arrayWithCapacity:keysToRemove.count];
+    for (NSUInteger i = 0; i < keysToRemove.count; ++i) {
+        NSString *key = keysToRemove[i];
+        NSString *filePath = [self.dataCacheFileManager pathForKey:key];
+        [self debugOutput:@"PersistentDataCache: gc removing record: %@, reason:%d", key, reasons[i].intValue];
+        // Expired records count towards the churn the garbage collection interval adapts to
+        const BOOL expired = (!forceExpire && !forceLocked);
+        const NSUInteger fileSize = (expired ? [self.dataCacheFileManager getFileSizeAtPath:filePath] : 0);
+        if ([self removeRecordForKeySync:key]) {
+            [removedKeys addObject:key];
+            if (expired) {
+                [self.garbageCollector recordExpiredBytes:fileSize];
+            }
+        }
+    }
+    // The lock journal is committed once for the whole slice
+    [self commitRemovalOfKeys:removedKeys];
 }
 
 - (void)dispatchEmptyResponseWithResult:(SPTPersistentCacheResponseCode)result
@@ -944,40 +3494,112 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 
 - (BOOL)pruneBySize
 {
-    if (self.options.sizeConstraintBytes == 0) {
+    SPTPersistentCachePartitionTable * const partitionTable = self.partitionTable;
+    if (self.options.sizeConstraintBytes == 0 && !partitionTable.hasSizeConstrainedPartitions) {
         return NO;
     }
 
-    // Find all the image names and attributes and sort oldest last
-    NSMutableArray<SPTPersistentCacheFileInfo *> *files = [self storedFileNamesAndAttributes];
+    NSArray<SPTPersistentCachePartition *> * const partitions = partitionTable.partitions;
+    const NSUInteger partitionCount = partitions.count;
 
-    // Find the free space on the disk
-    SPTPersistentCacheDiskSize currentCacheSize = (SPTPersistentCacheDiskSize)[self lockedItemsSizeInBytes];
-    for (SPTPersistentCacheFileInfo *file in files) {
-        currentCacheSize += file.fileSize;
+    // Locked records count towards the size of their partition but are never evicted
+    NSArray<NSNumber *> * const lockedSizes = [self lockedItemsSizesInBytesByPartition];
+    SPTPersistentCacheDiskSize *partitionSizes = calloc(partitionCount, sizeof(SPTPersistentCacheDiskSize));
+    NSMutableArray<NSMutableArray<SPTPersistentCacheFileInfo *> *> *partitionFiles = [NSMutableArray arrayWithCapacity:partitionCount];
+    for (NSUInteger index = 0; index < partitionCount; ++index) {
+        partitionSizes[index] = (SPTPersistentCacheDiskSize)lockedSizes[index].unsignedIntegerValue;
+        [partitionFiles addObject:[NSMutableArray array]];
     }
 
-    SPTPersistentCacheDiskSize optimalCacheSize = [self.dataCacheFileManager optimizedDiskSizeForCacheSize:currentCacheSize];
+    // Find all the image names and attributes and sort least worth keeping last, which each partition keeps
+    for (SPTPersistentCacheFileInfo *file in [self storedFileNamesAndAttributes]) {
+        const NSUInteger index = [partitionTable indexOfPartitionForKey:file.fileName.lastPathComponent];
+        [partitionFiles[index] addObject:file];
+        partitionSizes[index] += file.fileSize;
+    }
 
-    // Remove oldest data until we reach acceptable cache size
-    while (currentCacheSize > optimalCacheSize && files.count) {
-        SPTPersistentCacheFileInfo *file = files.lastObject;
-        [files removeLastObject];
+    // Prune each partition to its own size constraint first
+    NSMutableArray<NSString *> * const evictedKeys = [NSMutableArray arrayWithCapacity:SPTPersistentCacheEvictionBatchSize];
+    for (NSUInteger index = 0; index < partitionCount; ++index) {
+        const SPTPersistentCacheDiskSize partitionSizeConstraint = (SPTPersistentCacheDiskSize)partitions[index].sizeConstraintBytes;
+        while (partitionSizeConstraint > 0 && partitionSizes[index] > partitionSizeConstraint && partitionFiles[index].count) {
+            partitionSizes[index] -= [self evictLeastValuableFile:partitionFiles[index] evictedKeys:evictedKeys];
+        }
+    }
 
-        NSString *fileName = file.fileName;
-        NSError *localError = nil;
-        if (fileName.length > 0 && ![self.fileManager removeItemAtPath:fileName error:&localError]) {
-            [self debugOutput:@"PersistentDataCache: %@ ERROR %@", @(__PRETTY_FUNCTION__), [localError localizedDescription]];
-            continue;
-        } else {
-            [self debugOutput:@"PersistentDataCache: evicting by size key:%@", fileName.lastPathComponent];
+    if (self.options.sizeConstraintBytes > 0) {
+        SPTPersistentCacheDiskSize currentCacheSize = 0;
+        for (NSUInteger index = 0; index < partitionCount; ++index) {
+            currentCacheSize += partitionSizes[index];
         }
 
-        currentCacheSize -= file.fileSize;
+        // Find the free space on the disk
+        SPTPersistentCacheDiskSize optimalCacheSize = [self.dataCacheFileManager optimizedDiskSizeForCacheSize:currentCacheSize];
+
+        // Remove the least valuable data of the partition using the most space for its weight until the cache fits
+        while (currentCacheSize > optimalCacheSize) {
+            NSUInteger victimIndex = NSNotFound;
+            double victimUsage = -1.0;
+            for (NSUInteger index = 0; index < partitionCount; ++index) {
+                if (partitionFiles[index].count == 0) {
+                    continue;
+                }
+                const double weight = partitions[index].evictionWeight;
+                const double usage = (weight > 0.0 ? partitionSizes[index] / weight : INFINITY);
+                if (usage > victimUsage) {
+                    victimIndex = index;
+                    victimUsage = usage;
+                }
+            }
+            if (victimIndex == NSNotFound) {
+                break;
+            }
+
+            const SPTPersistentCacheDiskSize evictedSize = [self evictLeastValuableFile:partitionFiles[victimIndex] evictedKeys:evictedKeys];
+            partitionSizes[victimIndex] -= evictedSize;
+            currentCacheSize -= evictedSize;
+        }
     }
+
+    [self commitRemovalOfKeys:evictedKeys];
+    free(partitionSizes);
     return YES;
 }
 
+/**
+ Removes the last, i.e. least worth keeping, of files unless it is pinned or has been locked since it was listed. The
+ removed key is added to evictedKeys, which is committed with `commitRemovalOfKeys:` once per batch of evictions.
+ @return The size of the removed file or `0` if it wasn’t removed.
+ */
+- (SPTPersistentCacheDiskSize)evictLeastValuableFile:(NSMutableArray<SPTPersistentCacheFileInfo *> *)files
+                                         evictedKeys:(NSMutableArray<NSString *> *)evictedKeys
+{
+    // Foreground work goes first between batches of evictions
+    if (evictedKeys.count == SPTPersistentCacheEvictionBatchSize) {
+        [self commitRemovalOfKeys:evictedKeys];
+        [evictedKeys removeAllObjects];
+        [self.scheduler yieldToForegroundWork];
+    }
+
+    SPTPersistentCacheFileInfo *file = files.lastObject;
+    [files removeLastObject];
+
+    NSString *key = file.fileName.lastPathComponent;
+    // Open file handles pin their records, an eviction isn’t deferred until they are closed
+    @synchronized (self.pinnedKeys) {
+        if ([self.pinnedKeys countForObject:key] > 0) {
+            return 0;
+        }
+    }
+    if ([self.lockJournal refCountForKey:key] > 0 || ![self removeRecordForKeySync:key]) {
+        return 0;
+    }
+
+    [self debugOutput:@"PersistentDataCache: evicting by size key:%@", key];
+    [evictedKeys addObject:key];
+    return (SPTPersistentCacheDiskSize)file.fileSize;
+}
+
 - (NSMutableArray<SPTPersistentCacheFileInfo *> *)storedFileNamesAndAttributes
 {
     NSURL *urlPath = [NSURL fileURLWithPath:self.options.cachePath];
@@ -1007,11 +3629,15 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 
                 // We skip locked files always
                 BOOL __block locked = NO;
+                uint32_t __block priority = SPTPersistentCacheRecordPriorityNormal;
+                uint64_t __block refetchCost = 0;
                 
                 // WARNING: We may skip return result here bcuz in that case we will remove unknown file as unlocked trash
                 [self alterHeaderForFileAtPath:filePathString
                                      withBlock:^(SPTPersistentCacheRecordHeader *header) {
-                                         locked = (header->refCount > 0);
+                                         locked = ([self applyLockJournalToHeader:header forKey:theURL.lastPathComponent]->refCount > 0);
+                                         priority = header->priority;
+                                         refetchCost = header->refetchCost;
                                      } writeBack:NO
                                       complain:YES];
 
@@ -1034,10 +3660,15 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
                  Files with TTL have updateTime set once on creation.
                  */
 
-                NSDate *mdate = [NSDate dateWithTimeIntervalSince1970:(fileStat.st_mtimespec.tv_sec + fileStat.st_mtimespec.tv_nsec*1e9)];
+                NSDate *mdate = [NSDate dateWithTimeIntervalSince1970:(fileStat.st_mtimespec.tv_sec + fileStat.st_mtimespec.tv_nsec*1e-9)];
+                // Deduplicated records account for their share of the blob, evicting all of them frees it
+                const off_t blobShare = (off_t)[self.blobStore sizeShareForKey:theURL.lastPathComponent];
+                const off_t fileSize = fileStat.st_size + blobShare;
+                const double valuePerByte = SPTPersistentCacheEvictionValuePerByte(priority, refetchCost, fileSize);
                 SPTPersistentCacheFileInfo *info = [[SPTPersistentCacheFileInfo alloc] initWithFileName:filePathString
                                                                                                   mdate:mdate
-                                                                                               fileSize:fileStat.st_size];
+                                                                                               fileSize:fileSize
+                                                                                           valuePerByte:valuePerByte];
                 [files addObject:info];
             }
         } else {
@@ -1045,12 +3676,19 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
         }
     }
 
-    // Oldest goes last
-    NSComparisonResult(^SPTSortFilesByModificationDate)(id, id) = ^NSComparisonResult(SPTPersistentCacheFileInfo *file1, SPTPersistentCacheFileInfo *file2) {
+    // Least worth keeping goes last. Like GreedyDual-Size the value per byte ages, here by dividing it by the time since
+    // the record was last used, so records of equal value go oldest last.
+    const NSTimeInterval now = self.currentDateTimeInterval;
+    NSComparisonResult(^SPTSortFilesByAgedValue)(id, id) = ^NSComparisonResult(SPTPersistentCacheFileInfo *file1, SPTPersistentCacheFileInfo *file2) {
+        const double agedValue1 = file1.valuePerByte / (1.0 + MAX(0.0, now - file1.mdate.timeIntervalSince1970));
+        const double agedValue2 = file2.valuePerByte / (1.0 + MAX(0.0, now - file2.mdate.timeIntervalSince1970));
+        if (agedValue1 != agedValue2) {
+            return (agedValue1 > agedValue2 ? NSOrderedAscending : NSOrderedDescending);
+        }
         return [file2.mdate compare:file1.mdate];
     };
 
-    [files sortUsingComparator:SPTSortFilesByModificationDate];
+    [files sortUsingComparator:SPTSortFilesByAgedValue];
 
     return files;
 }
@@ -1060,12 +3698,52 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
     return [[NSDate date] timeIntervalSince1970];
 }
 
-- (void)doWork:(void (^)(void))block priority:(NSOperationQueuePriority)priority qos:(NSQualityOfService)qos
+- (void)doWork:(void (^)(void))block
+          lane:(SPTPersistentCacheSchedulerLane)lane
+      priority:(NSOperationQueuePriority)priority
+           qos:(NSQualityOfService)qos
+{
+    [self doWork:block lane:lane priority:priority qos:qos cancellationToken:nil];
+}
+
+- (void)doWork:(void (^)(void))block
+          lane:(SPTPersistentCacheSchedulerLane)lane
+      priority:(NSOperationQueuePriority)priority
+           qos:(NSQualityOfService)qos
+cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
 {
-    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:block];
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:[self.scheduler blockMeasuringLatencyOfBlock:block lane:lane]];
     operation.qualityOfService = qos;
     operation.queuePriority = priority;
-    [self.workQueue addOperation:operation];
+    // A cancelled operation is dropped by the queue without running its block
+    [cancellationToken addOperation:operation];
+    [self.scheduler addOperation:operation lane:lane];
+}
+
+- (void)recordTraceOperation:(SPTPersistentCacheTraceOperation)operation keys:(NSArray<NSString *> *)keys
+{
+    SPTPersistentCacheTraceRecorder * const traceRecorder = self.traceRecorder;
+    if (traceRecorder == nil) {
+        return;
+    }
+
+    // Recorded as one call, so it is replayed as one
+    [traceRecorder writeRecord:[traceRecorder recordOfOperation:operation key:nil] keys:keys];
+}
+
+- (void)recordTraceOfTags:(NSSet<NSString *> *)tags forKey:(NSString *)key
+{
+    SPTPersistentCacheTraceRecorder * const traceRecorder = self.traceRecorder;
+    if (traceRecorder == nil) {
+        return;
+    }
+
+    const uint64_t recordKeyHash = SPTPersistentCacheTraceKeyHash(key);
+    for (NSString *tag in tags) {
+        SPTPersistentCacheTraceRecord record = [traceRecorder recordOfOperation:SPTPersistentCacheTraceOperationTag key:tag];
+        record.recordKeyHash = recordKeyHash;
+        [traceRecorder writeRecord:record keys:nil];
+    }
 }
 
 - (void)logTimingForKey:(NSString *)key method:(SPTPersistentCacheDebugMethodType)method type:(SPTPersistentCacheDebugTimingType)type
@@ -1079,15 +3757,42 @@ void SPTPersistentCacheSafeDispatch(_Nullable dispatch_queue_t queue, _Nonnull d
 
 @end
 
+@implementation SPTPersistentCacheMetadataCursor
+
+- (instancetype)initWithPrefix:(NSString *)prefix
+                     predicate:(SPTPersistentCacheMetadataPredicate)predicate
+                     batchSize:(NSUInteger)batchSize
+             cancellationToken:(SPTPersistentCacheCancellationToken *)cancellationToken
+                      callback:(SPTPersistentCacheMetadataBatchCallback)callback
+                         queue:(dispatch_queue_t)queue
+{
+    self = [super init];
+    if (self) {
+        _prefix = [prefix copy];
+        _predicate = [predicate copy];
+        _batchSize = batchSize;
+        _cancellationToken = cancellationToken;
+        _callback = [callback copy];
+        _queue = queue;
+    }
+    return self;
+}
+
+@end
+
 @implementation SPTPersistentCacheFileInfo
 
-- (instancetype)initWithFileName:(NSString *)fileName mdate:(NSDate *)mdate fileSize:(off_t)fileSize
+- (instancetype)initWithFileName:(NSString *)fileName
+                           mdate:(NSDate *)mdate
+                        fileSize:(off_t)fileSize
+                    valuePerByte:(double)valuePerByte
 {
     self = [super init];
     if (self) {
         _fileName = fileName;
         _mdate = mdate;
         _fileSize = fileSize;
+        _valuePerByte = valuePerByte;
     }
     return self;
 }
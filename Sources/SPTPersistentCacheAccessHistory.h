@@ -0,0 +1,59 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The factor the access counts are multiplied with when they age, on start and whenever the history is trimmed.
+ */
+extern const double SPTPersistentCacheAccessHistoryDecay;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A bounded history of the keys accessed most often and most recently, kept across runs.
+ @discussion Each access adds one to the count of its key. Once the history holds twice its capacity, all counts age
+ by `SPTPersistentCacheAccessHistoryDecay` and only the keys with the highest counts are kept, so keys that stop being
+ accessed make way for new ones. Counts read back from an earlier run are aged the same way. This class is threadsafe.
+ */
+@interface SPTPersistentCacheAccessHistory : NSObject
+
+/// The number of keys the history keeps.
+@property (nonatomic, assign, readonly) NSUInteger capacity;
+/// The number of keys currently in the history, up to twice the capacity until it is trimmed.
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a history and reads back the one written to a path by an earlier run, if any.
+
+ @param path The path of the history file.
+ @param capacity The number of keys to keep, at least `1`.
+ @param debugOutput Callback used to report errors.
+ */
+- (instancetype)initWithPath:(NSString *)path
+                    capacity:(NSUInteger)capacity
+                 debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Counts an access to key.
+ */
+- (void)recordAccessToKey:(NSString *)key;
+
+/**
+ Returns up to `capacity` keys, the one with the highest count first.
+ */
+- (NSArray<NSString *> *)hottestKeys;
+
+/**
+ Writes the history to its path unless nothing changed since it was last written or read.
+ @return YES if the file is up to date.
+ */
+- (BOOL)save;
+
+@end
+
+NS_ASSUME_NONNULL_END
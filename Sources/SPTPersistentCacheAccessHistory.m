@@ -0,0 +1,161 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheAccessHistory.h"
+#import "SPTPersistentCacheDebugUtilities.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+const double SPTPersistentCacheAccessHistoryDecay = 0.5;
+
+@interface SPTPersistentCacheAccessHistory ()
+@property (nonatomic, copy, readonly) NSString *path;
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
+@end
+
+@implementation SPTPersistentCacheAccessHistory
+{
+    // The following are guarded by synchronizing on self
+    NSMutableDictionary<NSString *, NSNumber *> *_counts;
+    BOOL _changed;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+                    capacity:(NSUInteger)capacity
+                 debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _capacity = MAX(capacity, 1u);
+        _debugOutput = [debugOutput copy];
+        _counts = [NSMutableDictionary dictionary];
+        [self read];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    @synchronized (self) {
+        return _counts.count;
+    }
+}
+
+#pragma mark Recording Accesses
+
+- (void)recordAccessToKey:(NSString *)key
+{
+    @synchronized (self) {
+        _counts[key] = @(_counts[key].doubleValue + 1.0);
+        _changed = YES;
+
+        // Trimming sorts all keys, so it is spread over as many accesses as the history keeps
+        if (_counts.count >= self.capacity * 2) {
+            [self trimAging:YES];
+        }
+    }
+}
+
+- (NSArray<NSString *> *)hottestKeys
+{
+    @synchronized (self) {
+        return [self keysByCount];
+    }
+}
+
+/// Called with self synchronized
+- (NSArray<NSString *> *)keysByCount
+{
+    NSArray<NSString *> * const keys = [_counts keysSortedByValueUsingComparator:^NSComparisonResult(NSNumber *count, NSNumber *otherCount) {
+        return [otherCount compare:count];
+    }];
+    return (keys.count > self.capacity ? [keys subarrayWithRange:NSMakeRange(0, self.capacity)] : keys);
+}
+
+/// Called with self synchronized
+- (void)trimAging:(BOOL)aging
+{
+    NSArray<NSString *> * const keptKeys = [self keysByCount];
+    NSMutableDictionary<NSString *, NSNumber *> * const counts = [NSMutableDictionary dictionaryWithCapacity:self.capacity * 2];
+    for (NSString *key in keptKeys) {
+        const double count = _counts[key].doubleValue;
+        counts[key] = @(aging ? count * SPTPersistentCacheAccessHistoryDecay : count);
+    }
+    _counts = counts;
+}
+
+#pragma mark Persisting
+
+- (void)read
+{
+    NSData * const data = [NSData dataWithContentsOfFile:self.path];
+    if (data == nil) {
+        return;
+    }
+
+    NSError *error = nil;
+    id const counts = [NSPropertyListSerialization propertyListWithData:data
+                                                                options:NSPropertyListImmutable
+                                                                 format:NULL
+                                                                  error:&error];
+    if (![counts isKindOfClass:[NSDictionary class]]) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to read access history: %@, error: %@", self.path, error],
+                                            self.debugOutput);
+        return;
+    }
+
+    @synchronized (self) {
+        [(NSDictionary *)counts enumerateKeysAndObjectsUsingBlock:^(id key, id count, BOOL *stop) {
+            if ([key isKindOfClass:[NSString class]] && [count isKindOfClass:[NSNumber class]]) {
+                self->_counts[key] = count;
+            }
+        }];
+        // Accesses of earlier runs weigh less than the ones of this run
+        [self trimAging:YES];
+    }
+}
+
+- (BOOL)save
+{
+    NSDictionary<NSString *, NSNumber *> *counts = nil;
+    @synchronized (self) {
+        if (!_changed) {
+            return YES;
+        }
+        [self trimAging:NO];
+        counts = [_counts copy];
+        _changed = NO;
+    }
+
+    NSError *error = nil;
+    NSData * const data = [NSPropertyListSerialization dataWithPropertyList:counts
+                                                                     format:NSPropertyListBinaryFormat_v1_0
+                                                                    options:0
+                                                                      error:&error];
+    if (data == nil || ![data writeToFile:self.path options:NSDataWritingAtomic error:&error]) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to write access history: %@, error: %@", self.path, error],
+                                            self.debugOutput);
+        @synchronized (self) {
+            _changed = YES;
+        }
+        return NO;
+    }
+    return YES;
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.count), @"count");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.count), @"count",
+                                               @(self.capacity), @"capacity",
+                                               self.path, @"path");
+}
+
+@end
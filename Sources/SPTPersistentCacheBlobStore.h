@@ -0,0 +1,108 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The length in bytes of the content digest a deduplicated record holds instead of its payload.
+ */
+#define SPTPersistentCacheBlobStoreDigestLength 32
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The payloads of deduplicated records, stored once per content digest in a directory of the cache path.
+ @discussion A deduplicated record holds the SHA-256 digest of its payload instead of the payload. The store keeps the
+ digest of every such record in memory and counts the records referencing each blob, so a blob is removed together
+ with the last record referencing it. The references are populated from the records on start. Until then no blob is
+ removed, and blobs left without references, e.g. by a crash between writing a blob and its record, are removed once
+ populating finished. This class is threadsafe.
+ */
+@interface SPTPersistentCacheBlobStore : NSObject
+
+/// The directory the blobs are stored in.
+@property (nonatomic, copy, readonly) NSString *path;
+/// Whether the references of all records on disk have been populated.
+@property (nonatomic, assign, readonly, getter=isReady) BOOL ready;
+/// The size of all blobs on disk, found by listing the directory.
+@property (nonatomic, assign, readonly) NSUInteger usedSizeInBytes;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a store of blobs in a directory, which is created when the first blob is stored.
+
+ @param path The directory the blobs are stored in.
+ @param fileManager The file manager used to list the directory.
+ @param debugOutput Callback used to report errors.
+ */
+- (instancetype)initWithPath:(NSString *)path
+                 fileManager:(NSFileManager *)fileManager
+                 debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Writes the file system representation of the path of the blob with a digest into a buffer.
+
+ @param buffer The buffer the NUL terminated path is written to.
+ @param maxLength The size of the buffer in bytes.
+ @param digest The `SPTPersistentCacheBlobStoreDigestLength` bytes of the digest.
+ @return YES if the path was written, NO if it doesn’t fit.
+ */
+- (BOOL)getFileSystemPath:(char *)buffer maxLength:(size_t)maxLength forDigest:(const uint8_t *)digest;
+
+/**
+ Returns the path of the blob with a digest, the first two hex digits of it naming the directory the blob is in.
+ */
+- (NSString *)pathForDigest:(NSData *)digest;
+
+/**
+ Stores a payload as a blob unless a blob with the same content exists, and holds a reference to it until the record
+ is committed or abandoned.
+ @return The digest of the payload or nil if the blob couldn’t be written.
+ */
+- (nullable NSData *)storeBlobWithData:(NSData *)data error:(NSError **)error;
+
+/**
+ Makes the reference held since storing a blob the one of the record for key, once the record has been written. The
+ reference of an earlier record for key is released.
+ */
+- (void)commitBlobWithDigest:(NSData *)digest forKey:(NSString *)key;
+
+/**
+ Releases the reference held since storing a blob whose record couldn’t be written.
+ */
+- (void)abandonBlobWithDigest:(NSData *)digest;
+
+/**
+ Releases the reference of the record for key, removing the blob if it was the last one.
+ @return The size of the removed blob, `0` if none was removed.
+ */
+- (NSUInteger)removeKey:(NSString *)key;
+
+/**
+ Returns the share of the record for key in the size of its blob, `0` unless it is deduplicated. The shares of all
+ records referencing a blob add up to its size, less the remainder of dividing it among them.
+ */
+- (NSUInteger)sizeShareForKey:(NSString *)key;
+
+/**
+ Clears the references and marks the store as not ready. Records found on disk are then added with
+ `addPopulatedDigest:forKey:`.
+ */
+- (void)beginPopulating;
+
+/**
+ Adds the reference of a record found on disk unless it has been committed or removed since populating began.
+ */
+- (void)addPopulatedDigest:(NSData *)digest forKey:(NSString *)key;
+
+/**
+ Marks the store as ready once all records on disk have been added and removes the blobs without references.
+ */
+- (void)finishPopulating;
+
+@end
+
+NS_ASSUME_NONNULL_END
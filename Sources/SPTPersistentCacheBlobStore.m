@@ -0,0 +1,359 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheBlobStore.h"
+#import "SPTPersistentCacheDebugUtilities.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+#include <CommonCrypto/CommonDigest.h>
+#include <os/lock.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(SPTPersistentCacheBlobStoreDigestLength == CC_SHA256_DIGEST_LENGTH,
+               "Deduplicated records hold a SHA-256 digest");
+
+// Length of a digest written as lowercase hex, the file name of a blob
+static const size_t SPTPersistentCacheBlobStoreHexLength = 2 * CC_SHA256_DIGEST_LENGTH;
+
+static NSData *SPTPersistentCacheBlobStoreDigestOfData(NSData *data);
+static void SPTPersistentCacheBlobStoreHexFromDigest(const uint8_t *digest, char *hex);
+static NSData *SPTPersistentCacheBlobStoreDigestFromHex(NSString *hex);
+
+@interface SPTPersistentCacheBlobStore ()
+@property (nonatomic, strong, readonly) NSFileManager *fileManager;
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
+@end
+
+@implementation SPTPersistentCacheBlobStore
+{
+    os_unfair_lock _lock;
+    // The following are guarded by _lock
+    NSMutableDictionary<NSString *, NSData *> *_digestsByKey;
+    // Records referencing each blob
+    NSCountedSet<NSData *> *_references;
+    // Blobs stored for records that haven’t been written yet, kept apart so populating doesn’t drop them
+    NSCountedSet<NSData *> *_pending;
+    NSMutableDictionary<NSData *, NSNumber *> *_sizes;
+    // Keys committed or removed while populating, the population mustn’t overwrite them
+    NSMutableSet<NSString *> *_changedWhilePopulating;
+    BOOL _ready;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+                 fileManager:(NSFileManager *)fileManager
+                 debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _fileManager = fileManager;
+        _debugOutput = [debugOutput copy];
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _digestsByKey = [NSMutableDictionary dictionary];
+        _references = [NSCountedSet set];
+        _pending = [NSCountedSet set];
+        _sizes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (BOOL)isReady
+{
+    os_unfair_lock_lock(&_lock);
+    const BOOL ready = _ready;
+    os_unfair_lock_unlock(&_lock);
+    return ready;
+}
+
+- (NSUInteger)usedSizeInBytes
+{
+    NSUInteger size = 0;
+    NSDirectoryEnumerator<NSString *> *enumerator = [self.fileManager enumeratorAtPath:self.path];
+    for (NSString *fileName in enumerator) {
+        @autoreleasepool {
+            NSDictionary<NSFileAttributeKey, id> *attributes = enumerator.fileAttributes;
+            if ([attributes[NSFileType] isEqualToString:NSFileTypeRegular]) {
+                size += (NSUInteger)[attributes fileSize];
+            }
+        }
+    }
+    return size;
+}
+
+#pragma mark Paths
+
+- (BOOL)getFileSystemPath:(char *)buffer maxLength:(size_t)maxLength forDigest:(const uint8_t *)digest
+{
+    char hex[SPTPersistentCacheBlobStoreHexLength + 1];
+    SPTPersistentCacheBlobStoreHexFromDigest(digest, hex);
+    const int length = snprintf(buffer, maxLength, "%s/%.2s/%s", self.path.fileSystemRepresentation, hex, hex);
+    return length > 0 && (size_t)length < maxLength;
+}
+
+- (NSString *)pathForDigest:(NSData *)digest
+{
+    char hex[SPTPersistentCacheBlobStoreHexLength + 1];
+    SPTPersistentCacheBlobStoreHexFromDigest(digest.bytes, hex);
+    NSString *fileName = @(hex);
+    return [[self.path stringByAppendingPathComponent:[fileName substringToIndex:2]] stringByAppendingPathComponent:fileName];
+}
+
+#pragma mark Changes
+
+- (NSData *)storeBlobWithData:(NSData *)data error:(NSError **)error
+{
+    NSData *digest = SPTPersistentCacheBlobStoreDigestOfData(data);
+
+    // Holding the reference before looking for the blob keeps it from being removed in between
+    os_unfair_lock_lock(&_lock);
+    [_pending addObject:digest];
+    os_unfair_lock_unlock(&_lock);
+
+    NSString *path = [self pathForDigest:digest];
+    if ([self.fileManager fileExistsAtPath:path]) {
+        return digest;
+    }
+
+    NSError *writeError = nil;
+    const BOOL written = [self.fileManager createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                     withIntermediateDirectories:YES
+                                                      attributes:nil
+                                                           error:&writeError] &&
+                         [data writeToFile:path options:NSDataWritingAtomic error:&writeError];
+    if (!written) {
+        [self abandonBlobWithDigest:digest];
+        if (error) {
+            *error = writeError;
+        }
+        return nil;
+    }
+
+    os_unfair_lock_lock(&_lock);
+    _sizes[digest] = @(data.length);
+    os_unfair_lock_unlock(&_lock);
+
+    return digest;
+}
+
+- (void)commitBlobWithDigest:(NSData *)digest forKey:(NSString *)key
+{
+    os_unfair_lock_lock(&_lock);
+    [_changedWhilePopulating addObject:key];
+    NSData *previousDigest = _digestsByKey[key];
+    [_references addObject:digest];
+    [_pending removeObject:digest];
+    _digestsByKey[key] = digest;
+    if (previousDigest != nil) {
+        [self releaseReferenceToDigest:previousDigest];
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)abandonBlobWithDigest:(NSData *)digest
+{
+    os_unfair_lock_lock(&_lock);
+    [_pending removeObject:digest];
+    [self removeBlobIfUnreferenced:digest];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (NSUInteger)removeKey:(NSString *)key
+{
+    os_unfair_lock_lock(&_lock);
+    [_changedWhilePopulating addObject:key];
+    NSData *digest = _digestsByKey[key];
+    NSUInteger freedBytes = 0;
+    if (digest != nil) {
+        [_digestsByKey removeObjectForKey:key];
+        freedBytes = [self releaseReferenceToDigest:digest];
+    }
+    os_unfair_lock_unlock(&_lock);
+    return freedBytes;
+}
+
+- (NSUInteger)sizeShareForKey:(NSString *)key
+{
+    os_unfair_lock_lock(&_lock);
+    NSData *digest = _digestsByKey[key];
+    NSUInteger share = 0;
+    if (digest != nil) {
+        share = [self sizeOfBlob:digest] / MAX([_references countForObject:digest], 1u);
+    }
+    os_unfair_lock_unlock(&_lock);
+    return share;
+}
+
+/// Called with _lock held
+- (NSUInteger)releaseReferenceToDigest:(NSData *)digest
+{
+    [_references removeObject:digest];
+    return [self removeBlobIfUnreferenced:digest];
+}
+
+/// Called with _lock held, so a blob found unreferenced can’t be picked up by a store before it is unlinked
+- (NSUInteger)removeBlobIfUnreferenced:(NSData *)digest
+{
+    // Until populating finished, records on disk may still reference the blob
+    if (!_ready || [_references countForObject:digest] > 0 || [_pending countForObject:digest] > 0) {
+        return 0;
+    }
+
+    const NSUInteger size = [self sizeOfBlob:digest];
+    [_sizes removeObjectForKey:digest];
+
+    char path[PATH_MAX];
+    if (![self getFileSystemPath:path maxLength:sizeof(path) forDigest:digest.bytes] || unlink(path) != 0) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to remove blob: %@, error: %@",
+                                             [self pathForDigest:digest], @(strerror(errno))],
+                                            self.debugOutput);
+        return 0;
+    }
+    return size;
+}
+
+/// Called with _lock held
+- (NSUInteger)sizeOfBlob:(NSData *)digest
+{
+    NSNumber *size = _sizes[digest];
+    if (size == nil) {
+        char path[PATH_MAX];
+        struct stat blobStat;
+        if (![self getFileSystemPath:path maxLength:sizeof(path) forDigest:digest.bytes] || stat(path, &blobStat) != 0) {
+            return 0;
+        }
+        size = @(blobStat.st_size);
+        _sizes[digest] = size;
+    }
+    return size.unsignedIntegerValue;
+}
+
+#pragma mark Populating
+
+- (void)beginPopulating
+{
+    os_unfair_lock_lock(&_lock);
+    _ready = NO;
+    [_digestsByKey removeAllObjects];
+    [_references removeAllObjects];
+    _changedWhilePopulating = [NSMutableSet set];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)addPopulatedDigest:(NSData *)digest forKey:(NSString *)key
+{
+    os_unfair_lock_lock(&_lock);
+    // The record may have been read before it was removed or stored again
+    if (![_changedWhilePopulating containsObject:key] && _digestsByKey[key] == nil) {
+        _digestsByKey[key] = [digest copy];
+        [_references addObject:_digestsByKey[key]];
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)finishPopulating
+{
+    os_unfair_lock_lock(&_lock);
+    _ready = YES;
+    _changedWhilePopulating = nil;
+    os_unfair_lock_unlock(&_lock);
+
+    // Blobs stored after listing aren’t candidates, the others are checked again under the lock
+    NSMutableArray<NSData *> *digests = [NSMutableArray array];
+    for (NSString *directoryName in [self.fileManager contentsOfDirectoryAtPath:self.path error:nil]) {
+        NSString *directoryPath = [self.path stringByAppendingPathComponent:directoryName];
+        for (NSString *fileName in [self.fileManager contentsOfDirectoryAtPath:directoryPath error:nil]) {
+            NSData *digest = SPTPersistentCacheBlobStoreDigestFromHex(fileName);
+            if (digest != nil && [fileName hasPrefix:directoryName]) {
+                [digests addObject:digest];
+            }
+        }
+    }
+
+    NSUInteger removedCount = 0;
+    os_unfair_lock_lock(&_lock);
+    for (NSData *digest in digests) {
+        if ([self removeBlobIfUnreferenced:digest] > 0) {
+            ++removedCount;
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    if (removedCount > 0) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Removed %@ unreferenced blobs",
+                                             @(removedCount)],
+                                            self.debugOutput);
+    }
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.path, @"path");
+}
+
+- (NSString *)debugDescription
+{
+    os_unfair_lock_lock(&_lock);
+    const NSUInteger keyCount = _digestsByKey.count;
+    const NSUInteger blobCount = _references.count;
+    os_unfair_lock_unlock(&_lock);
+
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.path, @"path",
+                                               @(self.isReady), @"ready",
+                                               @(keyCount), @"key-count",
+                                               @(blobCount), @"blob-count");
+}
+
+@end
+
+static NSData *SPTPersistentCacheBlobStoreDigestOfData(NSData *data)
+{
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    // CC_LONG is 32 bits wide
+    const uint8_t *bytes = data.bytes;
+    for (NSUInteger offset = 0; offset < data.length;) {
+        const CC_LONG length = (CC_LONG)MIN(data.length - offset, (NSUInteger)UINT32_MAX);
+        CC_SHA256_Update(&context, bytes + offset, length);
+        offset += length;
+    }
+    CC_SHA256_Final(digest, &context);
+    return [NSData dataWithBytes:digest length:sizeof(digest)];
+}
+
+static void SPTPersistentCacheBlobStoreHexFromDigest(const uint8_t *digest, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    hex[SPTPersistentCacheBlobStoreHexLength] = '\0';
+}
+
+static NSData *SPTPersistentCacheBlobStoreDigestFromHex(NSString *hex)
+{
+    const char *characters = hex.UTF8String;
+    if (characters == NULL || strlen(characters) != SPTPersistentCacheBlobStoreHexLength) {
+        return nil;
+    }
+
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    for (size_t i = 0; i < SPTPersistentCacheBlobStoreHexLength; ++i) {
+        const char character = characters[i];
+        uint8_t value;
+        if (character >= '0' && character <= '9') {
+            value = (uint8_t)(character - '0');
+        } else if (character >= 'a' && character <= 'f') {
+            value = (uint8_t)(character - 'a' + 10);
+        } else {
+            return nil;
+        }
+        digest[i / 2] = (uint8_t)((i % 2 == 0) ? value << 4 : digest[i / 2] | value);
+    }
+    return [NSData dataWithBytes:digest length:sizeof(digest)];
+}
@@ -0,0 +1,26 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheCancellationToken.h>
+#import <SPTPersistentCache/SPTPersistentCacheImplementation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SPTPersistentCacheCancellationToken (Private)
+
+/**
+ Tracks an operation so it’s cancelled together with the token. If the token is already cancelled the operation is
+ cancelled right away.
+ */
+- (void)addOperation:(NSOperation *)operation;
+
+@end
+
+/**
+ Wraps a callback so it’s dropped if the token is cancelled by the time the response is delivered.
+ Returns the callback unchanged if there is no token or callback.
+ */
+extern SPTPersistentCacheResponseCallback _Nullable SPTPersistentCacheCancellableCallback(SPTPersistentCacheResponseCallback _Nullable callback,
+                                                                                          SPTPersistentCacheCancellationToken * _Nullable token);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,87 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheCancellationToken.h>
+#import "SPTPersistentCacheCancellationToken+Private.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+@implementation SPTPersistentCacheCancellationToken
+{
+    BOOL _cancelled;
+    // Weak so finished operations are released by the queue as usual
+    NSHashTable<NSOperation *> *_operations;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _operations = [NSHashTable weakObjectsHashTable];
+    }
+    return self;
+}
+
+- (BOOL)isCancelled
+{
+    @synchronized (self) {
+        return _cancelled;
+    }
+}
+
+- (void)cancel
+{
+    NSArray<NSOperation *> *operations = nil;
+    @synchronized (self) {
+        if (_cancelled) {
+            return;
+        }
+        _cancelled = YES;
+        operations = _operations.allObjects;
+        [_operations removeAllObjects];
+    }
+
+    // Cancel outside of the lock, the queue may call back into KVO observers
+    for (NSOperation *operation in operations) {
+        [operation cancel];
+    }
+}
+
+- (void)addOperation:(NSOperation *)operation
+{
+    @synchronized (self) {
+        if (!_cancelled) {
+            [_operations addObject:operation];
+            return;
+        }
+    }
+    [operation cancel];
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.isCancelled), @"cancelled");
+}
+
+- (NSString *)debugDescription
+{
+    return [self description];
+}
+
+@end
+
+SPTPersistentCacheResponseCallback SPTPersistentCacheCancellableCallback(SPTPersistentCacheResponseCallback callback,
+                                                                         SPTPersistentCacheCancellationToken *token)
+{
+    if (callback == nil || token == nil) {
+        return callback;
+    }
+
+    return ^(SPTPersistentCacheResponse *response) {
+        // Checked on the callback queue so a cancel issued there just before delivery is honoured too
+        if (!token.isCancelled) {
+            callback(response);
+        }
+    };
+}
@@ -0,0 +1,57 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The smallest number of operations whose latencies are averaged before the width of a queue is reconsidered.
+ */
+extern const NSUInteger SPTPersistentCacheConcurrencyControllerMinimumWindow;
+/**
+ The factor by which the average latency may exceed the lowest one seen before the width of a queue is halved.
+ */
+extern const double SPTPersistentCacheConcurrencyControllerLatencyTolerance;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Adjusts the width of an operation queue from the measured latency of its operations, additive increase and
+ multiplicative decrease style.
+ @discussion The latencies are averaged over windows of at least `SPTPersistentCacheConcurrencyControllerMinimumWindow`
+ operations, and at least as many as the current width. Once a window is complete the width is halved if the average
+ exceeds the baseline by more than `SPTPersistentCacheConcurrencyControllerLatencyTolerance`, or else raised by one
+ if operations are waiting for the queue. The baseline is the lowest average seen, drifting up slowly so that storage
+ that became slower for good is taken as the new normal. This class is threadsafe.
+ */
+@interface SPTPersistentCacheConcurrencyController : NSObject
+
+/// The number of operations the queue currently runs at the same time.
+@property (nonatomic, assign, readonly) NSInteger width;
+/// The average latency in seconds of a window that changes are judged against, `0` until a window completed.
+@property (nonatomic, assign, readonly) NSTimeInterval baselineLatency;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a controller and sets the width of the queue halfway between the bounds.
+
+ @param queue The queue whose `maxConcurrentOperationCount` is adjusted.
+ @param minimumWidth The smallest width, at least `1`.
+ @param maximumWidth The largest width, raised to `minimumWidth` if below it.
+ @param callback Callback the changes of width are reported to.
+ */
+- (instancetype)initWithQueue:(NSOperationQueue *)queue
+                 minimumWidth:(NSInteger)minimumWidth
+                 maximumWidth:(NSInteger)maximumWidth
+                     callback:(nullable SPTPersistentCacheConcurrencyCallback)callback NS_DESIGNATED_INITIALIZER;
+
+/**
+ Records the time an operation of the queue took to run, possibly changing the width of the queue.
+ */
+- (void)recordLatency:(NSTimeInterval)latency;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,128 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheConcurrencyController.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+const NSUInteger SPTPersistentCacheConcurrencyControllerMinimumWindow = 8;
+const double SPTPersistentCacheConcurrencyControllerLatencyTolerance = 2.0;
+
+// Share by which the baseline may rise per window when latencies stay above it
+static const double SPTPersistentCacheConcurrencyControllerBaselineDrift = 0.05;
+
+@interface SPTPersistentCacheConcurrencyController ()
+@property (nonatomic, strong, readonly) NSOperationQueue *queue;
+@property (nonatomic, assign, readonly) NSInteger minimumWidth;
+@property (nonatomic, assign, readonly) NSInteger maximumWidth;
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheConcurrencyCallback callback;
+@end
+
+@implementation SPTPersistentCacheConcurrencyController
+{
+    // The following are guarded by synchronizing on self
+    NSUInteger _windowCount;
+    NSTimeInterval _windowLatency;
+}
+
+@synthesize width = _width;
+@synthesize baselineLatency = _baselineLatency;
+
+- (instancetype)initWithQueue:(NSOperationQueue *)queue
+                 minimumWidth:(NSInteger)minimumWidth
+                 maximumWidth:(NSInteger)maximumWidth
+                     callback:(SPTPersistentCacheConcurrencyCallback)callback
+{
+    self = [super init];
+    if (self) {
+        _queue = queue;
+        _minimumWidth = MAX(minimumWidth, 1);
+        _maximumWidth = MAX(maximumWidth, _minimumWidth);
+        _callback = [callback copy];
+        _width = _minimumWidth + (_maximumWidth - _minimumWidth) / 2;
+        _queue.maxConcurrentOperationCount = _width;
+    }
+    return self;
+}
+
+- (NSInteger)width
+{
+    @synchronized (self) {
+        return _width;
+    }
+}
+
+- (NSTimeInterval)baselineLatency
+{
+    @synchronized (self) {
+        return _baselineLatency;
+    }
+}
+
+- (void)recordLatency:(NSTimeInterval)latency
+{
+    NSInteger width = 0;
+    NSTimeInterval averageLatency = 0.0;
+
+    @synchronized (self) {
+        _windowCount += 1;
+        _windowLatency += MAX(latency, 0.0);
+        if (_windowCount < MAX(SPTPersistentCacheConcurrencyControllerMinimumWindow, (NSUInteger)_width)) {
+            return;
+        }
+
+        averageLatency = _windowLatency / _windowCount;
+        _windowCount = 0;
+        _windowLatency = 0.0;
+
+        width = [self widthForAverageLatency:averageLatency];
+        if (width == _width) {
+            return;
+        }
+        _width = width;
+        self.queue.maxConcurrentOperationCount = width;
+    }
+
+    if (self.callback) {
+        self.callback(self.queue.name ?: @"", width, averageLatency);
+    }
+}
+
+/// Called with self synchronized
+- (NSInteger)widthForAverageLatency:(NSTimeInterval)averageLatency
+{
+    const NSTimeInterval baseline = _baselineLatency;
+    _baselineLatency = (baseline > 0.0 ?
+                        MIN(averageLatency, baseline * (1.0 + SPTPersistentCacheConcurrencyControllerBaselineDrift)) :
+                        averageLatency);
+
+    if (baseline > 0.0 && averageLatency > baseline * SPTPersistentCacheConcurrencyControllerLatencyTolerance) {
+        return MAX(_width / 2, self.minimumWidth);
+    }
+    // Without waiting operations a wider queue wouldn’t run any more of them
+    _Pragma("clang diagnostic push");
+    _Pragma("clang diagnostic ignored \"-Wdeprecated-declarations\"");
+    const NSInteger operationCount = (NSInteger)self.queue.operationCount;
+    _Pragma("clang diagnostic pop");
+    if (operationCount > _width) {
+        return MIN(_width + 1, self.maximumWidth);
+    }
+    return _width;
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.width), @"width");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.width), @"width",
+                                               @(self.minimumWidth), @"minimum-width",
+                                               @(self.maximumWidth), @"maximum-width",
+                                               @(self.baselineLatency), @"baseline-latency");
+}
+
+@end
@@ -0,0 +1,26 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheFileHandle.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SPTPersistentCacheFileHandle (Private)
+
+/**
+ Initializes a handle owning an open file descriptor.
+ @param key The key of the record.
+ @param fileDescriptor The open descriptor of the record file. The handle closes it.
+ @param payloadOffset The offset of the payload in the file.
+ @param payloadLength The length of the payload in bytes.
+ @param closeHandler Called once, after the descriptor has been closed. May be nil.
+ */
+- (instancetype)initWithKey:(NSString *)key
+             fileDescriptor:(int)fileDescriptor
+              payloadOffset:(off_t)payloadOffset
+              payloadLength:(uint64_t)payloadLength
+               closeHandler:(void (^ _Nullable)(void))closeHandler;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,80 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheFileHandle.h>
+#import "SPTPersistentCacheFileHandle+Private.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+#include <unistd.h>
+
+@implementation SPTPersistentCacheFileHandle
+{
+    int _fileDescriptor;
+    void (^_closeHandler)(void);
+}
+
+- (instancetype)initWithKey:(NSString *)key
+             fileDescriptor:(int)fileDescriptor
+              payloadOffset:(off_t)payloadOffset
+              payloadLength:(uint64_t)payloadLength
+               closeHandler:(void (^)(void))closeHandler
+{
+    self = [super init];
+    if (self) {
+        _key = [key copy];
+        _fileDescriptor = fileDescriptor;
+        _payloadOffset = payloadOffset;
+        _payloadLength = payloadLength;
+        _closeHandler = [closeHandler copy];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self close];
+}
+
+- (int)fileDescriptor
+{
+    @synchronized (self) {
+        return _fileDescriptor;
+    }
+}
+
+- (void)close
+{
+    void (^closeHandler)(void) = nil;
+    @synchronized (self) {
+        if (_fileDescriptor == -1) {
+            return;
+        }
+        close(_fileDescriptor);
+        _fileDescriptor = -1;
+        closeHandler = _closeHandler;
+        _closeHandler = nil;
+    }
+
+    // Outside of the lock, the handler schedules cache work
+    if (closeHandler) {
+        closeHandler();
+    }
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.key, @"key");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.key, @"key",
+                                               @(self.fileDescriptor), @"file-descriptor",
+                                               @(self.payloadOffset), @"payload-offset",
+                                               @(self.payloadLength), @"payload-length");
+}
+
+@end
@@ -4,6 +4,15 @@
 #import "SPTPersistentCacheFileManager.h"
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
 
+/**
+ How records are spread over the directories of the cache.
+ */
+typedef struct SPTPersistentCacheDirectoryLayout {
+    BOOL separated;         // NO if all records are in the cache path itself
+    NSUInteger depth;       // directory levels sharded by key hash, 0 to separate by the first characters of keys
+    NSUInteger fanOut;      // directories per level when depth is above 0, otherwise 0
+} SPTPersistentCacheDirectoryLayout;
+
 NS_ASSUME_NONNULL_BEGIN
 
 /// Private interface exposed for testability.
@@ -13,6 +22,13 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
 @property (nonatomic, strong, readonly) NSFileManager *fileManager;
 
+/// The layout given by the options, which records are stored in.
+@property (nonatomic, assign, readonly) SPTPersistentCacheDirectoryLayout currentLayout;
+/// The layout records were stored in before, equal to `currentLayout` unless migrating.
+@property (nonatomic, assign, readonly) SPTPersistentCacheDirectoryLayout previousLayout;
+
+- (NSString *)subDirectoryPathForKey:(NSString *)key layout:(SPTPersistentCacheDirectoryLayout)layout;
+
 @end
 
 NS_ASSUME_NONNULL_END
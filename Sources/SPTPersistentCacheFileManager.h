@@ -19,6 +19,37 @@ NS_ASSUME_NONNULL_BEGIN
 /// The total amount of bytes used by the cache given the reciever’s options.
 @property (nonatomic, readonly) NSUInteger totalUsedSizeInBytes;
 
+/// Hidden directory in the cache path that removed files are moved to until the trash is emptied.
+@property (nonatomic, copy, readonly) NSString *trashPath;
+
+/// Hidden file in the cache path holding the refCounts of records when `useLockJournal` is set in the options.
+@property (nonatomic, copy, readonly) NSString *lockJournalPath;
+
+/// Hidden file in the cache path holding the index shared by processes when `useMultiProcessCoordination` is set in the options.
+@property (nonatomic, copy, readonly) NSString *sharedIndexPath;
+
+/// Hidden file in the cache path locked by the one process that runs scheduled garbage collection.
+@property (nonatomic, copy, readonly) NSString *garbageCollectionLeaderPath;
+
+/// Hidden file in the cache path the history of accessed records is kept in across runs.
+@property (nonatomic, copy, readonly) NSString *accessHistoryPath;
+
+/// Hidden file in the cache path holding the tags of records when `useTagIndex` is set in the options.
+@property (nonatomic, copy, readonly) NSString *tagIndexPath;
+
+/// Hidden directory in the cache path holding the payloads of deduplicated records.
+@property (nonatomic, copy, readonly) NSString *blobsPath;
+
+/// Hidden file in the cache path describing the directory layout records were last migrated to.
+@property (nonatomic, copy, readonly) NSString *layoutPath;
+
+/// Whether records may still be stored in an earlier directory layout, until the layout has been migrated.
+@property (nonatomic, readonly, getter=isMigratingLayout) BOOL migratingLayout;
+
+/// Whether all keys starting with a prefix are in the sub directory for that prefix. Not the case when keys are
+/// sharded by hash or the layout is being migrated.
+@property (nonatomic, readonly) BOOL subDirectoriesGroupKeysByPrefix;
+
 - (instancetype)init NS_UNAVAILABLE;
 + (instancetype)new NS_UNAVAILABLE;
 
@@ -32,6 +63,7 @@ NS_ASSUME_NONNULL_BEGIN
 /**
  Creates the directory that will be used to persist the cached data. Returns YES if the operation is successful, 
  Or NO otherwise.
+ @discussion Also finds out if the records have to be migrated from an earlier directory layout.
  */
 - (BOOL)createCacheDirectory;
 
@@ -44,22 +76,75 @@ NS_ASSUME_NONNULL_BEGIN
 
 /**
  Returns the path for the data associated to a specific key.
+ @discussion While migrating the layout this is the path in the earlier layout if the record is only found there.
 
  @param key Key of the data you are looking for.
  */
 - (NSString *)pathForKey:(NSString *)key;
 
+/**
+ Returns the path new data for a specific key is written to, which is always in the current layout.
+
+ @param key Key of the data you are about to store.
+ */
+- (NSString *)pathForStoringKey:(NSString *)key;
+
+/**
+ Writes the file system representation of `pathForKey:` into a buffer, without creating any objects for the common
+ keys. Used on the hot path of reading records.
+
+ @param buffer The buffer the NUL terminated path is written to.
+ @param maxLength The size of the buffer in bytes.
+ @param key Key of the data you are looking for.
+ @return YES if the path was written, NO if it doesn't fit or the key is better served by `pathForKey:`.
+ */
+- (BOOL)getFileSystemPath:(char *)buffer maxLength:(size_t)maxLength forKey:(NSString *)key;
+
+/**
+ Returns the keys of all records starting with a prefix, looking through every sub directory.
+
+ @param prefix The prefix of the keys.
+ */
+- (NSArray<NSString *> *)keysWithPrefix:(NSString *)prefix;
+
 /**
  Removes all data files in the cache.
  */
 - (void)removeAllData;
 
 /**
- Removes the associated cached file for a key.
+ Removes all data files in the cache except the ones of the given keys. Sub directories without kept keys are moved
+ to the trash as a whole, so the time taken doesn’t depend on the number of files.
+
+ @param keptKeys Keys of the data to keep. May be nil.
+ */
+- (void)removeAllDataExceptKeys:(nullable NSSet<NSString *> *)keptKeys;
+
+/**
+ Removes the associated cached file for a key by moving it to the trash. Returns YES if the file was removed, or NO
+ otherwise.
 
  @param key Key of the data you are looking for.
  */
-- (void)removeDataForKey:(NSString *)key;
+- (BOOL)removeDataForKey:(NSString *)key;
+
+/**
+ Unlinks everything in the trash.
+
+ @param batchSize The number of files to unlink between calls of betweenBatches, counting the files inside trashed
+ directories at any depth.
+ @param betweenBatches Called after each batch, e.g. to let other work go first. May be nil.
+ */
+- (void)emptyTrashInBatchesOfSize:(NSUInteger)batchSize betweenBatches:(nullable dispatch_block_t)betweenBatches;
+
+/**
+ Moves records stored in an earlier directory layout to their path in the current one, then records the current
+ layout as the one the cache is in. Does nothing unless migrating.
+
+ @param batchSize The number of records to move between calls of betweenBatches.
+ @param betweenBatches Called after each batch, e.g. to let other work go first. May be nil.
+ */
+- (void)migrateLayoutInBatchesOfSize:(NSUInteger)batchSize betweenBatches:(nullable dispatch_block_t)betweenBatches;
 
 /**
  Based on a specific cache size, return a size optimized for the disk space. 
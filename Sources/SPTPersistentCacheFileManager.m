@@ -5,11 +5,65 @@
 #import "SPTPersistentCacheDebugUtilities.h"
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
 
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "fnv1a.h"
+
 static const double SPTPersistentCacheFileManagerMinFreeDiskSpace = 0.1;
 
 const NSUInteger SPTPersistentCacheFileManagerSubDirNameLength = 2;
 
+static NSString * const SPTPersistentCacheFileManagerTrashDirectoryName = @".trash";
+static NSString * const SPTPersistentCacheFileManagerLockJournalFileName = @".locks";
+static NSString * const SPTPersistentCacheFileManagerLayoutFileName = @".layout";
+static NSString * const SPTPersistentCacheFileManagerSharedIndexFileName = @".shared-index";
+static NSString * const SPTPersistentCacheFileManagerGarbageCollectionLeaderFileName = @".gc-leader";
+static NSString * const SPTPersistentCacheFileManagerAccessHistoryFileName = @".access-history";
+static NSString * const SPTPersistentCacheFileManagerTagIndexFileName = @".tags";
+static NSString * const SPTPersistentCacheFileManagerBlobsDirectoryName = @".blobs";
+
+static NSString * const SPTPersistentCacheFileManagerLayoutSeparatedKey = @"separated";
+static NSString * const SPTPersistentCacheFileManagerLayoutDepthKey = @"depth";
+static NSString * const SPTPersistentCacheFileManagerLayoutFanOutKey = @"fanOut";
+
+static BOOL SPTPersistentCacheDirectoryLayoutEqual(SPTPersistentCacheDirectoryLayout layout, SPTPersistentCacheDirectoryLayout otherLayout)
+{
+    return (layout.separated == otherLayout.separated &&
+            layout.depth == otherLayout.depth &&
+            layout.fanOut == otherLayout.fanOut);
+}
+
+/// The number of hex digits of the largest directory name at each level
+static int SPTPersistentCacheDirectoryLayoutNameLength(SPTPersistentCacheDirectoryLayout layout)
+{
+    int length = 1;
+    for (NSUInteger value = (layout.fanOut - 1) >> 4; value > 0; value >>= 4) {
+        length += 1;
+    }
+    return length;
+}
+
+/// Appends '/' and a component to the path of used bytes in buffer, keeping it NUL terminated
+static BOOL SPTPersistentCacheAppendPathComponent(char *buffer, size_t maxLength, size_t *used, const char *component, size_t componentLength)
+{
+    if (*used + 1 + componentLength >= maxLength) {
+        return NO;
+    }
+    buffer[*used] = '/';
+    memcpy(buffer + *used + 1, component, componentLength);
+    *used += 1 + componentLength;
+    buffer[*used] = '\0';
+    return YES;
+}
+
 @implementation SPTPersistentCacheFileManager
+{
+    atomic_bool _migratingLayout;
+    // The cache path as passed to the system, kept to build paths without creating strings
+    char *_cachePathFileSystemRepresentation;
+}
 
 #pragma mark - Initializer
 
@@ -20,10 +74,26 @@ const NSUInteger SPTPersistentCacheFileManagerSubDirNameLength = 2;
         _options = [options copy];
         _fileManager = [NSFileManager defaultManager];
         _debugOutput = options.debugOutput;
+
+        const BOOL separated = _options.useDirectorySeparation;
+        const NSUInteger depth = (separated ? _options.directoryShardingDepth : 0);
+        _currentLayout = (SPTPersistentCacheDirectoryLayout){ separated, depth, (depth > 0 ? _options.directoryShardingFanOut : 0) };
+        _previousLayout = _currentLayout;
+
+        // Trailing slashes are dropped like when appending path components to the string
+        _cachePathFileSystemRepresentation = strdup(_options.cachePath.fileSystemRepresentation);
+        for (size_t length = strlen(_cachePathFileSystemRepresentation); length > 1 && _cachePathFileSystemRepresentation[length - 1] == '/'; --length) {
+            _cachePathFileSystemRepresentation[length - 1] = '\0';
+        }
     }
     return self;
 }
 
+- (void)dealloc
+{
+    free(_cachePathFileSystemRepresentation);
+}
+
 #pragma mark -
 
 - (BOOL)createCacheDirectory
@@ -50,66 +120,561 @@ const NSUInteger SPTPersistentCacheFileManagerSubDirNameLength = 2;
             return NO;
         }
     }
-    
+
+    [self loadLayoutOfCreatedDirectory:!exists];
+
     return YES;
 }
 
+#pragma mark Layout
+
+- (NSString *)layoutPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerLayoutFileName];
+}
+
+- (BOOL)isMigratingLayout
+{
+    return atomic_load(&_migratingLayout);
+}
+
+- (BOOL)subDirectoriesGroupKeysByPrefix
+{
+    return (self.currentLayout.depth == 0 && !self.isMigratingLayout);
+}
+
 /**
- 2 letter separation is handled only by this method. All other code is agnostic to this fact.
+ Finds the layout the records are stored in. Without a layout file that is the layout from before sharding by hash.
+ */
+- (void)loadLayoutOfCreatedDirectory:(BOOL)createdDirectory
+{
+    const SPTPersistentCacheDirectoryLayout currentLayout = self.currentLayout;
+    SPTPersistentCacheDirectoryLayout previousLayout = { self.options.useDirectorySeparation, 0, 0 };
+
+    if (createdDirectory) {
+        previousLayout = currentLayout;
+        if (currentLayout.depth > 0) {
+            [self writeLayout];
+        }
+    } else {
+        NSDictionary<NSString *, NSNumber *> *layout = [NSDictionary dictionaryWithContentsOfFile:self.layoutPath];
+        if (layout != nil) {
+            previousLayout.separated = [layout[SPTPersistentCacheFileManagerLayoutSeparatedKey] boolValue];
+            previousLayout.depth = [layout[SPTPersistentCacheFileManagerLayoutDepthKey] unsignedIntegerValue];
+            previousLayout.fanOut = [layout[SPTPersistentCacheFileManagerLayoutFanOutKey] unsignedIntegerValue];
+        }
+    }
+
+    _previousLayout = previousLayout;
+    atomic_store(&_migratingLayout, !SPTPersistentCacheDirectoryLayoutEqual(previousLayout, currentLayout));
+}
+
+- (BOOL)writeLayout
+{
+    const SPTPersistentCacheDirectoryLayout layout = self.currentLayout;
+    NSDictionary<NSString *, NSNumber *> *dictionary = @{
+        SPTPersistentCacheFileManagerLayoutSeparatedKey: @(layout.separated),
+        SPTPersistentCacheFileManagerLayoutDepthKey: @(layout.depth),
+        SPTPersistentCacheFileManagerLayoutFanOutKey: @(layout.fanOut),
+    };
+    if (![dictionary writeToFile:self.layoutPath atomically:YES]) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to write layout: %@", self.layoutPath], self.debugOutput);
+        return NO;
+    }
+    return YES;
+}
+
+- (void)migrateLayoutInBatchesOfSize:(NSUInteger)batchSize betweenBatches:(dispatch_block_t)betweenBatches
+{
+    if (!self.isMigratingLayout) {
+        return;
+    }
+
+    NSString *cachePath = self.options.cachePath;
+    NSMutableArray<NSString *> *recordPaths = [NSMutableArray array];
+    NSMutableArray<NSString *> *directoryPaths = [NSMutableArray array];
+    [self collectRecordPaths:recordPaths directoryPaths:directoryPaths inDirectoryAtPath:cachePath];
+
+    BOOL migrated = YES;
+    NSUInteger movedInBatch = 0;
+    for (NSString *path in recordPaths) {
+        NSString *destinationPath = [self pathForStoringKey:path.lastPathComponent];
+        if ([path isEqualToString:destinationPath]) {
+            continue;
+        }
+
+        if (movedInBatch == batchSize) {
+            if (betweenBatches) {
+                betweenBatches();
+            }
+            movedInBatch = 0;
+        }
+        movedInBatch += 1;
+
+        migrated = [self moveRecordAtPath:path toPath:destinationPath] && migrated;
+    }
+
+    // The cache path the way it prefixes the collected paths, i.e. without any trailing slash
+    NSString *parentPath = [cachePath stringByAppendingPathComponent:@"_"].stringByDeletingLastPathComponent;
+
+    // Deepest first, so parents are empty by the time they are reached. Directories of the current layout are left,
+    // a store may be about to write into them.
+    for (NSString *directoryPath in directoryPaths.reverseObjectEnumerator) {
+        NSString *relativePath = [directoryPath substringFromIndex:parentPath.length + 1];
+        if (![self isSubDirectoryOfCurrentLayout:relativePath]) {
+            // Fails for directories still holding anything, which is fine
+            rmdir(directoryPath.fileSystemRepresentation);
+        }
+    }
+
+    // Without the layout file the remaining records are tried again on the next start
+    if (migrated && [self writeLayout]) {
+        atomic_store(&_migratingLayout, false);
+    }
+}
+
+/**
+ Moves a record to its path in the current layout. If it has been stored there since, the old copy is outdated. A
+ record removed since it was collected has nothing left to move.
+ */
+- (BOOL)moveRecordAtPath:(NSString *)path toPath:(NSString *)destinationPath
+{
+    if ([self.fileManager fileExistsAtPath:destinationPath]) {
+        return [self moveItemToTrashAtPath:path] || ![self.fileManager fileExistsAtPath:path];
+    }
+
+    NSError *error = nil;
+    [self.fileManager createDirectoryAtPath:destinationPath.stringByDeletingLastPathComponent
+                withIntermediateDirectories:YES
+                                 attributes:nil
+                                      error:nil];
+
+    // Never replaces the destination, so a record stored in the meantime wins
+    if (![self.fileManager moveItemAtPath:path toPath:destinationPath error:&error]) {
+        if (![self.fileManager fileExistsAtPath:path]) {
+            return YES;
+        }
+        if ([self.fileManager fileExistsAtPath:destinationPath]) {
+            return [self moveItemToTrashAtPath:path] || ![self.fileManager fileExistsAtPath:path];
+        }
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to move record from: %@ to: %@, error: %@", path, destinationPath, error], self.debugOutput);
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)isSubDirectoryOfCurrentLayout:(NSString *)relativePath
+{
+    const SPTPersistentCacheDirectoryLayout layout = self.currentLayout;
+    NSArray<NSString *> *components = relativePath.pathComponents;
+
+    if (!layout.separated) {
+        return NO;
+    }
+    if (layout.depth == 0) {
+        return (components.count == 1 && components.firstObject.length == SPTPersistentCacheFileManagerSubDirNameLength);
+    }
+    if (components.count > layout.depth) {
+        return NO;
+    }
+
+    NSCharacterSet *nonHexCharacters = [NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdef"].invertedSet;
+    const NSUInteger nameLength = (NSUInteger)SPTPersistentCacheDirectoryLayoutNameLength(layout);
+    for (NSString *component in components) {
+        if (component.length != nameLength ||
+            [component rangeOfCharacterFromSet:nonHexCharacters].location != NSNotFound ||
+            strtoull(component.UTF8String, NULL, 16) >= layout.fanOut) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+/**
+ Collects the paths of all records and sub directories below a directory, parents before their children.
+ */
+- (void)collectRecordPaths:(NSMutableArray<NSString *> *)recordPaths
+            directoryPaths:(nullable NSMutableArray<NSString *> *)directoryPaths
+         inDirectoryAtPath:(NSString *)directoryPath
+{
+    // WARNING: Not using enumeratorAtURL, it can get locked forever
+    for (NSString *name in [self.fileManager contentsOfDirectoryAtPath:directoryPath error:nil]) {
+        // Hidden entries, e.g. the trash or files being written, aren’t records
+        if ([name hasPrefix:@"."]) {
+            continue;
+        }
+
+        NSString *path = [directoryPath stringByAppendingPathComponent:name];
+        BOOL isDirectory = NO;
+        if (![self.fileManager fileExistsAtPath:path isDirectory:&isDirectory]) {
+            continue;
+        }
+
+        if (isDirectory) {
+            [directoryPaths addObject:path];
+            [self collectRecordPaths:recordPaths directoryPaths:directoryPaths inDirectoryAtPath:path];
+        } else {
+            [recordPaths addObject:path];
+        }
+    }
+}
+
+#pragma mark Paths
+
+/**
+ Separation of records into directories is handled only by these methods. All other code is agnostic to this fact.
  */
 - (NSString *)subDirectoryPathForKey:(NSString *)key
 {
-    // make folder tree: xx/  zx/  xy/  yz/ etc.
+    return [self subDirectoryPathForKey:key layout:self.currentLayout];
+}
+
+- (NSString *)subDirectoryPathForKey:(NSString *)key layout:(SPTPersistentCacheDirectoryLayout)layout
+{
     NSString *subDir = self.options.cachePath;
-    
-    if (self.options.useDirectorySeparation && key.length >= SPTPersistentCacheFileManagerSubDirNameLength) {
-        NSString *subDirectoryName = [key substringToIndex:SPTPersistentCacheFileManagerSubDirNameLength];
-        subDir = [self.options.cachePath stringByAppendingPathComponent:subDirectoryName];
+
+    if (!layout.separated) {
+        return subDir;
+    }
+
+    // make folder tree: xx/  zx/  xy/  yz/ etc.
+    if (layout.depth == 0) {
+        if (key.length >= SPTPersistentCacheFileManagerSubDirNameLength) {
+            NSString *subDirectoryName = [key substringToIndex:SPTPersistentCacheFileManagerSubDirNameLength];
+            subDir = [self.options.cachePath stringByAppendingPathComponent:subDirectoryName];
+        }
+        return subDir;
+    }
+
+    // make folder tree by hash: 3f/a0/  07/c2/ etc., whatever the keys look like
+    const char *keyBytes = key.UTF8String;
+    uint64_t hash = spt_fnv1a64((const uint8_t *)keyBytes, strlen(keyBytes));
+    const int nameLength = SPTPersistentCacheDirectoryLayoutNameLength(layout);
+    for (NSUInteger level = 0; level < layout.depth; ++level) {
+        NSString *subDirectoryName = [NSString stringWithFormat:@"%0*llx", nameLength, (unsigned long long)(hash % layout.fanOut)];
+        subDir = [subDir stringByAppendingPathComponent:subDirectoryName];
+        hash /= layout.fanOut;
     }
-    
     return subDir;
 }
 
-- (NSString *)pathForKey:(NSString *)key
+- (NSString *)pathForStoringKey:(NSString *)key
 {
     NSString *subDirectoryPathForKey = [self subDirectoryPathForKey:key];
     
     return [subDirectoryPathForKey stringByAppendingPathComponent:key];
 }
 
+- (NSString *)pathForKey:(NSString *)key
+{
+    NSString *path = [self pathForStoringKey:key];
+    if (!self.isMigratingLayout || [self.fileManager fileExistsAtPath:path]) {
+        return path;
+    }
+
+    // Checked second, so a record moved in between is found at the current path
+    NSString *previousPath = [[self subDirectoryPathForKey:key layout:self.previousLayout] stringByAppendingPathComponent:key];
+    return ([self.fileManager fileExistsAtPath:previousPath] ? previousPath : path);
+}
+
+- (BOOL)getFileSystemPath:(char *)buffer maxLength:(size_t)maxLength forKey:(NSString *)key
+{
+    if (![self getFileSystemPath:buffer maxLength:maxLength forKey:key layout:self.currentLayout]) {
+        return NO;
+    }
+    if (!self.isMigratingLayout || access(buffer, F_OK) == 0) {
+        return YES;
+    }
+
+    // Checked second, so a record moved in between is found at the current path
+    char previousPath[PATH_MAX];
+    if ([self getFileSystemPath:previousPath maxLength:sizeof(previousPath) forKey:key layout:self.previousLayout] &&
+        access(previousPath, F_OK) == 0) {
+        return strlcpy(buffer, previousPath, maxLength) < maxLength;
+    }
+    return YES;
+}
+
+/**
+ The C string counterpart of `subDirectoryPathForKey:layout:` followed by the key. Gives up on keys whose first
+ characters can't be told apart from their UTF-8 bytes, which the string methods handle.
+ */
+- (BOOL)getFileSystemPath:(char *)buffer
+                maxLength:(size_t)maxLength
+                   forKey:(NSString *)key
+                   layout:(SPTPersistentCacheDirectoryLayout)layout
+{
+    const size_t cachePathLength = strlen(_cachePathFileSystemRepresentation);
+    if (cachePathLength >= maxLength) {
+        return NO;
+    }
+    memcpy(buffer, _cachePathFileSystemRepresentation, cachePathLength + 1);
+    size_t used = cachePathLength;
+
+    if (layout.separated && layout.depth == 0 && key.length >= SPTPersistentCacheFileManagerSubDirNameLength) {
+        char subDirectoryName[8];
+        NSAssert(SPTPersistentCacheFileManagerSubDirNameLength <= sizeof(subDirectoryName), @"Sub directory names don't fit");
+        for (NSUInteger i = 0; i < SPTPersistentCacheFileManagerSubDirNameLength; ++i) {
+            const unichar character = [key characterAtIndex:i];
+            if (character == 0 || character > 0x7f) {
+                return NO;
+            }
+            subDirectoryName[i] = (char)character;
+        }
+        if (!SPTPersistentCacheAppendPathComponent(buffer, maxLength, &used, subDirectoryName, SPTPersistentCacheFileManagerSubDirNameLength)) {
+            return NO;
+        }
+    } else if (layout.separated && layout.depth > 0) {
+        char keyBytes[PATH_MAX];
+        NSUInteger keyLength = 0;
+        NSRange remainingRange = NSMakeRange(0, 0);
+        if (![key getBytes:keyBytes
+                 maxLength:sizeof(keyBytes)
+                usedLength:&keyLength
+                  encoding:NSUTF8StringEncoding
+                   options:0
+                     range:NSMakeRange(0, key.length)
+            remainingRange:&remainingRange] || remainingRange.length > 0) {
+            return NO;
+        }
+
+        uint64_t hash = spt_fnv1a64((const uint8_t *)keyBytes, keyLength);
+        const int nameLength = SPTPersistentCacheDirectoryLayoutNameLength(layout);
+        for (NSUInteger level = 0; level < layout.depth; ++level) {
+            char subDirectoryName[32];
+            const int subDirectoryNameLength = snprintf(subDirectoryName, sizeof(subDirectoryName), "%0*llx",
+                                                        nameLength, (unsigned long long)(hash % layout.fanOut));
+            if (!SPTPersistentCacheAppendPathComponent(buffer, maxLength, &used, subDirectoryName, (size_t)subDirectoryNameLength)) {
+                return NO;
+            }
+            hash /= layout.fanOut;
+        }
+    }
+
+    if (used + 1 >= maxLength) {
+        return NO;
+    }
+    buffer[used] = '/';
+    return [key getFileSystemRepresentation:buffer + used + 1 maxLength:maxLength - used - 1];
+}
+
+/**
+ The paths a record for key may be at, the one in the previous layout only while migrating.
+ */
+- (NSArray<NSString *> *)possiblePathsForKey:(NSString *)key
+{
+    NSString *path = [self pathForStoringKey:key];
+    if (!self.isMigratingLayout) {
+        return @[path];
+    }
+
+    NSString *previousPath = [[self subDirectoryPathForKey:key layout:self.previousLayout] stringByAppendingPathComponent:key];
+    return ([previousPath isEqualToString:path] ? @[path] : @[path, previousPath]);
+}
+
+- (NSArray<NSString *> *)keysWithPrefix:(NSString *)prefix
+{
+    NSMutableArray<NSString *> *recordPaths = [NSMutableArray array];
+    [self collectRecordPaths:recordPaths directoryPaths:nil inDirectoryAtPath:self.options.cachePath];
+
+    // A record may be in both layouts while migrating
+    NSMutableOrderedSet<NSString *> *keys = [NSMutableOrderedSet orderedSet];
+    for (NSString *path in recordPaths) {
+        NSString *key = path.lastPathComponent;
+        if ([key hasPrefix:prefix]) {
+            [keys addObject:key];
+        }
+    }
+    return keys.array;
+}
+
 - (void)removeAllData
 {
-    NSURL *urlPath = [NSURL fileURLWithPath:self.options.cachePath];
-    
-    NSDirectoryEnumerator *dirEnumerator = [self.fileManager enumeratorAtURL:urlPath
-                                                  includingPropertiesForKeys:@[NSURLIsDirectoryKey]
-                                                                     options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                                errorHandler:nil];
-    
-    // Enumerate the dirEnumerator results, each value is stored in allURLs
-    NSURL *theURL = nil;
-    while ((theURL = [dirEnumerator nextObject])) {
-        // Retrieve the file name. From cached during the enumeration.
-        NSNumber *isDirectory;
-        if ([theURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL]) {
-            if ([isDirectory boolValue] == NO) {
-                NSString *key = theURL.lastPathComponent;
-                
-                // That satisfies Req.#1.3
-                [self removeDataForKey:key];
+    [self removeAllDataExceptKeys:nil];
+}
+
+- (void)removeAllDataExceptKeys:(NSSet<NSString *> *)keptKeys
+{
+    NSString *cachePath = self.options.cachePath;
+
+    // Directories holding kept records, at any level, have to be emptied entry by entry
+    NSMutableSet<NSString *> *keptPaths = [NSMutableSet set];
+    NSMutableSet<NSString *> *keptDirectoryPaths = [NSMutableSet set];
+    for (NSString *key in keptKeys) {
+        for (NSString *path in [self possiblePathsForKey:key]) {
+            [keptPaths addObject:path];
+            for (NSString *directoryPath = path.stringByDeletingLastPathComponent;
+                 directoryPath.length > cachePath.length;
+                 directoryPath = directoryPath.stringByDeletingLastPathComponent) {
+                [keptDirectoryPaths addObject:directoryPath];
             }
         }
     }
+
+    [self removeContentsOfDirectoryAtPath:cachePath exceptPaths:keptPaths keptDirectoryPaths:keptDirectoryPaths];
 }
 
-- (void)removeDataForKey:(NSString *)key
+- (void)removeContentsOfDirectoryAtPath:(NSString *)directoryPath
+                            exceptPaths:(NSSet<NSString *> *)keptPaths
+                     keptDirectoryPaths:(NSSet<NSString *> *)keptDirectoryPaths
 {
     NSError *error = nil;
-    
-    NSString *filePath = [self pathForKey:key];
-    
-    if (![self.fileManager removeItemAtPath:filePath error:&error]) {
-        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Error removing data for Key:%@ , error:%@", key, error], self.debugOutput);
+    NSArray<NSString *> *contents = [self.fileManager contentsOfDirectoryAtPath:directoryPath error:&error];
+    if (contents == nil) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to get dir contents: %@, error: %@", directoryPath, error], self.debugOutput);
+        return;
+    }
+
+    for (NSString *name in contents) {
+        // Hidden entries, e.g. the trash itself, aren’t records
+        if ([name hasPrefix:@"."]) {
+            continue;
+        }
+
+        NSString *path = [directoryPath stringByAppendingPathComponent:name];
+        if ([keptPaths containsObject:path]) {
+            continue;
+        }
+        if ([keptDirectoryPaths containsObject:path]) {
+            [self removeContentsOfDirectoryAtPath:path exceptPaths:keptPaths keptDirectoryPaths:keptDirectoryPaths];
+            continue;
+        }
+
+        // That satisfies Req.#1.3, anything else goes as a whole so the time taken doesn’t depend on the number of files
+        [self moveItemToTrashAtPath:path];
+    }
+}
+
+- (BOOL)removeDataForKey:(NSString *)key
+{
+    if (!self.isMigratingLayout) {
+        return [self moveItemToTrashAtPath:[self pathForStoringKey:key]];
+    }
+
+    // A copy may be left in the previous layout as well
+    BOOL removed = NO;
+    for (NSString *path in [self possiblePathsForKey:key]) {
+        if ([self.fileManager fileExistsAtPath:path]) {
+            removed = [self moveItemToTrashAtPath:path] || removed;
+        }
+    }
+    return removed;
+}
+
+#pragma mark Trash
+
+- (NSString *)trashPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerTrashDirectoryName];
+}
+
+- (NSString *)lockJournalPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerLockJournalFileName];
+}
+
+- (NSString *)sharedIndexPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerSharedIndexFileName];
+}
+
+- (NSString *)garbageCollectionLeaderPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerGarbageCollectionLeaderFileName];
+}
+
+- (NSString *)accessHistoryPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerAccessHistoryFileName];
+}
+
+- (NSString *)tagIndexPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerTagIndexFileName];
+}
+
+- (NSString *)blobsPath
+{
+    return [self.options.cachePath stringByAppendingPathComponent:SPTPersistentCacheFileManagerBlobsDirectoryName];
+}
+
+/**
+ Moves a file or directory into the trash. A rename, so it’s atomic and takes the same time for any size.
+ */
+- (BOOL)moveItemToTrashAtPath:(NSString *)path
+{
+    NSError *error = nil;
+    NSString *trashPath = self.trashPath;
+
+    if (![self.fileManager createDirectoryAtPath:trashPath withIntermediateDirectories:YES attributes:nil error:&error]) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to create trash dir: %@ with error:%@", trashPath, error], self.debugOutput);
+        return NO;
+    }
+
+    // Unique name, the same key may be removed again before the previous file has been unlinked
+    NSString *trashedPath = [trashPath stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    if (![self.fileManager moveItemAtPath:path toPath:trashedPath error:&error]) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Error removing data at path:%@ , error:%@", path, error], self.debugOutput);
+        return NO;
+    }
+    return YES;
+}
+
+- (void)emptyTrashInBatchesOfSize:(NSUInteger)batchSize betweenBatches:(dispatch_block_t)betweenBatches
+{
+    // Trashed sub directories, e.g. whole shards, are emptied file by file so no single step takes long
+    NSMutableArray<NSString *> *filePaths = [NSMutableArray array];
+    NSMutableArray<NSString *> *directoryPaths = [NSMutableArray array];
+    [self collectTrashedFilePaths:filePaths directoryPaths:directoryPaths inDirectoryAtPath:self.trashPath];
+
+    NSUInteger removedInBatch = 0;
+    for (NSString *path in filePaths) {
+        if (removedInBatch == batchSize) {
+            if (betweenBatches) {
+                betweenBatches();
+            }
+            removedInBatch = 0;
+        }
+
+        [self removeTrashedItemAtPath:path];
+        removedInBatch += 1;
+    }
+
+    // Deepest first, so each one is empty by the time it is reached
+    for (NSString *path in directoryPaths.reverseObjectEnumerator) {
+        [self removeTrashedItemAtPath:path];
+    }
+}
+
+- (void)removeTrashedItemAtPath:(NSString *)path
+{
+    NSError *error = nil;
+    if (![self.fileManager removeItemAtPath:path error:&error]) {
+        SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Error emptying trash at path:%@ , error:%@", path, error], self.debugOutput);
+    }
+}
+
+/**
+ Collects everything below a directory of the trash, hidden entries included, with each directory before its contents.
+ */
+- (void)collectTrashedFilePaths:(NSMutableArray<NSString *> *)filePaths
+                 directoryPaths:(NSMutableArray<NSString *> *)directoryPaths
+              inDirectoryAtPath:(NSString *)directoryPath
+{
+    // WARNING: Not using enumeratorAtURL, it can get locked forever
+    for (NSString *name in [self.fileManager contentsOfDirectoryAtPath:directoryPath error:nil]) {
+        NSString *path = [directoryPath stringByAppendingPathComponent:name];
+        BOOL isDirectory = NO;
+        if (![self.fileManager fileExistsAtPath:path isDirectory:&isDirectory]) {
+            continue;
+        }
+
+        if (isDirectory) {
+            [directoryPaths addObject:path];
+            [self collectTrashedFilePaths:filePaths directoryPaths:directoryPaths inDirectoryAtPath:path];
+        } else {
+            [filePaths addObject:path];
+        }
     }
 }
 
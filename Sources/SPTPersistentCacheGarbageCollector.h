@@ -6,6 +6,23 @@
 @class SPTPersistentCache;
 @class SPTPersistentCacheOptions;
 
+/**
+ The factor by which the garbage collection interval may grow above `garbageCollectionInterval` while the cache is idle.
+ */
+extern const NSUInteger SPTPersistentCacheGarbageCollectorMaxBackoffFactor;
+/**
+ The churn, in bytes stored and expired between two runs, at which the cache is considered under write pressure when
+ it has no size constraint. With a size constraint a quarter of it is used.
+ */
+extern const uint64_t SPTPersistentCacheGarbageCollectorDefaultPressureBytes;
+
+/**
+ Runs garbage collection of a cache on a timer that doesn’t depend on any run loop.
+ @discussion The interval adapts to the churn seen since the last run. Without churn it doubles, up to
+ `SPTPersistentCacheGarbageCollectorMaxBackoffFactor` times `garbageCollectionInterval`. Under write pressure it
+ halves, down to `SPTPersistentCacheMinimumGCIntervalLimit`, and a run is brought forward as soon as the stored bytes
+ reach the pressure threshold. Otherwise it returns to `garbageCollectionInterval`.
+ */
 @interface SPTPersistentCacheGarbageCollector : NSObject
 
 /**
@@ -23,6 +40,19 @@
  */
 @property (nonatomic, readonly, getter=isGarbageCollectionScheduled) BOOL garbageCollectionScheduled;
 
+/**
+ Whether scheduled runs are performed by this garbage collector.
+ @discussion With `useMultiProcessCoordination` set in the options, the first collector to take an advisory lock on
+ a file in the cache directory leads until it is deallocated, and the collectors of other processes skip their runs.
+ Otherwise every collector leads.
+ */
+@property (nonatomic, readonly, getter=isGarbageCollectionLeader) BOOL garbageCollectionLeader;
+
+/**
+ The interval in seconds until the next garbage collection run.
+ */
+@property (nonatomic, readonly) NSTimeInterval currentInterval;
+
 /**
  Initializes the timer proxy on a specific queue using a specific data cache.
 
@@ -36,19 +66,22 @@
 
 /**
  Schedules the garbage collection operation.
-
- @warning The owner of the reference to this object should call 
- unscheduleGarbageCollection on its dealloc method to prevent a retain cycle 
- caused by an internal timer.
  */
 - (void)schedule;
 
 /**
  Unschedules the garbage collection operation.
-
- @warning Ensure the garbage collector is unscheduled to break the retain
- cycle that could be caused by the internal timer in this class.
  */
 - (void)unschedule;
 
+/**
+ Records bytes written to the cache. Called for every store.
+ */
+- (void)recordStoredBytes:(uint64_t)bytes;
+
+/**
+ Records bytes of expired records removed by garbage collection.
+ */
+- (void)recordExpiredBytes:(uint64_t)bytes;
+
 @end
@@ -4,18 +4,39 @@
 #import "SPTPersistentCacheGarbageCollector.h"
 #import "SPTPersistentCacheDebugUtilities.h"
 #import "SPTPersistentCache+Private.h"
+#import "SPTPersistentCacheFileManager.h"
 
-static BOOL SPTPersistentCacheGarbageCollectorSchedulerIsInMainQueue(void);
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+const NSUInteger SPTPersistentCacheGarbageCollectorMaxBackoffFactor = 4;
+const uint64_t SPTPersistentCacheGarbageCollectorDefaultPressureBytes = 32 * 1024 * 1024;
 
 static const NSTimeInterval SPTPersistentCacheGarbageCollectorSchedulerTimerTolerance = 300;
+// Share of the interval a run may be delayed by so the system can coalesce wake-ups
+static const double SPTPersistentCacheGarbageCollectorSchedulerLeewayShare = 0.1;
 
 @interface SPTPersistentCacheGarbageCollector ()
-@property (nonatomic, strong) NSTimer *timer;
 @property (nonatomic, copy) SPTPersistentCacheOptions *options;
+@property (nonatomic, assign, readonly) uint64_t pressureBytes;
 @end
 
 
 @implementation SPTPersistentCacheGarbageCollector
+{
+    dispatch_queue_t _timerQueue;
+    // The following are guarded by synchronizing on self
+    dispatch_source_t _timer;
+    NSTimeInterval _currentInterval;
+    NSTimeInterval _lastRunTime;
+    // Churn since the last run
+    atomic_uint_fast64_t _storedBytes;
+    atomic_uint_fast64_t _expiredBytes;
+    // Kept open while this collector is the leader of the processes sharing the cache, guarded by synchronizing on self
+    int _leaderLockDescriptor;
+}
 
 #pragma mark - Initializer
 
@@ -28,23 +49,31 @@ static const NSTimeInterval SPTPersistentCacheGarbageCollectorSchedulerTimerTole
         _options = [options copy];
         _cache = cache;
         _queue = queue;
+        _timerQueue = dispatch_queue_create("com.spotify.persistent.cache.gc", DISPATCH_QUEUE_SERIAL);
+        _currentInterval = _options.garbageCollectionInterval;
+        _leaderLockDescriptor = -1;
+        _pressureBytes = (_options.sizeConstraintBytes > 0 ?
+                          _options.sizeConstraintBytes / 4 :
+                          SPTPersistentCacheGarbageCollectorDefaultPressureBytes);
     }
     return self;
 }
 
 - (void)dealloc
 {
-    /**
-     Intentionally Left Blank
-
-     Our timer should be invalidated by unscheduling this garbage collector
-     on the -dealloc method of the object owning the reference.
-     */
+    // The timer only references us weakly, so it can simply be stopped here
+    if (_timer != nil) {
+        dispatch_source_cancel(_timer);
+    }
+    // Closing the file releases the leadership to another process
+    if (_leaderLockDescriptor != -1) {
+        close(_leaderLockDescriptor);
+    }
 }
 
 #pragma mark -
 
-- (void)enqueueGarbageCollection:(NSTimer *)timer
+- (void)enqueueGarbageCollection
 {
     __weak __typeof(self) const weakSelf = self;
     NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
@@ -64,62 +93,164 @@ static const NSTimeInterval SPTPersistentCacheGarbageCollectorSchedulerTimerTole
     [self.queue addOperation:operation];
 }
 
-- (void)schedule
+- (void)timerDidFire
 {
-    if (!SPTPersistentCacheGarbageCollectorSchedulerIsInMainQueue()) {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self schedule];
-        });
-        
-        return;
+    @synchronized (self) {
+        // Unscheduled while the event was already on its way
+        if (_timer == nil) {
+            return;
+        }
+        _lastRunTime = [NSDate timeIntervalSinceReferenceDate];
+        [self adaptIntervalToChurn];
+        [self armTimerWithDelay:_currentInterval];
     }
-                       
-    SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"runGarbageCollector:%@", self.timer],
-                                        self.options.debugOutput);
-    
-    if (self.isGarbageCollectionScheduled) {
+
+    // Processes sharing the cache would otherwise all scan it
+    if (!self.isGarbageCollectionLeader) {
+        SPTPersistentCacheSafeDebugCallback(@"PersistentDataCache: Skipping garbage collection run by another process",
+                                            self.options.debugOutput);
         return;
     }
 
-    self.timer = [NSTimer timerWithTimeInterval:self.options.garbageCollectionInterval
-                                         target:self
-                                       selector:@selector(enqueueGarbageCollection:)
-                                       userInfo:nil
-                                        repeats:YES];
-    
-    self.timer.tolerance = SPTPersistentCacheGarbageCollectorSchedulerTimerTolerance;
-    
-    [[NSRunLoop mainRunLoop] addTimer:self.timer forMode:NSDefaultRunLoopMode];
+    [self enqueueGarbageCollection];
 }
 
-- (void)unschedule
+- (BOOL)isGarbageCollectionLeader
+{
+    if (!self.options.useMultiProcessCoordination) {
+        return YES;
+    }
+
+    @synchronized (self) {
+        if (_leaderLockDescriptor != -1) {
+            return YES;
+        }
+
+        NSString * const path = self.cache.dataCacheFileManager.garbageCollectionLeaderPath;
+        if (path == nil) {
+            return NO;
+        }
+        const int descriptor = open(path.fileSystemRepresentation, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (descriptor == -1) {
+            return NO;
+        }
+        // The lock is held until the file is closed, the system releases it if the process dies
+        if (flock(descriptor, LOCK_EX | LOCK_NB) == -1) {
+            close(descriptor);
+            return NO;
+        }
+        _leaderLockDescriptor = descriptor;
+        return YES;
+    }
+}
+
+- (void)schedule
 {
-    if (!SPTPersistentCacheGarbageCollectorSchedulerIsInMainQueue()) {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self unschedule];
+    SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"runGarbageCollector:%@", self],
+                                        self.options.debugOutput);
+
+    @synchronized (self) {
+        if (_timer != nil) {
+            return;
+        }
+
+        _lastRunTime = [NSDate timeIntervalSinceReferenceDate];
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _timerQueue);
+        __weak __typeof(self) const weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            [weakSelf timerDidFire];
         });
-        
-        return;
+        [self armTimerWithDelay:_currentInterval];
+        dispatch_resume(_timer);
     }
-    
-    SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"stopGarbageCollector:%@", self.timer],
+}
+
+- (void)unschedule
+{
+    SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"stopGarbageCollector:%@", self],
                                         self.options.debugOutput);
-    
-    [self.timer invalidate];
-    
-    self.timer = nil;
+
+    @synchronized (self) {
+        if (_timer != nil) {
+            dispatch_source_cancel(_timer);
+        }
+        _timer = nil;
+    }
 }
 
 - (BOOL)isGarbageCollectionScheduled
 {
-    return (self.timer != nil);
+    @synchronized (self) {
+        return (_timer != nil);
+    }
+}
+
+#pragma mark Adapting the Interval
+
+- (NSTimeInterval)currentInterval
+{
+    @synchronized (self) {
+        return _currentInterval;
+    }
+}
+
+- (void)recordStoredBytes:(uint64_t)bytes
+{
+    const uint64_t previousBytes = atomic_fetch_add(&_storedBytes, bytes);
+
+    // Only crossing the threshold brings the next run forward, so it happens at most once per run
+    if (previousBytes < self.pressureBytes && previousBytes + bytes >= self.pressureBytes) {
+        [self expediteGarbageCollection];
+    }
 }
-@end
 
-static BOOL SPTPersistentCacheGarbageCollectorSchedulerIsInMainQueue(void)
+- (void)recordExpiredBytes:(uint64_t)bytes
 {
-    NSString *currentQueueLabelString = [NSString stringWithUTF8String:dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL)];
-    NSString *mainQueueLabelString = [NSString stringWithUTF8String:dispatch_queue_get_label(dispatch_get_main_queue())];
-    return [currentQueueLabelString isEqualToString:mainQueueLabelString];
+    atomic_fetch_add(&_expiredBytes, bytes);
 }
 
+/**
+ Sets the interval for the next run from the churn since the last run and resets the churn.
+ */
+- (void)adaptIntervalToChurn
+{
+    const uint64_t churnBytes = atomic_exchange(&_storedBytes, 0) + atomic_exchange(&_expiredBytes, 0);
+    const NSTimeInterval baseInterval = self.options.garbageCollectionInterval;
+
+    @synchronized (self) {
+        if (churnBytes == 0) {
+            _currentInterval = MIN(_currentInterval * 2, baseInterval * SPTPersistentCacheGarbageCollectorMaxBackoffFactor);
+        } else if (churnBytes >= self.pressureBytes) {
+            _currentInterval = MAX(_currentInterval / 2, (NSTimeInterval)SPTPersistentCacheMinimumGCIntervalLimit);
+        } else {
+            _currentInterval = baseInterval;
+        }
+    }
+}
+
+/**
+ Moves the next run to the earliest time the minimum interval allows.
+ */
+- (void)expediteGarbageCollection
+{
+    @synchronized (self) {
+        if (_timer == nil) {
+            return;
+        }
+        const NSTimeInterval sinceLastRun = [NSDate timeIntervalSinceReferenceDate] - _lastRunTime;
+        [self armTimerWithDelay:MAX(0.0, (NSTimeInterval)SPTPersistentCacheMinimumGCIntervalLimit - sinceLastRun)];
+    }
+}
+
+/// Called with self synchronized and a timer
+- (void)armTimerWithDelay:(NSTimeInterval)delay
+{
+    const NSTimeInterval leeway = MIN(SPTPersistentCacheGarbageCollectorSchedulerTimerTolerance,
+                                      _currentInterval * SPTPersistentCacheGarbageCollectorSchedulerLeewayShare);
+    dispatch_source_set_timer(_timer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                              (uint64_t)(_currentInterval * NSEC_PER_SEC),
+                              (uint64_t)(leeway * NSEC_PER_SEC));
+}
+
+@end
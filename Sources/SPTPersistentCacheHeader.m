@@ -9,6 +9,7 @@
 
 const SPTPersistentCacheMagicType SPTPersistentCacheMagicValue = 0x46545053; // SPTF
 const size_t SPTPersistentCacheRecordHeaderSize = sizeof(SPTPersistentCacheRecordHeader);
+const size_t SPTPersistentCacheRecordAlignedHeaderSize = 4096;
 
 _Static_assert(sizeof(SPTPersistentCacheRecordHeader) == 64,
                "Struct SPTPersistentCacheRecordHeader has to be packed without padding");
@@ -74,8 +75,9 @@ int /*SPTPersistentCacheLoadingError*/ SPTPersistentCacheValidateHeader(const SP
         return SPTPersistentCacheLoadingErrorInvalidHeaderCRC;
     }
 
-    // 3. Check header size
-    if (header->headerSize != SPTPersistentCacheRecordHeaderSize) {
+    // 3. Check header size, the header of a large record is padded
+    if (header->headerSize != SPTPersistentCacheRecordHeaderSize &&
+        header->headerSize != SPTPersistentCacheRecordAlignedHeaderSize) {
         return SPTPersistentCacheLoadingErrorWrongHeaderSize;
     }
 
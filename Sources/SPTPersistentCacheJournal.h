@@ -0,0 +1,92 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The header of one batch of entries in a journal. It is followed by `length` bytes of `entryCount` entries, encoded by
+ the codec of the journal.
+ */
+typedef struct SPTPersistentCacheJournalBatchHeader {
+    uint32_t magic;         // tells the kinds of journals apart
+    uint32_t entryCount;
+    uint32_t length;        // bytes of entries following the header
+    uint32_t crc;           // spt_crc32 of the entries
+} SPTPersistentCacheJournalBatchHeader;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Encodes the entries of a journal and keeps the state they are applied to. An entry sets the value of one key.
+ */
+@protocol SPTPersistentCacheJournalCodec <NSObject>
+
+/**
+ Encodes entries, returns `nil` if one of them can’t be encoded.
+ */
+- (nullable NSData *)encodeEntries:(NSDictionary<NSString *, id> *)entries;
+
+/**
+ Decodes entryCount entries that take up exactly length bytes, returns `nil` if they are malformed.
+ */
+- (nullable NSDictionary<NSString *, id> *)decodeEntries:(const uint8_t *)bytes
+                                                  length:(size_t)length
+                                                   count:(uint32_t)entryCount;
+
+/**
+ Applies entries to the state, either replayed from the file or once they have been written.
+ */
+- (void)applyEntries:(NSDictionary<NSString *, id> *)entries;
+
+/**
+ Returns the entries recreating the current state, written in place of the file when it is compacted.
+ */
+- (NSDictionary<NSString *, id> *)snapshotEntries;
+
+@end
+
+/**
+ An append-only file of checksummed batches of entries, kept next to the records.
+ @discussion Changes are appended as one batch, so changing any number of keys costs one write. A batch torn by a
+ crash fails its checksum and is dropped when the journal is opened, together with everything after it. The file is
+ rewritten as a snapshot of the current state once it has grown large. This class isn’t threadsafe, its owner
+ serializes the calls and those into the codec.
+ */
+@interface SPTPersistentCacheJournal : NSObject
+
+/// Whether the file didn’t exist and was created by this instance.
+@property (nonatomic, assign, readonly, getter=isCreated) BOOL created;
+/// The size of the file.
+@property (nonatomic, assign, readonly) off_t fileSize;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Opens the journal at a path, creating it if needed, and replays it into the codec.
+
+ @param path The path of the journal file.
+ @param name What the journal is called in debug output, like "lock journal".
+ @param magic The magic number at the start of each batch.
+ @param synchronous Whether each batch is made durable with an fsync before it is applied.
+ @param codec The codec of the entries. It isn’t retained.
+ @param debugOutput Callback used to report errors.
+ @return A journal or `nil` if the file couldn’t be opened.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                                 name:(NSString *)name
+                                magic:(uint32_t)magic
+                          synchronous:(BOOL)synchronous
+                                codec:(id<SPTPersistentCacheJournalCodec>)codec
+                          debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Appends entries as one batch and applies them to the codec once they are written. Nothing is written for no entries.
+ @return YES if the entries were written.
+ */
+- (BOOL)commitEntries:(NSDictionary<NSString *, id> *)entries;
+
+@end
+
+NS_ASSUME_NONNULL_END
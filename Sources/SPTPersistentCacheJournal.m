@@ -0,0 +1,250 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheJournal.h"
+#import "SPTPersistentCacheDebugUtilities.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "crc32iso3309.h"
+
+// Size above which the file is rewritten as a snapshot of the current state
+static const off_t SPTPersistentCacheJournalCompactionSize = 256 * 1024;
+
+_Static_assert(sizeof(SPTPersistentCacheJournalBatchHeader) == 16,
+               "Struct SPTPersistentCacheJournalBatchHeader has to be packed without padding");
+
+static BOOL SPTPersistentCacheJournalWriteAll(int fd, NSData *data);
+
+@interface SPTPersistentCacheJournal ()
+@property (nonatomic, copy, readonly) NSString *path;
+@property (nonatomic, copy, readonly) NSString *name;
+@property (nonatomic, weak, readonly) id<SPTPersistentCacheJournalCodec> codec;
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
+@end
+
+@implementation SPTPersistentCacheJournal
+{
+    int _fd;
+    uint32_t _magic;
+    BOOL _synchronous;
+    off_t _compactionSize;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+                        name:(NSString *)name
+                       magic:(uint32_t)magic
+                 synchronous:(BOOL)synchronous
+                       codec:(id<SPTPersistentCacheJournalCodec>)codec
+                 debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _name = [name copy];
+        _magic = magic;
+        _synchronous = synchronous;
+        _codec = codec;
+        _debugOutput = [debugOutput copy];
+        _compactionSize = SPTPersistentCacheJournalCompactionSize;
+
+        const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+        _fd = open(path.fileSystemRepresentation, O_RDWR | O_APPEND | O_CREAT | O_EXCL, mode);
+        if (_fd != -1) {
+            _created = YES;
+        } else if (errno == EEXIST) {
+            _fd = open(path.fileSystemRepresentation, O_RDWR | O_APPEND);
+        }
+        if (_fd == -1) {
+            SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to open %@: %@, error: %@", name, path, @(strerror(errno))],
+                                                debugOutput);
+            return nil;
+        }
+
+        if (!_created) {
+            [self replay];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    // Initialization failed, nothing to close
+    if (_fd == -1) {
+        return;
+    }
+    close(_fd);
+}
+
+#pragma mark Journal File
+
+- (BOOL)commitEntries:(NSDictionary<NSString *, id> *)entries
+{
+    if (entries.count == 0) {
+        return YES;
+    }
+
+    NSData *batch = [self encodeBatchWithEntries:entries];
+    if (batch == nil) {
+        [self debugOutput:@"PersistentDataCache: Unable to encode %@ batch, a key or value is too long", self.name];
+        return NO;
+    }
+
+    if (!SPTPersistentCacheJournalWriteAll(_fd, batch) || (_synchronous && fsync(_fd) == -1)) {
+        const int errorNumber = errno;
+        // A partial batch would hide every batch appended after it on replay
+        ftruncate(_fd, _fileSize);
+        [self debugOutput:@"PersistentDataCache: Error writing %@: %@, error: %@", self.name, self.path, @(strerror(errorNumber))];
+        return NO;
+    }
+    _fileSize += (off_t)batch.length;
+
+    [self.codec applyEntries:entries];
+
+    if (_fileSize > _compactionSize) {
+        [self compact];
+    }
+    return YES;
+}
+
+- (void)replay
+{
+    NSError *error = nil;
+    NSData *data = [NSData dataWithContentsOfFile:self.path options:0 error:&error];
+    if (data == nil) {
+        [self debugOutput:@"PersistentDataCache: Unable to read %@: %@, error: %@", self.name, self.path, error];
+        return;
+    }
+
+    const uint8_t *bytes = data.bytes;
+    const size_t length = data.length;
+    size_t offset = 0;
+    while (length - offset >= sizeof(SPTPersistentCacheJournalBatchHeader)) {
+        SPTPersistentCacheJournalBatchHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        const size_t entriesOffset = offset + sizeof(header);
+
+        if (header.magic != _magic ||
+            header.length > length - entriesOffset ||
+            spt_crc32(bytes + entriesOffset, header.length) != header.crc) {
+            break;
+        }
+        NSDictionary<NSString *, id> *entries = [self.codec decodeEntries:bytes + entriesOffset
+                                                                   length:header.length
+                                                                    count:header.entryCount];
+        if (entries == nil) {
+            break;
+        }
+
+        [self.codec applyEntries:entries];
+        offset = entriesOffset + header.length;
+    }
+
+    // Whatever follows the last complete batch was torn by a crash
+    if (offset != length) {
+        [self debugOutput:@"PersistentDataCache: Dropping %@ bytes of torn %@: %@", @(length - offset), self.name, self.path];
+        ftruncate(_fd, (off_t)offset);
+    }
+    _fileSize = (off_t)offset;
+
+    if (_fileSize > _compactionSize) {
+        [self compact];
+    }
+}
+
+/// Replaces the file with a single batch of the current state
+- (void)compact
+{
+    NSString *tempPath = [self.path stringByAppendingString:@".tmp"];
+    NSData *snapshot = [self encodeBatchWithEntries:[self.codec snapshotEntries]];
+
+    const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    int fd = open(tempPath.fileSystemRepresentation, O_RDWR | O_APPEND | O_CREAT | O_TRUNC, mode);
+    if (fd == -1 ||
+        snapshot == nil ||
+        !SPTPersistentCacheJournalWriteAll(fd, snapshot) ||
+        fsync(fd) == -1 ||
+        rename(tempPath.fileSystemRepresentation, self.path.fileSystemRepresentation) == -1) {
+        [self debugOutput:@"PersistentDataCache: Unable to compact %@: %@, error: %@", self.name, self.path, @(strerror(errno))];
+        if (fd != -1) {
+            close(fd);
+            unlink(tempPath.fileSystemRepresentation);
+        }
+        // Don’t try again on every commit
+        _compactionSize = _fileSize * 2;
+        return;
+    }
+
+    // The descriptor of the snapshot now refers to the journal path
+    close(_fd);
+    _fd = fd;
+    _fileSize = (off_t)snapshot.length;
+    _compactionSize = MAX(SPTPersistentCacheJournalCompactionSize, _fileSize * 2);
+}
+
+- (nullable NSData *)encodeBatchWithEntries:(NSDictionary<NSString *, id> *)entries
+{
+    NSData *encodedEntries = [self.codec encodeEntries:entries];
+    if (encodedEntries == nil || encodedEntries.length > UINT32_MAX) {
+        return nil;
+    }
+
+    SPTPersistentCacheJournalBatchHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = _magic;
+    header.entryCount = (uint32_t)entries.count;
+    header.length = (uint32_t)encodedEntries.length;
+    header.crc = spt_crc32(encodedEntries.bytes, encodedEntries.length);
+
+    NSMutableData *batch = [NSMutableData dataWithCapacity:sizeof(header) + encodedEntries.length];
+    [batch appendBytes:&header length:sizeof(header)];
+    [batch appendData:encodedEntries];
+    return batch;
+}
+
+- (void)debugOutput:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2)
+{
+    va_list list;
+    va_start(list, format);
+    NSString * const message = [[NSString alloc] initWithFormat:format arguments:list];
+    va_end(list);
+
+    SPTPersistentCacheSafeDebugCallback(message, self.debugOutput);
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.path, @"path");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.path, @"path",
+                                               self.name, @"name",
+                                               @(self.fileSize), @"file-size");
+}
+
+@end
+
+static BOOL SPTPersistentCacheJournalWriteAll(int fd, NSData *data)
+{
+    const uint8_t *bytes = data.bytes;
+    size_t remaining = data.length;
+    while (remaining > 0) {
+        const ssize_t writtenBytes = write(fd, bytes, remaining);
+        if (writtenBytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes += writtenBytes;
+        remaining -= (size_t)writtenBytes;
+    }
+    return YES;
+}
@@ -0,0 +1,60 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ An in-memory counting Bloom filter of the keys present in the cache, used to answer definite misses without
+ touching the disk.
+ @discussion Until the filter has been populated from disk it reports every key as possibly present. Removals are
+ ignored while the filter is being populated, which can only make it overcount, i.e. return false positives. This
+ class is threadsafe.
+ */
+@interface SPTPersistentCacheKeyFilter : NSObject
+
+/// Whether the filter has been populated and can rule out keys.
+@property (nonatomic, assign, readonly, getter=isReady) BOOL ready;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a filter.
+ @param capacity The number of keys the filter is sized for. Above it the false positive rate grows.
+ @param falsePositiveRate The rate of absent keys reported as possibly present at capacity.
+ @return A filter or `nil` if the parameters are invalid or the memory couldn’t be allocated.
+ */
+- (nullable instancetype)initWithCapacity:(NSUInteger)capacity
+                        falsePositiveRate:(double)falsePositiveRate NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns NO if the key is definitely not in the cache.
+ */
+- (BOOL)mightContainKey:(NSString *)key;
+
+/**
+ Adds a key that is put on disk. Adding a key that is already present, e.g. when it is overwritten, only makes the
+ filter overcount.
+ */
+- (void)addKey:(NSString *)key;
+
+/**
+ Removes a key whose file was deleted.
+ */
+- (void)removeKey:(NSString *)key;
+
+/**
+ Clears the filter and marks it as not ready. Keys found on disk are then added with `addKey:`.
+ */
+- (void)beginPopulating;
+
+/**
+ Marks the filter as ready once all keys on disk have been added.
+ */
+- (void)finishPopulating;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,111 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheKeyFilter.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+#include <os/lock.h>
+#include "countingbloomfilter.h"
+#include "fnv1a.h"
+
+static uint64_t SPTPersistentCacheKeyFilterHash(NSString *key)
+{
+    const char *utf8Key = key.UTF8String;
+    return spt_fnv1a64((const uint8_t *)utf8Key, strlen(utf8Key));
+}
+
+@implementation SPTPersistentCacheKeyFilter
+{
+    spt_counting_bloom_filter *_filter;
+    os_unfair_lock _lock;
+    BOOL _ready;
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity falsePositiveRate:(double)falsePositiveRate
+{
+    self = [super init];
+    if (self) {
+        _filter = spt_counting_bloom_filter_create(capacity, falsePositiveRate);
+        if (_filter == NULL) {
+            return nil;
+        }
+        _lock = OS_UNFAIR_LOCK_INIT;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    spt_counting_bloom_filter_destroy(_filter);
+}
+
+- (BOOL)isReady
+{
+    os_unfair_lock_lock(&_lock);
+    const BOOL ready = _ready;
+    os_unfair_lock_unlock(&_lock);
+    return ready;
+}
+
+- (BOOL)mightContainKey:(NSString *)key
+{
+    const uint64_t hash = SPTPersistentCacheKeyFilterHash(key);
+
+    os_unfair_lock_lock(&_lock);
+    const BOOL mightContain = (!_ready || spt_counting_bloom_filter_might_contain(_filter, hash));
+    os_unfair_lock_unlock(&_lock);
+    return mightContain;
+}
+
+- (void)addKey:(NSString *)key
+{
+    const uint64_t hash = SPTPersistentCacheKeyFilterHash(key);
+
+    os_unfair_lock_lock(&_lock);
+    spt_counting_bloom_filter_add(_filter, hash);
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeKey:(NSString *)key
+{
+    const uint64_t hash = SPTPersistentCacheKeyFilterHash(key);
+
+    os_unfair_lock_lock(&_lock);
+    // While populating the key might not have been added yet, decrementing could create a false negative
+    if (_ready) {
+        spt_counting_bloom_filter_remove(_filter, hash);
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)beginPopulating
+{
+    os_unfair_lock_lock(&_lock);
+    _ready = NO;
+    spt_counting_bloom_filter_clear(_filter);
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)finishPopulating
+{
+    os_unfair_lock_lock(&_lock);
+    _ready = YES;
+    os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.isReady), @"ready");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.isReady), @"ready",
+                                               @(spt_counting_bloom_filter_counter_count(_filter)), @"counter-count",
+                                               @(spt_counting_bloom_filter_hash_count(_filter)), @"hash-count");
+}
+
+@end
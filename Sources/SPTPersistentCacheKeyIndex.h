@@ -0,0 +1,81 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheHeader.h>
+
+@class SPTPersistentCachePartitionTable;
+@class SPTPersistentCacheRecordMetadata;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ An in-memory index of the keys in the cache, sorted so keys sharing a prefix form one range, together with the
+ metadata of their records.
+ @discussion Until the index has been populated from disk it can’t answer queries. Keys removed while it is being
+ populated aren’t added back by the population. This class is threadsafe.
+ */
+@interface SPTPersistentCacheKeyIndex : NSObject
+
+/// Whether the index has been populated and holds every key on disk.
+@property (nonatomic, assign, readonly, getter=isReady) BOOL ready;
+/// The number of keys in the index.
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes an empty index.
+ @param partitionTable The partitions giving the expiration period of records without a TTL.
+ */
+- (instancetype)initWithPartitionTable:(SPTPersistentCachePartitionTable *)partitionTable NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns the metadata of the record for key, `nil` if the key isn’t in the index.
+ */
+- (nullable SPTPersistentCacheRecordMetadata *)metadataForKey:(NSString *)key;
+
+/**
+ Returns the metadata of all records whose key starts with prefix, in the order of their keys.
+ */
+- (NSArray<SPTPersistentCacheRecordMetadata *> *)metadataForKeysWithPrefix:(NSString *)prefix;
+
+/**
+ Returns the metadata of at most limit records whose key starts with prefix and sorts after key, in the order of their
+ keys. Passing the last key of one page as key returns the next one, so all matches can be walked page by page.
+ @param key The key to continue after, `nil` to start at the first match.
+ */
+- (NSArray<SPTPersistentCacheRecordMetadata *> *)metadataForKeysWithPrefix:(NSString *)prefix
+                                                                   afterKey:(nullable NSString *)key
+                                                                      limit:(NSUInteger)limit;
+
+/**
+ Adds a key or updates its metadata after its header was written.
+ */
+- (void)setMetadataWithHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key;
+
+/**
+ Removes a key whose file was deleted.
+ */
+- (void)removeKey:(NSString *)key;
+
+/**
+ Clears the index and marks it as not ready. Keys found on disk are then added with
+ `addPopulatedMetadataWithHeader:forKey:`.
+ */
+- (void)beginPopulating;
+
+/**
+ Adds a key found on disk unless it has been set or removed since populating began.
+ */
+- (void)addPopulatedMetadataWithHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key;
+
+/**
+ Marks the index as ready once all keys on disk have been added.
+ */
+- (void)finishPopulating;
+
+@end
+
+NS_ASSUME_NONNULL_END
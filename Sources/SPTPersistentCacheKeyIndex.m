@@ -0,0 +1,193 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheKeyIndex.h"
+#import "SPTPersistentCacheObjectDescription.h"
+#import "SPTPersistentCachePartitionTable.h"
+#import "SPTPersistentCacheRecordMetadata+Private.h"
+
+#include <os/lock.h>
+
+@implementation SPTPersistentCacheKeyIndex
+{
+    SPTPersistentCachePartitionTable *_partitionTable;
+    os_unfair_lock _lock;
+    // The following are guarded by _lock
+    // Not maintained while populating, it is sorted once when populating finishes
+    NSMutableArray<NSString *> *_sortedKeys;
+    NSMutableDictionary<NSString *, SPTPersistentCacheRecordMetadata *> *_metadata;
+    // Keys set or removed while populating, the population mustn’t overwrite them
+    NSMutableSet<NSString *> *_changedWhilePopulating;
+    BOOL _ready;
+}
+
+- (instancetype)initWithPartitionTable:(SPTPersistentCachePartitionTable *)partitionTable
+{
+    self = [super init];
+    if (self) {
+        _partitionTable = partitionTable;
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _sortedKeys = [NSMutableArray array];
+        _metadata = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (BOOL)isReady
+{
+    os_unfair_lock_lock(&_lock);
+    const BOOL ready = _ready;
+    os_unfair_lock_unlock(&_lock);
+    return ready;
+}
+
+- (NSUInteger)count
+{
+    os_unfair_lock_lock(&_lock);
+    const NSUInteger count = _metadata.count;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+#pragma mark Queries
+
+- (SPTPersistentCacheRecordMetadata *)metadataForKey:(NSString *)key
+{
+    os_unfair_lock_lock(&_lock);
+    SPTPersistentCacheRecordMetadata *metadata = _metadata[key];
+    os_unfair_lock_unlock(&_lock);
+    return metadata;
+}
+
+- (NSArray<SPTPersistentCacheRecordMetadata *> *)metadataForKeysWithPrefix:(NSString *)prefix
+{
+    return [self metadataForKeysWithPrefix:prefix afterKey:nil limit:NSUIntegerMax];
+}
+
+- (NSArray<SPTPersistentCacheRecordMetadata *> *)metadataForKeysWithPrefix:(NSString *)prefix
+                                                                   afterKey:(NSString *)key
+                                                                      limit:(NSUInteger)limit
+{
+    NSMutableArray<SPTPersistentCacheRecordMetadata *> *result = [NSMutableArray array];
+
+    os_unfair_lock_lock(&_lock);
+    NSUInteger index = [self insertionIndexOfKey:prefix];
+    // The key may have been removed since it was returned, the walk continues at the key following it either way
+    if (key != nil && [key compare:prefix options:NSLiteralSearch] != NSOrderedAscending) {
+        index = [self insertionIndexOfKey:key];
+        if (index < _sortedKeys.count && [_sortedKeys[index] isEqualToString:key]) {
+            ++index;
+        }
+    }
+    // Sorted by UTF-16 code units, like hasPrefix: compares, keys with the prefix follow it without gaps
+    for (; index < _sortedKeys.count && result.count < limit; ++index) {
+        NSString *sortedKey = _sortedKeys[index];
+        if (![sortedKey hasPrefix:prefix]) {
+            break;
+        }
+        [result addObject:_metadata[sortedKey]];
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    return result;
+}
+
+/// Called with _lock held
+- (NSUInteger)insertionIndexOfKey:(NSString *)key
+{
+    return [_sortedKeys indexOfObject:key
+                        inSortedRange:NSMakeRange(0, _sortedKeys.count)
+                              options:NSBinarySearchingInsertionIndex | NSBinarySearchingFirstEqual
+                      usingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+                          return [key1 compare:key2 options:NSLiteralSearch];
+                      }];
+}
+
+#pragma mark Changes
+
+- (void)setMetadataWithHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    SPTPersistentCacheRecordMetadata *metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:key
+                                                                                               header:header
+                                                                              defaultExpirationPeriod:[_partitionTable expirationPeriodForKey:key]];
+    os_unfair_lock_lock(&_lock);
+    [_changedWhilePopulating addObject:key];
+    [self setMetadata:metadata forKey:key];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeKey:(NSString *)key
+{
+    os_unfair_lock_lock(&_lock);
+    [_changedWhilePopulating addObject:key];
+    if (_metadata[key] != nil) {
+        [_metadata removeObjectForKey:key];
+        if (_changedWhilePopulating == nil) {
+            [_sortedKeys removeObjectAtIndex:[self insertionIndexOfKey:key]];
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+/// Called with _lock held
+- (void)setMetadata:(SPTPersistentCacheRecordMetadata *)metadata forKey:(NSString *)key
+{
+    // Inserting each key found on disk in order would be quadratic in the number of records
+    if (_metadata[key] == nil && _changedWhilePopulating == nil) {
+        [_sortedKeys insertObject:key atIndex:[self insertionIndexOfKey:key]];
+    }
+    _metadata[key] = metadata;
+}
+
+#pragma mark Populating
+
+- (void)beginPopulating
+{
+    os_unfair_lock_lock(&_lock);
+    _ready = NO;
+    [_sortedKeys removeAllObjects];
+    [_metadata removeAllObjects];
+    _changedWhilePopulating = [NSMutableSet set];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)addPopulatedMetadataWithHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    SPTPersistentCacheRecordMetadata *metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:key
+                                                                                               header:header
+                                                                              defaultExpirationPeriod:[_partitionTable expirationPeriodForKey:key]];
+    os_unfair_lock_lock(&_lock);
+    // The header may have been read before the record was removed or stored again
+    if (![_changedWhilePopulating containsObject:key]) {
+        [self setMetadata:metadata forKey:key];
+    }
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)finishPopulating
+{
+    os_unfair_lock_lock(&_lock);
+    [_sortedKeys setArray:_metadata.allKeys];
+    [_sortedKeys sortUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+        return [key1 compare:key2 options:NSLiteralSearch];
+    }];
+    _ready = YES;
+    _changedWhilePopulating = nil;
+    os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.isReady), @"ready");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.isReady), @"ready",
+                                               @(self.count), @"count");
+}
+
+@end
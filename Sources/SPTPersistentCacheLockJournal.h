@@ -0,0 +1,68 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The value of the magic number at the start of each batch in a lock journal. Each entry of a batch is an absolute
+ `uint32_t` refCount and a `uint16_t` key length followed by the UTF-8 key.
+ */
+extern const uint32_t SPTPersistentCacheLockJournalMagicValue;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A crash-safe side table of the refCounts of cache records.
+ @discussion Kept in an `SPTPersistentCacheJournal` whose batches are made durable with a single fsync, so locking or
+ unlocking any number of keys costs one write. This class is threadsafe.
+ */
+@interface SPTPersistentCacheLockJournal : NSObject
+
+/// Whether the journal file didn’t exist and was created by this instance.
+@property (nonatomic, assign, readonly, getter=isCreated) BOOL created;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Opens the journal at a path, creating it if needed, and replays it.
+
+ @param path The path of the journal file.
+ @param debugOutput Callback used to report errors.
+ @return A journal or `nil` if the file couldn’t be opened.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                          debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns the refCount of key, `0` if it isn’t in the journal.
+ */
+- (NSUInteger)refCountForKey:(NSString *)key;
+
+/**
+ Returns all non-zero refCounts by key.
+ */
+- (NSDictionary<NSString *, NSNumber *> *)allRefCounts;
+
+/**
+ Adds signed deltas to the refCounts of keys in one transaction. Counts never drop below `0`.
+ @return YES if the change was made durable.
+ */
+- (BOOL)applyRefCountDeltas:(NSDictionary<NSString *, NSNumber *> *)deltas;
+
+/**
+ Sets the refCounts of keys in one transaction. Keys whose count doesn’t change aren’t written.
+ @return YES if the change was made durable.
+ */
+- (BOOL)setRefCounts:(NSDictionary<NSString *, NSNumber *> *)refCounts;
+
+/**
+ Resets the refCount of every key except the given ones to `0` in one transaction.
+ @return YES if the change was made durable.
+ */
+- (BOOL)removeAllRefCountsExceptKeys:(NSSet<NSString *> *)keys;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,189 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheLockJournal.h"
+#import "SPTPersistentCacheJournal.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+const uint32_t SPTPersistentCacheLockJournalMagicValue = 0x4B4C5053; // SPLK
+
+@interface SPTPersistentCacheLockJournal () <SPTPersistentCacheJournalCodec>
+@property (nonatomic, copy, readonly) NSString *path;
+@end
+
+@implementation SPTPersistentCacheLockJournal
+{
+    SPTPersistentCacheJournal *_journal;
+    NSMutableDictionary<NSString *, NSNumber *> *_refCounts;
+}
+
+- (instancetype)initWithPath:(NSString *)path debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _refCounts = [NSMutableDictionary dictionary];
+        _journal = [[SPTPersistentCacheJournal alloc] initWithPath:path
+                                                              name:@"lock journal"
+                                                             magic:SPTPersistentCacheLockJournalMagicValue
+                                                       synchronous:YES
+                                                             codec:self
+                                                       debugOutput:debugOutput];
+        if (_journal == nil) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (BOOL)isCreated
+{
+    return _journal.isCreated;
+}
+
+#pragma mark Reading Counts
+
+- (NSUInteger)refCountForKey:(NSString *)key
+{
+    @synchronized (self) {
+        return _refCounts[key].unsignedIntegerValue;
+    }
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)allRefCounts
+{
+    @synchronized (self) {
+        return [_refCounts copy];
+    }
+}
+
+#pragma mark Changing Counts
+
+- (BOOL)applyRefCountDeltas:(NSDictionary<NSString *, NSNumber *> *)deltas
+{
+    @synchronized (self) {
+        NSMutableDictionary<NSString *, NSNumber *> *changes = [NSMutableDictionary dictionaryWithCapacity:deltas.count];
+        [deltas enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *delta, BOOL *stop) {
+            const long long current = (long long)self->_refCounts[key].unsignedIntegerValue;
+            const long long refCount = MIN(MAX(current + delta.longLongValue, 0LL), (long long)UINT32_MAX);
+            if (refCount != current) {
+                changes[key] = @(refCount);
+            }
+        }];
+        return [_journal commitEntries:changes];
+    }
+}
+
+- (BOOL)setRefCounts:(NSDictionary<NSString *, NSNumber *> *)refCounts
+{
+    @synchronized (self) {
+        NSMutableDictionary<NSString *, NSNumber *> *changes = [NSMutableDictionary dictionaryWithCapacity:refCounts.count];
+        [refCounts enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *refCount, BOOL *stop) {
+            if (self->_refCounts[key].unsignedIntegerValue != refCount.unsignedIntegerValue) {
+                changes[key] = refCount;
+            }
+        }];
+        return [_journal commitEntries:changes];
+    }
+}
+
+- (BOOL)removeAllRefCountsExceptKeys:(NSSet<NSString *> *)keys
+{
+    @synchronized (self) {
+        NSMutableDictionary<NSString *, NSNumber *> *changes = [NSMutableDictionary dictionary];
+        for (NSString *key in _refCounts) {
+            if (![keys containsObject:key]) {
+                changes[key] = @0;
+            }
+        }
+        return [_journal commitEntries:changes];
+    }
+}
+
+#pragma mark Journal Entries
+
+- (NSData *)encodeEntries:(NSDictionary<NSString *, NSNumber *> *)refCounts
+{
+    NSMutableData *entries = [NSMutableData data];
+    for (NSString *key in refCounts) {
+        const char *utf8Key = key.UTF8String;
+        const size_t keyLength = strlen(utf8Key);
+        if (keyLength > UINT16_MAX) {
+            return nil;
+        }
+        const uint32_t refCount = (uint32_t)MIN(refCounts[key].unsignedIntegerValue, (NSUInteger)UINT32_MAX);
+        const uint16_t encodedKeyLength = (uint16_t)keyLength;
+        [entries appendBytes:&refCount length:sizeof(refCount)];
+        [entries appendBytes:&encodedKeyLength length:sizeof(encodedKeyLength)];
+        [entries appendBytes:utf8Key length:keyLength];
+    }
+    return entries;
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)decodeEntries:(const uint8_t *)entries
+                                                 length:(size_t)length
+                                                  count:(uint32_t)entryCount
+{
+    NSMutableDictionary<NSString *, NSNumber *> *refCounts = [NSMutableDictionary dictionaryWithCapacity:entryCount];
+    size_t offset = 0;
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        uint32_t refCount = 0;
+        uint16_t keyLength = 0;
+        if (length - offset < sizeof(refCount) + sizeof(keyLength)) {
+            return nil;
+        }
+        memcpy(&refCount, entries + offset, sizeof(refCount));
+        offset += sizeof(refCount);
+        memcpy(&keyLength, entries + offset, sizeof(keyLength));
+        offset += sizeof(keyLength);
+        if (length - offset < keyLength) {
+            return nil;
+        }
+        NSString *key = [[NSString alloc] initWithBytes:entries + offset length:keyLength encoding:NSUTF8StringEncoding];
+        if (key == nil) {
+            return nil;
+        }
+        offset += keyLength;
+        refCounts[key] = @(refCount);
+    }
+    return (offset == length ? refCounts : nil);
+}
+
+- (void)applyEntries:(NSDictionary<NSString *, NSNumber *> *)changes
+{
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *refCount, BOOL *stop) {
+        if (refCount.unsignedIntegerValue == 0) {
+            [self->_refCounts removeObjectForKey:key];
+        } else {
+            self->_refCounts[key] = refCount;
+        }
+    }];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)snapshotEntries
+{
+    return [_refCounts copy];
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.path, @"path");
+}
+
+- (NSString *)debugDescription
+{
+    NSUInteger keyCount = 0;
+    off_t fileSize = 0;
+    @synchronized (self) {
+        keyCount = _refCounts.count;
+        fileSize = _journal.fileSize;
+    }
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.path, @"path",
+                                               @(keyCount), @"key-count",
+                                               @(fileSize), @"file-size");
+}
+
+@end
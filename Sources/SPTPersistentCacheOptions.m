@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
 #import "SPTPersistentCacheObjectDescription.h"
 #import "SPTPersistentCacheDebugUtilities.h"
 
@@ -10,6 +11,12 @@
 const NSUInteger SPTPersistentCacheDefaultExpirationTimeSec = 10 * 60;
 const NSUInteger SPTPersistentCacheDefaultGCIntervalSec = 6 * 60 + 3;
 static const NSUInteger SPTPersistentCacheDefaultCacheSizeInBytes = 0; // unbounded
+static const double SPTPersistentCacheDefaultMaintenanceConcurrencyShare = 0.25;
+static const double SPTPersistentCacheDefaultKeyFilterFalsePositiveRate = 0.01;
+static const NSUInteger SPTPersistentCacheDefaultDirectoryShardingFanOut = 256;
+static const NSUInteger SPTPersistentCacheMaximumDirectoryShardingDepth = 4;
+static const NSUInteger SPTPersistentCacheMinimumDirectoryShardingFanOut = 2;
+static const NSUInteger SPTPersistentCacheMaximumDirectoryShardingFanOut = 65536;
 
 const NSUInteger SPTPersistentCacheMinimumGCIntervalLimit = 60;
 const NSUInteger SPTPersistentCacheMinimumExpirationLimit = 60;
@@ -34,11 +41,18 @@ static NSUInteger SPTGuardedPropertyValue(NSUInteger proposedValue, NSUInteger m
         _cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"/com.spotify.temppersistent.image.cache"];
         _cacheIdentifier = @"persistent.cache";
         _useDirectorySeparation = YES;
+        _directoryShardingFanOut = SPTPersistentCacheDefaultDirectoryShardingFanOut;
 
         _garbageCollectionInterval = SPTPersistentCacheDefaultGCIntervalSec;
         _defaultExpirationPeriod = SPTPersistentCacheDefaultExpirationTimeSec;
         _sizeConstraintBytes = SPTPersistentCacheDefaultCacheSizeInBytes;
+        _partitions = @[];
+        _keyFilterFalsePositiveRate = SPTPersistentCacheDefaultKeyFilterFalsePositiveRate;
         _maxConcurrentOperations = NSOperationQueueDefaultMaxConcurrentOperationCount;
+        _maxConcurrentReadOperations = NSOperationQueueDefaultMaxConcurrentOperationCount;
+        _maxConcurrentWriteOperations = NSOperationQueueDefaultMaxConcurrentOperationCount;
+        _maintenanceConcurrencyShare = SPTPersistentCacheDefaultMaintenanceConcurrencyShare;
+        _minConcurrentOperations = 1;
         _writePriority = NSOperationQueuePriorityNormal;
         _writeQualityOfService = NSQualityOfServiceDefault;
         _readPriority = NSOperationQueuePriorityNormal;
@@ -63,6 +77,31 @@ static NSUInteger SPTGuardedPropertyValue(NSUInteger proposedValue, NSUInteger m
             (void *)self];
 }
 
+#pragma mark Directory Options
+
+- (void)setDirectoryShardingDepth:(NSUInteger)directoryShardingDepth
+{
+    _directoryShardingDepth = MIN(directoryShardingDepth, SPTPersistentCacheMaximumDirectoryShardingDepth);
+}
+
+- (void)setDirectoryShardingFanOut:(NSUInteger)directoryShardingFanOut
+{
+    _directoryShardingFanOut = MIN(MAX(directoryShardingFanOut, SPTPersistentCacheMinimumDirectoryShardingFanOut),
+                                   SPTPersistentCacheMaximumDirectoryShardingFanOut);
+}
+
+#pragma mark Priority Options
+
+- (void)setMaintenanceConcurrencyShare:(double)maintenanceConcurrencyShare
+{
+    _maintenanceConcurrencyShare = MIN(MAX(maintenanceConcurrencyShare, 0.0), 1.0);
+}
+
+- (void)setMinConcurrentOperations:(NSInteger)minConcurrentOperations
+{
+    _minConcurrentOperations = MAX(minConcurrentOperations, 1);
+}
+
 #pragma mark Garbage Collection Options
 
 - (void)setGarbageCollectionInterval:(NSUInteger)garbageCollectionInterval
@@ -96,15 +135,34 @@ static NSUInteger SPTGuardedPropertyValue(NSUInteger proposedValue, NSUInteger m
     copy.cacheIdentifier = self.cacheIdentifier;
     copy.cachePath = self.cachePath;
     copy.useDirectorySeparation = self.useDirectorySeparation;
+    copy.directoryShardingDepth = self.directoryShardingDepth;
+    copy.directoryShardingFanOut = self.directoryShardingFanOut;
 
     copy.garbageCollectionInterval = self.garbageCollectionInterval;
     copy.defaultExpirationPeriod = self.defaultExpirationPeriod;
     copy.sizeConstraintBytes = self.sizeConstraintBytes;
+    copy.partitions = [[NSArray alloc] initWithArray:self.partitions copyItems:YES];
+    copy.keyFilterCapacity = self.keyFilterCapacity;
+    copy.keyFilterFalsePositiveRate = self.keyFilterFalsePositiveRate;
+    copy.useKeyIndex = self.useKeyIndex;
+    copy.useLockJournal = self.useLockJournal;
+    copy.useMultiProcessCoordination = self.useMultiProcessCoordination;
+    copy.accessHistoryCapacity = self.accessHistoryCapacity;
+    copy.useTagIndex = self.useTagIndex;
+    copy.deduplicationThresholdBytes = self.deduplicationThresholdBytes;
+    copy.largeRecordThresholdBytes = self.largeRecordThresholdBytes;
 
     copy.debugOutput = self.debugOutput;
     copy.timingCallback = self.timingCallback;
+    copy.concurrencyCallback = self.concurrencyCallback;
+    copy.traceFilePath = self.traceFilePath;
 
     copy.maxConcurrentOperations = self.maxConcurrentOperations;
+    copy.maxConcurrentReadOperations = self.maxConcurrentReadOperations;
+    copy.maxConcurrentWriteOperations = self.maxConcurrentWriteOperations;
+    copy.maintenanceConcurrencyShare = self.maintenanceConcurrencyShare;
+    copy.useAdaptiveConcurrency = self.useAdaptiveConcurrency;
+    copy.minConcurrentOperations = self.minConcurrentOperations;
     copy.writePriority = self.writePriority;
     copy.writeQualityOfService = self.writeQualityOfService;
     copy.readPriority = self.readPriority;
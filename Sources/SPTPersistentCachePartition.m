@@ -0,0 +1,68 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import "SPTPersistentCacheObjectDescription.h"
+
+static const double SPTPersistentCachePartitionDefaultEvictionWeight = 1.0;
+
+@implementation SPTPersistentCachePartition
+
+#pragma mark Object Life Cycle
+
+- (instancetype)initWithName:(NSString *)name keyPrefix:(NSString *)keyPrefix
+{
+    self = [super init];
+    if (self) {
+        _name = [name copy];
+        _keyPrefix = [keyPrefix copy];
+        _evictionWeight = SPTPersistentCachePartitionDefaultEvictionWeight;
+    }
+    return self;
+}
+
+#pragma mark Partition Options
+
+- (void)setDefaultExpirationPeriod:(NSUInteger)defaultExpirationPeriod
+{
+    _defaultExpirationPeriod = (defaultExpirationPeriod > 0 ?
+                                MAX(defaultExpirationPeriod, SPTPersistentCacheMinimumExpirationLimit) :
+                                0);
+}
+
+- (void)setEvictionWeight:(double)evictionWeight
+{
+    _evictionWeight = MAX(evictionWeight, 0.0);
+}
+
+#pragma mark NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    SPTPersistentCachePartition * const copy = [(SPTPersistentCachePartition *)[self.class allocWithZone:zone] initWithName:self.name
+                                                                                                                  keyPrefix:self.keyPrefix];
+    copy.sizeConstraintBytes = self.sizeConstraintBytes;
+    copy.defaultExpirationPeriod = self.defaultExpirationPeriod;
+    copy.evictionWeight = self.evictionWeight;
+    return copy;
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.name, @"name");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.name, @"name",
+                                               self.keyPrefix, @"key-prefix",
+                                               @(self.sizeConstraintBytes), @"size-constraint-bytes",
+                                               @(self.defaultExpirationPeriod), @"default-expiration-period",
+                                               @(self.evictionWeight), @"eviction-weight");
+}
+
+@end
@@ -0,0 +1,45 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+@class SPTPersistentCacheOptions;
+@class SPTPersistentCachePartition;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Maps keys to the partitions configured in the cache options.
+ @discussion Keys that match no configured partition belong to a default partition with an empty key prefix, the
+ `defaultExpirationPeriod` of the options and weight `1.0`, unless a partition with an empty prefix is configured.
+ This class is immutable and therefore threadsafe.
+ */
+@interface SPTPersistentCachePartitionTable : NSObject
+
+/// All partitions including the default one, longest key prefix first.
+@property (nonatomic, copy, readonly) NSArray<SPTPersistentCachePartition *> *partitions;
+/// Whether any partition constrains its own size.
+@property (nonatomic, assign, readonly) BOOL hasSizeConstrainedPartitions;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+- (instancetype)initWithOptions:(SPTPersistentCacheOptions *)options NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns the partition with the longest key prefix key starts with.
+ */
+- (SPTPersistentCachePartition *)partitionForKey:(NSString *)key;
+/**
+ Returns the index in `partitions` of the partition for key.
+ */
+- (NSUInteger)indexOfPartitionForKey:(NSString *)key;
+
+/**
+ Returns the time period after which a record for key stored without a TTL expires.
+ */
+- (NSUInteger)expirationPeriodForKey:(NSString *)key;
+
+@end
+
+NS_ASSUME_NONNULL_END
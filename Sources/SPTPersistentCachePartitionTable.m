@@ -0,0 +1,85 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCachePartitionTable.h"
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
+#import "SPTPersistentCacheObjectDescription.h"
+
+static NSString * const SPTPersistentCachePartitionTableDefaultPartitionName = @"default";
+
+@implementation SPTPersistentCachePartitionTable
+{
+    NSUInteger _defaultExpirationPeriod;
+}
+
+- (instancetype)initWithOptions:(SPTPersistentCacheOptions *)options
+{
+    self = [super init];
+    if (self) {
+        _defaultExpirationPeriod = options.defaultExpirationPeriod;
+
+        NSMutableArray<SPTPersistentCachePartition *> *partitions = [NSMutableArray arrayWithCapacity:options.partitions.count + 1];
+        BOOL hasDefaultPartition = NO;
+        for (SPTPersistentCachePartition *partition in options.partitions) {
+            [partitions addObject:[partition copy]];
+            hasDefaultPartition = hasDefaultPartition || partition.keyPrefix.length == 0;
+            _hasSizeConstrainedPartitions = _hasSizeConstrainedPartitions || partition.sizeConstraintBytes > 0;
+        }
+        if (!hasDefaultPartition) {
+            [partitions addObject:[[SPTPersistentCachePartition alloc] initWithName:SPTPersistentCachePartitionTableDefaultPartitionName
+                                                                          keyPrefix:@""]];
+        }
+
+        // The first match is then the longest one
+        [partitions sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(SPTPersistentCachePartition *partition1, SPTPersistentCachePartition *partition2) {
+            if (partition1.keyPrefix.length == partition2.keyPrefix.length) {
+                return NSOrderedSame;
+            }
+            return (partition1.keyPrefix.length > partition2.keyPrefix.length ? NSOrderedAscending : NSOrderedDescending);
+        }];
+        _partitions = [partitions copy];
+    }
+    return self;
+}
+
+- (SPTPersistentCachePartition *)partitionForKey:(NSString *)key
+{
+    return self.partitions[[self indexOfPartitionForKey:key]];
+}
+
+- (NSUInteger)indexOfPartitionForKey:(NSString *)key
+{
+    NSArray<SPTPersistentCachePartition *> * const partitions = self.partitions;
+    for (NSUInteger index = 0; index < partitions.count; ++index) {
+        NSString * const keyPrefix = partitions[index].keyPrefix;
+        // An empty string isn’t a prefix of anything according to `hasPrefix:`
+        if (keyPrefix.length == 0 || [key hasPrefix:keyPrefix]) {
+            return index;
+        }
+    }
+    return partitions.count - 1;
+}
+
+- (NSUInteger)expirationPeriodForKey:(NSString *)key
+{
+    // Most caches have only the default partition
+    if (self.partitions.count == 1) {
+        return _defaultExpirationPeriod;
+    }
+    return [self partitionForKey:key].defaultExpirationPeriod ?: _defaultExpirationPeriod;
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.partitions.count), @"partition-count");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self, self.partitions.debugDescription, @"partitions");
+}
+
+@end
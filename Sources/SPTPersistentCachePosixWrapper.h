@@ -5,6 +5,18 @@
 
 #include <sys/stat.h>
 
+/**
+ One read of a batch performed by `readBatch:count:`.
+ */
+typedef struct SPTPersistentCachePosixReadRequest {
+    int descriptor;
+    void *buffer;
+    size_t bufferSize;
+    off_t offset;
+    ssize_t result;     // bytes read or -1, set by the batch
+    int error;          // errno of a failed read, set by the batch
+} SPTPersistentCachePosixReadRequest;
+
 /**
  An Obj-C wrapper for POSIX functions mainly made for mocking functions during unit tests.
  */
@@ -47,5 +59,34 @@
  @param statStruct The structure to store the file stats in.
  */
 - (int)stat:(const char *)path statStruct:(struct stat *)statStruct;
+/**
+ See POSIX "flock"
+ @param descriptor The file descriptor to lock or unlock.
+ @param operation The lock operation, e.g. `LOCK_EX`.
+ */
+- (int)flock:(int)descriptor operation:(int)operation;
+/**
+ See "fcntl" with `F_RDADVISE`, or POSIX "posix_fadvise" with `POSIX_FADV_WILLNEED` where that isn’t available
+ @discussion Asks the system to start reading a range of the file into its page cache, without waiting for it.
+ @param descriptor The file descriptor to read ahead.
+ @param offset The offset of the range in bytes.
+ @param length The length of the range in bytes.
+ */
+- (int)adviseWillNeed:(int)descriptor offset:(off_t)offset length:(off_t)length;
+/**
+ See "fcntl" with `F_NOCACHE`, or POSIX "posix_fadvise" with `POSIX_FADV_DONTNEED` where that isn’t available
+ @discussion Keeps the data read and written through the descriptor out of the page cache of the system. Where the
+ cache can’t be bypassed the pages of the file cached so far are dropped instead, so it is called again once done.
+ @param descriptor The file descriptor to bypass the page cache with.
+ */
+- (int)adviseNoCache:(int)descriptor;
+/**
+ See POSIX "lio_listio"
+ @discussion The reads are submitted to the system together and waited for, so a batch costs one system call
+ instead of one per read. Reads the system can’t queue are performed with "pread" instead.
+ @param requests The reads to perform. Their results are set when the method returns.
+ @param count The number of reads.
+ */
+- (void)readBatch:(SPTPersistentCachePosixReadRequest *)requests count:(size_t)count;
 
 @end
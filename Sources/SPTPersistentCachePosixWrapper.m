@@ -3,6 +3,32 @@
 
 #import "SPTPersistentCachePosixWrapper.h"
 
+#include <aio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// Upper bound of the reads submitted at once, the system may allow fewer
+enum { SPTPersistentCachePosixWrapperMaxListIOCount = 64 };
+
+static long SPTPersistentCachePosixWrapperListIOCount(void)
+{
+    static long count;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        const long systemCount = sysconf(_SC_AIO_LISTIO_MAX);
+        count = (systemCount > 0 ? MIN(systemCount, (long)SPTPersistentCachePosixWrapperMaxListIOCount) : 0);
+    });
+    return count;
+}
+
+static void SPTPersistentCachePosixWrapperRead(SPTPersistentCachePosixReadRequest *request)
+{
+    request->result = pread(request->descriptor, request->buffer, request->bufferSize, request->offset);
+    request->error = (request->result == -1 ? errno : 0);
+}
+
 @implementation SPTPersistentCachePosixWrapper
 
 - (int)close:(int)descriptor
@@ -35,4 +61,89 @@
     return stat(path, statStruct);
 }
 
+- (int)flock:(int)descriptor operation:(int)operation
+{
+    return flock(descriptor, operation);
+}
+
+- (int)adviseWillNeed:(int)descriptor offset:(off_t)offset length:(off_t)length
+{
+#if defined(F_RDADVISE)
+    struct radvisory advisory = { .ra_offset = offset, .ra_count = (int)MIN(length, (off_t)INT_MAX) };
+    return fcntl(descriptor, F_RDADVISE, &advisory);
+#else
+    // Returns the error number instead of setting errno
+    const int errorNumber = posix_fadvise(descriptor, offset, length, POSIX_FADV_WILLNEED);
+    if (errorNumber != 0) {
+        errno = errorNumber;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+- (int)adviseNoCache:(int)descriptor
+{
+#if defined(F_NOCACHE)
+    return fcntl(descriptor, F_NOCACHE, 1);
+#else
+    // Returns the error number instead of setting errno
+    const int errorNumber = posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+    if (errorNumber != 0) {
+        errno = errorNumber;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+- (void)readBatch:(SPTPersistentCachePosixReadRequest *)requests count:(size_t)count
+{
+    const size_t listCount = (size_t)SPTPersistentCachePosixWrapperListIOCount();
+    if (listCount == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            SPTPersistentCachePosixWrapperRead(&requests[i]);
+        }
+        return;
+    }
+
+    struct aiocb controlBlocks[SPTPersistentCachePosixWrapperMaxListIOCount];
+    struct aiocb *list[SPTPersistentCachePosixWrapperMaxListIOCount];
+
+    for (size_t start = 0; start < count; start += listCount) {
+        const size_t chunkCount = MIN(listCount, count - start);
+        memset(controlBlocks, 0, sizeof(controlBlocks));
+        for (size_t i = 0; i < chunkCount; ++i) {
+            const SPTPersistentCachePosixReadRequest *request = &requests[start + i];
+            controlBlocks[i].aio_fildes = request->descriptor;
+            controlBlocks[i].aio_buf = request->buffer;
+            controlBlocks[i].aio_nbytes = request->bufferSize;
+            controlBlocks[i].aio_offset = request->offset;
+            controlBlocks[i].aio_lio_opcode = LIO_READ;
+            list[i] = &controlBlocks[i];
+        }
+
+        // Failing as a whole only means some reads weren’t performed, each one is checked below
+        lio_listio(LIO_WAIT, list, (int)chunkCount, NULL);
+
+        for (size_t i = 0; i < chunkCount; ++i) {
+            SPTPersistentCachePosixReadRequest *request = &requests[start + i];
+            int error = aio_error(&controlBlocks[i]);
+            while (error == EINPROGRESS) {
+                const struct aiocb *pending[1] = { &controlBlocks[i] };
+                aio_suspend(pending, 1, NULL);
+                error = aio_error(&controlBlocks[i]);
+            }
+            // Also releases the resources of the read
+            const ssize_t result = aio_return(&controlBlocks[i]);
+            if (error == 0) {
+                request->result = result;
+                request->error = 0;
+            } else {
+                SPTPersistentCachePosixWrapperRead(request);
+            }
+        }
+    }
+}
+
 @end
@@ -0,0 +1,33 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheRecordMetadata.h>
+#import <SPTPersistentCache/SPTPersistentCacheHeader.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SPTPersistentCacheRecordMetadata (Private)
+
+- (instancetype)initWithKey:(NSString *)key
+                   refCount:(NSUInteger)refCount
+                        ttl:(NSUInteger)ttl
+                payloadSize:(uint64_t)payloadSize
+                 updateTime:(NSTimeInterval)updateTime
+             expirationTime:(NSTimeInterval)expirationTime;
+
+/**
+ Creates the metadata of a record from its header.
+ @param defaultExpirationPeriod The expiration period of records without a TTL.
+ */
+- (instancetype)initWithKey:(NSString *)key
+                     header:(const SPTPersistentCacheRecordHeader *)header
+    defaultExpirationPeriod:(NSUInteger)defaultExpirationPeriod;
+
+/**
+ Returns the metadata with another refCount, e.g. the one from the lock journal.
+ */
+- (SPTPersistentCacheRecordMetadata *)metadataWithRefCount:(NSUInteger)refCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,73 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheRecordMetadata+Private.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+@implementation SPTPersistentCacheRecordMetadata
+
+#pragma mark SPTPersistentCacheRecordMetadata
+
+- (instancetype)initWithKey:(NSString *)key
+                   refCount:(NSUInteger)refCount
+                        ttl:(NSUInteger)ttl
+                payloadSize:(uint64_t)payloadSize
+                 updateTime:(NSTimeInterval)updateTime
+             expirationTime:(NSTimeInterval)expirationTime
+{
+    self = [super init];
+    if (self) {
+        _key = [key copy];
+        _refCount = refCount;
+        _ttl = ttl;
+        _payloadSize = payloadSize;
+        _updateTime = updateTime;
+        _expirationTime = expirationTime;
+    }
+    return self;
+}
+
+- (instancetype)initWithKey:(NSString *)key
+                     header:(const SPTPersistentCacheRecordHeader *)header
+    defaultExpirationPeriod:(NSUInteger)defaultExpirationPeriod
+{
+    const uint64_t expirationPeriod = (header->ttl > 0 ? header->ttl : defaultExpirationPeriod);
+    return [self initWithKey:key
+                    refCount:header->refCount
+                         ttl:(NSUInteger)header->ttl
+                 payloadSize:header->payloadSizeBytes
+                  updateTime:header->updateTimeSec
+              expirationTime:(NSTimeInterval)(header->updateTimeSec + expirationPeriod)];
+}
+
+- (SPTPersistentCacheRecordMetadata *)metadataWithRefCount:(NSUInteger)refCount
+{
+    if (refCount == self.refCount) {
+        return self;
+    }
+    return [[SPTPersistentCacheRecordMetadata alloc] initWithKey:self.key
+                                                        refCount:refCount
+                                                             ttl:self.ttl
+                                                     payloadSize:self.payloadSize
+                                                      updateTime:self.updateTime
+                                                  expirationTime:self.expirationTime];
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.key, @"key");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.key, @"key",
+                                               @(self.ttl), @"ttl",
+                                               @(self.refCount), @"ref-count",
+                                               @(self.payloadSize), @"payload-size",
+                                               @(self.updateTime), @"update-time");
+}
+
+@end
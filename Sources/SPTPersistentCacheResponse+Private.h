@@ -11,4 +11,9 @@ extern NSString *NSStringFromSPTPersistentCacheResponseCode(SPTPersistentCacheRe
                          error:(NSError *)error
                         record:(SPTPersistentCacheRecord *)record;
 
+- (instancetype)initWithResult:(SPTPersistentCacheResponseCode)result
+                         error:(NSError *)error
+                        record:(SPTPersistentCacheRecord *)record
+                         stale:(BOOL)stale;
+
 @end
@@ -11,6 +11,7 @@
 @property (nonatomic, assign, readwrite) SPTPersistentCacheResponseCode result;
 @property (nonatomic, strong, readwrite) NSError *error;
 @property (nonatomic, strong, readwrite) SPTPersistentCacheRecord *record;
+@property (nonatomic, assign, readwrite, getter=isStale) BOOL stale;
 
 @end
 
@@ -19,12 +20,21 @@
 - (instancetype)initWithResult:(SPTPersistentCacheResponseCode)result
                          error:(NSError *)error
                         record:(SPTPersistentCacheRecord *)record
+{
+    return [self initWithResult:result error:error record:record stale:NO];
+}
+
+- (instancetype)initWithResult:(SPTPersistentCacheResponseCode)result
+                         error:(NSError *)error
+                        record:(SPTPersistentCacheRecord *)record
+                         stale:(BOOL)stale
 {
     self = [super init];
     if (self) {
         _result = result;
         _error = error;
         _record = record;
+        _stale = stale;
     }
     return self;
 }
@@ -50,6 +60,7 @@ NSString *NSStringFromSPTPersistentCacheResponseCode(SPTPersistentCacheResponseC
     return SPTPersistentCacheObjectDescription(self,
                                                NSStringFromSPTPersistentCacheResponseCode(self.result), @"result",
                                                self.record.debugDescription, @"record",
+                                               @(self.isStale), @"stale",
                                                self.error.debugDescription, @"error");
 }
 
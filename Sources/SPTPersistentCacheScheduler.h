@@ -0,0 +1,101 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+@class SPTPersistentCacheOptions;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The lanes the cache work is scheduled on. Each lane has its own concurrency budget.
+ */
+typedef NS_ENUM(NSUInteger, SPTPersistentCacheSchedulerLane) {
+    /// Foreground loads.
+    SPTPersistentCacheSchedulerLaneRead,
+    /// Foreground stores, touches, locks, unlocks and removes.
+    SPTPersistentCacheSchedulerLaneWrite,
+    /// Garbage collection, pruning and wiping.
+    SPTPersistentCacheSchedulerLaneMaintenance
+};
+
+/**
+ Interval after which a queued operation that hasn’t started is raised one queue priority step.
+ */
+extern const NSTimeInterval SPTPersistentCacheSchedulerAgingInterval;
+/**
+ The longest time a maintenance slice waits for foreground work to drain before it continues anyway.
+ */
+extern const NSTimeInterval SPTPersistentCacheSchedulerMaintenanceMaxYield;
+
+/**
+ Runs the cache work on separate queues for reads, writes and maintenance.
+ @discussion Reads and writes never wait behind a long garbage collection or wipe, since maintenance runs on its own
+ queue which is capped to a share of the configured I/O concurrency. Reads and writes split the rest, so the lanes
+ together stay within it, except that each lane gets at least one operation at a time. Maintenance work calls
+ `yieldToForegroundWork` between slices to let pending foreground work go first. Queued operations are aged so low
+ priority work can’t be starved forever by a stream of higher priority work, all of them by one timer that only runs
+ while operations are queued. With `useAdaptiveConcurrency` the widths of the read
+ and write lanes follow the latency of their operations, see `SPTPersistentCacheConcurrencyController`.
+ */
+@interface SPTPersistentCacheScheduler : NSObject
+
+/// Queue running `SPTPersistentCacheSchedulerLaneRead` operations.
+@property (nonatomic, strong, readonly) NSOperationQueue *readQueue;
+/// Queue running `SPTPersistentCacheSchedulerLaneWrite` operations.
+@property (nonatomic, strong, readonly) NSOperationQueue *writeQueue;
+/// Queue running `SPTPersistentCacheSchedulerLaneMaintenance` operations.
+@property (nonatomic, strong, readonly) NSOperationQueue *maintenanceQueue;
+
+/// Suspends or resumes all lanes.
+@property (nonatomic, assign, getter=isSuspended) BOOL suspended;
+/// Whether any foreground operation is queued or running.
+@property (nonatomic, assign, readonly) BOOL hasForegroundWork;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a scheduler with the concurrency budgets of the given options.
+ @param options The options to read the concurrency budgets and queue name from.
+ */
+- (instancetype)initWithOptions:(SPTPersistentCacheOptions *)options NS_DESIGNATED_INITIALIZER;
+
+/**
+ Enqueues an operation on a lane.
+ @param operation The operation to run.
+ @param lane The lane to run the operation on.
+ */
+- (void)addOperation:(NSOperation *)operation lane:(SPTPersistentCacheSchedulerLane)lane;
+
+/**
+ Wraps a block so the time it takes to run is fed to adaptive concurrency, when `useAdaptiveConcurrency` is set in
+ the options and the lane is a foreground one.
+ @param block The block of an operation for the lane.
+ @param lane The lane the operation will be added to.
+ @return A block to create the operation with, block itself if its latency isn’t measured.
+ */
+- (dispatch_block_t)blockMeasuringLatencyOfBlock:(dispatch_block_t)block lane:(SPTPersistentCacheSchedulerLane)lane;
+
+/**
+ Runs a block on the calling thread as work of a foreground lane. Maintenance yields to it as to a queued operation,
+ and its latency is fed to adaptive concurrency like the one of an operation.
+ @param block The work to run.
+ @param lane The foreground lane the work belongs to.
+ */
+- (void)performForegroundBlock:(dispatch_block_t)block lane:(SPTPersistentCacheSchedulerLane)lane;
+
+/**
+ Blocks until no foreground operation is queued or running, or `SPTPersistentCacheSchedulerMaintenanceMaxYield`
+ has passed. Called by maintenance work between slices.
+ */
+- (void)yieldToForegroundWork;
+
+/**
+ Blocks until all lanes are empty.
+ */
+- (void)waitUntilAllOperationsAreFinished;
+
+@end
+
+NS_ASSUME_NONNULL_END
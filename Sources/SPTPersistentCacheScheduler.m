@@ -0,0 +1,322 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheScheduler.h"
+
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import "SPTPersistentCacheObjectDescription.h"
+#import "SPTPersistentCacheConcurrencyController.h"
+
+const NSTimeInterval SPTPersistentCacheSchedulerAgingInterval = 0.5;
+const NSTimeInterval SPTPersistentCacheSchedulerMaintenanceMaxYield = 0.5;
+
+static const NSInteger SPTPersistentCacheSchedulerPriorityStep = NSOperationQueuePriorityHigh - NSOperationQueuePriorityNormal;
+
+static void SPTPersistentCacheSchedulerSplitForegroundWidth(NSInteger foregroundWidth,
+                                                            NSInteger proposedReadWidth,
+                                                            NSInteger proposedWriteWidth,
+                                                            NSInteger *readWidth,
+                                                            NSInteger *writeWidth);
+
+@implementation SPTPersistentCacheScheduler
+{
+    SPTPersistentCacheConcurrencyController *_readConcurrencyController;
+    SPTPersistentCacheConcurrencyController *_writeConcurrencyController;
+    dispatch_queue_t _agingQueue;
+    // Ages all queued operations, runs only while there are any. Both only touched on the aging queue.
+    dispatch_source_t _agingTimer;
+    BOOL _agingTimerRunning;
+    // Queued operations that can still be aged, mapped to the system uptime they were queued or last aged at
+    NSMapTable<NSOperation *, NSNumber *> *_agingOperations;
+    NSCondition *_foregroundCondition;
+    NSUInteger _foregroundOperationCount;
+}
+
+- (instancetype)initWithOptions:(SPTPersistentCacheOptions *)options
+{
+    self = [super init];
+    if (self) {
+        // The budget the maintenance share applies to, the system decides the width if it isn’t configured
+        const NSInteger totalWidth = (options.maxConcurrentOperations > 0 ?
+                                      options.maxConcurrentOperations :
+                                      (NSInteger)[NSProcessInfo processInfo].activeProcessorCount);
+        // Never less than one, otherwise maintenance would never run
+        const NSInteger maintenanceWidth = MAX(1, (NSInteger)floor(totalWidth * options.maintenanceConcurrencyShare));
+        // Reads and writes split the rest, so the lanes together stay within the budget
+        NSInteger readWidth = 0;
+        NSInteger writeWidth = 0;
+        SPTPersistentCacheSchedulerSplitForegroundWidth(MAX(1, totalWidth - maintenanceWidth),
+                                                        options.maxConcurrentReadOperations,
+                                                        options.maxConcurrentWriteOperations,
+                                                        &readWidth,
+                                                        &writeWidth);
+
+        NSString * const queueName = options.identifierForQueue;
+
+        _readQueue = [NSOperationQueue new];
+        _readQueue.name = [queueName stringByAppendingString:@".read"];
+        _readQueue.maxConcurrentOperationCount = readWidth;
+
+        _writeQueue = [NSOperationQueue new];
+        _writeQueue.name = [queueName stringByAppendingString:@".write"];
+        _writeQueue.maxConcurrentOperationCount = writeWidth;
+
+        _maintenanceQueue = [NSOperationQueue new];
+        _maintenanceQueue.name = [queueName stringByAppendingString:@".maintenance"];
+        _maintenanceQueue.maxConcurrentOperationCount = maintenanceWidth;
+
+        if (options.useAdaptiveConcurrency) {
+            // The configured widths become the upper bounds
+            _readConcurrencyController = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:_readQueue
+                                                                                           minimumWidth:options.minConcurrentOperations
+                                                                                           maximumWidth:readWidth
+                                                                                               callback:options.concurrencyCallback];
+            _writeConcurrencyController = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:_writeQueue
+                                                                                            minimumWidth:options.minConcurrentOperations
+                                                                                            maximumWidth:writeWidth
+                                                                                                callback:options.concurrencyCallback];
+        }
+
+        _agingQueue = dispatch_queue_create("com.spotify.persistent.cache.scheduler.aging", DISPATCH_QUEUE_SERIAL);
+        _agingOperations = [NSMapTable weakToStrongObjectsMapTable];
+        _agingTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _agingQueue);
+        // Ticks twice per interval, so no operation waits much longer than an interval to be aged
+        const uint64_t tickInterval = (uint64_t)(SPTPersistentCacheSchedulerAgingInterval * NSEC_PER_SEC / 2);
+        dispatch_source_set_timer(_agingTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)tickInterval), tickInterval, tickInterval / 10);
+        __weak __typeof(self) const weakSelf = self;
+        dispatch_source_set_event_handler(_agingTimer, ^{
+            [weakSelf ageQueuedOperations];
+        });
+        _foregroundCondition = [NSCondition new];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    // A suspended source mustn't be released
+    if (!_agingTimerRunning) {
+        dispatch_resume(_agingTimer);
+    }
+    dispatch_source_cancel(_agingTimer);
+}
+
+#pragma mark Scheduling
+
+- (NSOperationQueue *)queueForLane:(SPTPersistentCacheSchedulerLane)lane
+{
+    switch (lane) {
+        case SPTPersistentCacheSchedulerLaneRead:           return self.readQueue;
+        case SPTPersistentCacheSchedulerLaneWrite:          return self.writeQueue;
+        case SPTPersistentCacheSchedulerLaneMaintenance:    return self.maintenanceQueue;
+    }
+}
+
+- (SPTPersistentCacheConcurrencyController *)concurrencyControllerForLane:(SPTPersistentCacheSchedulerLane)lane
+{
+    switch (lane) {
+        case SPTPersistentCacheSchedulerLaneRead:           return _readConcurrencyController;
+        case SPTPersistentCacheSchedulerLaneWrite:          return _writeConcurrencyController;
+        case SPTPersistentCacheSchedulerLaneMaintenance:    return nil;
+    }
+}
+
+- (dispatch_block_t)blockMeasuringLatencyOfBlock:(dispatch_block_t)block lane:(SPTPersistentCacheSchedulerLane)lane
+{
+    SPTPersistentCacheConcurrencyController * const concurrencyController = [self concurrencyControllerForLane:lane];
+    if (concurrencyController == nil) {
+        return block;
+    }
+
+    return ^{
+        NSProcessInfo * const processInfo = [NSProcessInfo processInfo];
+        const NSTimeInterval startTime = processInfo.systemUptime;
+        block();
+        [concurrencyController recordLatency:processInfo.systemUptime - startTime];
+    };
+}
+
+- (void)addOperation:(NSOperation *)operation lane:(SPTPersistentCacheSchedulerLane)lane
+{
+    if (lane != SPTPersistentCacheSchedulerLaneMaintenance) {
+        [self trackForegroundOperation:operation];
+    }
+
+    [[self queueForLane:lane] addOperation:operation];
+    [self scheduleAgingOfOperation:operation];
+}
+
+- (void)performForegroundBlock:(dispatch_block_t)block lane:(SPTPersistentCacheSchedulerLane)lane
+{
+    NSParameterAssert(lane != SPTPersistentCacheSchedulerLaneMaintenance);
+
+    [_foregroundCondition lock];
+    _foregroundOperationCount += 1;
+    [_foregroundCondition unlock];
+
+    [self blockMeasuringLatencyOfBlock:block lane:lane]();
+    [self foregroundOperationDidFinish];
+}
+
+- (void)scheduleAgingOfOperation:(NSOperation *)operation
+{
+    if (operation.queuePriority >= NSOperationQueuePriorityVeryHigh) {
+        return;
+    }
+
+    const NSTimeInterval queuedTime = [NSProcessInfo processInfo].systemUptime;
+    dispatch_async(_agingQueue, ^{
+        [self->_agingOperations setObject:@(queuedTime) forKey:operation];
+        if (!self->_agingTimerRunning) {
+            self->_agingTimerRunning = YES;
+            dispatch_resume(self->_agingTimer);
+        }
+    });
+}
+
+/**
+ Raises every operation that has been waiting for an aging interval one priority step. Called on the aging queue.
+ */
+- (void)ageQueuedOperations
+{
+    const NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    // Weak keys of released operations are only purged lazily, the snapshot holds just the live ones
+    NSArray<NSOperation *> * const operations = _agingOperations.keyEnumerator.allObjects;
+    NSUInteger remainingCount = operations.count;
+
+    for (NSOperation *operation in operations) {
+        if (operation.isExecuting || operation.isFinished || operation.isCancelled) {
+            [_agingOperations removeObjectForKey:operation];
+            remainingCount -= 1;
+            continue;
+        }
+        if (now - [_agingOperations objectForKey:operation].doubleValue < SPTPersistentCacheSchedulerAgingInterval) {
+            continue;
+        }
+
+        const NSInteger agedPriority = MIN(operation.queuePriority + SPTPersistentCacheSchedulerPriorityStep,
+                                           (NSInteger)NSOperationQueuePriorityVeryHigh);
+        operation.queuePriority = (NSOperationQueuePriority)agedPriority;
+        if (agedPriority >= NSOperationQueuePriorityVeryHigh) {
+            [_agingOperations removeObjectForKey:operation];
+            remainingCount -= 1;
+        } else {
+            [_agingOperations setObject:@(now) forKey:operation];
+        }
+    }
+
+    if (remainingCount == 0) {
+        [_agingOperations removeAllObjects];
+        _agingTimerRunning = NO;
+        dispatch_suspend(_agingTimer);
+    }
+}
+
+#pragma mark Maintenance Preemption
+
+- (void)trackForegroundOperation:(NSOperation *)operation
+{
+    [_foregroundCondition lock];
+    _foregroundOperationCount += 1;
+    [_foregroundCondition unlock];
+
+    // Also called for operations that were cancelled before they started
+    void (^ const completionBlock)(void) = operation.completionBlock;
+    operation.completionBlock = ^{
+        if (completionBlock) {
+            completionBlock();
+        }
+        [self foregroundOperationDidFinish];
+    };
+}
+
+- (void)foregroundOperationDidFinish
+{
+    [_foregroundCondition lock];
+    if (_foregroundOperationCount > 0) {
+        _foregroundOperationCount -= 1;
+    }
+    [_foregroundCondition broadcast];
+    [_foregroundCondition unlock];
+}
+
+- (BOOL)hasForegroundWork
+{
+    [_foregroundCondition lock];
+    const BOOL hasForegroundWork = (_foregroundOperationCount > 0);
+    [_foregroundCondition unlock];
+    return hasForegroundWork;
+}
+
+- (void)yieldToForegroundWork
+{
+    NSDate * const deadline = [NSDate dateWithTimeIntervalSinceNow:SPTPersistentCacheSchedulerMaintenanceMaxYield];
+
+    [_foregroundCondition lock];
+    while (_foregroundOperationCount > 0 && !self.isSuspended) {
+        if (![_foregroundCondition waitUntilDate:deadline]) {
+            break;
+        }
+    }
+    [_foregroundCondition unlock];
+}
+
+#pragma mark Suspending and Waiting
+
+- (BOOL)isSuspended
+{
+    return self.readQueue.isSuspended;
+}
+
+- (void)setSuspended:(BOOL)suspended
+{
+    self.readQueue.suspended = suspended;
+    self.writeQueue.suspended = suspended;
+    self.maintenanceQueue.suspended = suspended;
+}
+
+- (void)waitUntilAllOperationsAreFinished
+{
+    [self.readQueue waitUntilAllOperationsAreFinished];
+    [self.writeQueue waitUntilAllOperationsAreFinished];
+    [self.maintenanceQueue waitUntilAllOperationsAreFinished];
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.readQueue.name, @"read-queue");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.readQueue.maxConcurrentOperationCount), @"read-width",
+                                               @(self.writeQueue.maxConcurrentOperationCount), @"write-width",
+                                               @(self.maintenanceQueue.maxConcurrentOperationCount), @"maintenance-width");
+}
+
+@end
+
+/**
+ Splits the width left after maintenance between the read and write lanes. A lane that isn’t configured asks for all
+ of it, the lanes are narrowed in proportion to what they asked for when they don’t fit. Each lane gets at least one.
+ */
+static void SPTPersistentCacheSchedulerSplitForegroundWidth(NSInteger foregroundWidth,
+                                                            NSInteger proposedReadWidth,
+                                                            NSInteger proposedWriteWidth,
+                                                            NSInteger *readWidth,
+                                                            NSInteger *writeWidth)
+{
+    const NSInteger read = (proposedReadWidth > 0 ? proposedReadWidth : foregroundWidth);
+    const NSInteger write = (proposedWriteWidth > 0 ? proposedWriteWidth : foregroundWidth);
+    if (read + write <= foregroundWidth) {
+        *readWidth = read;
+        *writeWidth = write;
+        return;
+    }
+
+    *readWidth = MAX(1, (NSInteger)lround((double)foregroundWidth * read / (read + write)));
+    *writeWidth = MAX(1, foregroundWidth - *readWidth);
+}
@@ -0,0 +1,98 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheHeader.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The value of the magic number at the start of a shared index file.
+ */
+extern const uint32_t SPTPersistentCacheSharedIndexMagicValue;
+
+/**
+ The answers the shared index can give for a key.
+ */
+typedef NS_ENUM(NSInteger, SPTPersistentCacheSharedIndexLookupResult) {
+    /// The index isn’t populated or couldn’t be read consistently, the disk has to be checked.
+    SPTPersistentCacheSharedIndexLookupResultUnknown,
+    /// There is no record for the key.
+    SPTPersistentCacheSharedIndexLookupResultAbsent,
+    /// There is a record for the key, its header fields are returned.
+    SPTPersistentCacheSharedIndexLookupResultPresent
+};
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A table of the records in a cache directory and their header fields, memory mapped from a file so every process
+ using the directory shares it.
+ @discussion Keys are stored as 64-bit hashes in an open addressing table. Lookups don’t take any lock: writers bump a
+ sequence number before and after changing the table and readers retry when it changed under them. Writers exclude
+ each other with an advisory lock on the file, which the system releases if a process dies. A process that dies while
+ changing the table leaves the sequence number odd, the next writer then marks the table unpopulated.
+
+ The first process to open the table marks it unpopulated, as records may have changed while no process had it open.
+ It is then populated once by one of the processes using `beginPopulating`. Once the table is fuller than its
+ capacity allows it stops answering until it is populated again. This class is threadsafe.
+ */
+@interface SPTPersistentCacheSharedIndex : NSObject
+
+/// Whether the index has been populated and holds every record on disk.
+@property (nonatomic, assign, readonly, getter=isReady) BOOL ready;
+/// Whether the index is unpopulated and no process has begun populating it, e.g. after a writer died while changing it.
+@property (nonatomic, assign, readonly) BOOL needsPopulating;
+/// The number of slots of the table.
+@property (nonatomic, assign, readonly) NSUInteger capacity;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Opens the index at a path, creating it if needed, and maps it into memory.
+
+ @param path The path of the index file. A second file with `-members` appended tracks the processes using it.
+ @param capacity The number of keys the table is sized for when it is created. An existing table keeps its size.
+ @param debugOutput Callback used to report errors.
+ @return An index or `nil` if the file couldn’t be opened or mapped.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                             capacity:(NSUInteger)capacity
+                          debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Looks up key without taking any lock.
+ @param header Filled with the ttl, payload size, update time and refCount of the record if it is present.
+ */
+- (SPTPersistentCacheSharedIndexLookupResult)lookupKey:(NSString *)key header:(nullable SPTPersistentCacheRecordHeader *)header;
+
+/**
+ Adds a key or updates its header fields after its header was written.
+ */
+- (void)setHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key;
+
+/**
+ Removes a key whose file was deleted.
+ */
+- (void)removeKey:(NSString *)key;
+
+/**
+ Claims the population of an unpopulated index and clears it.
+ @return YES if this instance has to add the records on disk and call `finishPopulating`, NO if the index is ready or
+ another process is populating it.
+ */
+- (BOOL)beginPopulating;
+
+/**
+ Adds a key found on disk unless it has been set since populating began.
+ */
+- (void)addPopulatedHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key;
+
+/**
+ Marks the index as ready once all records on disk have been added.
+ */
+- (void)finishPopulating;
+
+@end
+
+NS_ASSUME_NONNULL_END
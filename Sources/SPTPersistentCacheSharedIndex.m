@@ -0,0 +1,431 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheSharedIndex.h"
+#import "SPTPersistentCacheDebugUtilities.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+#include <fcntl.h>
+#include <os/lock.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "fnv1a.h"
+
+const uint32_t SPTPersistentCacheSharedIndexMagicValue = 0x58444953; // SIDX
+
+static const uint32_t SPTPersistentCacheSharedIndexVersion = 1;
+static const NSUInteger SPTPersistentCacheSharedIndexMinimumCapacity = 64;
+static const double SPTPersistentCacheSharedIndexMaximumLoadFactor = 0.75;
+// Lookups racing with this many writes give up and let the caller check the disk
+static const NSUInteger SPTPersistentCacheSharedIndexReadAttempts = 16;
+
+// Key hashes of free slots, keys hashing to them are stored with the next hash
+static const uint64_t SPTPersistentCacheSharedIndexEmptySlot = 0;
+static const uint64_t SPTPersistentCacheSharedIndexRemovedSlot = 1;
+
+typedef NS_ENUM(uint32_t, SPTPersistentCacheSharedIndexState) {
+    SPTPersistentCacheSharedIndexStateUnpopulated,
+    SPTPersistentCacheSharedIndexStatePopulating,
+    SPTPersistentCacheSharedIndexStateReady,
+    SPTPersistentCacheSharedIndexStateOverflowed
+};
+
+typedef struct SPTPersistentCacheSharedIndexFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t usedSlotCount;     // slots holding a key or marked as removed
+    _Atomic uint32_t state;
+    uint32_t reserved;
+    _Atomic uint64_t sequence;  // odd while a writer is changing the table
+} SPTPersistentCacheSharedIndexFileHeader;
+
+typedef struct SPTPersistentCacheSharedIndexSlot {
+    uint64_t keyHash;
+    uint64_t updateTimeSec;
+    uint64_t ttl;
+    uint64_t payloadSizeBytes;
+    uint32_t refCount;
+    uint32_t reserved;
+} SPTPersistentCacheSharedIndexSlot;
+
+_Static_assert(sizeof(SPTPersistentCacheSharedIndexFileHeader) == 40,
+               "Struct SPTPersistentCacheSharedIndexFileHeader has to be packed without padding");
+_Static_assert(sizeof(SPTPersistentCacheSharedIndexSlot) == 40,
+               "Struct SPTPersistentCacheSharedIndexSlot has to be packed without padding");
+
+static uint64_t SPTPersistentCacheSharedIndexHashKey(NSString *key)
+{
+    const char *utf8Key = key.UTF8String;
+    const uint64_t keyHash = spt_fnv1a64((const uint8_t *)utf8Key, strlen(utf8Key));
+    return (keyHash > SPTPersistentCacheSharedIndexRemovedSlot ? keyHash : keyHash + 2);
+}
+
+static size_t SPTPersistentCacheSharedIndexFileSize(uint64_t capacity)
+{
+    return sizeof(SPTPersistentCacheSharedIndexFileHeader) + (size_t)capacity * sizeof(SPTPersistentCacheSharedIndexSlot);
+}
+
+@interface SPTPersistentCacheSharedIndex ()
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
+@end
+
+@implementation SPTPersistentCacheSharedIndex
+{
+    int _fd;
+    int _membersFd;
+    size_t _mappedSize;
+    SPTPersistentCacheSharedIndexFileHeader *_header;
+    SPTPersistentCacheSharedIndexSlot *_slots;
+    // Advisory locks are held per open file, so the threads of this process are excluded separately
+    os_unfair_lock _writeLock;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+                    capacity:(NSUInteger)capacity
+                 debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _debugOutput = [debugOutput copy];
+        _writeLock = OS_UNFAIR_LOCK_INIT;
+        _membersFd = -1;
+
+        const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+        _fd = open(path.fileSystemRepresentation, O_RDWR | O_CREAT, mode);
+        if (_fd == -1) {
+            [self debugOutput:@"PersistentDataCache: Unable to open shared index: %@, error: %@", path, @(strerror(errno))];
+            return nil;
+        }
+        NSString * const membersPath = [path stringByAppendingString:@"-members"];
+        _membersFd = open(membersPath.fileSystemRepresentation, O_RDWR | O_CREAT, mode);
+        if (_membersFd == -1) {
+            [self debugOutput:@"PersistentDataCache: Unable to open shared index: %@, error: %@", membersPath, @(strerror(errno))];
+            return nil;
+        }
+
+        // Nobody kept the table up to date while no process had it open
+        const BOOL firstMember = (flock(_membersFd, LOCK_EX | LOCK_NB) == 0);
+
+        flock(_fd, LOCK_EX);
+        const BOOL mapped = [self mapTableWithCapacity:capacity firstMember:firstMember];
+        if (mapped && firstMember) {
+            atomic_store(&_header->state, SPTPersistentCacheSharedIndexStateUnpopulated);
+            // The last process may have died while changing the table
+            if (atomic_load(&_header->sequence) % 2 == 1) {
+                atomic_fetch_add(&_header->sequence, 1);
+            }
+        }
+        flock(_fd, LOCK_UN);
+
+        // Stay a member for as long as the index is open
+        flock(_membersFd, LOCK_SH);
+
+        if (!mapped) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_header != NULL) {
+        munmap(_header, _mappedSize);
+    }
+    if (_fd != -1) {
+        close(_fd);
+    }
+    if (_membersFd != -1) {
+        close(_membersFd);
+    }
+}
+
+/**
+ Maps the table, creating it if the file is empty or invalid. Called with the file locked.
+ */
+- (BOOL)mapTableWithCapacity:(NSUInteger)requestedCapacity firstMember:(BOOL)firstMember
+{
+    SPTPersistentCacheSharedIndexFileHeader fileHeader;
+    struct stat fileStat;
+    const BOOL valid = (fstat(_fd, &fileStat) == 0 &&
+                        pread(_fd, &fileHeader, sizeof(fileHeader), 0) == (ssize_t)sizeof(fileHeader) &&
+                        fileHeader.magic == SPTPersistentCacheSharedIndexMagicValue &&
+                        fileHeader.version == SPTPersistentCacheSharedIndexVersion &&
+                        fileHeader.capacity > 0 &&
+                        (fileHeader.capacity & (fileHeader.capacity - 1)) == 0 &&
+                        (size_t)fileStat.st_size == SPTPersistentCacheSharedIndexFileSize(fileHeader.capacity));
+
+    uint64_t capacity = SPTPersistentCacheSharedIndexMinimumCapacity;
+    while (capacity * SPTPersistentCacheSharedIndexMaximumLoadFactor < requestedCapacity) {
+        capacity <<= 1;
+    }
+
+    BOOL recreate = !valid;
+    if (valid) {
+        // A table that overflowed is recreated larger once no other process uses it
+        const BOOL overflowed = (atomic_load(&fileHeader.state) == SPTPersistentCacheSharedIndexStateOverflowed);
+        if (firstMember && (overflowed || fileHeader.capacity < capacity)) {
+            capacity = MAX(capacity, (overflowed ? fileHeader.capacity * 2 : fileHeader.capacity));
+            recreate = YES;
+        } else {
+            capacity = fileHeader.capacity;
+        }
+    }
+
+    if (recreate) {
+        // Other processes may have the file mapped, resizing it under them would crash them
+        if (!firstMember) {
+            [self debugOutput:@"PersistentDataCache: Shared index is invalid and in use by another process"];
+            return NO;
+        }
+        if (ftruncate(_fd, 0) == -1 || ftruncate(_fd, (off_t)SPTPersistentCacheSharedIndexFileSize(capacity)) == -1) {
+            [self debugOutput:@"PersistentDataCache: Unable to size shared index, error: %@", @(strerror(errno))];
+            return NO;
+        }
+    }
+
+    _mappedSize = SPTPersistentCacheSharedIndexFileSize(capacity);
+    void * const table = mmap(NULL, _mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (table == MAP_FAILED) {
+        [self debugOutput:@"PersistentDataCache: Unable to map shared index, error: %@", @(strerror(errno))];
+        return NO;
+    }
+    _header = table;
+    _slots = (SPTPersistentCacheSharedIndexSlot *)(_header + 1);
+    _capacity = (NSUInteger)capacity;
+
+    if (recreate) {
+        // The file was truncated, so the table is all zeroes already
+        _header->magic = SPTPersistentCacheSharedIndexMagicValue;
+        _header->version = SPTPersistentCacheSharedIndexVersion;
+        _header->capacity = capacity;
+    }
+    return YES;
+}
+
+- (BOOL)isReady
+{
+    return atomic_load(&_header->state) == SPTPersistentCacheSharedIndexStateReady;
+}
+
+- (BOOL)needsPopulating
+{
+    return atomic_load(&_header->state) == SPTPersistentCacheSharedIndexStateUnpopulated;
+}
+
+#pragma mark Reading
+
+- (SPTPersistentCacheSharedIndexLookupResult)lookupKey:(NSString *)key header:(SPTPersistentCacheRecordHeader *)header
+{
+    const uint64_t keyHash = SPTPersistentCacheSharedIndexHashKey(key);
+
+    for (NSUInteger attempt = 0; attempt < SPTPersistentCacheSharedIndexReadAttempts; ++attempt) {
+        const uint64_t sequence = atomic_load_explicit(&_header->sequence, memory_order_acquire);
+        if (sequence % 2 == 1) {
+            sched_yield();
+            continue;
+        }
+        if (atomic_load_explicit(&_header->state, memory_order_relaxed) != SPTPersistentCacheSharedIndexStateReady) {
+            return SPTPersistentCacheSharedIndexLookupResultUnknown;
+        }
+
+        SPTPersistentCacheSharedIndexSlot slot = { 0 };
+        const NSUInteger index = [self indexOfSlotForKeyHash:keyHash];
+        if (index != NSNotFound) {
+            slot = _slots[index];
+        }
+
+        // Nothing read is used unless no writer changed the table meanwhile
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&_header->sequence, memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        if (slot.keyHash != keyHash) {
+            return SPTPersistentCacheSharedIndexLookupResultAbsent;
+        }
+        if (header != NULL) {
+            memset(header, 0, sizeof(*header));
+            header->ttl = slot.ttl;
+            header->payloadSizeBytes = slot.payloadSizeBytes;
+            header->updateTimeSec = slot.updateTimeSec;
+            header->refCount = slot.refCount;
+        }
+        return SPTPersistentCacheSharedIndexLookupResultPresent;
+    }
+
+    return SPTPersistentCacheSharedIndexLookupResultUnknown;
+}
+
+/**
+ Returns the index of the slot holding keyHash, `NSNotFound` if there is none.
+ */
+- (NSUInteger)indexOfSlotForKeyHash:(uint64_t)keyHash
+{
+    const uint64_t mask = _capacity - 1;
+    uint64_t index = keyHash & mask;
+    for (NSUInteger probe = 0; probe < _capacity; ++probe, index = (index + 1) & mask) {
+        const uint64_t slotKeyHash = _slots[index].keyHash;
+        if (slotKeyHash == keyHash) {
+            return (NSUInteger)index;
+        }
+        if (slotKeyHash == SPTPersistentCacheSharedIndexEmptySlot) {
+            break;
+        }
+    }
+    return NSNotFound;
+}
+
+#pragma mark Writing
+
+- (void)setHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    const uint64_t keyHash = SPTPersistentCacheSharedIndexHashKey(key);
+    [self changeTableWithBlock:^{
+        [self storeHeader:header forKeyHash:keyHash onlyIfAbsent:NO];
+    }];
+}
+
+- (void)removeKey:(NSString *)key
+{
+    const uint64_t keyHash = SPTPersistentCacheSharedIndexHashKey(key);
+    [self changeTableWithBlock:^{
+        const NSUInteger index = [self indexOfSlotForKeyHash:keyHash];
+        if (index != NSNotFound) {
+            self->_slots[index].keyHash = SPTPersistentCacheSharedIndexRemovedSlot;
+        }
+    }];
+}
+
+- (void)changeTableWithBlock:(dispatch_block_t)block
+{
+    os_unfair_lock_lock(&_writeLock);
+    flock(_fd, LOCK_EX);
+
+    uint64_t sequence = atomic_load_explicit(&_header->sequence, memory_order_relaxed);
+    if (sequence % 2 == 1) {
+        // A process died while changing the table, it can’t be trusted until populated again
+        atomic_store(&_header->state, SPTPersistentCacheSharedIndexStateUnpopulated);
+        sequence += 1;
+    }
+
+    atomic_store_explicit(&_header->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    block();
+
+    atomic_store_explicit(&_header->sequence, sequence + 2, memory_order_release);
+
+    flock(_fd, LOCK_UN);
+    os_unfair_lock_unlock(&_writeLock);
+}
+
+/// Called while changing the table
+- (void)storeHeader:(const SPTPersistentCacheRecordHeader *)header forKeyHash:(uint64_t)keyHash onlyIfAbsent:(BOOL)onlyIfAbsent
+{
+    const uint64_t mask = _capacity - 1;
+    uint64_t index = keyHash & mask;
+    NSUInteger freeIndex = NSNotFound;
+    BOOL freeSlotIsEmpty = NO;
+    for (NSUInteger probe = 0; probe < _capacity; ++probe, index = (index + 1) & mask) {
+        const uint64_t slotKeyHash = _slots[index].keyHash;
+        if (slotKeyHash == keyHash) {
+            if (onlyIfAbsent) {
+                return;
+            }
+            freeIndex = (NSUInteger)index;
+            break;
+        }
+        if (slotKeyHash == SPTPersistentCacheSharedIndexRemovedSlot && freeIndex == NSNotFound) {
+            freeIndex = (NSUInteger)index;
+        } else if (slotKeyHash == SPTPersistentCacheSharedIndexEmptySlot) {
+            if (freeIndex == NSNotFound) {
+                freeIndex = (NSUInteger)index;
+                freeSlotIsEmpty = YES;
+            }
+            break;
+        }
+    }
+
+    if (freeIndex == NSNotFound ||
+        (freeSlotIsEmpty && _header->usedSlotCount + 1 > _capacity * SPTPersistentCacheSharedIndexMaximumLoadFactor)) {
+        if (atomic_exchange(&_header->state, SPTPersistentCacheSharedIndexStateOverflowed) != SPTPersistentCacheSharedIndexStateOverflowed) {
+            [self debugOutput:@"PersistentDataCache: Shared index is full with capacity: %@", @(_capacity)];
+        }
+        return;
+    }
+    if (freeSlotIsEmpty) {
+        _header->usedSlotCount += 1;
+    }
+
+    SPTPersistentCacheSharedIndexSlot * const slot = &_slots[freeIndex];
+    slot->keyHash = keyHash;
+    slot->updateTimeSec = header->updateTimeSec;
+    slot->ttl = header->ttl;
+    slot->payloadSizeBytes = header->payloadSizeBytes;
+    slot->refCount = header->refCount;
+}
+
+#pragma mark Populating
+
+- (BOOL)beginPopulating
+{
+    __block BOOL claimed = NO;
+    [self changeTableWithBlock:^{
+        if (atomic_load(&self->_header->state) != SPTPersistentCacheSharedIndexStateUnpopulated) {
+            return;
+        }
+        memset(self->_slots, 0, self->_capacity * sizeof(SPTPersistentCacheSharedIndexSlot));
+        self->_header->usedSlotCount = 0;
+        atomic_store(&self->_header->state, SPTPersistentCacheSharedIndexStatePopulating);
+        claimed = YES;
+    }];
+    return claimed;
+}
+
+- (void)addPopulatedHeader:(const SPTPersistentCacheRecordHeader *)header forKey:(NSString *)key
+{
+    const uint64_t keyHash = SPTPersistentCacheSharedIndexHashKey(key);
+    [self changeTableWithBlock:^{
+        // Records stored meanwhile are newer than the header read from disk
+        [self storeHeader:header forKeyHash:keyHash onlyIfAbsent:YES];
+    }];
+}
+
+- (void)finishPopulating
+{
+    [self changeTableWithBlock:^{
+        uint32_t expected = SPTPersistentCacheSharedIndexStatePopulating;
+        atomic_compare_exchange_strong(&self->_header->state, &expected, SPTPersistentCacheSharedIndexStateReady);
+    }];
+}
+
+#pragma mark Debugging
+
+- (void)debugOutput:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2)
+{
+    va_list list;
+    va_start(list, format);
+    NSString * const message = [[NSString alloc] initWithFormat:format arguments:list];
+    va_end(list);
+
+    SPTPersistentCacheSafeDebugCallback(message, self.debugOutput);
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.capacity), @"capacity");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.capacity), @"capacity", @(self.isReady), @"ready");
+}
+
+@end
@@ -0,0 +1,42 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheStoreOptions.h>
+#import "SPTPersistentCacheObjectDescription.h"
+
+@implementation SPTPersistentCacheStoreOptions
+
+#pragma mark NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    SPTPersistentCacheStoreOptions * const copy = [(SPTPersistentCacheStoreOptions *)[self.class allocWithZone:zone] init];
+    copy.ttl = self.ttl;
+    copy.locked = self.isLocked;
+    copy.tags = self.tags;
+    copy.priority = self.priority;
+    copy.refetchCost = self.refetchCost;
+    // The token is shared, cancelling it cancels the stores of every copy
+    copy.cancellationToken = self.cancellationToken;
+    return copy;
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.ttl), @"ttl", @(self.isLocked), @"locked");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.ttl), @"ttl",
+                                               @(self.isLocked), @"locked",
+                                               self.tags, @"tags",
+                                               @(self.priority), @"priority",
+                                               @(self.refetchCost), @"refetch-cost",
+                                               self.cancellationToken, @"cancellation-token");
+}
+
+@end
@@ -0,0 +1,70 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+/**
+ The value of the magic number at the start of each batch in a tag index file. Each entry of a batch is a `uint16_t`
+ key length followed by the UTF-8 key and a `uint16_t` tag count followed by that many tags, each a `uint16_t` length
+ followed by the UTF-8 tag. An entry without tags removes the key from the index.
+ */
+extern const uint32_t SPTPersistentCacheTagIndexMagicValue;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A secondary index from tags to the keys of the records they were attached to, kept next to the records.
+ @discussion Kept in an `SPTPersistentCacheJournal`, so tagging a record costs one small write instead of a field in
+ every record. Like the records themselves, the batches aren’t synced to disk one by one. This class is threadsafe.
+ */
+@interface SPTPersistentCacheTagIndex : NSObject
+
+/// The number of keys with at least one tag.
+@property (nonatomic, assign, readonly) NSUInteger keyCount;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Opens the index at a path, creating it if needed, and replays it.
+
+ @param path The path of the index file.
+ @param debugOutput Callback used to report errors.
+ @return An index or `nil` if the file couldn’t be opened.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                          debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns the keys a tag is attached to, sorted.
+ */
+- (NSArray<NSString *> *)keysForTag:(NSString *)tag;
+
+/**
+ Returns the tags attached to key, empty if it has none.
+ */
+- (NSSet<NSString *> *)tagsForKey:(NSString *)key;
+
+/**
+ Replaces the tags attached to key. An empty set removes the key from the index. Nothing is written if the tags
+ don’t change.
+ @return YES if the change was written.
+ */
+- (BOOL)setTags:(NSSet<NSString *> *)tags forKey:(NSString *)key;
+
+/**
+ Removes keys from the index in one batch.
+ @return YES if the change was written.
+ */
+- (BOOL)removeKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Removes every key except the given ones from the index in one batch.
+ @return YES if the change was written.
+ */
+- (BOOL)removeAllKeysExceptKeys:(NSSet<NSString *> *)keys;
+
+@end
+
+NS_ASSUME_NONNULL_END
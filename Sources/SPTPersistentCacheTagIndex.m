@@ -0,0 +1,235 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheTagIndex.h"
+#import "SPTPersistentCacheJournal.h"
+#import "SPTPersistentCacheObjectDescription.h"
+
+const uint32_t SPTPersistentCacheTagIndexMagicValue = 0x47544053; // SPTG
+
+static BOOL SPTPersistentCacheTagIndexAppendString(NSMutableData *entries, NSString *string)
+{
+    const char *utf8String = string.UTF8String;
+    const size_t stringLength = strlen(utf8String);
+    if (stringLength > UINT16_MAX) {
+        return NO;
+    }
+    const uint16_t encodedLength = (uint16_t)stringLength;
+    [entries appendBytes:&encodedLength length:sizeof(encodedLength)];
+    [entries appendBytes:utf8String length:stringLength];
+    return YES;
+}
+
+static NSString *SPTPersistentCacheTagIndexDecodeString(const uint8_t *entries, size_t length, size_t *offset)
+{
+    uint16_t stringLength = 0;
+    if (length - *offset < sizeof(stringLength)) {
+        return nil;
+    }
+    memcpy(&stringLength, entries + *offset, sizeof(stringLength));
+    *offset += sizeof(stringLength);
+    if (length - *offset < stringLength) {
+        return nil;
+    }
+    NSString *string = [[NSString alloc] initWithBytes:entries + *offset length:stringLength encoding:NSUTF8StringEncoding];
+    *offset += stringLength;
+    return string;
+}
+
+@interface SPTPersistentCacheTagIndex () <SPTPersistentCacheJournalCodec>
+@property (nonatomic, copy, readonly) NSString *path;
+@end
+
+@implementation SPTPersistentCacheTagIndex
+{
+    SPTPersistentCacheJournal *_journal;
+    NSMutableDictionary<NSString *, NSSet<NSString *> *> *_tagsByKey;
+    NSMutableDictionary<NSString *, NSMutableSet<NSString *> *> *_keysByTag;
+}
+
+- (instancetype)initWithPath:(NSString *)path debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _tagsByKey = [NSMutableDictionary dictionary];
+        _keysByTag = [NSMutableDictionary dictionary];
+        // Like the records themselves, the batches aren’t synced to disk one by one
+        _journal = [[SPTPersistentCacheJournal alloc] initWithPath:path
+                                                              name:@"tag index"
+                                                             magic:SPTPersistentCacheTagIndexMagicValue
+                                                       synchronous:NO
+                                                             codec:self
+                                                       debugOutput:debugOutput];
+        if (_journal == nil) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+#pragma mark Reading Tags
+
+- (NSUInteger)keyCount
+{
+    @synchronized (self) {
+        return _tagsByKey.count;
+    }
+}
+
+- (NSArray<NSString *> *)keysForTag:(NSString *)tag
+{
+    @synchronized (self) {
+        return [_keysByTag[tag].allObjects sortedArrayUsingSelector:@selector(compare:)] ?: @[];
+    }
+}
+
+- (NSSet<NSString *> *)tagsForKey:(NSString *)key
+{
+    @synchronized (self) {
+        return _tagsByKey[key] ?: [NSSet set];
+    }
+}
+
+#pragma mark Changing Tags
+
+- (BOOL)setTags:(NSSet<NSString *> *)tags forKey:(NSString *)key
+{
+    @synchronized (self) {
+        if ([(_tagsByKey[key] ?: [NSSet set]) isEqualToSet:tags]) {
+            return YES;
+        }
+        return [_journal commitEntries:@{ key: [tags copy] }];
+    }
+}
+
+- (BOOL)removeKeys:(NSArray<NSString *> *)keys
+{
+    @synchronized (self) {
+        NSMutableDictionary<NSString *, NSSet<NSString *> *> *changes = [NSMutableDictionary dictionary];
+        for (NSString *key in keys) {
+            if (_tagsByKey[key] != nil) {
+                changes[key] = [NSSet set];
+            }
+        }
+        return [_journal commitEntries:changes];
+    }
+}
+
+- (BOOL)removeAllKeysExceptKeys:(NSSet<NSString *> *)keys
+{
+    @synchronized (self) {
+        NSMutableDictionary<NSString *, NSSet<NSString *> *> *changes = [NSMutableDictionary dictionary];
+        for (NSString *key in _tagsByKey) {
+            if (![keys containsObject:key]) {
+                changes[key] = [NSSet set];
+            }
+        }
+        return [_journal commitEntries:changes];
+    }
+}
+
+#pragma mark Index Entries
+
+- (NSData *)encodeEntries:(NSDictionary<NSString *, NSSet<NSString *> *> *)tagsByKey
+{
+    NSMutableData *entries = [NSMutableData data];
+    for (NSString *key in tagsByKey) {
+        NSSet<NSString *> *tags = tagsByKey[key];
+        if (tags.count > UINT16_MAX || !SPTPersistentCacheTagIndexAppendString(entries, key)) {
+            return nil;
+        }
+        const uint16_t tagCount = (uint16_t)tags.count;
+        [entries appendBytes:&tagCount length:sizeof(tagCount)];
+        for (NSString *tag in tags) {
+            if (!SPTPersistentCacheTagIndexAppendString(entries, tag)) {
+                return nil;
+            }
+        }
+    }
+    return entries;
+}
+
+- (NSDictionary<NSString *, NSSet<NSString *> *> *)decodeEntries:(const uint8_t *)entries
+                                                          length:(size_t)length
+                                                           count:(uint32_t)entryCount
+{
+    NSMutableDictionary<NSString *, NSSet<NSString *> *> *tagsByKey = [NSMutableDictionary dictionaryWithCapacity:entryCount];
+    size_t offset = 0;
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        NSString *key = SPTPersistentCacheTagIndexDecodeString(entries, length, &offset);
+        uint16_t tagCount = 0;
+        if (key == nil || length - offset < sizeof(tagCount)) {
+            return nil;
+        }
+        memcpy(&tagCount, entries + offset, sizeof(tagCount));
+        offset += sizeof(tagCount);
+
+        NSMutableSet<NSString *> *tags = [NSMutableSet setWithCapacity:tagCount];
+        for (uint16_t j = 0; j < tagCount; ++j) {
+            NSString *tag = SPTPersistentCacheTagIndexDecodeString(entries, length, &offset);
+            if (tag == nil) {
+                return nil;
+            }
+            [tags addObject:tag];
+        }
+        tagsByKey[key] = tags;
+    }
+    return (offset == length ? tagsByKey : nil);
+}
+
+- (void)applyEntries:(NSDictionary<NSString *, NSSet<NSString *> *> *)changes
+{
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSSet<NSString *> *tags, BOOL *stop) {
+        for (NSString *tag in self->_tagsByKey[key]) {
+            NSMutableSet<NSString *> *keys = self->_keysByTag[tag];
+            [keys removeObject:key];
+            if (keys.count == 0) {
+                [self->_keysByTag removeObjectForKey:tag];
+            }
+        }
+
+        if (tags.count == 0) {
+            [self->_tagsByKey removeObjectForKey:key];
+            return;
+        }
+        self->_tagsByKey[key] = tags;
+        for (NSString *tag in tags) {
+            NSMutableSet<NSString *> *keys = self->_keysByTag[tag];
+            if (keys == nil) {
+                keys = [NSMutableSet set];
+                self->_keysByTag[tag] = keys;
+            }
+            [keys addObject:key];
+        }
+    }];
+}
+
+- (NSDictionary<NSString *, NSSet<NSString *> *> *)snapshotEntries
+{
+    return [_tagsByKey copy];
+}
+
+#pragma mark Describing Object
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, self.path, @"path");
+}
+
+- (NSString *)debugDescription
+{
+    NSUInteger tagCount = 0;
+    off_t fileSize = 0;
+    @synchronized (self) {
+        tagCount = _keysByTag.count;
+        fileSize = _journal.fileSize;
+    }
+    return SPTPersistentCacheObjectDescription(self,
+                                               self.path, @"path",
+                                               @(self.keyCount), @"key-count",
+                                               @(tagCount), @"tag-count",
+                                               @(fileSize), @"file-size");
+}
+
+@end
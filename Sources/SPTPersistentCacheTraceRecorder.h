@@ -0,0 +1,116 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCacheTraceReplayer.h>
+
+/**
+ The value of the magic number at the start of a trace file.
+ */
+extern const uint32_t SPTPersistentCacheTraceMagicValue;
+/**
+ The version of the trace format written by `SPTPersistentCacheTraceRecorder`.
+ */
+extern const uint32_t SPTPersistentCacheTraceVersion;
+
+/**
+ Describes the flags of a trace record.
+ */
+typedef NS_OPTIONS(uint8_t, SPTPersistentCacheTraceRecordFlags) {
+    SPTPersistentCacheTraceRecordFlagsLocked = 0x1,
+};
+
+/**
+ The header at the start of a trace file.
+ */
+typedef struct SPTPersistentCacheTraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t startTimeSec; // unix time scale
+} SPTPersistentCacheTraceFileHeader;
+
+/**
+ One recorded call to the public cache API. A call with several keys is recorded once, followed by the `uint64_t`
+ hashes of its `keyCount` keys.
+ */
+typedef struct SPTPersistentCacheTraceRecord {
+    uint64_t timestampNs;   // since the start of the trace
+    uint64_t keyHash;       // spt_fnv1a64 of the UTF-8 key, 0 if the operation has no key or several keys
+    uint64_t payloadSize;
+    uint64_t rangeLength;   // the length of a replaced range
+    uint64_t recordKeyHash; // the key hash of the record a tag is attached to or a prefix load opened, 0 if none
+    uint32_t ttl;
+    uint32_t keyCount;      // the number of key hashes following the record
+    uint32_t batchSize;     // the batch size of a metadata enumeration
+    uint8_t operation;      // See SPTPersistentCacheTraceOperation
+    uint8_t flags;          // See SPTPersistentCacheTraceRecordFlags
+    uint16_t reserved;
+} SPTPersistentCacheTraceRecord;
+
+/**
+ Returns the hash used to identify a key in a trace.
+ */
+uint64_t SPTPersistentCacheTraceKeyHash(NSString * _Nullable key);
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Writes a compact binary trace of the operations performed on a cache.
+ @discussion Records are buffered and written on a private serial queue, so recording never blocks on disk I/O.
+ */
+@interface SPTPersistentCacheTraceRecorder : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a recorder writing to a file at a given path. Any existing file at the path is replaced.
+
+ @param path The path of the trace file.
+ @param debugOutput Callback used to report errors.
+ @return A recorder or `nil` if the trace file couldn’t be created.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                          debugOutput:(nullable SPTPersistentCacheDebugCallback)debugOutput NS_DESIGNATED_INITIALIZER;
+
+/**
+ Records a call to the cache.
+
+ @param operation The operation that was called.
+ @param key The key the operation was called with, if any.
+ @param payloadSize The size in bytes of the stored payload, if applicable.
+ @param ttl The TTL the operation was called with, if applicable.
+ @param locked Whether the operation was called with the locked flag.
+ */
+- (void)recordOperation:(SPTPersistentCacheTraceOperation)operation
+                    key:(nullable NSString *)key
+            payloadSize:(uint64_t)payloadSize
+                    ttl:(uint64_t)ttl
+                 locked:(BOOL)locked;
+
+/**
+ Returns a record of a call to the cache made now, to be completed by the caller and written with
+ `writeRecord:keys:`. Used for operations with more than a payload size, TTL and locked flag.
+ */
+- (SPTPersistentCacheTraceRecord)recordOfOperation:(SPTPersistentCacheTraceOperation)operation
+                                               key:(nullable NSString *)key;
+
+/**
+ Writes a record, followed by the hashes of keys if the call had several of them.
+
+ @param record The record of the call.
+ @param keys The keys of a call with several keys, sets the `keyCount` of the record.
+ */
+- (void)writeRecord:(SPTPersistentCacheTraceRecord)record keys:(nullable NSArray<NSString *> *)keys;
+
+/**
+ Writes all recorded operations to disk. Blocks until done.
+ */
+- (void)flush;
+
+@end
+
+NS_ASSUME_NONNULL_END
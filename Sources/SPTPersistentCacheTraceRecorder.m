@@ -0,0 +1,141 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheTraceRecorder.h"
+#import "SPTPersistentCacheDebugUtilities.h"
+
+#import <mach/mach_time.h>
+
+#include <stdio.h>
+#include "fnv1a.h"
+
+const uint32_t SPTPersistentCacheTraceMagicValue = 0x54545053; // SPTT
+const uint32_t SPTPersistentCacheTraceVersion = 2;
+
+_Static_assert(sizeof(SPTPersistentCacheTraceFileHeader) == 24,
+               "Struct SPTPersistentCacheTraceFileHeader has to be packed without padding");
+_Static_assert(sizeof(SPTPersistentCacheTraceRecord) == 56,
+               "Struct SPTPersistentCacheTraceRecord has to be packed without padding");
+
+uint64_t SPTPersistentCacheTraceKeyHash(NSString *key)
+{
+    if (key.length == 0) {
+        return 0;
+    }
+    const char *utf8Key = key.UTF8String;
+    return spt_fnv1a64((const uint8_t *)utf8Key, strlen(utf8Key));
+}
+
+@interface SPTPersistentCacheTraceRecorder ()
+@property (nonatomic, copy, readonly, nullable) SPTPersistentCacheDebugCallback debugOutput;
+@end
+
+@implementation SPTPersistentCacheTraceRecorder
+{
+    FILE *_file;
+    dispatch_queue_t _queue;
+    uint64_t _startMachTime;
+    mach_timebase_info_data_t _timebase;
+}
+
+- (instancetype)initWithPath:(NSString *)path debugOutput:(SPTPersistentCacheDebugCallback)debugOutput
+{
+    self = [super init];
+    if (self) {
+        _debugOutput = [debugOutput copy];
+
+        _file = fopen(path.fileSystemRepresentation, "wb");
+        if (_file == NULL) {
+            SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to create trace file: %@, error: %@", path, @(strerror(errno))],
+                                                debugOutput);
+            return nil;
+        }
+
+        SPTPersistentCacheTraceFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = SPTPersistentCacheTraceMagicValue;
+        header.version = SPTPersistentCacheTraceVersion;
+        header.recordSize = (uint32_t)sizeof(SPTPersistentCacheTraceRecord);
+        header.startTimeSec = (uint64_t)[[NSDate date] timeIntervalSince1970];
+
+        if (fwrite(&header, sizeof(header), 1, _file) != 1) {
+            SPTPersistentCacheSafeDebugCallback([NSString stringWithFormat:@"PersistentDataCache: Unable to write trace header: %@", path],
+                                                debugOutput);
+            fclose(_file);
+            return nil;
+        }
+
+        mach_timebase_info(&_timebase);
+        _startMachTime = mach_absolute_time();
+        _queue = dispatch_queue_create("com.spotify.persistent.cache.trace", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    // Initialization failed, nothing to close
+    if (_queue == nil) {
+        return;
+    }
+
+    FILE * const file = _file;
+    // The queue is retained by the block, so pending writes finish before the file is closed
+    dispatch_async(_queue, ^{
+        fclose(file);
+    });
+}
+
+- (void)recordOperation:(SPTPersistentCacheTraceOperation)operation
+                    key:(NSString *)key
+            payloadSize:(uint64_t)payloadSize
+                    ttl:(uint64_t)ttl
+                 locked:(BOOL)locked
+{
+    SPTPersistentCacheTraceRecord record = [self recordOfOperation:operation key:key];
+    record.payloadSize = payloadSize;
+    record.ttl = (uint32_t)MIN(ttl, (uint64_t)UINT32_MAX);
+    record.flags = (locked ? SPTPersistentCacheTraceRecordFlagsLocked : 0);
+    [self writeRecord:record keys:nil];
+}
+
+- (SPTPersistentCacheTraceRecord)recordOfOperation:(SPTPersistentCacheTraceOperation)operation key:(NSString *)key
+{
+    SPTPersistentCacheTraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestampNs = (mach_absolute_time() - _startMachTime) * _timebase.numer / _timebase.denom;
+    record.keyHash = SPTPersistentCacheTraceKeyHash(key);
+    record.operation = (uint8_t)operation;
+    return record;
+}
+
+- (void)writeRecord:(SPTPersistentCacheTraceRecord)record keys:(NSArray<NSString *> *)keys
+{
+    NSMutableData *keyHashes = nil;
+    if (keys != nil) {
+        record.keyCount = (uint32_t)MIN(keys.count, (NSUInteger)UINT32_MAX);
+        keyHashes = [NSMutableData dataWithCapacity:record.keyCount * sizeof(uint64_t)];
+        for (NSUInteger i = 0; i < record.keyCount; ++i) {
+            const uint64_t keyHash = SPTPersistentCacheTraceKeyHash(keys[i]);
+            [keyHashes appendBytes:&keyHash length:sizeof(keyHash)];
+        }
+    }
+
+    FILE * const file = _file;
+    dispatch_async(_queue, ^{
+        fwrite(&record, sizeof(record), 1, file);
+        if (keyHashes.length > 0) {
+            fwrite(keyHashes.bytes, keyHashes.length, 1, file);
+        }
+    });
+}
+
+- (void)flush
+{
+    FILE * const file = _file;
+    dispatch_sync(_queue, ^{
+        fflush(file);
+    });
+}
+
+@end
@@ -0,0 +1,390 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <SPTPersistentCache/SPTPersistentCacheTraceReplayer.h>
+#import <SPTPersistentCache/SPTPersistentCacheImplementation.h>
+#import <SPTPersistentCache/SPTPersistentCacheResponse.h>
+
+#import "SPTPersistentCacheTraceRecorder.h"
+#import "SPTPersistentCacheObjectDescription.h"
+#import "NSError+SPTPersistentCacheDomainErrors.h"
+
+#import <mach/mach_time.h>
+
+#include <stdio.h>
+
+/// Returns the key an operation on a key is replayed with, derived from the hash it was recorded with
+static NSString *SPTPersistentCacheTraceReplayKey(uint64_t keyHash)
+{
+    return [NSString stringWithFormat:@"%016llx", keyHash];
+}
+
+#pragma mark - SPTPersistentCacheTraceOperationStatistics
+
+@interface SPTPersistentCacheTraceOperationStatistics ()
+@property (nonatomic, assign, readwrite) NSUInteger count;
+@property (nonatomic, assign, readwrite) NSTimeInterval totalLatency;
+@property (nonatomic, assign, readwrite) NSTimeInterval maximumLatency;
+@end
+
+@implementation SPTPersistentCacheTraceOperationStatistics
+
+- (instancetype)initWithOperation:(SPTPersistentCacheTraceOperation)operation
+{
+    self = [super init];
+    if (self) {
+        _operation = operation;
+    }
+    return self;
+}
+
+- (void)addLatency:(NSTimeInterval)latency
+{
+    self.count += 1;
+    self.totalLatency += latency;
+    self.maximumLatency = MAX(self.maximumLatency, latency);
+}
+
+- (NSTimeInterval)averageLatency
+{
+    return (self.count > 0 ? self.totalLatency / self.count : 0.0);
+}
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.operation), @"operation");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.operation), @"operation",
+                                               @(self.count), @"count",
+                                               @(self.averageLatency), @"average-latency",
+                                               @(self.maximumLatency), @"maximum-latency");
+}
+
+@end
+
+
+#pragma mark - SPTPersistentCacheTraceReplayReport
+
+@interface SPTPersistentCacheTraceReplayReport ()
+@property (nonatomic, assign, readwrite) NSUInteger recordCount;
+@property (nonatomic, assign, readwrite) NSUInteger skippedRecordCount;
+@property (nonatomic, assign, readwrite) NSUInteger loadCount;
+@property (nonatomic, assign, readwrite) NSUInteger hitCount;
+@property (nonatomic, assign, readwrite) NSTimeInterval duration;
+@property (nonatomic, copy, readwrite) NSDictionary<NSNumber *, SPTPersistentCacheTraceOperationStatistics *> *operationStatistics;
+@end
+
+@implementation SPTPersistentCacheTraceReplayReport
+
+- (double)hitRatio
+{
+    return (self.loadCount > 0 ? (double)self.hitCount / self.loadCount : 0.0);
+}
+
+- (NSString *)description
+{
+    return SPTPersistentCacheObjectDescription(self, @(self.hitRatio), @"hit-ratio");
+}
+
+- (NSString *)debugDescription
+{
+    return SPTPersistentCacheObjectDescription(self,
+                                               @(self.recordCount), @"record-count",
+                                               @(self.skippedRecordCount), @"skipped-record-count",
+                                               @(self.hitRatio), @"hit-ratio",
+                                               @(self.duration), @"duration",
+                                               self.operationStatistics.allValues, @"operation-statistics");
+}
+
+@end
+
+
+#pragma mark - SPTPersistentCacheTraceReplayer
+
+@implementation SPTPersistentCacheTraceReplayer
+
+- (instancetype)initWithTracePath:(NSString *)tracePath
+{
+    self = [super init];
+    if (self) {
+        _tracePath = [tracePath copy];
+    }
+    return self;
+}
+
+- (SPTPersistentCacheTraceReplayReport *)replayAgainstCache:(SPTPersistentCache *)cache
+                                                    timing:(SPTPersistentCacheTraceReplayTiming)timing
+                                                     error:(NSError * __autoreleasing *)error
+{
+    FILE *file = fopen(self.tracePath.fileSystemRepresentation, "rb");
+    if (file == NULL) {
+        if (error) {
+            const int errorNumber = errno;
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                         code:errorNumber
+                                     userInfo:@{ NSLocalizedDescriptionKey: @(strerror(errorNumber)) }];
+        }
+        return nil;
+    }
+
+    SPTPersistentCacheTraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != SPTPersistentCacheTraceMagicValue ||
+        header.version != SPTPersistentCacheTraceVersion ||
+        header.recordSize != sizeof(SPTPersistentCacheTraceRecord)) {
+        fclose(file);
+        if (error) {
+            *error = [NSError spt_persistentDataCacheErrorWithCode:SPTPersistentCacheLoadingErrorMagicMismatch];
+        }
+        return nil;
+    }
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+
+    // Callbacks are delivered on a private serial queue, which also guards the statistics and the hit count
+    dispatch_queue_t const callbackQueue = dispatch_queue_create("com.spotify.persistent.cache.trace.replay", DISPATCH_QUEUE_SERIAL);
+    dispatch_group_t const pendingOperations = dispatch_group_create();
+
+    NSMutableDictionary<NSNumber *, SPTPersistentCacheTraceOperationStatistics *> *statistics = [NSMutableDictionary dictionary];
+    SPTPersistentCacheTraceReplayReport *report = [SPTPersistentCacheTraceReplayReport new];
+    NSUInteger __block hitCount = 0;
+
+    // Payloads are slices of zero filled buffers, a larger one is allocated for a larger payload. Earlier buffers are
+    // kept since operations still running may read from them.
+    NSMutableArray<NSData *> *zeroBuffers = [NSMutableArray array];
+
+    // Tags recorded ahead of the store of their record, keyed by the key hash of the record
+    NSMutableDictionary<NSNumber *, NSMutableSet<NSString *> *> *pendingTags = [NSMutableDictionary dictionary];
+
+    const uint64_t startMachTime = mach_absolute_time();
+    SPTPersistentCacheTraceRecord record;
+
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        report.recordCount += 1;
+
+        @autoreleasepool {
+            // The keys of an operation on several keys follow its record
+            NSMutableArray<NSString *> * const keys = [NSMutableArray arrayWithCapacity:record.keyCount];
+            uint64_t keyHash = 0;
+            while (keys.count < record.keyCount && fread(&keyHash, sizeof(keyHash), 1, file) == 1) {
+                [keys addObject:SPTPersistentCacheTraceReplayKey(keyHash)];
+            }
+            if (keys.count < record.keyCount) {
+                // The trace ends in the middle of the record
+                report.skippedRecordCount += 1;
+                break;
+            }
+
+            if (timing == SPTPersistentCacheTraceReplayTimingOriginal) {
+                const uint64_t elapsedNs = (mach_absolute_time() - startMachTime) * timebase.numer / timebase.denom;
+                if (record.timestampNs > elapsedNs) {
+                    [NSThread sleepForTimeInterval:(double)(record.timestampNs - elapsedNs) / NSEC_PER_SEC];
+                }
+            }
+
+            NSString * const key = SPTPersistentCacheTraceReplayKey(record.keyHash);
+            const BOOL locked = (record.flags & SPTPersistentCacheTraceRecordFlagsLocked) != 0;
+            const SPTPersistentCacheTraceOperation operation = record.operation;
+
+            // Tags aren’t operations of their own, they go with the store that follows them
+            if (operation == SPTPersistentCacheTraceOperationTag) {
+                NSNumber * const recordKeyHash = @(record.recordKeyHash);
+                NSMutableSet<NSString *> *tags = pendingTags[recordKeyHash];
+                if (tags == nil) {
+                    tags = [NSMutableSet set];
+                    pendingTags[recordKeyHash] = tags;
+                }
+                [tags addObject:key];
+                continue;
+            }
+
+            const uint64_t issueMachTime = mach_absolute_time();
+            // Locks and unlocks call back once per key
+            NSUInteger __block pendingCallbacks = 1;
+            void (^ const complete)(void) = ^{
+                if (--pendingCallbacks > 0) {
+                    return;
+                }
+                const uint64_t latencyNs = (mach_absolute_time() - issueMachTime) * timebase.numer / timebase.denom;
+                NSNumber * const operationKey = @(operation);
+                SPTPersistentCacheTraceOperationStatistics *operationStatistics = statistics[operationKey];
+                if (operationStatistics == nil) {
+                    operationStatistics = [[SPTPersistentCacheTraceOperationStatistics alloc] initWithOperation:operation];
+                    statistics[operationKey] = operationStatistics;
+                }
+                [operationStatistics addLatency:(double)latencyNs / NSEC_PER_SEC];
+                dispatch_group_leave(pendingOperations);
+            };
+            SPTPersistentCacheResponseCallback const callback = ^(SPTPersistentCacheResponse *response) {
+                if ((operation == SPTPersistentCacheTraceOperationLoad ||
+                     operation == SPTPersistentCacheTraceOperationFetch ||
+                     operation == SPTPersistentCacheTraceOperationLoadWithPrefix) &&
+                    response.result == SPTPersistentCacheResponseCodeOperationSucceeded) {
+                    hitCount += 1;
+                }
+                complete();
+            };
+
+            // Stores, appends and replaced ranges carry a payload
+            NSData *payload = nil;
+            if (operation == SPTPersistentCacheTraceOperationStore ||
+                operation == SPTPersistentCacheTraceOperationAppend ||
+                operation == SPTPersistentCacheTraceOperationReplaceRange) {
+                const NSUInteger payloadSize = (NSUInteger)record.payloadSize;
+                if (zeroBuffers.lastObject.length < payloadSize) {
+                    NSData * const zeroBuffer = [NSMutableData dataWithLength:payloadSize];
+                    if (zeroBuffer != nil) {
+                        [zeroBuffers addObject:zeroBuffer];
+                    }
+                }
+                if (zeroBuffers.lastObject.length >= payloadSize) {
+                    payload = [NSData dataWithBytesNoCopy:(void *)zeroBuffers.lastObject.bytes length:payloadSize freeWhenDone:NO];
+                }
+            }
+
+            dispatch_group_enter(pendingOperations);
+            BOOL issued = YES;
+
+            switch (operation) {
+                case SPTPersistentCacheTraceOperationLoad:
+                // A miss of a fetch is followed by the store of the fetched data in the trace
+                case SPTPersistentCacheTraceOperationFetch:
+                    issued = [cache loadDataForKey:key withCallback:callback onQueue:callbackQueue];
+                    report.loadCount += (issued ? 1 : 0);
+                    break;
+                case SPTPersistentCacheTraceOperationLoadWithPrefix: {
+                    // Keys are only known by their hashes, so the replayed key of the record that was opened is used
+                    // as the prefix, only that key has it. A load that opened nothing lists the keys with the prefix
+                    // replayed like a key, which none of them have.
+                    NSString * const prefix = (record.recordKeyHash != 0 ? SPTPersistentCacheTraceReplayKey(record.recordKeyHash) : key);
+                    issued = [cache loadDataForKeysWithPrefix:prefix
+                                            chooseKeyCallback:^NSString *(NSArray<NSString *> *keysToConsider) {
+                                                return keysToConsider.firstObject;
+                                            } withCallback:callback onQueue:callbackQueue];
+                    report.loadCount += (issued ? 1 : 0);
+                    break;
+                }
+                case SPTPersistentCacheTraceOperationLoadMetadataWithPrefix:
+                    // The prefix is only known by its hash, so no key has it, the listing is replayed still
+                    issued = [cache loadMetadataForKeysWithPrefix:key callback:^(SPTPersistentCacheResponse *response, NSArray<SPTPersistentCacheRecordMetadata *> *metadata) {
+                        complete();
+                    } onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationStore: {
+                    if (payload == nil) {
+                        issued = NO;
+                        break;
+                    }
+                    NSSet<NSString *> * const tags = pendingTags[@(record.keyHash)];
+                    [pendingTags removeObjectForKey:@(record.keyHash)];
+                    SPTPersistentCacheStoreOptions * const storeOptions = [SPTPersistentCacheStoreOptions new];
+                    storeOptions.ttl = record.ttl;
+                    storeOptions.locked = locked;
+                    storeOptions.tags = tags;
+                    issued = [cache storeData:payload forKey:key options:storeOptions withCallback:callback onQueue:callbackQueue];
+                    // Without a tag index the record is stored without its tags
+                    if (!issued && tags.count > 0) {
+                        storeOptions.tags = nil;
+                        issued = [cache storeData:payload forKey:key options:storeOptions withCallback:callback onQueue:callbackQueue];
+                    }
+                    break;
+                }
+                case SPTPersistentCacheTraceOperationAppend:
+                    issued = (payload != nil && [cache appendData:payload toKey:key callback:callback onQueue:callbackQueue]);
+                    break;
+                case SPTPersistentCacheTraceOperationReplaceRange:
+                    // Only the length of the range is recorded, it is replaced at the start of the record
+                    issued = (payload != nil && record.rangeLength <= NSUIntegerMax &&
+                              [cache replaceRange:NSMakeRange(0, (NSUInteger)record.rangeLength)
+                                         withData:payload
+                                           forKey:key
+                                         callback:callback
+                                          onQueue:callbackQueue]);
+                    break;
+                case SPTPersistentCacheTraceOperationRemoveTag:
+                    issued = [cache removeDataForTag:key callback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationLockTag:
+                    issued = [cache lockDataForTag:key callback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationWarmUp:
+                    issued = [cache warmUpWithCallback:^(NSUInteger prefetchedRecordCount, BOOL completed) {
+                        complete();
+                    } onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationEnumerateMetadata:
+                    // Like for prefix loads only walks of all records can be replayed
+                    if (record.keyHash != 0) {
+                        issued = NO;
+                        break;
+                    }
+                    issued = [cache enumerateMetadataForKeysWithPrefix:nil
+                                                             predicate:nil
+                                                             batchSize:record.batchSize
+                                                     cancellationToken:nil
+                                                              callback:^(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished) {
+                                                                  if (finished) {
+                                                                      complete();
+                                                                  }
+                                                              } onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationTouch:
+                    [cache touchDataForKey:key callback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationRemove:
+                    [cache removeDataForKeys:keys callback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationLock:
+                    pendingCallbacks = keys.count;
+                    issued = [cache lockDataForKeys:keys callback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationUnlock:
+                    pendingCallbacks = keys.count;
+                    issued = [cache unlockDataForKeys:keys callback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationPrune:
+                    [cache pruneWithCallback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationWipeLocked:
+                    [cache wipeLockedFilesWithCallback:callback onQueue:callbackQueue];
+                    break;
+                case SPTPersistentCacheTraceOperationWipeNonLocked:
+                    [cache wipeNonLockedFilesWithCallback:callback onQueue:callbackQueue];
+                    break;
+                default:
+                    issued = NO;
+                    break;
+            }
+
+            if (!issued) {
+                dispatch_group_leave(pendingOperations);
+                report.skippedRecordCount += 1;
+                continue;
+            }
+
+            if (timing == SPTPersistentCacheTraceReplayTimingAsFastAsPossible) {
+                dispatch_group_wait(pendingOperations, DISPATCH_TIME_FOREVER);
+            }
+        }
+    }
+
+    fclose(file);
+    dispatch_group_wait(pendingOperations, DISPATCH_TIME_FOREVER);
+    // Every operation has called back, so no store reads from the zero buffers anymore
+    [zeroBuffers removeAllObjects];
+
+    dispatch_sync(callbackQueue, ^{
+        report.hitCount = hitCount;
+        report.operationStatistics = statistics;
+    });
+    report.duration = (double)((mach_absolute_time() - startMachTime) * timebase.numer / timebase.denom) / NSEC_PER_SEC;
+
+    return report;
+}
+
+@end
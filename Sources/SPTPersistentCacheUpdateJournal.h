@@ -0,0 +1,47 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheHeader.h>
+
+/**
+ The value of the magic number at the start of an update journal.
+ */
+extern const uint32_t SPTPersistentCacheUpdateJournalMagicValue;
+
+/**
+ The header of the journal of an in-place update of a record. It is followed by `length` bytes that are written at
+ `offset` of the payload, after which the record is truncated to and gets `recordHeader`.
+ */
+typedef struct SPTPersistentCacheUpdateJournalHeader {
+    uint32_t magic;
+    uint32_t crc;           // spt_crc32 of everything following it
+    uint64_t offset;        // offset in the payload the bytes are written at
+    uint64_t length;        // bytes following the header
+    SPTPersistentCacheRecordHeader recordHeader;
+} SPTPersistentCacheUpdateJournalHeader;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Encodes the journal of an update writing bytes at an offset of the payload of a record.
+
+ @param recordHeader The header of the record once the update has been applied.
+ @param offset The offset in the payload the bytes are written at.
+ @param bytes The bytes to write.
+ */
+FOUNDATION_EXPORT NSData *SPTPersistentCacheUpdateJournalEncode(const SPTPersistentCacheRecordHeader *recordHeader,
+                                                                 uint64_t offset,
+                                                                 NSData *bytes);
+
+/**
+ Decodes and checks an update journal.
+
+ @param journal The contents of the journal file.
+ @param header Set to the header of the journal.
+ @return The bytes to write, or nil if the journal is torn or isn’t one.
+ */
+FOUNDATION_EXPORT NSData * _Nullable SPTPersistentCacheUpdateJournalDecode(NSData *journal,
+                                                                           SPTPersistentCacheUpdateJournalHeader *header);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,52 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import "SPTPersistentCacheUpdateJournal.h"
+
+#include "crc32iso3309.h"
+
+const uint32_t SPTPersistentCacheUpdateJournalMagicValue = 0x55545053; // SPTU
+
+// The checksum covers everything after the magic and itself
+static const size_t SPTPersistentCacheUpdateJournalChecksumOffset = offsetof(SPTPersistentCacheUpdateJournalHeader, offset);
+
+_Static_assert(sizeof(SPTPersistentCacheUpdateJournalHeader) == 88,
+               "Struct SPTPersistentCacheUpdateJournalHeader has to be packed without padding");
+
+NSData *SPTPersistentCacheUpdateJournalEncode(const SPTPersistentCacheRecordHeader *recordHeader,
+                                              uint64_t offset,
+                                              NSData *bytes)
+{
+    SPTPersistentCacheUpdateJournalHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SPTPersistentCacheUpdateJournalMagicValue;
+    header.offset = offset;
+    header.length = bytes.length;
+    header.recordHeader = *recordHeader;
+
+    NSMutableData *journal = [NSMutableData dataWithCapacity:sizeof(header) + bytes.length];
+    [journal appendBytes:&header length:sizeof(header)];
+    [journal appendData:bytes];
+
+    SPTPersistentCacheUpdateJournalHeader *journalHeader = journal.mutableBytes;
+    journalHeader->crc = spt_crc32((const uint8_t *)journal.bytes + SPTPersistentCacheUpdateJournalChecksumOffset,
+                                   journal.length - SPTPersistentCacheUpdateJournalChecksumOffset);
+    return journal;
+}
+
+NSData *SPTPersistentCacheUpdateJournalDecode(NSData *journal, SPTPersistentCacheUpdateJournalHeader *header)
+{
+    if (journal.length < sizeof(*header)) {
+        return nil;
+    }
+
+    memcpy(header, journal.bytes, sizeof(*header));
+    if (header->magic != SPTPersistentCacheUpdateJournalMagicValue ||
+        header->length != journal.length - sizeof(*header) ||
+        spt_crc32((const uint8_t *)journal.bytes + SPTPersistentCacheUpdateJournalChecksumOffset,
+                  journal.length - SPTPersistentCacheUpdateJournalChecksumOffset) != header->crc) {
+        return nil;
+    }
+
+    return [journal subdataWithRange:NSMakeRange(sizeof(*header), (NSUInteger)header->length)];
+}
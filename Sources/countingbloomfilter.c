@@ -0,0 +1,120 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "countingbloomfilter.h"
+
+#include <math.h>
+#include <string.h>
+
+/**
+ Counters are derived with double hashing as described in Kirsch, Mitzenmacher: "Less Hashing, Same Performance:
+ Building a Better Bloom Filter". Counters that reach the maximum stick, so they never underflow on removal.
+ */
+
+static const uint8_t counter_max = UINT8_MAX;
+static const unsigned max_hash_count = 16;
+
+struct spt_counting_bloom_filter {
+    size_t counter_count;
+    unsigned hash_count;
+    uint8_t *counters;
+};
+
+/* splitmix64 finalizer, spreads weak input hashes over all 64 bits */
+static uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+spt_counting_bloom_filter *spt_counting_bloom_filter_create(size_t capacity, double false_positive_rate)
+{
+    if (capacity == 0 || !(false_positive_rate > 0.0 && false_positive_rate < 1.0)) {
+        return NULL;
+    }
+
+    const double ln2 = 0.69314718055994530942;
+    const double counters = ceil(-(double)capacity * log(false_positive_rate) / (ln2 * ln2));
+    const double hashes = round(counters / (double)capacity * ln2);
+
+    spt_counting_bloom_filter *filter = malloc(sizeof(*filter));
+    if (filter == NULL) {
+        return NULL;
+    }
+    filter->counter_count = (size_t)counters;
+    filter->hash_count = (unsigned)fmin(fmax(hashes, 1.0), (double)max_hash_count);
+    filter->counters = calloc(filter->counter_count, sizeof(uint8_t));
+    if (filter->counters == NULL) {
+        free(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+void spt_counting_bloom_filter_destroy(spt_counting_bloom_filter *filter)
+{
+    if (filter == NULL) {
+        return;
+    }
+    free(filter->counters);
+    free(filter);
+}
+
+static size_t counter_index(const spt_counting_bloom_filter *filter, uint64_t mixed, unsigned i)
+{
+    const uint64_t h1 = mixed & 0xffffffffULL;
+    const uint64_t h2 = (mixed >> 32) | 1ULL;
+    return (size_t)((h1 + i * h2) % filter->counter_count);
+}
+
+void spt_counting_bloom_filter_add(spt_counting_bloom_filter *filter, uint64_t hash)
+{
+    const uint64_t mixed = mix64(hash);
+    for (unsigned i = 0; i < filter->hash_count; ++i) {
+        uint8_t *counter = &filter->counters[counter_index(filter, mixed, i)];
+        if (*counter < counter_max) {
+            ++*counter;
+        }
+    }
+}
+
+void spt_counting_bloom_filter_remove(spt_counting_bloom_filter *filter, uint64_t hash)
+{
+    const uint64_t mixed = mix64(hash);
+    for (unsigned i = 0; i < filter->hash_count; ++i) {
+        uint8_t *counter = &filter->counters[counter_index(filter, mixed, i)];
+        if (*counter > 0 && *counter < counter_max) {
+            --*counter;
+        }
+    }
+}
+
+int spt_counting_bloom_filter_might_contain(const spt_counting_bloom_filter *filter, uint64_t hash)
+{
+    const uint64_t mixed = mix64(hash);
+    for (unsigned i = 0; i < filter->hash_count; ++i) {
+        if (filter->counters[counter_index(filter, mixed, i)] == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void spt_counting_bloom_filter_clear(spt_counting_bloom_filter *filter)
+{
+    memset(filter->counters, 0, filter->counter_count);
+}
+
+size_t spt_counting_bloom_filter_counter_count(const spt_counting_bloom_filter *filter)
+{
+    return filter->counter_count;
+}
+
+unsigned spt_counting_bloom_filter_hash_count(const spt_counting_bloom_filter *filter)
+{
+    return filter->hash_count;
+}
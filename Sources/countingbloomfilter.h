@@ -0,0 +1,35 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef COUNTINGBLOOMFILTER_H
+#define COUNTINGBLOOMFILTER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counting Bloom filter over 64-bit hashes with 8-bit saturating counters. Not thread safe. */
+typedef struct spt_counting_bloom_filter spt_counting_bloom_filter;
+
+/* Create a filter sized for capacity elements at the given false positive rate. Returns NULL on failure. */
+spt_counting_bloom_filter *spt_counting_bloom_filter_create(size_t capacity, double false_positive_rate);
+void spt_counting_bloom_filter_destroy(spt_counting_bloom_filter *filter);
+
+void spt_counting_bloom_filter_add(spt_counting_bloom_filter *filter, uint64_t hash);
+/* Only call for hashes that were added before, otherwise false negatives are introduced. */
+void spt_counting_bloom_filter_remove(spt_counting_bloom_filter *filter, uint64_t hash);
+/* Return 0 if the hash was definitely never added, 1 otherwise. */
+int spt_counting_bloom_filter_might_contain(const spt_counting_bloom_filter *filter, uint64_t hash);
+void spt_counting_bloom_filter_clear(spt_counting_bloom_filter *filter);
+
+size_t spt_counting_bloom_filter_counter_count(const spt_counting_bloom_filter *filter);
+unsigned spt_counting_bloom_filter_hash_count(const spt_counting_bloom_filter *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
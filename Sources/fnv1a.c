@@ -0,0 +1,23 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "fnv1a.h"
+
+/**
+ Algorithm is taken from draft-eastlake-fnv. Fowler/Noll/Vo hash, FNV-1a variant.
+ */
+
+static const uint64_t fnv1a64_offset_basis = 0xcbf29ce484222325ULL;
+static const uint64_t fnv1a64_prime = 0x00000100000001b3ULL;
+
+/* Return the 64-bit FNV-1a hash of the bytes buf[0..len-1]. */
+uint64_t spt_fnv1a64(const uint8_t *buf, size_t len)
+{
+    uint64_t h = fnv1a64_offset_basis;
+
+    for (size_t n = 0; n < len; ++n) {
+        h ^= buf[n];
+        h *= fnv1a64_prime;
+    }
+    return h;
+}
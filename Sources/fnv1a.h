@@ -0,0 +1,21 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef FNV1A_H
+#define FNV1A_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Return the 64-bit FNV-1a hash of the bytes buf[0..len-1]. */
+uint64_t spt_fnv1a64(const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,8 +1,14 @@
 // Copyright Spotify AB.
 // SPDX-License-Identifier: Apache-2.0
 
+#import <SPTPersistentCache/SPTPersistentCacheCancellationToken.h>
+#import <SPTPersistentCache/SPTPersistentCacheFileHandle.h>
 #import <SPTPersistentCache/SPTPersistentCacheHeader.h>
 #import <SPTPersistentCache/SPTPersistentCacheImplementation.h>
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
 #import <SPTPersistentCache/SPTPersistentCacheRecord.h>
+#import <SPTPersistentCache/SPTPersistentCacheRecordMetadata.h>
 #import <SPTPersistentCache/SPTPersistentCacheResponse.h>
+#import <SPTPersistentCache/SPTPersistentCacheStoreOptions.h>
+#import <SPTPersistentCache/SPTPersistentCacheTraceReplayer.h>
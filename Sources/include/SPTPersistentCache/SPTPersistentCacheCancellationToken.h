@@ -0,0 +1,31 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @brief SPTPersistentCacheCancellationToken
+ @discussion Class defines a handle that cancels the cache operations it was passed to.
+             Operations that haven’t started yet are removed from the work queue and never touch the disk.
+             Operations that are already running finish their I/O, but their callbacks aren’t invoked.
+             One token may be passed to several operations, e.g. all loads issued for one reusable cell, and
+             cancels all of them at once. Once cancelled a token stays cancelled, operations started with it
+             are cancelled immediately. This class is threadsafe.
+ */
+@interface SPTPersistentCacheCancellationToken : NSObject
+
+/**
+ Whether `cancel` has been called on the token.
+ */
+@property (nonatomic, assign, readonly, getter=isCancelled) BOOL cancelled;
+
+/**
+ Cancels all operations started with the token.
+ */
+- (void)cancel;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,46 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @brief SPTPersistentCacheFileHandle
+ @discussion Class defines a read-only file descriptor of a validated cache record, for consumers that want to hand
+             the payload to `sendfile`, `mmap` and alike instead of loading it into memory. The payload is the
+             `payloadLength` bytes at `payloadOffset`, the bytes before it are the record header.
+             While the handle is open the record is neither evicted nor removed, removals are carried out once the
+             last handle of the key is closed. The descriptor is closed when the handle is closed or deallocated,
+             so keep a reference to the handle for as long as the descriptor is used. This class is threadsafe.
+ */
+@interface SPTPersistentCacheFileHandle : NSObject
+
+/**
+ The key of the record.
+ */
+@property (nonatomic, copy, readonly) NSString *key;
+/**
+ The file descriptor of the record, opened read-only. `-1` once the handle has been closed.
+ */
+@property (nonatomic, assign, readonly) int fileDescriptor;
+/**
+ The offset of the payload in the file.
+ */
+@property (nonatomic, assign, readonly) off_t payloadOffset;
+/**
+ The length of the payload in bytes.
+ */
+@property (nonatomic, assign, readonly) uint64_t payloadLength;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Closes the file descriptor and unpins the record. Calling it more than once has no effect.
+ */
+- (void)close;
+
+@end
+
+NS_ASSUME_NONNULL_END
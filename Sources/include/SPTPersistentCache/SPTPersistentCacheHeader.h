@@ -18,6 +18,16 @@ typedef NS_ENUM(NSInteger, SPTPersistentCacheRecordHeaderFlags) {
      This is not an error state but more Application logic.
      */
     SPTPersistentCacheRecordHeaderFlagsStreamIncomplete = 0x1,
+    /*
+     Indicates that the header is followed by the digest of the payload, which is kept in a blob shared by all records
+     with the same payload. `payloadSizeBytes` is the size of the payload, not of the digest.
+     */
+    SPTPersistentCacheRecordHeaderFlagsDeduplicated = 0x2,
+    /*
+     Indicates that an in-place update of the payload was started and may not have been applied completely. The update
+     journal next to the record holds what is needed to finish it.
+     */
+    SPTPersistentCacheRecordHeaderFlagsUpdatePending = 0x4,
 };
 
 /**
@@ -33,8 +43,15 @@ typedef struct SPTPersistentCacheRecordHeader {
     // Time of last update i.e. creation or access
     uint64_t updateTimeSec; // unix time scale
     uint64_t payloadSizeBytes;
-    uint64_t reserved2;
-    uint32_t reserved3;
+    // The reserved fields keep their names for source compatibility, the hints alias them
+    union {
+        uint64_t reserved2;
+        uint64_t refetchCost;   // cost hint of fetching the payload again, 0 if none was given
+    };
+    union {
+        uint32_t reserved3;
+        uint32_t priority;      // See SPTPersistentCacheRecordPriority
+    };
     uint32_t reserved4;
     uint32_t flags;         // See SPTPersistentRecordHeaderFlags
     uint32_t crc;
@@ -49,6 +66,11 @@ FOUNDATION_EXPORT const SPTPersistentCacheMagicType SPTPersistentCacheMagicValue
  The size of the record header in bytes.
  */
 FOUNDATION_EXPORT const size_t SPTPersistentCacheRecordHeaderSize;
+/**
+ The size in bytes the header of a large record is padded to, so its payload starts at a page aligned offset. The
+ `headerSize` of such a header is set to it.
+ */
+FOUNDATION_EXPORT const size_t SPTPersistentCacheRecordAlignedHeaderSize;
 
 // Following functions used internally and could be used for testing purposes also.
 
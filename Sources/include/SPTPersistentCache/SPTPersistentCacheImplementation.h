@@ -2,8 +2,12 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #import <Foundation/Foundation.h>
+#import <SPTPersistentCache/SPTPersistentCacheStoreOptions.h>
 
+@class SPTPersistentCacheCancellationToken;
+@class SPTPersistentCacheFileHandle;
 @class SPTPersistentCacheOptions;
+@class SPTPersistentCacheRecordMetadata;
 @class SPTPersistentCacheResponse;
 
 NS_ASSUME_NONNULL_BEGIN
@@ -65,6 +69,35 @@ typedef void (^SPTPersistentCacheResponseCallback)(SPTPersistentCacheResponse *r
  Type of callback that is used to give caller a chance to choose which key to open if any.
  */
 typedef NSString * _Nonnull(^SPTPersistentCacheChooseKeyCallback)(NSArray<NSString *> *keys);
+/**
+ Type of callback a loader calls once it is done. Data is nil if the load failed, in which case error may say why.
+ */
+typedef void (^SPTPersistentCacheLoaderCompletion)(NSData * _Nullable data, NSError * _Nullable error);
+/**
+ Type of block that fetches the data for a key the cache doesn’t have, e.g. from the network. The completion must be
+ called exactly once, on any thread.
+ */
+typedef void (^SPTPersistentCacheLoader)(NSString *key, SPTPersistentCacheLoaderCompletion completion);
+/**
+ Type of callback for opening file handles. The file handle is nil unless the operation succeeded.
+ */
+typedef void (^SPTPersistentCacheFileHandleCallback)(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle * _Nullable fileHandle);
+/**
+ Type of callback for metadata queries. The array is empty unless the operation succeeded.
+ */
+typedef void (^SPTPersistentCacheMetadataCallback)(SPTPersistentCacheResponse *response, NSArray<SPTPersistentCacheRecordMetadata *> *metadata);
+/**
+ Type of callback for warming up the cache. Completed is NO if the warm-up stopped early for foreground work.
+ */
+typedef void (^SPTPersistentCacheWarmUpCallback)(NSUInteger prefetchedRecordCount, BOOL completed);
+/**
+ Type of block choosing the records a metadata enumeration passes on.
+ */
+typedef BOOL (^SPTPersistentCacheMetadataPredicate)(SPTPersistentCacheRecordMetadata *metadata);
+/**
+ Type of callback for enumerating metadata in batches. Finished is YES for the last batch, which may be empty.
+ */
+typedef void (^SPTPersistentCacheMetadataBatchCallback)(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished);
 
 
 #pragma mark - SPTPersistentCache Interface
@@ -101,6 +134,19 @@ typedef NSString * _Nonnull(^SPTPersistentCacheChooseKeyCallback)(NSArray<NSStri
 - (BOOL)loadDataForKey:(NSString *)key
           withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Load data from cache for specified key. The load can be cancelled through the given token.
+ If the token is cancelled before the load has started no I/O is done, if it’s cancelled later the callback is not
+ called.
+ @param key Key used to access the data.
+ @param cancellationToken Token that cancels the load. May be nil.
+ @param callback callback to call once data is loaded. It mustn't be nil.
+ @param queue Queue on which to run the callback. Mustn't be nil.
+ */
+- (BOOL)loadDataForKey:(NSString *)key
+     cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
+          withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+               onQueue:(dispatch_queue_t _Nullable)queue;
 /**
  @discussion Load data for key which has specified prefix. chooseKeyCallback is called with array of matching keys.
  Req.#1.1a. To load the data user needs to pick one key and return it.
@@ -116,6 +162,87 @@ typedef NSString * _Nonnull(^SPTPersistentCacheChooseKeyCallback)(NSArray<NSStri
                 chooseKeyCallback:(SPTPersistentCacheChooseKeyCallback _Nullable)chooseKeyCallback
                      withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
                           onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Load data for key which has specified prefix. Behaves like
+ loadDataForKeysWithPrefix:chooseKeyCallback:withCallback:onQueue: but can be cancelled through the given token.
+ Neither chooseKeyCallback nor callback are called once the token is cancelled.
+ @param prefix Prefix which key should have to be candidate for loading.
+ @param chooseKeyCallback callback to call to define which key to use to load the data.
+ @param cancellationToken Token that cancels the load. May be nil.
+ @param callback callback to call once data is loaded. It mustn't be nil.
+ @param queue Queue on which to run the callback. Mustn't be nil.
+ */
+- (BOOL)loadDataForKeysWithPrefix:(NSString *)prefix
+                chooseKeyCallback:(SPTPersistentCacheChooseKeyCallback _Nullable)chooseKeyCallback
+                cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
+                     withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                          onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Finds the records whose key has specified prefix and passes their metadata to the callback, sorted by
+ key, without loading any payload. If no record matches the response is SPTPersistentCacheResponseCodeNotFound.
+ With `useKeyIndex` set in the options this is answered from memory once the index has been populated.
+ Req.#1.2. Expired records are left out.
+ @param prefix Prefix which key should have to be included.
+ @param callback callback to call with the metadata. It mustn't be nil.
+ @param queue Queue on which to run the callback. Mustn't be nil.
+ */
+- (BOOL)loadMetadataForKeysWithPrefix:(NSString *)prefix
+                             callback:(SPTPersistentCacheMetadataCallback _Nullable)callback
+                              onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Walks the metadata of all records, or of the ones whose key has the given prefix, and passes it to the
+ callback in batches, without loading any payload. Only the headers of the records are read, or nothing at all with
+ `useKeyIndex` set in the options once the index has been populated. The next batch is only read once the callback
+ returned, so the memory used doesn't depend on the number of records. The walk runs with the priority of garbage
+ collection and lets other work go first between batches. Records aren't visited in any particular order and, unlike
+ loadMetadataForKeysWithPrefix:callback:onQueue:, expired records are included.
+ Once the token is cancelled no more records are read and the callback isn't called anymore.
+ @param prefix Prefix which key should have to be included. May be nil to include all records.
+ @param predicate Block choosing the records to include. May be nil to include all records.
+ @param batchSize The maximum number of records passed to one call of the callback, at least 1.
+ @param cancellationToken Token that stops the enumeration. May be nil.
+ @param callback callback to call with each batch of metadata. It mustn't be nil.
+ @param queue Queue on which to run the callback. Mustn't be nil.
+ */
+- (BOOL)enumerateMetadataForKeysWithPrefix:(NSString * _Nullable)prefix
+                                 predicate:(SPTPersistentCacheMetadataPredicate _Nullable)predicate
+                                 batchSize:(NSUInteger)batchSize
+                         cancellationToken:(SPTPersistentCacheCancellationToken * _Nullable)cancellationToken
+                                  callback:(SPTPersistentCacheMetadataBatchCallback _Nullable)callback
+                                   onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Load data from cache for specified key, fetching it with the loader if it isn’t cached.
+ On a miss the loader is run, its data is stored with the given TTL and then passed to the callback. Concurrent misses
+ for the same key share one run of the loader. If the loader fails the callback gets
+ SPTPersistentCacheResponseCodeOperationError. A record that can’t be read is treated as a miss.
+ When serveStale is YES an expired record is passed to the callback right away, with the response flagged as stale,
+ while a fresh copy is loaded and stored in the background. Otherwise expired records are treated as misses.
+ @param key Key used to access the data.
+ @param loader Block fetching the data on a miss. It mustn't be nil.
+ @param ttl TTL to store the loaded data with. 0 means the default expiration policy.
+ @param serveStale Whether an expired record is returned while it’s being refreshed.
+ @param callback callback to call once data is loaded. It mustn't be nil.
+ @param queue Queue on which to run the callback. Mustn't be nil.
+ */
+- (BOOL)loadDataForKey:(NSString *)key
+                loader:(SPTPersistentCacheLoader _Nullable)loader
+                   ttl:(NSUInteger)ttl
+            serveStale:(BOOL)serveStale
+          withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+               onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Opens the record for specified key as a read-only file descriptor instead of loading its payload.
+ The header is validated and the access time updated just like on load, the payload itself isn’t read. The record is
+ pinned until the handle is closed: it isn’t evicted, and removals, wipes and prunes of it are carried out once it’s
+ closed. The response carries no record.
+ Req.#1.2. Expired records treated as not found.
+ @param key Key used to access the data.
+ @param callback callback to call once the record is opened. It mustn't be nil.
+ @param queue Queue on which to run the callback. Mustn't be nil.
+ */
+- (BOOL)openFileHandleForKey:(NSString *)key
+                withCallback:(SPTPersistentCacheFileHandleCallback _Nullable)callback
+                     onQueue:(dispatch_queue_t _Nullable)queue;
 /**
  @discussion Req.#1.0. If data already exist for that key it will be overwritten otherwise created.
  Its access time will be updated. RefCount depends on locked parameter.
@@ -149,6 +276,89 @@ typedef NSString * _Nonnull(^SPTPersistentCacheChooseKeyCallback)(NSArray<NSStri
            locked:(BOOL)locked
      withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
           onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Req.#1.0. If data already exist for that key it will be overwritten otherwise created.
+ Behaves like storeData:forKey:ttl:locked:withCallback:onQueue: with the TTL, lock status, tags, eviction hints and
+ cancellation token given by the options.
+ @param data Data to store. Mustn't be nil.
+ @param key Key to associate the data with.
+ @param options How to store the record. May be nil to use the defaults of SPTPersistentCacheStoreOptions.
+ @param callback Callback to call once data is stored. Could be nil.
+ @param queue Queue on which to run the callback. Couldn't be nil if callback is specified.
+ @return NO if the arguments are invalid, e.g. tags are given without `useTagIndex` set in the cache options.
+ */
+- (BOOL)storeData:(NSData *)data
+           forKey:(NSString *)key
+          options:(SPTPersistentCacheStoreOptions * _Nullable)options
+     withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+          onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Stores the contents of an existing file, e.g. a finished download, without loading it into memory.
+ The payload is copied behind the record header in fixed size chunks into a temporary file which is then moved into
+ place, so memory use doesn’t depend on the size of the file and a failed copy never leaves a partial record.
+ Otherwise behaves like storeData:forKey:ttl:locked:withCallback:onQueue:.
+ @param filePath Path of the file to store. The file is neither modified nor removed.
+ @param key Key to associate the data with.
+ @param ttl TTL value for a file. 0 is equivalent to storeData:forKey: behavior.
+ @param locked If YES then data refCount is set to 1. If NO then set to 0.
+ @param callback Callback to call once the file is stored. Could be nil.
+ @param queue Queue on which to run the callback. Couldn't be nil if callback is specified.
+ */
+- (BOOL)storeFileAtPath:(NSString *)filePath
+                 forKey:(NSString *)key
+                    ttl:(NSUInteger)ttl
+                 locked:(BOOL)locked
+           withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Behaves like storeFileAtPath:forKey:ttl:locked:withCallback:onQueue: with the TTL, lock status, tags,
+ eviction hints and cancellation token given by the options.
+ @param filePath Path of the file to store. The file is neither modified nor removed.
+ @param key Key to associate the data with.
+ @param options How to store the record. May be nil to use the defaults of SPTPersistentCacheStoreOptions.
+ @param callback Callback to call once the file is stored. Could be nil.
+ @param queue Queue on which to run the callback. Couldn't be nil if callback is specified.
+ @return NO if the arguments are invalid, e.g. tags are given without `useTagIndex` set in the cache options.
+ */
+- (BOOL)storeFileAtPath:(NSString *)filePath
+                 forKey:(NSString *)key
+                options:(SPTPersistentCacheStoreOptions * _Nullable)options
+           withCallback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Appends data to the payload of an existing record, writing only the appended bytes. Behaves like
+ replaceRange:withData:forKey:callback:onQueue: with the empty range at the end of the payload.
+ @param data Data to append. Mustn't be nil.
+ @param key Key of the record to append to.
+ @param callback May be nil if not interested in result.
+ @param queue Queue on which to run the callback. If callback is nil this is ignored otherwise mustn't be nil.
+ @return NO if the arguments are invalid.
+ */
+- (BOOL)appendData:(NSData *)data
+             toKey:(NSString *)key
+          callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+           onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Replaces a range of the payload of an existing record in place. Only the new bytes are written, plus the
+ rest of the payload if the length of the range changes, so the cost follows the size of the change rather than the
+ size of the record. The bytes are first written to a journal next to the record, so an update interrupted by a crash
+ is finished by the next load instead of leaving a mix of old and new bytes. The record keeps its TTL and lock, and
+ its update time is set as if it was stored.
+ The callback is given SPTPersistentCacheResponseCodeNotFound if there is no record for key or it expired, and an
+ error if the range lies outside the payload or the record is open as a file handle
+ (SPTPersistentCacheLoadingErrorRecordIsStreamAndBusy).
+ @param range The range of the payload to replace.
+ @param data Data to replace the range with. Mustn't be nil.
+ @param key Key of the record to update.
+ @param callback May be nil if not interested in result.
+ @param queue Queue on which to run the callback. If callback is nil this is ignored otherwise mustn't be nil.
+ @return NO if the arguments are invalid.
+ */
+- (BOOL)replaceRange:(NSRange)range
+            withData:(NSData *)data
+              forKey:(NSString *)key
+            callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+             onQueue:(dispatch_queue_t _Nullable)queue;
 /**
  @discussion Update last access time in header of the record. Only applies for default expiration policy (ttl == 0).
  Locked files could be touched even if they are expired.
@@ -191,6 +401,75 @@ typedef NSString * _Nonnull(^SPTPersistentCacheChooseKeyCallback)(NSArray<NSStri
 - (BOOL)unlockDataForKeys:(NSArray<NSString *> *)keys
                  callback:(SPTPersistentCacheResponseCallback _Nullable)callback
                   onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @brief Removes the data of all records the tag is attached to unconditionally, in one operation.
+ @discussion The callback is called once, with SPTPersistentCacheResponseCodeNotFound if no record has the tag.
+ Requires `useTagIndex` to be set in the options.
+ @param tag The tag of the records to remove.
+ @param callback May be nil if not interested in result.
+ @param queue Queue on which to run the callback. If callback is nil this is ignored otherwise mustn't be nil.
+ @return NO if the arguments are invalid or there is no tag index.
+ */
+- (BOOL)removeDataForTag:(NSString *)tag
+                callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+                 onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Increment ref count of all records the tag is attached to, in one operation. Behaves like
+ lockDataForKeys:callback:onQueue: for their keys, or calls back once with SPTPersistentCacheResponseCodeNotFound if
+ no record has the tag. Requires `useTagIndex` to be set in the options.
+ Req.#1.2. Expired records treated as not found on lock.
+ @param tag The tag of the records to lock.
+ @param callback May be nil if not interested in result.
+ @param queue Queue on which to run the callback. If callback is nil this is ignored otherwise mustn't be nil.
+ @return NO if the arguments are invalid or there is no tag index.
+ */
+- (BOOL)lockDataForTag:(NSString *)tag
+              callback:(SPTPersistentCacheResponseCallback _Nullable)callback
+               onQueue:(dispatch_queue_t _Nullable)queue;
+/**
+ @discussion Loads data for key on the calling thread and returns the response the callback of
+ loadDataForKey:withCallback:onQueue: would be given. Meant for callers already on a background thread, it saves
+ the hops to the work queue and back. Like queued work it goes through the same record locking and maintenance
+ yields to it, but it doesn’t wait for work queued before it. Blocks on disk I/O, so don’t call it on the main thread.
+ @param key Key used to access the data. Mustn't be nil.
+ */
+- (SPTPersistentCacheResponse *)synchronouslyLoadDataForKey:(NSString *)key;
+/**
+ @discussion Stores data for key on the calling thread, see synchronouslyLoadDataForKey: and
+ storeData:forKey:ttl:locked:withCallback:onQueue:.
+ @param data Data to store. Mustn't be nil.
+ @param key Key associated with the data. Mustn't be nil.
+ @param ttl TTL value for a file. 0 is equivalent to no TTL. Not 0 means file has TTL in seconds.
+ @param locked If YES then data will be stored with refCount 1.
+ @return The response, an error if the arguments are invalid.
+ */
+- (SPTPersistentCacheResponse *)synchronouslyStoreData:(NSData *)data
+                                                forKey:(NSString *)key
+                                                   ttl:(NSUInteger)ttl
+                                                locked:(BOOL)locked;
+/**
+ @discussion Touches the record for key on the calling thread, see synchronouslyLoadDataForKey: and
+ touchDataForKey:callback:onQueue:.
+ @param key Key which record header to update. Mustn't be nil.
+ */
+- (SPTPersistentCacheResponse *)synchronouslyTouchDataForKey:(NSString *)key;
+/**
+ @discussion Removes data for keys on the calling thread, see synchronouslyLoadDataForKey: and
+ removeDataForKeys:callback:onQueue:.
+ @param keys The keys corresponding to the data to remove.
+ */
+- (SPTPersistentCacheResponse *)synchronouslyRemoveDataForKeys:(NSArray<NSString *> *)keys;
+/**
+ @discussion Asks the system to read the records in the access history into its page cache, the ones loaded most
+ often and most recently first, so the first loads after a restart don’t wait for the disk. The warm-up runs on the
+ maintenance lane at garbage collection priority and stops as soon as a load, store or other foreground operation is
+ queued. Does nothing unless `accessHistoryCapacity` is set in the options.
+ @param callback Callback to call once the warm-up finished or stopped. May be nil.
+ @param queue Queue on which to run the callback. If callback is nil this is ignored otherwise mustn't be nil.
+ @return YES if the warm-up was scheduled, NO if there is no access history.
+ */
+- (BOOL)warmUpWithCallback:(SPTPersistentCacheWarmUpCallback _Nullable)callback
+                   onQueue:(dispatch_queue_t _Nullable)queue;
 /**
  Schedule garbage collection. If already scheduled then this method does nothing.
  */
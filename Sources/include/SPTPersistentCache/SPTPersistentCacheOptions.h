@@ -3,6 +3,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class SPTPersistentCachePartition;
+
 NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark - Callback Types
@@ -42,6 +44,14 @@ typedef NS_ENUM(NSUInteger, SPTPersistentCacheDebugMethodType) {
  */
 typedef void (^SPTPersistentCacheDebugTimingCallback)(NSString *key, SPTPersistentCacheDebugMethodType method, SPTPersistentCacheDebugTimingType type, uint64_t machTime);
 
+/**
+ Type of callback that can be used to follow the changes adaptive concurrency makes to the width of a queue.
+ @param queueName The name of the queue whose width changed.
+ @param concurrency The number of operations the queue now runs at the same time.
+ @param latency The average time in seconds the operations took to run before the change.
+ */
+typedef void (^SPTPersistentCacheConcurrencyCallback)(NSString *queueName, NSInteger concurrency, NSTimeInterval latency);
+
 
 #pragma mark - Garbage Collection Constants
 
@@ -104,13 +114,65 @@ FOUNDATION_EXPORT const NSUInteger SPTPersistentCacheMinimumExpirationLimit;
  @note Defaults to `YES`.
  */
 @property (nonatomic, assign) BOOL useDirectorySeparation;
+/**
+ The number of directory levels records are sharded into by a hash of their key, when `useDirectorySeparation` is set.
+ @discussion Keys sharing a prefix end up in a handful of directories when separated by their first two characters,
+ which makes lookups slow once those directories hold many records. With a depth above `0` records are spread evenly
+ over `directoryShardingFanOut` directories at each level instead. Records stored under another layout are moved
+ over in the background after the cache is created, and are found in either place until then. Loading data for keys
+ with a prefix has to look through all records with a hashed layout. At most `4`.
+ @note Defaults to `0`, which separates records by the first two characters of their key.
+ */
+@property (nonatomic, assign) NSUInteger directoryShardingDepth;
+/**
+ The number of directories at each level when `directoryShardingDepth` is above `0`. Between `2` and `65536`.
+ @note Defaults to `256`.
+ */
+@property (nonatomic, assign) NSUInteger directoryShardingFanOut;
 
 #pragma mark Priority Options
 
 /**
  Max concurrent operations that the cache can perform. Defaults to NSOperationQueueDefaultMaxConcurrentOperationCount.
+ @discussion Reads, writes and maintenance (garbage collection, prune and wipe) run on separate lanes that split this
+ budget. Maintenance gets its `maintenanceConcurrencyShare`, reads and writes share the rest. Each lane gets at least
+ one operation at a time, so budgets below three are exceeded. If left at the default the number of active processors
+ is used as budget.
  */
 @property (nonatomic) NSInteger maxConcurrentOperations;
+/**
+ Max concurrent loads. Defaults to NSOperationQueueDefaultMaxConcurrentOperationCount which means as many as the
+ budget of `maxConcurrentOperations` leaves. If reads and writes together ask for more than the budget left after
+ maintenance, both are narrowed in proportion.
+ */
+@property (nonatomic) NSInteger maxConcurrentReadOperations;
+/**
+ Max concurrent stores, touches, locks, unlocks and removes. Defaults to NSOperationQueueDefaultMaxConcurrentOperationCount
+ which means as many as the budget of `maxConcurrentOperations` leaves, see `maxConcurrentReadOperations`.
+ */
+@property (nonatomic) NSInteger maxConcurrentWriteOperations;
+/**
+ The share, between `0` and `1`, of `maxConcurrentOperations` that garbage collection, prune and wipe may use at most.
+ @discussion Maintenance always gets at least one operation at a time. It also pauses between files while reads or
+ writes are waiting, so foreground work isn’t stuck behind a long garbage collection.
+ @note Defaults to `0.25`.
+ */
+@property (nonatomic) double maintenanceConcurrencyShare;
+/**
+ Whether the widths of the read and write lanes are adjusted at runtime from the measured latency of their operations.
+ @discussion The configured width of each lane becomes its maximum, and the lane starts halfway between that and
+ `minConcurrentOperations`. After each window of operations the width grows by one while operations are waiting and
+ their average latency stays within twice the lowest latency seen, and is halved once latency rises above that. So
+ storage that serves parallel requests well gets more of them, while slow storage isn’t thrashed. Every change is
+ reported to `concurrencyCallback`.
+ @note Defaults to `NO`.
+ */
+@property (nonatomic, assign) BOOL useAdaptiveConcurrency;
+/**
+ The smallest width adaptive concurrency reduces the read and write lanes to. Values below `1` are raised to `1`.
+ @note Defaults to `1`.
+ */
+@property (nonatomic) NSInteger minConcurrentOperations;
 /**
  The queue priority for writes. Will also be used for touch and lock. Defaults to NSOperationQueuePriorityNormal.
  */
@@ -140,8 +202,11 @@ FOUNDATION_EXPORT const NSUInteger SPTPersistentCacheMinimumExpirationLimit;
 #pragma mark Garbage Collection Options
 
 /**
- Garbage collection (GC) interval in seconds. It is guaranteed that once started the GC runs with this interval.
- @note To start GC call `scheduleGarbageCollector` on `SPTPersistentCache` object.
+ Garbage collection (GC) interval in seconds. Once started the GC runs with this interval while the cache sees
+ moderate churn. The interval grows up to four times this value while nothing is stored or expires, and shrinks
+ down to `SPTPersistentCacheMinimumGCIntervalLimit` under write pressure.
+ @note To start GC call `scheduleGarbageCollector` on `SPTPersistentCache` object. The GC timer doesn’t depend on
+ any run loop.
  @discussion Its recommended to use `SPTPersistentCacheDefaultGCIntervalSec` constant if unsure. The
  implementation will make sure the value isn’t below the minimum (`SPTPersistentCacheMinimumGCIntervalLimit`).
  @note Defaults to `SPTPersistentCacheDefaultGCIntervalSec`.
@@ -160,6 +225,98 @@ FOUNDATION_EXPORT const NSUInteger SPTPersistentCacheMinimumExpirationLimit;
  @note Defaults to `0` (unbounded).
  */
 @property (nonatomic, assign) NSUInteger sizeConstraintBytes;
+/**
+ Named groups of records, each with its own size constraint, expiration period and eviction weight.
+ @discussion All partitions share the queues, key filter, key index and garbage collection runs of the cache. Each
+ run first prunes every partition to its own `sizeConstraintBytes`. If the cache as a whole still exceeds
+ `sizeConstraintBytes`, records are evicted from the partitions that use the most space for their `evictionWeight`
+ until it fits. Records that match no partition are pruned as a partition with weight `1.0`.
+ @note Defaults to an empty array.
+ */
+@property (nonatomic, copy) NSArray<SPTPersistentCachePartition *> *partitions;
+/**
+ The number of keys the in-memory filter of present keys is sized for, `0` to disable the filter.
+ @discussion When enabled the cache populates a counting Bloom filter from disk on start and keeps it up to date on
+ store and remove. Loads of keys the filter rules out are answered with `SPTPersistentCacheResponseCodeNotFound`
+ without any disk access or queueing. Each key takes roughly `-1.44 * log2(keyFilterFalsePositiveRate)` bytes.
+ @warning Only one cache instance may manage the cache path, otherwise keys stored by another instance are reported
+ as missing.
+ @note Defaults to `0` (disabled).
+ */
+@property (nonatomic, assign) NSUInteger keyFilterCapacity;
+/**
+ The rate of absent keys the filter reports as possibly present when it holds `keyFilterCapacity` keys.
+ @note Defaults to `0.01`.
+ */
+@property (nonatomic, assign) double keyFilterFalsePositiveRate;
+/**
+ Whether the cache keeps a sorted in-memory index of its keys and the metadata of their records.
+ @discussion The index is populated from the record headers on start and kept up to date on every store, access and
+ remove. Once populated, `loadDataForKeysWithPrefix:chooseKeyCallback:withCallback:onQueue:` and
+ `loadMetadataForKeysWithPrefix:callback:onQueue:` find the live keys with a prefix without listing directories or
+ reading any record. Each key takes roughly the size of the key plus 100 bytes.
+ @warning Only one cache instance may manage the cache path, otherwise keys stored by another instance are missing
+ from prefix queries.
+ @note Defaults to `NO`.
+ */
+@property (nonatomic, assign) BOOL useKeyIndex;
+/**
+ Whether the refCounts of locked records are kept in a journal next to the records instead of in their headers.
+ @discussion Each call to `lockDataForKeys:callback:onQueue:` or `unlockDataForKeys:callback:onQueue:` is then
+ applied in one transaction with a single fsync, whatever the number of keys, instead of rewriting and flushing the
+ header of every record. The journal is created from the record headers on the first start with this option, and
+ written back into the headers on the first start without it.
+ @note Defaults to `NO`.
+ */
+@property (nonatomic, assign) BOOL useLockJournal;
+/**
+ Whether several processes use the cache directory at the same time, for example an app and its extensions.
+ @discussion Writers of a record then hold an advisory lock on its file, and only one process at a time runs the
+ scheduled garbage collection. With `keyFilterCapacity` set, the key filter is replaced by an index shared by all
+ processes through a memory mapped file, so a process doesn’t have to scan the directory to answer misses for
+ records another process removed or stored. The lock journal isn’t used in this mode.
+ @note Defaults to `NO`.
+ */
+@property (nonatomic, assign) BOOL useMultiProcessCoordination;
+/**
+ The number of keys the history of accessed records keeps, `0` to disable the history.
+ @discussion The history counts the loads of each key that hit a record, with older counts weighing less, and is
+ written next to the records on every scheduled garbage collection. It is read back on start, so
+ `warmUpWithCallback:onQueue:` can prefetch the records used most often and most recently in earlier runs. Each key
+ takes roughly the size of the key plus 50 bytes.
+ @note Defaults to `0` (disabled).
+ */
+@property (nonatomic, assign) NSUInteger accessHistoryCapacity;
+/**
+ Whether tags can be attached to records when they are stored, so all records with a tag can be removed or locked
+ at once.
+ @discussion The tags are kept in an index file next to the records rather than in every record, and the entries of a
+ record are dropped when it is removed. Each tagged key takes roughly the size of the key and its tags plus 100 bytes
+ of memory. The index isn’t used by multiple processes.
+ @note Defaults to `NO`.
+ */
+@property (nonatomic, assign) BOOL useTagIndex;
+/**
+ The size in bytes from which stored payloads are deduplicated, `0` to disable deduplication.
+ @discussion Each deduplicated payload is kept once per content, hashed with SHA-256, in a blob shared by all records
+ with the same payload, and the records hold only the hash. The blob is removed with the last record referencing it,
+ and `sizeConstraintBytes` counts it once. Smaller payloads aren’t worth the extra file and lookup, so this should be
+ at least the block size of the file system, typically 4096 bytes. Files stored with `storeFileAtPath:` aren’t
+ deduplicated, and deduplication isn’t used by multiple processes. Records written with deduplication can’t be read
+ by earlier versions of the cache.
+ @note Defaults to `0` (disabled).
+ */
+@property (nonatomic, assign) NSUInteger deduplicationThresholdBytes;
+/**
+ The payload size in bytes from which records are stored as large records, `0` to store all records alike.
+ @discussion The header of a large record is padded to `SPTPersistentCacheRecordAlignedHeaderSize`, so its payload
+ starts at a page aligned offset, and its payload is read and written around the page cache of the system. Streaming
+ a few very large records then doesn’t evict the small records that are loaded often. Large records aren’t kept
+ warm by `warmUpWithCallback:onQueue:`. Deduplicated payloads are stored in blobs instead. Large records can’t be read
+ by earlier versions of the cache.
+ @note Defaults to `0` (disabled).
+ */
+@property (nonatomic, assign) NSUInteger largeRecordThresholdBytes;
 /**
  The queue priority for garbage collection. Defaults to NSOperationQueuePriorityLow.
  */
@@ -185,6 +342,25 @@ FOUNDATION_EXPORT const NSUInteger SPTPersistentCacheMinimumExpirationLimit;
  */
 @property (nonatomic, copy, nullable) SPTPersistentCacheDebugTimingCallback timingCallback;
 
+/**
+ Callback used to report the lane widths chosen by adaptive concurrency, see `useAdaptiveConcurrency`.
+ @warning The block might be executed on any thread or queue. Make sure your code is thread-safe or dispatches out
+ to a thread safe for you.
+ */
+@property (nonatomic, copy, nullable) SPTPersistentCacheConcurrencyCallback concurrencyCallback;
+
+/**
+ Path of a file to which every call to the public cache API is recorded, `nil` to disable recording.
+ @discussion Each call is stored as a compact binary record holding the key hash, payload size, TTL, lock flag and
+ a timestamp. Calls with several keys are recorded once per key, tags are recorded by their hash like keys. Loads with
+ a loader are recorded as fetches, followed by a store of the data the loader returned. Opening a file handle is
+ recorded as a load, loading metadata by prefix as a load by prefix. The trace can be replayed offline with
+ `SPTPersistentCacheTraceReplayer`, e.g. to tune eviction and garbage collection options against a production
+ workload. An existing file at the path is replaced.
+ @note Defaults to `nil`.
+ */
+@property (nonatomic, copy, nullable) NSString *traceFilePath;
+
 @end
 
 
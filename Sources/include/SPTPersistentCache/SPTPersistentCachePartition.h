@@ -0,0 +1,56 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @brief SPTPersistentCachePartition
+ @discussion Describes a named group of records inside one cache, with its own size constraint, expiration period and
+ eviction weight. A record belongs to the partition with the longest key prefix its key starts with. Records that
+ match no partition belong to an implicit default partition configured by the cache options.
+ */
+@interface SPTPersistentCachePartition : NSObject <NSCopying>
+
+/**
+ The name of the partition, used in debug output.
+ */
+@property (nonatomic, copy, readonly) NSString *name;
+/**
+ The prefix of the keys of the records in the partition. An empty prefix matches the records no other partition does.
+ */
+@property (nonatomic, copy, readonly) NSString *keyPrefix;
+/**
+ Size in bytes to which the partition is pruned on each garbage collection run, `0` for no constraint of its own.
+ @discussion Records of the partition also count towards the `sizeConstraintBytes` of the cache.
+ @note Defaults to `0`.
+ */
+@property (nonatomic, assign) NSUInteger sizeConstraintBytes;
+/**
+ Time period, in seconds, after which records stored in the partition without a TTL expire, `0` to use the
+ `defaultExpirationPeriod` of the cache. Values below `SPTPersistentCacheMinimumExpirationLimit` are raised to it.
+ @note Defaults to `0`.
+ */
+@property (nonatomic, assign) NSUInteger defaultExpirationPeriod;
+/**
+ The share of the cache size the partition keeps, relative to the weights of the other partitions, when the cache has
+ to be pruned to its `sizeConstraintBytes`. Records are evicted from the partition that uses the most space for its
+ weight first. A partition with weight `0` is emptied before any other is pruned.
+ @note Defaults to `1.0`.
+ */
+@property (nonatomic, assign) double evictionWeight;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a partition.
+ @param name The name of the partition.
+ @param keyPrefix The prefix of the keys of the records in the partition.
+ */
+- (instancetype)initWithName:(NSString *)name keyPrefix:(NSString *)keyPrefix NS_DESIGNATED_INITIALIZER;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,44 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @brief SPTPersistentCacheRecordMetadata
+ @discussion Class describes one record in cache as found in its header, without its payload.
+ */
+@interface SPTPersistentCacheRecordMetadata : NSObject
+
+/**
+ Key for that record.
+ */
+@property (nonatomic, copy, readonly) NSString *key;
+/**
+ Defines the number of times external logical references to this cache item. Records with refCount > 0 are locked.
+ */
+@property (nonatomic, assign, readonly) NSUInteger refCount;
+/**
+ Defines ttl for given record if applicable. 0 means not applicable.
+ */
+@property (nonatomic, assign, readonly) NSUInteger ttl;
+/**
+ The size of the data that was passed into storeData:... in bytes.
+ */
+@property (nonatomic, assign, readonly) uint64_t payloadSize;
+/**
+ Time of the last store or access of the record, in seconds since 1970.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval updateTime;
+/**
+ Time after which the record is treated as not found unless it’s locked, in seconds since 1970.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval expirationTime;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -49,6 +49,11 @@ typedef NS_ENUM(NSInteger, SPTPersistentCacheResponseCode) {
  @seealso SPTPersistentCacheRecord
  */
 @property (nonatomic, strong, readonly, nullable) SPTPersistentCacheRecord *record;
+/**
+ Whether the record has expired and is returned while a fresh copy is being loaded.
+ @seealso -[SPTPersistentCache loadDataForKey:loader:ttl:serveStale:withCallback:onQueue:]
+ */
+@property (nonatomic, assign, readonly, getter=isStale) BOOL stale;
 
 @end
 
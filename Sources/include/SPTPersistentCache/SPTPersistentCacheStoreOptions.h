@@ -0,0 +1,77 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+@class SPTPersistentCacheCancellationToken;
+
+/**
+ The priority class of a record, which weighs how much of its cost of being fetched again is kept when pruning by size.
+ */
+typedef NS_ENUM(uint32_t, SPTPersistentCacheRecordPriority) {
+    /**
+     The priority of records stored without one.
+     */
+    SPTPersistentCacheRecordPriorityNormal = 0,
+    /**
+     Evicted before normal records of the same value, e.g. speculative prefetches.
+     */
+    SPTPersistentCacheRecordPriorityLow = 1,
+    /**
+     Kept over normal records of the same value, e.g. what is playing right now.
+     */
+    SPTPersistentCacheRecordPriorityHigh = 2,
+};
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @brief SPTPersistentCacheStoreOptions
+ @discussion Describes how a record is stored, passed to storeData:forKey:options:withCallback:onQueue: and
+ storeFileAtPath:forKey:options:withCallback:onQueue:. The defaults store an unlocked record with the default
+ expiration policy, no tags and no eviction hints, just like storeData:forKey:locked:withCallback:onQueue:.
+ */
+@interface SPTPersistentCacheStoreOptions : NSObject <NSCopying>
+
+/**
+ TTL value for the record in seconds. `0` means the default expiration policy, the record then expires once it hasn’t
+ been accessed for the `defaultExpirationPeriod` of the cache.
+ @note Defaults to `0`.
+ */
+@property (nonatomic, assign) NSUInteger ttl;
+/**
+ If YES the refCount of the record is set to 1, otherwise to 0.
+ @note Defaults to `NO`.
+ */
+@property (nonatomic, assign, getter=isLocked) BOOL locked;
+/**
+ Tags attached to the record, e.g. the album the key is a variant of, so it is found by
+ removeDataForTag:callback:onQueue: and lockDataForTag:callback:onQueue:. The tags replace the ones of an earlier
+ record for the key; storing without tags removes them. Storing with tags requires `useTagIndex` to be set in the
+ options of the cache.
+ @note Defaults to `nil`.
+ */
+@property (nonatomic, copy, nullable) NSSet<NSString *> *tags;
+/**
+ The priority class of the record when pruning by size.
+ @note Defaults to `SPTPersistentCacheRecordPriorityNormal`.
+ */
+@property (nonatomic, assign) SPTPersistentCacheRecordPriority priority;
+/**
+ What fetching the data again costs, e.g. the bytes to download including any overhead. Use the same unit for all
+ records. When pruning by size records are evicted by their value per byte on disk, `refetchCost` weighted by the
+ priority, discounted by the time since they were last used. `0` means the size of the record, so among records stored
+ without hints the least recently used go first.
+ @note Defaults to `0`.
+ */
+@property (nonatomic, assign) uint64_t refetchCost;
+/**
+ Token that cancels the store. If it is cancelled before the store has started nothing is written, if it’s cancelled
+ later the record is stored but the callback is not called.
+ @note Defaults to `nil`.
+ */
+@property (nonatomic, strong, nullable) SPTPersistentCacheCancellationToken *cancellationToken;
+
+@end
+
+NS_ASSUME_NONNULL_END
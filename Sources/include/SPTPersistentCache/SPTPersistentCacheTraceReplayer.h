@@ -0,0 +1,140 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <Foundation/Foundation.h>
+
+@class SPTPersistentCache;
+
+NS_ASSUME_NONNULL_BEGIN
+
+#pragma mark - Trace Types
+
+/**
+ The public cache operations that are captured in an operation trace.
+ @seealso SPTPersistentCacheOptions.traceFilePath
+ */
+typedef NS_ENUM(NSUInteger, SPTPersistentCacheTraceOperation) {
+    SPTPersistentCacheTraceOperationLoad = 1,
+    // A load of one of the keys with a prefix, recorded once it chose the key to open unless it was cancelled before
+    SPTPersistentCacheTraceOperationLoadWithPrefix,
+    SPTPersistentCacheTraceOperationStore,
+    SPTPersistentCacheTraceOperationTouch,
+    SPTPersistentCacheTraceOperationRemove,
+    SPTPersistentCacheTraceOperationLock,
+    SPTPersistentCacheTraceOperationUnlock,
+    SPTPersistentCacheTraceOperationPrune,
+    SPTPersistentCacheTraceOperationWipeLocked,
+    SPTPersistentCacheTraceOperationWipeNonLocked,
+    // A load with a loader. Data the loader fetched is recorded as a store of it right after.
+    SPTPersistentCacheTraceOperationFetch,
+    SPTPersistentCacheTraceOperationAppend,
+    SPTPersistentCacheTraceOperationReplaceRange,
+    // A tag of the record stored by the store following it
+    SPTPersistentCacheTraceOperationTag,
+    SPTPersistentCacheTraceOperationRemoveTag,
+    SPTPersistentCacheTraceOperationLockTag,
+    SPTPersistentCacheTraceOperationWarmUp,
+    SPTPersistentCacheTraceOperationEnumerateMetadata,
+    SPTPersistentCacheTraceOperationLoadMetadataWithPrefix
+};
+
+/**
+ Defines how fast a trace is replayed.
+ */
+typedef NS_ENUM(NSUInteger, SPTPersistentCacheTraceReplayTiming) {
+    /**
+     Each operation is issued as soon as the previous one has completed.
+     */
+    SPTPersistentCacheTraceReplayTimingAsFastAsPossible,
+    /**
+     Each operation is issued at the same offset from the start of the replay as it had from the start of the
+     recording, without waiting for the operations issued before it, so they overlap like they did when recorded.
+     */
+    SPTPersistentCacheTraceReplayTimingOriginal
+};
+
+
+#pragma mark - SPTPersistentCacheTraceOperationStatistics Interface
+
+/**
+ Latency statistics for one kind of operation during a trace replay.
+ */
+@interface SPTPersistentCacheTraceOperationStatistics : NSObject
+
+/// The operation the statistics are collected for.
+@property (nonatomic, assign, readonly) SPTPersistentCacheTraceOperation operation;
+/// The number of replayed operations of this kind.
+@property (nonatomic, assign, readonly) NSUInteger count;
+/// The accumulated time, in seconds, from issuing the operations until their callbacks were invoked.
+@property (nonatomic, assign, readonly) NSTimeInterval totalLatency;
+/// The longest time, in seconds, a single operation of this kind took.
+@property (nonatomic, assign, readonly) NSTimeInterval maximumLatency;
+/// The mean latency, in seconds, of an operation of this kind.
+@property (nonatomic, assign, readonly) NSTimeInterval averageLatency;
+
+@end
+
+
+#pragma mark - SPTPersistentCacheTraceReplayReport Interface
+
+/**
+ The result of replaying a trace against a cache.
+ */
+@interface SPTPersistentCacheTraceReplayReport : NSObject
+
+/// The number of records read from the trace.
+@property (nonatomic, assign, readonly) NSUInteger recordCount;
+/// The number of records that could not be replayed, e.g. enumerations of the records with a prefix.
+@property (nonatomic, assign, readonly) NSUInteger skippedRecordCount;
+/// The number of load operations that were replayed.
+@property (nonatomic, assign, readonly) NSUInteger loadCount;
+/// The number of load operations that returned data.
+@property (nonatomic, assign, readonly) NSUInteger hitCount;
+/// The ratio of loads that returned data, `0` if no loads were replayed.
+@property (nonatomic, assign, readonly) double hitRatio;
+/// The wall clock time, in seconds, the replay took.
+@property (nonatomic, assign, readonly) NSTimeInterval duration;
+/// Latency statistics keyed by the boxed `SPTPersistentCacheTraceOperation`.
+@property (nonatomic, copy, readonly) NSDictionary<NSNumber *, SPTPersistentCacheTraceOperationStatistics *> *operationStatistics;
+
+@end
+
+
+#pragma mark - SPTPersistentCacheTraceReplayer Interface
+
+/**
+ Re-runs an operation trace, recorded by setting `traceFilePath` on the cache options, against a cache.
+ @discussion Keys are only stored as hashes in the trace. The replayer derives a stable key from each hash and
+ stores zero filled payloads of the recorded size, so eviction and garbage collection behave as they did for the
+ recorded workload.
+ */
+@interface SPTPersistentCacheTraceReplayer : NSObject
+
+/// The path of the trace file to replay.
+@property (nonatomic, copy, readonly) NSString *tracePath;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/**
+ Initializes a new replayer for the trace at the given path.
+ @param tracePath The path of a trace file written by `SPTPersistentCache`.
+ */
+- (instancetype)initWithTracePath:(NSString *)tracePath NS_DESIGNATED_INITIALIZER;
+
+/**
+ Replays the trace against a cache. The call blocks until all operations have completed. Operations on several keys
+ are replayed as one call with all of them.
+ @warning Don’t call this method on the main thread, as the cache might need it to deliver callbacks.
+ @param cache The cache to replay against. It should be fresh, i.e. empty, to make the results reproducible.
+ @param timing How fast the operations are issued.
+ @param error Set to the reason of the failure if the trace couldn’t be read.
+ @return A report of the replay or `nil` if the trace couldn’t be read.
+ */
+- (nullable SPTPersistentCacheTraceReplayReport *)replayAgainstCache:(SPTPersistentCache *)cache
+                                                             timing:(SPTPersistentCacheTraceReplayTiming)timing
+                                                              error:(NSError * _Nullable __autoreleasing * _Nullable)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
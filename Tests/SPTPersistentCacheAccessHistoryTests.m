@@ -0,0 +1,118 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheAccessHistory.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheAccessHistoryTests : XCTestCase
+@property (nonatomic, copy) NSString *historyPath;
+@end
+
+@implementation SPTPersistentCacheAccessHistoryTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.historyPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.historyPath error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCacheAccessHistory *)openHistoryWithCapacity:(NSUInteger)capacity
+{
+    return [[SPTPersistentCacheAccessHistory alloc] initWithPath:self.historyPath capacity:capacity debugOutput:nil];
+}
+
+- (void)recordAccesses:(NSUInteger)count toKey:(NSString *)key history:(SPTPersistentCacheAccessHistory *)history
+{
+    for (NSUInteger i = 0; i < count; ++i) {
+        [history recordAccessToKey:key];
+    }
+}
+
+- (void)testKeysAreOrderedByAccesses
+{
+    SPTPersistentCacheAccessHistory * const history = [self openHistoryWithCapacity:10];
+
+    [self recordAccesses:1 toKey:@"AA-key" history:history];
+    [self recordAccesses:3 toKey:@"BB-key" history:history];
+    [self recordAccesses:2 toKey:@"CC-key" history:history];
+
+    XCTAssertEqualObjects(history.hottestKeys, (@[@"BB-key", @"CC-key", @"AA-key"]));
+}
+
+- (void)testHistoryIsTrimmedToCapacity
+{
+    SPTPersistentCacheAccessHistory * const history = [self openHistoryWithCapacity:2];
+    [self recordAccesses:3 toKey:@"AA-key" history:history];
+    [self recordAccesses:2 toKey:@"BB-key" history:history];
+    [self recordAccesses:1 toKey:@"CC-key" history:history];
+    XCTAssertEqual(history.count, 3u);
+
+    [self recordAccesses:1 toKey:@"DD-key" history:history];
+
+    XCTAssertEqual(history.count, 2u);
+    XCTAssertEqualObjects(history.hottestKeys, (@[@"AA-key", @"BB-key"]));
+}
+
+- (void)testRecentAccessesOutweighAgedOnes
+{
+    SPTPersistentCacheAccessHistory * const history = [self openHistoryWithCapacity:2];
+    [self recordAccesses:3 toKey:@"AA-key" history:history];
+    [self recordAccesses:2 toKey:@"BB-key" history:history];
+    [self recordAccesses:1 toKey:@"CC-key" history:history];
+    [self recordAccesses:1 toKey:@"DD-key" history:history];
+
+    // AA-key aged to 1.5 accesses
+    [self recordAccesses:2 toKey:@"EE-key" history:history];
+
+    XCTAssertEqualObjects(history.hottestKeys.firstObject, @"EE-key");
+}
+
+- (void)testHistoryIsKeptAcrossRuns
+{
+    SPTPersistentCacheAccessHistory *history = [self openHistoryWithCapacity:10];
+    [self recordAccesses:1 toKey:@"AA-key" history:history];
+    [self recordAccesses:2 toKey:@"BB-key" history:history];
+    XCTAssertTrue([history save]);
+
+    history = [self openHistoryWithCapacity:10];
+
+    XCTAssertEqualObjects(history.hottestKeys, (@[@"BB-key", @"AA-key"]));
+    // Aged counts of the earlier run lose to the accesses of this one
+    [self recordAccesses:2 toKey:@"CC-key" history:history];
+    XCTAssertEqualObjects(history.hottestKeys.firstObject, @"CC-key");
+}
+
+- (void)testUnreadableHistoryIsIgnored
+{
+    XCTAssertTrue([[@"not a history" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:self.historyPath atomically:YES]);
+    __block BOOL called = NO;
+    SPTPersistentCacheAccessHistory * const history = [[SPTPersistentCacheAccessHistory alloc] initWithPath:self.historyPath
+                                                                                                   capacity:10
+                                                                                                debugOutput:^(NSString *output) {
+        called = YES;
+    }];
+
+    XCTAssertTrue(called);
+    XCTAssertEqual(history.count, 0u);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheAccessHistory * const history = [self openHistoryWithCapacity:10];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:history.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:history.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
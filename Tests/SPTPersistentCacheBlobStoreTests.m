@@ -0,0 +1,134 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheBlobStore.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheBlobStoreTests : XCTestCase
+@property (nonatomic, copy) NSString *blobsPath;
+@end
+
+@implementation SPTPersistentCacheBlobStoreTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.blobsPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.blobsPath error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCacheBlobStore *)readyStore
+{
+    SPTPersistentCacheBlobStore * const store = [[SPTPersistentCacheBlobStore alloc] initWithPath:self.blobsPath
+                                                                                      fileManager:[NSFileManager defaultManager]
+                                                                                      debugOutput:nil];
+    [store beginPopulating];
+    [store finishPopulating];
+    return store;
+}
+
+- (NSData *)payload
+{
+    return [[@"payload-" stringByPaddingToLength:100 withString:@"x" startingAtIndex:0] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void)testEqualPayloadsAreStoredOnce
+{
+    SPTPersistentCacheBlobStore * const store = [self readyStore];
+
+    NSData * const digest = [store storeBlobWithData:self.payload error:nil];
+    XCTAssertEqual(digest.length, (NSUInteger)SPTPersistentCacheBlobStoreDigestLength);
+    XCTAssertEqualObjects([store storeBlobWithData:self.payload error:nil], digest);
+    [store commitBlobWithDigest:digest forKey:@"AA-key"];
+    [store commitBlobWithDigest:digest forKey:@"BB-key"];
+
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:[store pathForDigest:digest]], self.payload);
+    XCTAssertEqual(store.usedSizeInBytes, self.payload.length);
+    XCTAssertEqual([store sizeShareForKey:@"AA-key"], self.payload.length / 2);
+    XCTAssertEqual([store sizeShareForKey:@"CC-key"], 0u);
+}
+
+- (void)testBlobIsRemovedWithLastReference
+{
+    SPTPersistentCacheBlobStore * const store = [self readyStore];
+    NSData * const digest = [store storeBlobWithData:self.payload error:nil];
+    XCTAssertNotNil([store storeBlobWithData:self.payload error:nil]);
+    [store commitBlobWithDigest:digest forKey:@"AA-key"];
+    [store commitBlobWithDigest:digest forKey:@"BB-key"];
+
+    XCTAssertEqual([store removeKey:@"AA-key"], 0u);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[store pathForDigest:digest]]);
+
+    XCTAssertEqual([store removeKey:@"BB-key"], self.payload.length);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[store pathForDigest:digest]]);
+    XCTAssertEqual([store removeKey:@"BB-key"], 0u);
+}
+
+- (void)testAbandonedBlobIsRemoved
+{
+    SPTPersistentCacheBlobStore * const store = [self readyStore];
+    NSData * const digest = [store storeBlobWithData:self.payload error:nil];
+
+    [store abandonBlobWithDigest:digest];
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[store pathForDigest:digest]]);
+}
+
+- (void)testBlobsAreKeptUntilPopulated
+{
+    SPTPersistentCacheBlobStore *store = [self readyStore];
+    NSData * const kept = [store storeBlobWithData:self.payload error:nil];
+    NSData * const orphaned = [store storeBlobWithData:[self.payload subdataWithRange:NSMakeRange(1, 10)] error:nil];
+    [store commitBlobWithDigest:kept forKey:@"AA-key"];
+    [store commitBlobWithDigest:orphaned forKey:@"BB-key"];
+
+    store = [[SPTPersistentCacheBlobStore alloc] initWithPath:self.blobsPath
+                                                  fileManager:[NSFileManager defaultManager]
+                                                  debugOutput:nil];
+    [store beginPopulating];
+    [store addPopulatedDigest:kept forKey:@"AA-key"];
+    XCTAssertFalse(store.isReady);
+    XCTAssertEqual([store removeKey:@"AA-key"], 0u);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[store pathForDigest:kept]]);
+
+    // A record removed while populating mustn’t be added back
+    [store addPopulatedDigest:kept forKey:@"AA-key"];
+    [store finishPopulating];
+
+    XCTAssertTrue(store.isReady);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[store pathForDigest:kept]]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[store pathForDigest:orphaned]]);
+}
+
+- (void)testFileSystemPathMatchesPath
+{
+    SPTPersistentCacheBlobStore * const store = [self readyStore];
+    NSData * const digest = [store storeBlobWithData:self.payload error:nil];
+
+    char path[PATH_MAX];
+    XCTAssertTrue([store getFileSystemPath:path maxLength:sizeof(path) forDigest:digest.bytes]);
+    XCTAssertEqualObjects(@(path), [store pathForDigest:digest]);
+
+    char shortPath[8];
+    XCTAssertFalse([store getFileSystemPath:shortPath maxLength:sizeof(shortPath) forDigest:digest.bytes]);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheBlobStore * const store = [self readyStore];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:store.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:store.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
@@ -0,0 +1,82 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheCancellationToken.h>
+#import <SPTPersistentCache/SPTPersistentCacheResponse.h>
+#import "SPTPersistentCacheCancellationToken+Private.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheCancellationTokenTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCacheCancellationToken *token;
+@end
+
+@implementation SPTPersistentCacheCancellationTokenTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.token = [SPTPersistentCacheCancellationToken new];
+}
+
+- (void)testNewTokenIsNotCancelled
+{
+    XCTAssertFalse(self.token.isCancelled);
+}
+
+- (void)testCancelCancelsAddedOperations
+{
+    NSOperation * const firstOperation = [NSBlockOperation blockOperationWithBlock:^{}];
+    NSOperation * const secondOperation = [NSBlockOperation blockOperationWithBlock:^{}];
+    [self.token addOperation:firstOperation];
+    [self.token addOperation:secondOperation];
+
+    XCTAssertFalse(firstOperation.isCancelled);
+
+    [self.token cancel];
+
+    XCTAssertTrue(self.token.isCancelled);
+    XCTAssertTrue(firstOperation.isCancelled);
+    XCTAssertTrue(secondOperation.isCancelled);
+}
+
+- (void)testAddingOperationToCancelledTokenCancelsIt
+{
+    [self.token cancel];
+
+    NSOperation * const operation = [NSBlockOperation blockOperationWithBlock:^{}];
+    [self.token addOperation:operation];
+
+    XCTAssertTrue(operation.isCancelled);
+}
+
+- (void)testCancellableCallbackIsDroppedAfterCancel
+{
+    __block NSUInteger callCount = 0;
+    SPTPersistentCacheResponseCallback const callback = SPTPersistentCacheCancellableCallback(^(SPTPersistentCacheResponse *response) {
+        callCount += 1;
+    }, self.token);
+
+    callback(nil);
+    [self.token cancel];
+    callback(nil);
+
+    XCTAssertEqual(callCount, 1u);
+}
+
+- (void)testCancellableCallbackWithoutTokenIsUnchanged
+{
+    SPTPersistentCacheResponseCallback const callback = ^(SPTPersistentCacheResponse *response) {};
+    XCTAssertEqual(SPTPersistentCacheCancellableCallback(callback, nil), callback);
+    XCTAssertNil(SPTPersistentCacheCancellableCallback(nil, self.token));
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.token.description], @"The description string should follow our style.");
+}
+
+@end
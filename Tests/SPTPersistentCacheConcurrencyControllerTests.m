@@ -0,0 +1,133 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheConcurrencyController.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheConcurrencyControllerTests : XCTestCase
+@property (nonatomic, strong) NSOperationQueue *queue;
+@end
+
+@implementation SPTPersistentCacheConcurrencyControllerTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.queue = [NSOperationQueue new];
+    self.queue.name = @"test.read";
+    self.queue.suspended = YES;
+}
+
+- (void)tearDown
+{
+    [self.queue cancelAllOperations];
+    self.queue.suspended = NO;
+
+    [super tearDown];
+}
+
+- (void)addWaitingOperations:(NSUInteger)count
+{
+    for (NSUInteger i = 0; i < count; ++i) {
+        [self.queue addOperationWithBlock:^{}];
+    }
+}
+
+- (void)recordWindowOfLatency:(NSTimeInterval)latency controller:(SPTPersistentCacheConcurrencyController *)controller
+{
+    const NSUInteger window = MAX(SPTPersistentCacheConcurrencyControllerMinimumWindow, (NSUInteger)controller.width);
+    for (NSUInteger i = 0; i < window; ++i) {
+        [controller recordLatency:latency];
+    }
+}
+
+- (void)testWidthStartsHalfwayBetweenBounds
+{
+    SPTPersistentCacheConcurrencyController * const controller = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:self.queue
+                                                                                                                    minimumWidth:2
+                                                                                                                    maximumWidth:8
+                                                                                                                        callback:nil];
+
+    XCTAssertEqual(controller.width, 5);
+    XCTAssertEqual(self.queue.maxConcurrentOperationCount, 5);
+    XCTAssertEqual(controller.baselineLatency, 0.0);
+}
+
+- (void)testWidthGrowsWhileOperationsAreWaiting
+{
+    SPTPersistentCacheConcurrencyController * const controller = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:self.queue
+                                                                                                                    minimumWidth:1
+                                                                                                                    maximumWidth:4
+                                                                                                                        callback:nil];
+    XCTAssertEqual(controller.width, 2);
+
+    // Nothing to gain from a wider queue without a backlog
+    [self recordWindowOfLatency:0.01 controller:controller];
+    XCTAssertEqual(controller.width, 2);
+
+    [self addWaitingOperations:20];
+    [self recordWindowOfLatency:0.01 controller:controller];
+    XCTAssertEqual(controller.width, 3);
+    [self recordWindowOfLatency:0.01 controller:controller];
+    [self recordWindowOfLatency:0.01 controller:controller];
+    XCTAssertEqual(controller.width, 4);
+    XCTAssertEqual(self.queue.maxConcurrentOperationCount, 4);
+}
+
+- (void)testWidthIsHalvedWhenLatencyRises
+{
+    SPTPersistentCacheConcurrencyController * const controller = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:self.queue
+                                                                                                                    minimumWidth:3
+                                                                                                                    maximumWidth:16
+                                                                                                                        callback:nil];
+    XCTAssertEqual(controller.width, 9);
+    [self recordWindowOfLatency:0.01 controller:controller];
+    XCTAssertEqualWithAccuracy(controller.baselineLatency, 0.01, DBL_EPSILON);
+
+    [self recordWindowOfLatency:0.01 * SPTPersistentCacheConcurrencyControllerLatencyTolerance * 2 controller:controller];
+    XCTAssertEqual(controller.width, 4);
+
+    // Never below the minimum
+    [self recordWindowOfLatency:0.01 * SPTPersistentCacheConcurrencyControllerLatencyTolerance * 2 controller:controller];
+    XCTAssertEqual(controller.width, 3);
+    XCTAssertEqual(self.queue.maxConcurrentOperationCount, 3);
+}
+
+- (void)testChangesAreReported
+{
+    __block NSString *reportedQueueName = nil;
+    __block NSInteger reportedConcurrency = 0;
+    __block NSTimeInterval reportedLatency = 0.0;
+    SPTPersistentCacheConcurrencyController * const controller = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:self.queue
+                                                                                                                    minimumWidth:1
+                                                                                                                    maximumWidth:4
+                                                                                                                        callback:^(NSString *queueName, NSInteger concurrency, NSTimeInterval latency) {
+        reportedQueueName = queueName;
+        reportedConcurrency = concurrency;
+        reportedLatency = latency;
+    }];
+
+    [self addWaitingOperations:20];
+    [self recordWindowOfLatency:0.02 controller:controller];
+
+    XCTAssertEqualObjects(reportedQueueName, @"test.read");
+    XCTAssertEqual(reportedConcurrency, 3);
+    XCTAssertEqualWithAccuracy(reportedLatency, 0.02, DBL_EPSILON);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheConcurrencyController * const controller = [[SPTPersistentCacheConcurrencyController alloc] initWithQueue:self.queue
+                                                                                                                    minimumWidth:1
+                                                                                                                    maximumWidth:4
+                                                                                                                        callback:nil];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:controller.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:controller.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
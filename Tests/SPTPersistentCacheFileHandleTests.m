@@ -0,0 +1,89 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheFileHandle.h>
+#import "SPTPersistentCacheFileHandle+Private.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+#include <fcntl.h>
+
+@interface SPTPersistentCacheFileHandleTests : XCTestCase
+@property (nonatomic, copy) NSString *filePath;
+@end
+
+@implementation SPTPersistentCacheFileHandleTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.filePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [[@"HEADERPAYLOAD" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:self.filePath atomically:YES];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.filePath error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCacheFileHandle *)fileHandleWithCloseHandler:(void (^)(void))closeHandler
+{
+    const int fd = open(self.filePath.fileSystemRepresentation, O_RDONLY);
+    XCTAssertNotEqual(fd, -1);
+    return [[SPTPersistentCacheFileHandle alloc] initWithKey:@"key"
+                                              fileDescriptor:fd
+                                               payloadOffset:6
+                                               payloadLength:7
+                                                closeHandler:closeHandler];
+}
+
+- (void)testPayloadCanBeReadThroughDescriptor
+{
+    SPTPersistentCacheFileHandle * const fileHandle = [self fileHandleWithCloseHandler:nil];
+
+    char buffer[7];
+    XCTAssertEqual(pread(fileHandle.fileDescriptor, buffer, sizeof(buffer), fileHandle.payloadOffset), (ssize_t)fileHandle.payloadLength);
+    XCTAssertEqual(memcmp(buffer, "PAYLOAD", sizeof(buffer)), 0);
+    XCTAssertEqualObjects(fileHandle.key, @"key");
+}
+
+- (void)testCloseCallsHandlerOnce
+{
+    __block NSUInteger closeCount = 0;
+    SPTPersistentCacheFileHandle * const fileHandle = [self fileHandleWithCloseHandler:^{
+        closeCount += 1;
+    }];
+
+    [fileHandle close];
+    [fileHandle close];
+
+    XCTAssertEqual(fileHandle.fileDescriptor, -1);
+    XCTAssertEqual(closeCount, 1u);
+}
+
+- (void)testDeallocCloses
+{
+    __block NSUInteger closeCount = 0;
+    @autoreleasepool {
+        __unused SPTPersistentCacheFileHandle *fileHandle = [self fileHandleWithCloseHandler:^{
+            closeCount += 1;
+        }];
+        fileHandle = nil;
+    }
+
+    XCTAssertEqual(closeCount, 1u);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheFileHandle * const fileHandle = [self fileHandleWithCloseHandler:nil];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:fileHandle.description], @"The description string should follow our style.");
+}
+
+@end
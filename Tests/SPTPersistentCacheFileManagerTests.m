@@ -8,6 +8,8 @@
 
 #import <objc/runtime.h>
 
+#include "fnv1a.h"
+
 #pragma mark -
 
 @interface SPTPersistentCacheFileManagerForTests : SPTPersistentCacheFileManager
@@ -141,6 +143,68 @@
     XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:pathForKey]);
 }
 
+- (void)testRemovedFileIsMovedToTrash
+{
+    NSString *key = @"AA";
+    [self createFileForKey:key];
+
+    XCTAssertTrue([self.cacheFileManager removeDataForKey:key]);
+
+    NSArray<NSString *> *trashContents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.cacheFileManager.trashPath error:nil];
+    XCTAssertEqual(trashContents.count, 1u);
+    XCTAssertFalse([self.cacheFileManager removeDataForKey:key]);
+}
+
+- (void)testEmptyTrashInBatches
+{
+    for (NSString *key in @[@"AA", @"AB", @"AC"]) {
+        [self createFileForKey:key];
+        [self.cacheFileManager removeDataForKey:key];
+    }
+
+    __block NSUInteger batches = 0;
+    [self.cacheFileManager emptyTrashInBatchesOfSize:2 betweenBatches:^{
+        batches += 1;
+    }];
+
+    XCTAssertEqual(batches, 1u);
+    XCTAssertEqual([[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.cacheFileManager.trashPath error:nil].count, 0u);
+}
+
+- (void)testEmptyTrashInBatchesCountsFilesOfTrashedDirectories
+{
+    // A trashed shard holding nested directories of records
+    NSString * const shardPath = [self.cacheFileManager.trashPath stringByAppendingPathComponent:@"AA"];
+    for (NSString *directory in @[@"AB", @"AC"]) {
+        NSString * const directoryPath = [shardPath stringByAppendingPathComponent:directory];
+        XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:nil]);
+        for (NSString *name in @[@"1", @"2", @".3"]) {
+            XCTAssertTrue([[NSFileManager defaultManager] createFileAtPath:[directoryPath stringByAppendingPathComponent:name] contents:[NSData data] attributes:nil]);
+        }
+    }
+
+    __block NSUInteger batches = 0;
+    [self.cacheFileManager emptyTrashInBatchesOfSize:2 betweenBatches:^{
+        batches += 1;
+    }];
+
+    XCTAssertEqual(batches, 2u);
+    XCTAssertEqual([[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.cacheFileManager.trashPath error:nil].count, 0u);
+}
+
+- (void)testRemoveAllDataKeepsKeptKeys
+{
+    NSString *keptPath = [self createFileForKey:@"AA-kept"];
+    NSString *removedPath = [self createFileForKey:@"AA-removed"];
+    NSString *otherPath = [self createFileForKey:@"AB"];
+
+    [self.cacheFileManager removeAllDataExceptKeys:[NSSet setWithObject:@"AA-kept"]];
+
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:keptPath]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:removedPath]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:otherPath]);
+}
+
 - (void)testOptimizedDiskSizeForCacheSizeInsanelyBig
 {
     SPTPersistentCacheDiskSize insanelyBigCacheSize = LONG_LONG_MAX;
@@ -226,8 +290,179 @@
     XCTAssertTrue(called);
 }
 
+#pragma mark Directory Sharding
+
+- (void)testSubdirectoryPathForKeyWithHashedLayout
+{
+    SPTPersistentCacheFileManager * const fileManager = [self fileManagerWithShardingDepth:2];
+    NSString * const key = @"track:1234";
+
+    const char *keyBytes = key.UTF8String;
+    const uint64_t hash = spt_fnv1a64((const uint8_t *)keyBytes, strlen(keyBytes));
+    NSString *expectedSubDirectoryPath = [self.options.cachePath stringByAppendingPathComponent:[NSString stringWithFormat:@"%02llx", hash % 256]];
+    expectedSubDirectoryPath = [expectedSubDirectoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"%02llx", (hash / 256) % 256]];
+
+    XCTAssertEqualObjects([fileManager subDirectoryPathForKey:key], expectedSubDirectoryPath);
+    XCTAssertEqualObjects([fileManager pathForKey:key], [expectedSubDirectoryPath stringByAppendingPathComponent:key]);
+}
+
+- (void)testFileSystemPathMatchesPathForKey
+{
+    NSArray<SPTPersistentCacheFileManager *> * const fileManagers = @[self.cacheFileManager, [self fileManagerWithShardingDepth:2]];
+    NSArray<NSString *> * const keys = @[@"track:1234", @"A"];
+
+    for (SPTPersistentCacheFileManager *fileManager in fileManagers) {
+        for (NSString *key in keys) {
+            char path[PATH_MAX];
+            XCTAssertTrue([fileManager getFileSystemPath:path maxLength:sizeof(path) forKey:key]);
+            XCTAssertEqualObjects([[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)],
+                                  [fileManager pathForKey:key]);
+        }
+    }
+
+    // Non-ASCII first characters are left to the string methods, as are paths that don't fit
+    char path[PATH_MAX];
+    XCTAssertFalse([self.cacheFileManager getFileSystemPath:path maxLength:sizeof(path) forKey:@"\u00e9t\u00e9"]);
+    XCTAssertFalse([self.cacheFileManager getFileSystemPath:path maxLength:8 forKey:@"track:1234"]);
+}
+
+- (void)testHashedLayoutOfNewDirectoryIsRecorded
+{
+    SPTPersistentCacheFileManager *fileManager = [self fileManagerWithShardingDepth:2];
+
+    XCTAssertTrue([fileManager createCacheDirectory]);
+
+    XCTAssertFalse(fileManager.isMigratingLayout);
+    XCTAssertFalse(fileManager.subDirectoriesGroupKeysByPrefix);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:fileManager.layoutPath]);
+
+    fileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([fileManager createCacheDirectory]);
+    XCTAssertFalse(fileManager.isMigratingLayout);
+}
+
+- (void)testMigrateLayout
+{
+    NSArray<NSString *> * const keys = @[@"track:1", @"track:2", @"img:1"];
+    NSMutableArray<NSString *> * const legacyPaths = [NSMutableArray array];
+    for (NSString *key in keys) {
+        [legacyPaths addObject:[self createFileForKey:key]];
+    }
+
+    SPTPersistentCacheFileManager *fileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([fileManager createCacheDirectory]);
+    XCTAssertTrue(fileManager.isMigratingLayout);
+    XCTAssertFalse(fileManager.subDirectoriesGroupKeysByPrefix);
+
+    // Found where they are until moved
+    for (NSUInteger i = 0; i < keys.count; ++i) {
+        XCTAssertEqualObjects([fileManager pathForKey:keys[i]], legacyPaths[i]);
+        char path[PATH_MAX];
+        XCTAssertTrue([fileManager getFileSystemPath:path maxLength:sizeof(path) forKey:keys[i]]);
+        XCTAssertEqual(strcmp(path, legacyPaths[i].fileSystemRepresentation), 0);
+        XCTAssertNotEqualObjects([fileManager pathForStoringKey:keys[i]], legacyPaths[i]);
+    }
+    NSArray<NSString *> * const trackKeys = [[fileManager keysWithPrefix:@"track:"] sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqualObjects(trackKeys, (@[@"track:1", @"track:2"]));
+
+    __block NSUInteger batches = 0;
+    [fileManager migrateLayoutInBatchesOfSize:1 betweenBatches:^{
+        batches += 1;
+    }];
+
+    XCTAssertEqual(batches, 2u);
+    XCTAssertFalse(fileManager.isMigratingLayout);
+    for (NSUInteger i = 0; i < keys.count; ++i) {
+        XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:legacyPaths[i]]);
+        XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[fileManager pathForStoringKey:keys[i]]]);
+        XCTAssertEqualObjects([fileManager pathForKey:keys[i]], [fileManager pathForStoringKey:keys[i]]);
+    }
+    // The emptied directories of the earlier layout are gone
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:legacyPaths[0].stringByDeletingLastPathComponent]);
+
+    fileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([fileManager createCacheDirectory]);
+    XCTAssertFalse(fileManager.isMigratingLayout);
+}
+
+- (void)testMigrateLayoutKeepsNewerRecord
+{
+    NSString * const key = @"track:1";
+    NSString * const legacyPath = [self createFileForKey:key];
+
+    SPTPersistentCacheFileManager * const fileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([fileManager createCacheDirectory]);
+
+    NSString * const path = [fileManager pathForStoringKey:key];
+    [[NSFileManager defaultManager] createDirectoryAtPath:path.stringByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:nil];
+    XCTAssertTrue([@"Newer" writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:nil]);
+    XCTAssertEqualObjects([fileManager pathForKey:key], path);
+
+    [fileManager migrateLayoutInBatchesOfSize:64 betweenBatches:nil];
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:legacyPath]);
+    XCTAssertEqualObjects([NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil], @"Newer");
+}
+
+- (void)testMigrateLayoutFinishesWhenRecordsAreRemovedMeanwhile
+{
+    NSArray<NSString *> * const legacyPaths = @[[self createFileForKey:@"track:1"], [self createFileForKey:@"track:2"]];
+
+    SPTPersistentCacheFileManager * const fileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([fileManager createCacheDirectory]);
+
+    // Whichever record hasn't been moved yet is removed before its batch
+    [fileManager migrateLayoutInBatchesOfSize:1 betweenBatches:^{
+        for (NSString *legacyPath in legacyPaths) {
+            [[NSFileManager defaultManager] removeItemAtPath:legacyPath error:nil];
+        }
+    }];
+
+    XCTAssertFalse(fileManager.isMigratingLayout);
+}
+
+- (void)testRemoveDataForKeyWhileMigratingRemovesBothCopies
+{
+    NSString * const key = @"track:1";
+    NSString * const legacyPath = [self createFileForKey:key];
+
+    SPTPersistentCacheFileManager * const fileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([fileManager createCacheDirectory]);
+    NSString * const path = [fileManager pathForStoringKey:key];
+    [[NSFileManager defaultManager] createDirectoryAtPath:path.stringByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:nil];
+    XCTAssertTrue([@"Newer" writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:nil]);
+
+    XCTAssertTrue([fileManager removeDataForKey:key]);
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:legacyPath]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+    XCTAssertFalse([fileManager removeDataForKey:key]);
+}
+
+- (void)testRemoveAllDataKeepsKeptKeysInHashedLayout
+{
+    self.cacheFileManager = [self fileManagerWithShardingDepth:2];
+    XCTAssertTrue([self.cacheFileManager createCacheDirectory]);
+
+    NSString *keptPath = [self createFileForKey:@"track:kept"];
+    NSString *removedPath = [self createFileForKey:@"track:removed"];
+
+    [self.cacheFileManager removeAllDataExceptKeys:[NSSet setWithObject:@"track:kept"]];
+
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:keptPath]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:removedPath]);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:self.cacheFileManager.layoutPath]);
+}
+
 #pragma mark - Helper Functions
 
+- (SPTPersistentCacheFileManagerForTests *)fileManagerWithShardingDepth:(NSUInteger)depth
+{
+    SPTPersistentCacheOptions * const options = [self.options copy];
+    options.directoryShardingDepth = depth;
+    return [[SPTPersistentCacheFileManagerForTests alloc] initWithOptions:options];
+}
+
 - (NSString *)createFileForKey:(NSString *)key
 {
     NSError *error;
@@ -6,8 +6,8 @@
 #import <SPTPersistentCache/SPTPersistentCache.h>
 
 @interface SPTPersistentCacheGarbageCollector ()
-@property (nonatomic, strong) NSTimer *timer;
-- (void)enqueueGarbageCollection:(NSTimer *)timer;
+- (void)enqueueGarbageCollection;
+- (void)adaptIntervalToChurn;
 @end
     
 
@@ -68,7 +68,8 @@
     
     XCTAssertEqual(self.garbageCollector.queue, self.operationQueue);
     XCTAssertEqualObjects(strongCache, self.cache);
-    XCTAssertNil(self.garbageCollector.timer);
+    XCTAssertFalse(self.garbageCollector.isGarbageCollectionScheduled);
+    XCTAssertEqualWithAccuracy(self.garbageCollector.currentInterval, self.options.garbageCollectionInterval, 0.0);
 }
 
 - (void)testGarbageCollectorEnqueue
@@ -79,7 +80,7 @@
     dataCacheForUnitTests.queue = self.garbageCollector.queue;
 
     dataCacheForUnitTests.testExpectation = expectation;
-    [self.garbageCollector enqueueGarbageCollection:nil];
+    [self.garbageCollector enqueueGarbageCollection];
     
     [self waitForExpectationsWithTimeout:1.0 handler:^(NSError * _Nullable error) {
         XCTAssertTrue(dataCacheForUnitTests.wasRunRegularGCCalled);
@@ -100,27 +101,25 @@
 - (void)testScheduleGarbageCollection
 {
     [self.garbageCollector schedule];
-    XCTAssertNotNil(self.garbageCollector.timer);
-    XCTAssertTrue(self.garbageCollector.timer.isValid);
-    XCTAssertEqualWithAccuracy(self.garbageCollector.timer.timeInterval, self.options.garbageCollectionInterval, 0.0);
+    XCTAssertTrue(self.garbageCollector.isGarbageCollectionScheduled);
+    XCTAssertEqualWithAccuracy(self.garbageCollector.currentInterval, self.options.garbageCollectionInterval, 0.0);
 }
 
 - (void)testRepeatedScheduleGarbageCollection
 {
     [self.garbageCollector schedule];
-    NSTimer *timerFirstCall = self.garbageCollector.timer;
-    
     [self.garbageCollector schedule];
-    NSTimer *timerSecondCall = self.garbageCollector.timer;
-    
-    XCTAssertEqualObjects(timerFirstCall, timerSecondCall);
+    XCTAssertTrue(self.garbageCollector.isGarbageCollectionScheduled);
+
+    [self.garbageCollector unschedule];
+    XCTAssertFalse(self.garbageCollector.isGarbageCollectionScheduled);
 }
 
 - (void)testUnscheduleGarbageCollection
 {
     [self.garbageCollector schedule];
     [self.garbageCollector unschedule];
-    XCTAssertNil(self.garbageCollector.timer);
+    XCTAssertFalse(self.garbageCollector.isGarbageCollectionScheduled);
 }
 
 - (void)testSchedulingGarbageCollectionOnAnotherThread
@@ -128,12 +127,48 @@
     __weak XCTestExpectation *expectation = [self expectationWithDescription:@"Scheduled Expectation"];
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^ {
         [self.garbageCollector schedule];
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1.0 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
-            [expectation fulfill];
-        });
+        // Scheduling doesn’t need the main queue
+        XCTAssertTrue(self.garbageCollector.isGarbageCollectionScheduled);
+        [expectation fulfill];
     });
     [self waitForExpectationsWithTimeout:5.0 handler:nil];
-    XCTAssertTrue(self.garbageCollector.isGarbageCollectionScheduled);
+}
+
+#pragma mark Adaptive Interval
+
+- (void)testIntervalBacksOffWhileIdle
+{
+    const NSTimeInterval baseInterval = self.options.garbageCollectionInterval;
+
+    [self.garbageCollector adaptIntervalToChurn];
+    XCTAssertEqualWithAccuracy(self.garbageCollector.currentInterval, baseInterval * 2, 0.0);
+
+    for (NSUInteger i = 0; i < 10; ++i) {
+        [self.garbageCollector adaptIntervalToChurn];
+    }
+    XCTAssertEqualWithAccuracy(self.garbageCollector.currentInterval, baseInterval * SPTPersistentCacheGarbageCollectorMaxBackoffFactor, 0.0);
+}
+
+- (void)testIntervalShrinksUnderWritePressure
+{
+    for (NSUInteger i = 0; i < 20; ++i) {
+        [self.garbageCollector recordStoredBytes:SPTPersistentCacheGarbageCollectorDefaultPressureBytes / 2];
+        [self.garbageCollector recordExpiredBytes:SPTPersistentCacheGarbageCollectorDefaultPressureBytes / 2];
+        [self.garbageCollector adaptIntervalToChurn];
+    }
+
+    XCTAssertEqualWithAccuracy(self.garbageCollector.currentInterval, SPTPersistentCacheMinimumGCIntervalLimit, 0.0);
+}
+
+- (void)testIntervalReturnsToBaseWithModerateChurn
+{
+    [self.garbageCollector adaptIntervalToChurn];
+    XCTAssertGreaterThan(self.garbageCollector.currentInterval, self.options.garbageCollectionInterval);
+
+    [self.garbageCollector recordStoredBytes:1024];
+    [self.garbageCollector adaptIntervalToChurn];
+
+    XCTAssertEqualWithAccuracy(self.garbageCollector.currentInterval, self.options.garbageCollectionInterval, 0.0);
 }
 
 @end
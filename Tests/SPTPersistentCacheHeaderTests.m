@@ -84,4 +84,29 @@
     XCTAssertEqual(header.crc, SPTPersistentCacheCalculateHeaderCRC(&header));
 }
 
+- (void)testHintsAliasReservedFields
+{
+    SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 400, 0, NO);
+
+    header.refetchCost = 1024;
+    header.priority = 2;
+
+    XCTAssertEqual(header.reserved2, (uint64_t)1024);
+    XCTAssertEqual(header.reserved3, (uint32_t)2);
+    XCTAssertEqual(SPTPersistentCacheRecordHeaderSize, (size_t)64);
+}
+
+- (void)testValidateHeaderSize
+{
+    SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 400, 0, NO);
+
+    header.headerSize = (uint32_t)SPTPersistentCacheRecordAlignedHeaderSize;
+    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+    XCTAssertEqual(SPTPersistentCacheValidateHeader(&header), -1);
+
+    header.headerSize = (uint32_t)SPTPersistentCacheRecordHeaderSize + 8;
+    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+    XCTAssertEqual(SPTPersistentCacheValidateHeader(&header), SPTPersistentCacheLoadingErrorWrongHeaderSize);
+}
+
 @end
@@ -0,0 +1,253 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheJournal.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+static const uint32_t SPTPersistentCacheJournalTestsMagicValue = 0x54534554; // TEST
+
+/**
+ Keeps strings by key, each entry a `uint16_t` key length, the key, a `uint16_t` value length and the value. An empty
+ value removes the key.
+ */
+@interface SPTPersistentCacheJournalTestCodec : NSObject <SPTPersistentCacheJournalCodec>
+@property (nonatomic, strong, readonly) NSMutableDictionary<NSString *, NSString *> *values;
+@end
+
+@implementation SPTPersistentCacheJournalTestCodec
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _values = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSData *)encodeEntries:(NSDictionary<NSString *, NSString *> *)entries
+{
+    NSMutableData * const data = [NSMutableData data];
+    for (NSString *key in entries) {
+        for (NSString *string in @[key, entries[key]]) {
+            NSData * const utf8String = [string dataUsingEncoding:NSUTF8StringEncoding];
+            if (utf8String.length > UINT16_MAX) {
+                return nil;
+            }
+            const uint16_t length = (uint16_t)utf8String.length;
+            [data appendBytes:&length length:sizeof(length)];
+            [data appendData:utf8String];
+        }
+    }
+    return data;
+}
+
+- (NSDictionary<NSString *, NSString *> *)decodeEntries:(const uint8_t *)bytes length:(size_t)length count:(uint32_t)entryCount
+{
+    NSMutableArray<NSString *> * const strings = [NSMutableArray array];
+    size_t offset = 0;
+    while (strings.count < entryCount * 2) {
+        uint16_t stringLength = 0;
+        if (length - offset < sizeof(stringLength)) {
+            return nil;
+        }
+        memcpy(&stringLength, bytes + offset, sizeof(stringLength));
+        offset += sizeof(stringLength);
+        if (length - offset < stringLength) {
+            return nil;
+        }
+        [strings addObject:[[NSString alloc] initWithBytes:bytes + offset length:stringLength encoding:NSUTF8StringEncoding]];
+        offset += stringLength;
+    }
+
+    NSMutableDictionary<NSString *, NSString *> * const entries = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < strings.count; i += 2) {
+        entries[strings[i]] = strings[i + 1];
+    }
+    return (offset == length ? entries : nil);
+}
+
+- (void)applyEntries:(NSDictionary<NSString *, NSString *> *)entries
+{
+    [entries enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *value, BOOL *stop) {
+        self.values[key] = (value.length > 0 ? value : nil);
+    }];
+}
+
+- (NSDictionary<NSString *, NSString *> *)snapshotEntries
+{
+    return [self.values copy];
+}
+
+@end
+
+@interface SPTPersistentCacheJournalTests : XCTestCase
+@property (nonatomic, copy) NSString *journalPath;
+@property (nonatomic, strong) SPTPersistentCacheJournalTestCodec *codec;
+@end
+
+@implementation SPTPersistentCacheJournalTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.journalPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.journalPath error:nil];
+
+    [super tearDown];
+}
+
+/// Opens the journal into a new codec, as the cache does when it is created again
+- (SPTPersistentCacheJournal *)openJournal
+{
+    self.codec = [SPTPersistentCacheJournalTestCodec new];
+    return [[SPTPersistentCacheJournal alloc] initWithPath:self.journalPath
+                                                      name:@"test journal"
+                                                     magic:SPTPersistentCacheJournalTestsMagicValue
+                                               synchronous:YES
+                                                     codec:self.codec
+                                               debugOutput:nil];
+}
+
+- (unsigned long long)journalFileSize
+{
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath:self.journalPath error:nil] fileSize];
+}
+
+- (void)appendBatchWithHeader:(SPTPersistentCacheJournalBatchHeader)header entries:(NSData *)entries
+{
+    NSFileHandle * const fileHandle = [NSFileHandle fileHandleForWritingAtPath:self.journalPath];
+    [fileHandle seekToEndOfFile];
+    [fileHandle writeData:[NSData dataWithBytes:&header length:sizeof(header)]];
+    [fileHandle writeData:entries];
+    [fileHandle closeFile];
+}
+
+- (void)testNewJournalIsCreatedEmpty
+{
+    SPTPersistentCacheJournal * const journal = [self openJournal];
+
+    XCTAssertNotNil(journal);
+    XCTAssertTrue(journal.isCreated);
+    XCTAssertEqual(journal.fileSize, 0);
+    XCTAssertEqual(self.codec.values.count, 0u);
+}
+
+- (void)testUnopenableJournalFails
+{
+    NSString * const path = [self.journalPath stringByAppendingPathComponent:@"missing-dir/.journal"];
+    SPTPersistentCacheJournalTestCodec * const codec = [SPTPersistentCacheJournalTestCodec new];
+
+    XCTAssertNil([[SPTPersistentCacheJournal alloc] initWithPath:path
+                                                            name:@"test journal"
+                                                           magic:SPTPersistentCacheJournalTestsMagicValue
+                                                     synchronous:NO
+                                                           codec:codec
+                                                     debugOutput:nil]);
+}
+
+- (void)testEntriesAreAppliedAndReplayedWhenOpenedAgain
+{
+    SPTPersistentCacheJournal *journal = [self openJournal];
+    XCTAssertTrue([journal commitEntries:@{ @"AA-key": @"1", @"BB-key": @"2" }]);
+    XCTAssertTrue([journal commitEntries:@{ @"AA-key": @"", @"CC-key": @"3" }]);
+    XCTAssertTrue([journal commitEntries:@{}]);
+
+    NSDictionary<NSString *, NSString *> * const expected = @{ @"BB-key": @"2", @"CC-key": @"3" };
+    XCTAssertEqualObjects(self.codec.values, expected);
+    XCTAssertEqual((unsigned long long)journal.fileSize, [self journalFileSize]);
+    journal = nil;
+
+    journal = [self openJournal];
+
+    XCTAssertFalse(journal.isCreated);
+    XCTAssertEqualObjects(self.codec.values, expected);
+}
+
+- (void)testTornBatchIsDropped
+{
+    SPTPersistentCacheJournal *journal = [self openJournal];
+    XCTAssertTrue([journal commitEntries:@{ @"AA-key": @"1" }]);
+    journal = nil;
+    const unsigned long long validSize = [self journalFileSize];
+
+    // A batch header promising more entries than were written before the crash
+    SPTPersistentCacheJournalBatchHeader header = { SPTPersistentCacheJournalTestsMagicValue, 1, 64, 0 };
+    [self appendBatchWithHeader:header entries:[@"BB" dataUsingEncoding:NSUTF8StringEncoding]];
+
+    journal = [self openJournal];
+
+    XCTAssertEqualObjects(self.codec.values, (@{ @"AA-key": @"1" }));
+    XCTAssertEqual([self journalFileSize], validSize);
+
+    // Batches appended after the torn one are replayed
+    XCTAssertTrue([journal commitEntries:@{ @"BB-key": @"2" }]);
+    journal = nil;
+    journal = [self openJournal];
+    XCTAssertEqualObjects(self.codec.values[@"BB-key"], @"2");
+}
+
+- (void)testBatchOfAnotherJournalIsDropped
+{
+    SPTPersistentCacheJournal *journal = [self openJournal];
+    XCTAssertTrue([journal commitEntries:@{ @"AA-key": @"1" }]);
+    journal = nil;
+    const unsigned long long validSize = [self journalFileSize];
+
+    NSData * const entries = [self.codec encodeEntries:@{ @"BB-key": @"2" }];
+    SPTPersistentCacheJournalBatchHeader header = { SPTPersistentCacheJournalTestsMagicValue + 1, 1, (uint32_t)entries.length, 0 };
+    [self appendBatchWithHeader:header entries:entries];
+
+    journal = [self openJournal];
+
+    XCTAssertEqualObjects(self.codec.values, (@{ @"AA-key": @"1" }));
+    XCTAssertEqual([self journalFileSize], validSize);
+}
+
+- (void)testUnencodableEntriesAreNotWritten
+{
+    SPTPersistentCacheJournal * const journal = [self openJournal];
+    NSString * const tooLongValue = [@"" stringByPaddingToLength:UINT16_MAX + 1 withString:@"x" startingAtIndex:0];
+
+    XCTAssertFalse([journal commitEntries:@{ @"AA-key": tooLongValue }]);
+
+    XCTAssertEqual(self.codec.values.count, 0u);
+    XCTAssertEqual([self journalFileSize], 0u);
+}
+
+- (void)testJournalIsCompacted
+{
+    SPTPersistentCacheJournal *journal = [self openJournal];
+    NSString * const key = [@"AA-" stringByPaddingToLength:200 withString:@"x" startingAtIndex:0];
+    for (NSUInteger i = 0; i < 2000; ++i) {
+        XCTAssertTrue([journal commitEntries:@{ key: (i % 2 == 0 ? @"1" : @"2") }]);
+    }
+
+    XCTAssertLessThan([self journalFileSize], 2000u * 200u);
+    XCTAssertEqual((unsigned long long)journal.fileSize, [self journalFileSize]);
+
+    // Batches appended after the snapshot are replayed with it
+    XCTAssertTrue([journal commitEntries:@{ @"BB-key": @"3" }]);
+    journal = nil;
+    journal = [self openJournal];
+    NSDictionary<NSString *, NSString *> * const expected = @{ key: @"2", @"BB-key": @"3" };
+    XCTAssertEqualObjects(self.codec.values, expected);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheJournal * const journal = [self openJournal];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:journal.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:journal.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
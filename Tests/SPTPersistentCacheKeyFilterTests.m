@@ -0,0 +1,99 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheKeyFilter.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheKeyFilterTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCacheKeyFilter *keyFilter;
+@end
+
+@implementation SPTPersistentCacheKeyFilterTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.keyFilter = [[SPTPersistentCacheKeyFilter alloc] initWithCapacity:1000 falsePositiveRate:0.01];
+}
+
+- (void)testInvalidParametersFail
+{
+    XCTAssertNil([[SPTPersistentCacheKeyFilter alloc] initWithCapacity:0 falsePositiveRate:0.01]);
+    XCTAssertNil([[SPTPersistentCacheKeyFilter alloc] initWithCapacity:1000 falsePositiveRate:0.0]);
+    XCTAssertNil([[SPTPersistentCacheKeyFilter alloc] initWithCapacity:1000 falsePositiveRate:1.0]);
+}
+
+- (void)testEveryKeyMightExistUntilPopulated
+{
+    XCTAssertFalse(self.keyFilter.isReady);
+    XCTAssertTrue([self.keyFilter mightContainKey:@"AA-missing"]);
+
+    [self.keyFilter beginPopulating];
+    XCTAssertTrue([self.keyFilter mightContainKey:@"AA-missing"]);
+
+    [self.keyFilter finishPopulating];
+    XCTAssertTrue(self.keyFilter.isReady);
+    XCTAssertFalse([self.keyFilter mightContainKey:@"AA-missing"]);
+}
+
+- (void)testAddedKeysAreNeverRuledOut
+{
+    [self.keyFilter beginPopulating];
+    [self.keyFilter finishPopulating];
+
+    for (NSUInteger i = 0; i < 1000; ++i) {
+        [self.keyFilter addKey:[NSString stringWithFormat:@"key-%@", @(i)]];
+    }
+    for (NSUInteger i = 0; i < 1000; ++i) {
+        XCTAssertTrue([self.keyFilter mightContainKey:[NSString stringWithFormat:@"key-%@", @(i)]]);
+    }
+}
+
+- (void)testFalsePositiveRateIsNearConfiguredRate
+{
+    [self.keyFilter beginPopulating];
+    [self.keyFilter finishPopulating];
+
+    for (NSUInteger i = 0; i < 1000; ++i) {
+        [self.keyFilter addKey:[NSString stringWithFormat:@"key-%@", @(i)]];
+    }
+
+    NSUInteger falsePositives = 0;
+    for (NSUInteger i = 1000; i < 11000; ++i) {
+        falsePositives += [self.keyFilter mightContainKey:[NSString stringWithFormat:@"key-%@", @(i)]] ? 1 : 0;
+    }
+    XCTAssertLessThan(falsePositives, 300u);
+}
+
+- (void)testRemovedKeyIsRuledOut
+{
+    [self.keyFilter beginPopulating];
+    [self.keyFilter finishPopulating];
+
+    [self.keyFilter addKey:@"AA-key"];
+    [self.keyFilter removeKey:@"AA-key"];
+
+    XCTAssertFalse([self.keyFilter mightContainKey:@"AA-key"]);
+}
+
+- (void)testRemoveIsIgnoredWhilePopulating
+{
+    [self.keyFilter beginPopulating];
+    [self.keyFilter addKey:@"AA-key"];
+    [self.keyFilter removeKey:@"AA-key"];
+    [self.keyFilter finishPopulating];
+
+    XCTAssertTrue([self.keyFilter mightContainKey:@"AA-key"]);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.keyFilter.description], @"The description string should follow our style.");
+}
+
+@end
@@ -0,0 +1,150 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+
+#import "SPTPersistentCacheKeyIndex.h"
+#import "SPTPersistentCachePartitionTable.h"
+#import "SPTPersistentCacheRecordMetadata+Private.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+static const NSUInteger SPTPersistentCacheKeyIndexTestsExpirationPeriod = 100;
+
+@interface SPTPersistentCacheKeyIndexTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCacheKeyIndex *keyIndex;
+@end
+
+@implementation SPTPersistentCacheKeyIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    SPTPersistentCacheOptions * const options = [SPTPersistentCacheOptions new];
+    options.defaultExpirationPeriod = SPTPersistentCacheKeyIndexTestsExpirationPeriod;
+    SPTPersistentCachePartitionTable * const partitionTable = [[SPTPersistentCachePartitionTable alloc] initWithOptions:options];
+    self.keyIndex = [[SPTPersistentCacheKeyIndex alloc] initWithPartitionTable:partitionTable];
+}
+
+- (void)setKeys:(NSArray<NSString *> *)keys
+{
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 4, 1000, NO);
+    for (NSString *key in keys) {
+        [self.keyIndex setMetadataWithHeader:&header forKey:key];
+    }
+}
+
+- (void)testIndexIsReadyOncePopulated
+{
+    XCTAssertFalse(self.keyIndex.isReady);
+
+    [self.keyIndex beginPopulating];
+    XCTAssertFalse(self.keyIndex.isReady);
+
+    [self.keyIndex finishPopulating];
+    XCTAssertTrue(self.keyIndex.isReady);
+}
+
+- (void)testPrefixQueryReturnsSortedRange
+{
+    [self setKeys:@[@"BB-2", @"AA-1", @"BB-1", @"B", @"BC-1", @"BB-10"]];
+
+    NSArray<SPTPersistentCacheRecordMetadata *> * const metadata = [self.keyIndex metadataForKeysWithPrefix:@"BB-"];
+    NSArray<NSString *> * const expectedKeys = @[@"BB-1", @"BB-10", @"BB-2"];
+    XCTAssertEqualObjects([metadata valueForKey:@"key"], expectedKeys);
+
+    XCTAssertEqual([self.keyIndex metadataForKeysWithPrefix:@""].count, 6u);
+    XCTAssertEqual([self.keyIndex metadataForKeysWithPrefix:@"CC"].count, 0u);
+}
+
+- (void)testPrefixQueryIsPagedAfterKey
+{
+    [self setKeys:@[@"BB-2", @"AA-1", @"BB-1", @"BB-3", @"BC-1", @"BB-10"]];
+
+    NSArray<SPTPersistentCacheRecordMetadata *> * const firstPage = [self.keyIndex metadataForKeysWithPrefix:@"BB-" afterKey:nil limit:2];
+    XCTAssertEqualObjects([firstPage valueForKey:@"key"], (@[@"BB-1", @"BB-10"]));
+
+    // The last key of a page may be removed before the next one is asked for
+    [self.keyIndex removeKey:@"BB-10"];
+    NSArray<SPTPersistentCacheRecordMetadata *> * const secondPage = [self.keyIndex metadataForKeysWithPrefix:@"BB-" afterKey:firstPage.lastObject.key limit:2];
+    XCTAssertEqualObjects([secondPage valueForKey:@"key"], (@[@"BB-2", @"BB-3"]));
+
+    XCTAssertEqual([self.keyIndex metadataForKeysWithPrefix:@"BB-" afterKey:@"BB-3" limit:2].count, 0u);
+    XCTAssertEqual([self.keyIndex metadataForKeysWithPrefix:@"BB-" afterKey:@"AA-1" limit:10].count, 3u);
+}
+
+- (void)testSetAndRemoveKeys
+{
+    [self setKeys:@[@"AA-1", @"AA-2"]];
+    XCTAssertEqual(self.keyIndex.count, 2u);
+
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(30, 8, 2000, YES);
+    [self.keyIndex setMetadataWithHeader:&header forKey:@"AA-1"];
+    XCTAssertEqual(self.keyIndex.count, 2u);
+
+    SPTPersistentCacheRecordMetadata * const metadata = [self.keyIndex metadataForKey:@"AA-1"];
+    XCTAssertEqual(metadata.refCount, 1u);
+    XCTAssertEqual(metadata.ttl, 30u);
+    XCTAssertEqual(metadata.payloadSize, 8u);
+    XCTAssertEqualWithAccuracy(metadata.expirationTime, 2030.0, DBL_EPSILON);
+
+    [self.keyIndex removeKey:@"AA-1"];
+    [self.keyIndex removeKey:@"AA-missing"];
+    XCTAssertNil([self.keyIndex metadataForKey:@"AA-1"]);
+    XCTAssertEqual(self.keyIndex.count, 1u);
+}
+
+- (void)testPopulationDoesNotOverrideChangesMadeMeanwhile
+{
+    [self.keyIndex beginPopulating];
+
+    // Stored and removed while the population was listing the directory
+    const SPTPersistentCacheRecordHeader newHeader = SPTPersistentCacheRecordHeaderMake(0, 8, 2000, NO);
+    [self.keyIndex setMetadataWithHeader:&newHeader forKey:@"AA-stored"];
+    [self.keyIndex removeKey:@"AA-removed"];
+
+    const SPTPersistentCacheRecordHeader oldHeader = SPTPersistentCacheRecordHeaderMake(0, 4, 1000, NO);
+    [self.keyIndex addPopulatedMetadataWithHeader:&oldHeader forKey:@"AA-stored"];
+    [self.keyIndex addPopulatedMetadataWithHeader:&oldHeader forKey:@"AA-removed"];
+    [self.keyIndex addPopulatedMetadataWithHeader:&oldHeader forKey:@"AA-found"];
+    [self.keyIndex finishPopulating];
+
+    XCTAssertEqual([self.keyIndex metadataForKey:@"AA-stored"].payloadSize, 8u);
+    XCTAssertNil([self.keyIndex metadataForKey:@"AA-removed"]);
+    XCTAssertNotNil([self.keyIndex metadataForKey:@"AA-found"]);
+    XCTAssertEqual(self.keyIndex.count, 2u);
+}
+
+- (void)testPopulatedKeysAreSortedOnceAndStaySorted
+{
+    [self.keyIndex beginPopulating];
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 4, 1000, NO);
+    for (NSString *key in @[@"BB-2", @"AA-1", @"BB-1", @"BB-3"]) {
+        [self.keyIndex addPopulatedMetadataWithHeader:&header forKey:key];
+    }
+    [self.keyIndex removeKey:@"BB-3"];
+    [self.keyIndex setMetadataWithHeader:&header forKey:@"BB-0"];
+    [self.keyIndex finishPopulating];
+
+    NSArray<NSString *> *expectedKeys = @[@"BB-0", @"BB-1", @"BB-2"];
+    XCTAssertEqualObjects([[self.keyIndex metadataForKeysWithPrefix:@"BB-"] valueForKey:@"key"], expectedKeys);
+
+    // Once populated, keys are inserted in order
+    [self setKeys:@[@"BB-11"]];
+    [self.keyIndex removeKey:@"BB-0"];
+    expectedKeys = @[@"BB-1", @"BB-11", @"BB-2"];
+    XCTAssertEqualObjects([[self.keyIndex metadataForKeysWithPrefix:@"BB-"] valueForKey:@"key"], expectedKeys);
+    XCTAssertEqual(self.keyIndex.count, 4u);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    [self setKeys:@[@"AA-1"]];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.keyIndex.description], @"The description string should follow our style.");
+}
+
+@end
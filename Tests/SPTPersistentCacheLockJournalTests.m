@@ -0,0 +1,102 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheLockJournal.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheLockJournalTests : XCTestCase
+@property (nonatomic, copy) NSString *journalPath;
+@end
+
+@implementation SPTPersistentCacheLockJournalTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.journalPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.journalPath error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCacheLockJournal *)openJournal
+{
+    return [[SPTPersistentCacheLockJournal alloc] initWithPath:self.journalPath debugOutput:nil];
+}
+
+- (void)testNewJournalIsCreatedEmpty
+{
+    SPTPersistentCacheLockJournal * const journal = [self openJournal];
+
+    XCTAssertNotNil(journal);
+    XCTAssertTrue(journal.isCreated);
+    XCTAssertEqual(journal.allRefCounts.count, 0u);
+    XCTAssertEqual([journal refCountForKey:@"AA-key"], 0u);
+}
+
+- (void)testDeltasAreClampedAtZero
+{
+    SPTPersistentCacheLockJournal * const journal = [self openJournal];
+
+    XCTAssertTrue([journal applyRefCountDeltas:@{ @"AA-key": @2, @"BB-key": @-1 }]);
+    XCTAssertTrue([journal applyRefCountDeltas:@{ @"AA-key": @-3 }]);
+
+    XCTAssertEqual([journal refCountForKey:@"AA-key"], 0u);
+    XCTAssertEqual([journal refCountForKey:@"BB-key"], 0u);
+    XCTAssertEqual(journal.allRefCounts.count, 0u);
+}
+
+- (void)testCountsAreReplayedWhenOpenedAgain
+{
+    SPTPersistentCacheLockJournal *journal = [self openJournal];
+    XCTAssertTrue([journal setRefCounts:@{ @"AA-key": @1, @"BB-key": @3 }]);
+    XCTAssertTrue([journal applyRefCountDeltas:@{ @"AA-key": @-1, @"BB-key": @1, @"CC-key": @1 }]);
+    journal = nil;
+
+    journal = [self openJournal];
+
+    XCTAssertFalse(journal.isCreated);
+    NSDictionary<NSString *, NSNumber *> * const expected = @{ @"BB-key": @4, @"CC-key": @1 };
+    XCTAssertEqualObjects(journal.allRefCounts, expected);
+}
+
+- (void)testUnchangedCountsAreNotWritten
+{
+    SPTPersistentCacheLockJournal * const journal = [self openJournal];
+    XCTAssertTrue([journal setRefCounts:@{ @"AA-key": @1 }]);
+    const unsigned long long size = [[[NSFileManager defaultManager] attributesOfItemAtPath:self.journalPath error:nil] fileSize];
+
+    XCTAssertTrue([journal setRefCounts:@{ @"AA-key": @1, @"BB-key": @0 }]);
+
+    XCTAssertEqual([[[NSFileManager defaultManager] attributesOfItemAtPath:self.journalPath error:nil] fileSize], size);
+}
+
+- (void)testRemoveAllRefCountsExceptKeys
+{
+    SPTPersistentCacheLockJournal *journal = [self openJournal];
+    XCTAssertTrue([journal setRefCounts:@{ @"AA-key": @1, @"BB-key": @2, @"CC-key": @3 }]);
+
+    XCTAssertTrue([journal removeAllRefCountsExceptKeys:[NSSet setWithObject:@"BB-key"]]);
+    journal = nil;
+    journal = [self openJournal];
+
+    NSDictionary<NSString *, NSNumber *> * const expected = @{ @"BB-key": @2 };
+    XCTAssertEqualObjects(journal.allRefCounts, expected);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheLockJournal * const journal = [self openJournal];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:journal.description], @"The description string should follow our style.");
+}
+
+@end
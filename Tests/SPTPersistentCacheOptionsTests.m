@@ -4,6 +4,7 @@
 #import <XCTest/XCTest.h>
 
 #import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
 #import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
 
 static NSString * const SPTPersistentCacheOptionsPathComponent = @"com.spotify.tmp.cache";
@@ -29,6 +30,48 @@ static NSString * const SPTPersistentCacheOptionsPathComponent = @"com.spotify.t
     XCTAssertNotNil(self.dataCacheOptions.cachePath, @"The cache path cannot be nil");
     XCTAssertNotNil(self.dataCacheOptions.cacheIdentifier, @"The cache identifier cannot be nil");
     XCTAssertNotNil(self.dataCacheOptions.identifierForQueue, @"The identifier for queue shouldn't be nil");
+    XCTAssertEqual(self.dataCacheOptions.maxConcurrentReadOperations, NSOperationQueueDefaultMaxConcurrentOperationCount);
+    XCTAssertEqual(self.dataCacheOptions.maxConcurrentWriteOperations, NSOperationQueueDefaultMaxConcurrentOperationCount);
+    XCTAssertEqualWithAccuracy(self.dataCacheOptions.maintenanceConcurrencyShare, 0.25, DBL_EPSILON);
+    XCTAssertFalse(self.dataCacheOptions.useAdaptiveConcurrency, @"Adaptive concurrency should be disabled");
+    XCTAssertEqual(self.dataCacheOptions.minConcurrentOperations, 1);
+    XCTAssertFalse(self.dataCacheOptions.useKeyIndex, @"The key index should be disabled");
+    XCTAssertFalse(self.dataCacheOptions.useLockJournal, @"The lock journal should be disabled");
+    XCTAssertFalse(self.dataCacheOptions.useMultiProcessCoordination, @"Multi-process coordination should be disabled");
+    XCTAssertEqual(self.dataCacheOptions.accessHistoryCapacity, 0u, @"The access history should be disabled");
+    XCTAssertFalse(self.dataCacheOptions.useTagIndex, @"The tag index should be disabled");
+    XCTAssertEqual(self.dataCacheOptions.deduplicationThresholdBytes, 0u, @"Deduplication should be disabled");
+    XCTAssertEqual(self.dataCacheOptions.largeRecordThresholdBytes, 0u, @"Large records should be disabled");
+    XCTAssertEqual(self.dataCacheOptions.directoryShardingDepth, 0u, @"Records should be separated by key prefix");
+    XCTAssertEqual(self.dataCacheOptions.directoryShardingFanOut, 256u);
+    XCTAssertEqual(self.dataCacheOptions.partitions.count, 0u, @"There should be no partitions");
+}
+
+- (void)testDirectoryShardingIsClamped
+{
+    self.dataCacheOptions.directoryShardingDepth = 10;
+    XCTAssertEqual(self.dataCacheOptions.directoryShardingDepth, 4u);
+
+    self.dataCacheOptions.directoryShardingFanOut = 1;
+    XCTAssertEqual(self.dataCacheOptions.directoryShardingFanOut, 2u);
+
+    self.dataCacheOptions.directoryShardingFanOut = 1 << 20;
+    XCTAssertEqual(self.dataCacheOptions.directoryShardingFanOut, 65536u);
+}
+
+- (void)testMaintenanceConcurrencyShareIsClamped
+{
+    self.dataCacheOptions.maintenanceConcurrencyShare = 2.0;
+    XCTAssertEqualWithAccuracy(self.dataCacheOptions.maintenanceConcurrencyShare, 1.0, DBL_EPSILON);
+
+    self.dataCacheOptions.maintenanceConcurrencyShare = -1.0;
+    XCTAssertEqualWithAccuracy(self.dataCacheOptions.maintenanceConcurrencyShare, 0.0, DBL_EPSILON);
+}
+
+- (void)testMinConcurrentOperationsIsClamped
+{
+    self.dataCacheOptions.minConcurrentOperations = 0;
+    XCTAssertEqual(self.dataCacheOptions.minConcurrentOperations, 1);
 }
 
 - (void)testMinimumGarbageCollectorIntervalForDeprecatedInit
@@ -107,9 +150,29 @@ static NSString * const SPTPersistentCacheOptionsPathComponent = @"com.spotify.t
     original.cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:SPTPersistentCacheOptionsPathComponent];
     original.cacheIdentifier = @"test";
     original.useDirectorySeparation = NO;
+    original.directoryShardingDepth = 2;
+    original.directoryShardingFanOut = 16;
     original.garbageCollectionInterval = SPTPersistentCacheDefaultGCIntervalSec + 10;
     original.defaultExpirationPeriod = SPTPersistentCacheDefaultExpirationTimeSec + 10;
     original.sizeConstraintBytes = 1024 * 1024;
+    original.partitions = @[[[SPTPersistentCachePartition alloc] initWithName:@"images" keyPrefix:@"image:"]];
+    original.traceFilePath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"trace"];
+    original.maxConcurrentReadOperations = 3;
+    original.maxConcurrentWriteOperations = 2;
+    original.maintenanceConcurrencyShare = 0.5;
+    original.useAdaptiveConcurrency = YES;
+    original.minConcurrentOperations = 2;
+    original.concurrencyCallback = ^(NSString *queueName, NSInteger concurrency, NSTimeInterval latency) {
+    };
+    original.keyFilterCapacity = 10000;
+    original.keyFilterFalsePositiveRate = 0.001;
+    original.useKeyIndex = YES;
+    original.useLockJournal = YES;
+    original.useMultiProcessCoordination = YES;
+    original.accessHistoryCapacity = 1000;
+    original.useTagIndex = YES;
+    original.deduplicationThresholdBytes = 4096;
+    original.largeRecordThresholdBytes = 64 * 1024 * 1024;
     original.debugOutput = ^(NSString *message) {
         NSLog(@"Foo: %@", message);
     };
@@ -122,15 +185,36 @@ static NSString * const SPTPersistentCacheOptionsPathComponent = @"com.spotify.t
     XCTAssertNotEqual(original, copy, @"The original and copy shouldn’t be the same object");
 
     XCTAssertNotNil(copy.debugOutput, @"The debug output callback block should exist after copy");
+    XCTAssertNotNil(copy.concurrencyCallback, @"The concurrency callback block should exist after copy");
 
     XCTAssertTrue([copy.identifierForQueue hasPrefix:queueIdentifierPrefix] , @"The values of the property \"identifierForQueue\" should have the same prefix");
     XCTAssertEqualObjects(original.cachePath, copy.cachePath, @"The values of the property \"cachePath\" should be equal");
     XCTAssertEqualObjects(original.cacheIdentifier, copy.cacheIdentifier, @"The values of the property \"cacheIdentifier\" should be equal");
 
     XCTAssertEqual(original.useDirectorySeparation, copy.useDirectorySeparation, @"The values of the property \"useDirectorySeparation\" should be equal");
+    XCTAssertEqual(original.directoryShardingDepth, copy.directoryShardingDepth, @"The values of the property \"directoryShardingDepth\" should be equal");
+    XCTAssertEqual(original.directoryShardingFanOut, copy.directoryShardingFanOut, @"The values of the property \"directoryShardingFanOut\" should be equal");
     XCTAssertEqual(original.garbageCollectionInterval, copy.garbageCollectionInterval, @"The values of the property \"garbageCollectionInterval\" should be equal");
     XCTAssertEqual(original.defaultExpirationPeriod, copy.defaultExpirationPeriod, @"The values of the property \"defaultExpirationPeriod\" should be equal");
     XCTAssertEqual(original.sizeConstraintBytes, copy.sizeConstraintBytes, @"The values of the property \"sizeConstraintBytes\" should be equal");
+    XCTAssertEqual(original.partitions.count, copy.partitions.count, @"The values of the property \"partitions\" should be equal");
+    XCTAssertNotEqual(original.partitions.firstObject, copy.partitions.firstObject, @"The partitions should be copied");
+    XCTAssertEqualObjects(original.partitions.firstObject.keyPrefix, copy.partitions.firstObject.keyPrefix, @"The partitions should be copied");
+    XCTAssertEqualObjects(original.traceFilePath, copy.traceFilePath, @"The values of the property \"traceFilePath\" should be equal");
+    XCTAssertEqual(original.maxConcurrentReadOperations, copy.maxConcurrentReadOperations, @"The values of the property \"maxConcurrentReadOperations\" should be equal");
+    XCTAssertEqual(original.maxConcurrentWriteOperations, copy.maxConcurrentWriteOperations, @"The values of the property \"maxConcurrentWriteOperations\" should be equal");
+    XCTAssertEqual(original.maintenanceConcurrencyShare, copy.maintenanceConcurrencyShare, @"The values of the property \"maintenanceConcurrencyShare\" should be equal");
+    XCTAssertEqual(original.useAdaptiveConcurrency, copy.useAdaptiveConcurrency, @"The values of the property \"useAdaptiveConcurrency\" should be equal");
+    XCTAssertEqual(original.minConcurrentOperations, copy.minConcurrentOperations, @"The values of the property \"minConcurrentOperations\" should be equal");
+    XCTAssertEqual(original.keyFilterCapacity, copy.keyFilterCapacity, @"The values of the property \"keyFilterCapacity\" should be equal");
+    XCTAssertEqual(original.keyFilterFalsePositiveRate, copy.keyFilterFalsePositiveRate, @"The values of the property \"keyFilterFalsePositiveRate\" should be equal");
+    XCTAssertEqual(original.useKeyIndex, copy.useKeyIndex, @"The values of the property \"useKeyIndex\" should be equal");
+    XCTAssertEqual(original.useLockJournal, copy.useLockJournal, @"The values of the property \"useLockJournal\" should be equal");
+    XCTAssertEqual(original.useMultiProcessCoordination, copy.useMultiProcessCoordination, @"The values of the property \"useMultiProcessCoordination\" should be equal");
+    XCTAssertEqual(original.accessHistoryCapacity, copy.accessHistoryCapacity, @"The values of the property \"accessHistoryCapacity\" should be equal");
+    XCTAssertEqual(original.useTagIndex, copy.useTagIndex, @"The values of the property \"useTagIndex\" should be equal");
+    XCTAssertEqual(original.deduplicationThresholdBytes, copy.deduplicationThresholdBytes, @"The values of the property \"deduplicationThresholdBytes\" should be equal");
+    XCTAssertEqual(original.largeRecordThresholdBytes, copy.largeRecordThresholdBytes, @"The values of the property \"largeRecordThresholdBytes\" should be equal");
 }
 
 #pragma mark Compatibility Properties for Deprecated Properties
@@ -0,0 +1,76 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
+#import "SPTPersistentCachePartitionTable.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCachePartitionTableTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCacheOptions *options;
+@end
+
+@implementation SPTPersistentCachePartitionTableTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.options = [SPTPersistentCacheOptions new];
+}
+
+- (void)testKeysBelongToDefaultPartitionWithoutPartitions
+{
+    SPTPersistentCachePartitionTable * const partitionTable = [[SPTPersistentCachePartitionTable alloc] initWithOptions:self.options];
+
+    XCTAssertEqual(partitionTable.partitions.count, 1u);
+    XCTAssertFalse(partitionTable.hasSizeConstrainedPartitions);
+    XCTAssertEqualObjects([partitionTable partitionForKey:@"AA-key"].keyPrefix, @"");
+    XCTAssertEqual([partitionTable expirationPeriodForKey:@"AA-key"], self.options.defaultExpirationPeriod);
+}
+
+- (void)testLongestPrefixWins
+{
+    SPTPersistentCachePartition * const images = [[SPTPersistentCachePartition alloc] initWithName:@"images" keyPrefix:@"image:"];
+    SPTPersistentCachePartition * const thumbnails = [[SPTPersistentCachePartition alloc] initWithName:@"thumbnails" keyPrefix:@"image:thumb:"];
+    thumbnails.sizeConstraintBytes = 1024;
+    thumbnails.defaultExpirationPeriod = SPTPersistentCacheDefaultExpirationTimeSec * 2;
+    self.options.partitions = @[images, thumbnails];
+
+    SPTPersistentCachePartitionTable * const partitionTable = [[SPTPersistentCachePartitionTable alloc] initWithOptions:self.options];
+
+    XCTAssertEqual(partitionTable.partitions.count, 3u);
+    XCTAssertTrue(partitionTable.hasSizeConstrainedPartitions);
+    XCTAssertEqualObjects([partitionTable partitionForKey:@"image:thumb:1"].name, @"thumbnails");
+    XCTAssertEqualObjects([partitionTable partitionForKey:@"image:1"].name, @"images");
+    XCTAssertEqualObjects([partitionTable partitionForKey:@"audio:1"].keyPrefix, @"");
+    XCTAssertEqual([partitionTable indexOfPartitionForKey:@"image:thumb:1"], 0u);
+
+    XCTAssertEqual([partitionTable expirationPeriodForKey:@"image:thumb:1"], SPTPersistentCacheDefaultExpirationTimeSec * 2);
+    XCTAssertEqual([partitionTable expirationPeriodForKey:@"image:1"], self.options.defaultExpirationPeriod);
+}
+
+- (void)testPartitionWithEmptyPrefixReplacesDefaultPartition
+{
+    SPTPersistentCachePartition * const rest = [[SPTPersistentCachePartition alloc] initWithName:@"rest" keyPrefix:@""];
+    SPTPersistentCachePartition * const images = [[SPTPersistentCachePartition alloc] initWithName:@"images" keyPrefix:@"image:"];
+    self.options.partitions = @[rest, images];
+
+    SPTPersistentCachePartitionTable * const partitionTable = [[SPTPersistentCachePartitionTable alloc] initWithOptions:self.options];
+
+    XCTAssertEqual(partitionTable.partitions.count, 2u);
+    XCTAssertEqualObjects([partitionTable partitionForKey:@"audio:1"].name, @"rest");
+    XCTAssertEqualObjects([partitionTable partitionForKey:@"image:1"].name, @"images");
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCachePartitionTable * const partitionTable = [[SPTPersistentCachePartitionTable alloc] initWithOptions:self.options];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:partitionTable.description], @"The description string should follow our style.");
+}
+
+@end
@@ -0,0 +1,68 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import <SPTPersistentCache/SPTPersistentCachePartition.h>
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCachePartitionTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCachePartition *partition;
+@end
+
+@implementation SPTPersistentCachePartitionTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.partition = [[SPTPersistentCachePartition alloc] initWithName:@"images" keyPrefix:@"image:"];
+}
+
+- (void)testDefaultValues
+{
+    XCTAssertEqualObjects(self.partition.name, @"images");
+    XCTAssertEqualObjects(self.partition.keyPrefix, @"image:");
+    XCTAssertEqual(self.partition.sizeConstraintBytes, 0u);
+    XCTAssertEqual(self.partition.defaultExpirationPeriod, 0u, @"The expiration period of the cache should be used");
+    XCTAssertEqualWithAccuracy(self.partition.evictionWeight, 1.0, DBL_EPSILON);
+}
+
+- (void)testValuesAreClamped
+{
+    self.partition.defaultExpirationPeriod = 1;
+    XCTAssertEqual(self.partition.defaultExpirationPeriod, SPTPersistentCacheMinimumExpirationLimit);
+
+    self.partition.defaultExpirationPeriod = 0;
+    XCTAssertEqual(self.partition.defaultExpirationPeriod, 0u);
+
+    self.partition.evictionWeight = -1.0;
+    XCTAssertEqualWithAccuracy(self.partition.evictionWeight, 0.0, DBL_EPSILON);
+}
+
+- (void)testCopying
+{
+    self.partition.sizeConstraintBytes = 1024;
+    self.partition.defaultExpirationPeriod = SPTPersistentCacheDefaultExpirationTimeSec * 2;
+    self.partition.evictionWeight = 2.5;
+
+    SPTPersistentCachePartition * const copy = [self.partition copy];
+
+    XCTAssertNotEqual(self.partition, copy, @"The original and copy shouldn’t be the same object");
+    XCTAssertEqualObjects(self.partition.name, copy.name);
+    XCTAssertEqualObjects(self.partition.keyPrefix, copy.keyPrefix);
+    XCTAssertEqual(self.partition.sizeConstraintBytes, copy.sizeConstraintBytes);
+    XCTAssertEqual(self.partition.defaultExpirationPeriod, copy.defaultExpirationPeriod);
+    XCTAssertEqualWithAccuracy(self.partition.evictionWeight, copy.evictionWeight, DBL_EPSILON);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.partition.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.partition.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
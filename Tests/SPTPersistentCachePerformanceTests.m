@@ -3,12 +3,40 @@
 
 #import <XCTest/XCTest.h>
 #import <mach/mach_time.h>
+#include <pthread.h>
 
 #import <SPTPersistentCache/SPTPersistentCache.h>
+#import "SPTPersistentCache+Private.h"
 #import "SPTTestBundle.h"
 double convertMachToMilliSeconds(uint64_t mach_time);
 
 static const int SPTPersistentCachePerformanceIterationCount = 200;
+// Payload buffer, data, record and response, with some room for the system
+static const double SPTPersistentCacheLoadHitAllocationBudget = 8.0;
+
+// The hook of the system allocator that memory analysis tools use, called for every allocation and free while set
+typedef void (SPTPersistentCacheMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip);
+extern SPTPersistentCacheMallocLogger *malloc_logger;
+
+enum {
+    SPTPersistentCacheMallocLogTypeAllocate = 2,
+    SPTPersistentCacheMallocLogTypeDeallocate = 4,
+};
+
+// Only touched by the thread being measured, the hook itself must not allocate
+static pthread_t SPTPersistentCacheMeasuredThread;
+static uint64_t SPTPersistentCacheAllocationCount;
+static uint64_t SPTPersistentCacheAllocatedBytes;
+
+static void SPTPersistentCacheCountAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip)
+{
+    if (!(type & SPTPersistentCacheMallocLogTypeAllocate) || !pthread_equal(pthread_self(), SPTPersistentCacheMeasuredThread)) {
+        return;
+    }
+    SPTPersistentCacheAllocationCount += 1;
+    // A reallocation passes the old pointer before the new size
+    SPTPersistentCacheAllocatedBytes += ((type & SPTPersistentCacheMallocLogTypeDeallocate) ? arg3 : arg2);
+}
 
 @interface SPTPersistentCacheTiming : NSObject
 @property (nonatomic) uint64_t queueTime;
@@ -207,6 +235,45 @@ static const int SPTPersistentCachePerformanceIterationCount = 200;
     }
 }
 
+- (void)testAllocationsPerLoadHit
+{
+    NSData * const data = self.fileContents.firstObject;
+    NSMutableArray<NSString *> * const keys = [NSMutableArray arrayWithCapacity:SPTPersistentCachePerformanceIterationCount];
+    for (NSUInteger i = 0; i < SPTPersistentCachePerformanceIterationCount; i++) {
+        NSString *key = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        [keys addObject:key];
+        __weak XCTestExpectation *expectation = [self expectationWithDescription:[NSString stringWithFormat:@"%@ store", key]];
+        // Records with a TTL are only read, so the write back of access times isn't measured
+        [self.dataCache storeData:data forKey:key ttl:3600 locked:NO withCallback:^(SPTPersistentCacheResponse * _Nonnull response) {
+            [expectation fulfill];
+        } onQueue:dispatch_get_main_queue()];
+    }
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    // Lazily created state of the cache and the system isn't part of a hit
+    XCTAssertEqual([self.dataCache loadResponseForKeySync:keys.firstObject allowStale:NO].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    NSUInteger hits = 0;
+    SPTPersistentCacheMeasuredThread = pthread_self();
+    SPTPersistentCacheAllocationCount = 0;
+    SPTPersistentCacheAllocatedBytes = 0;
+    malloc_logger = SPTPersistentCacheCountAllocation;
+    for (NSString *key in keys) {
+        @autoreleasepool {
+            SPTPersistentCacheResponse *response = [self.dataCache loadResponseForKeySync:key allowStale:NO];
+            hits += (response.result == SPTPersistentCacheResponseCodeOperationSucceeded ? 1 : 0);
+        }
+    }
+    malloc_logger = NULL;
+
+    const double allocationsPerHit = (double)SPTPersistentCacheAllocationCount / keys.count;
+    const double overheadBytesPerHit = (double)SPTPersistentCacheAllocatedBytes / keys.count - data.length;
+    NSLog(@"****Load hit allocations per operation: %f, bytes per operation besides the payload: %f", allocationsPerHit, overheadBytesPerHit);
+
+    XCTAssertEqual(hits, keys.count);
+    XCTAssertLessThanOrEqual(allocationsPerHit, SPTPersistentCacheLoadHitAllocationBudget);
+}
+
 double convertMachToMilliSeconds(uint64_t mach_time)
 {
     mach_timebase_info_data_t info;
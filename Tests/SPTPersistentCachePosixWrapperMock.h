@@ -18,7 +18,8 @@
  */
 @property (nonatomic, assign, readwrite) ssize_t readValue;
 /**
- When this is set to YES the "read:" method will return the readValue above.
+ When this is set to YES the "read:" method will return the readValue above, and so will every read of the
+ "readBatch:" method.
  */
 @property (nonatomic, assign, readwrite, getter = isReadOverridden) BOOL readOverridden;
 /**
@@ -37,5 +38,9 @@
  The value to return when executing the "stat:" method.
  */
 @property (nonatomic, assign, readwrite) int statValue;
+/**
+ The number of times the "readBatch:" method was executed.
+ */
+@property (nonatomic, assign, readonly) NSUInteger readBatchCount;
 
 @end
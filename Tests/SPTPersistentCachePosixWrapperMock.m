@@ -18,6 +18,19 @@
     return [super read:descriptor buffer:buffer bufferSize:bufferSize];
 }
 
+- (void)readBatch:(SPTPersistentCachePosixReadRequest *)requests count:(size_t)count
+{
+    _readBatchCount += 1;
+    if (!self.readOverridden) {
+        [super readBatch:requests count:count];
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        requests[i].result = self.readValue;
+        requests[i].error = (self.readValue == -1 ? EIO : 0);
+    }
+}
+
 - (off_t)lseek:(int)descriptor seekType:(off_t)seekType seekAmount:(int)seekAmount
 {
     return self.lseekValue;
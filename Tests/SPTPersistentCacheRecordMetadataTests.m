@@ -0,0 +1,66 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheRecordMetadata+Private.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheRecordMetadataTests : XCTestCase
+@end
+
+@implementation SPTPersistentCacheRecordMetadataTests
+
+- (void)testMetadataFromHeader
+{
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(60, 128, 1000, YES);
+    SPTPersistentCacheRecordMetadata * const metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:@"AA-key"
+                                                                                                       header:&header
+                                                                                      defaultExpirationPeriod:600];
+
+    XCTAssertEqualObjects(metadata.key, @"AA-key");
+    XCTAssertEqual(metadata.refCount, 1u);
+    XCTAssertEqual(metadata.ttl, 60u);
+    XCTAssertEqual(metadata.payloadSize, 128u);
+    XCTAssertEqualWithAccuracy(metadata.updateTime, 1000.0, DBL_EPSILON);
+    XCTAssertEqualWithAccuracy(metadata.expirationTime, 1060.0, DBL_EPSILON);
+}
+
+- (void)testRecordWithoutTTLExpiresAfterDefaultPeriod
+{
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 128, 1000, NO);
+    SPTPersistentCacheRecordMetadata * const metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:@"AA-key"
+                                                                                                       header:&header
+                                                                                      defaultExpirationPeriod:600];
+
+    XCTAssertEqualWithAccuracy(metadata.expirationTime, 1600.0, DBL_EPSILON);
+}
+
+- (void)testMetadataWithRefCount
+{
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 128, 1000, NO);
+    SPTPersistentCacheRecordMetadata * const metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:@"AA-key"
+                                                                                                       header:&header
+                                                                                      defaultExpirationPeriod:600];
+
+    XCTAssertEqual([metadata metadataWithRefCount:0], metadata);
+
+    SPTPersistentCacheRecordMetadata * const lockedMetadata = [metadata metadataWithRefCount:2];
+    XCTAssertEqual(lockedMetadata.refCount, 2u);
+    XCTAssertEqualObjects(lockedMetadata.key, metadata.key);
+    XCTAssertEqualWithAccuracy(lockedMetadata.expirationTime, metadata.expirationTime, DBL_EPSILON);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    const SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 128, 1000, NO);
+    SPTPersistentCacheRecordMetadata * const metadata = [[SPTPersistentCacheRecordMetadata alloc] initWithKey:@"AA-key"
+                                                                                                       header:&header
+                                                                                      defaultExpirationPeriod:600];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:metadata.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:metadata.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
@@ -39,6 +39,16 @@ static const SPTPersistentCacheResponseCode SPTPersistentCacheResponseTestsTestC
     XCTAssertEqual(self.persistentCacheResponse.result, SPTPersistentCacheResponseTestsTestCode);
     XCTAssertEqualObjects(self.persistentCacheResponse.error, self.testError);
     XCTAssertEqualObjects(self.persistentCacheResponse.record, self.testCacheRecord);
+    XCTAssertFalse(self.persistentCacheResponse.isStale);
+}
+
+- (void)testStaleInitializer
+{
+    SPTPersistentCacheResponse * const response = [[SPTPersistentCacheResponse alloc] initWithResult:SPTPersistentCacheResponseCodeOperationSucceeded
+                                                                                               error:nil
+                                                                                              record:self.testCacheRecord
+                                                                                               stale:YES];
+    XCTAssertTrue(response.isStale);
 }
 
 #pragma mark Test describing objects
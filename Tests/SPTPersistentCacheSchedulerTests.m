@@ -0,0 +1,199 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheOptions.h>
+#import "SPTPersistentCacheScheduler.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheSchedulerTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCacheOptions *options;
+@end
+
+@implementation SPTPersistentCacheSchedulerTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.options = [SPTPersistentCacheOptions new];
+    self.options.maxConcurrentOperations = 8;
+}
+
+- (void)testLaneWidthsSplitMaxConcurrentOperations
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    XCTAssertEqual(scheduler.readQueue.maxConcurrentOperationCount, 3);
+    XCTAssertEqual(scheduler.writeQueue.maxConcurrentOperationCount, 3);
+    XCTAssertEqual(scheduler.maintenanceQueue.maxConcurrentOperationCount, 2);
+}
+
+- (void)testLaneWidthsFromOptions
+{
+    self.options.maxConcurrentReadOperations = 3;
+    self.options.maxConcurrentWriteOperations = 1;
+    self.options.maintenanceConcurrencyShare = 0.5;
+
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    XCTAssertEqual(scheduler.readQueue.maxConcurrentOperationCount, 3);
+    XCTAssertEqual(scheduler.writeQueue.maxConcurrentOperationCount, 1);
+    XCTAssertEqual(scheduler.maintenanceQueue.maxConcurrentOperationCount, 4);
+}
+
+- (void)testLaneWidthsAreNarrowedToTheBudget
+{
+    self.options.maxConcurrentReadOperations = 6;
+    self.options.maxConcurrentWriteOperations = 3;
+    self.options.maintenanceConcurrencyShare = 0.5;
+
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    // The 4 operations left after maintenance are split 2:1
+    XCTAssertEqual(scheduler.readQueue.maxConcurrentOperationCount, 3);
+    XCTAssertEqual(scheduler.writeQueue.maxConcurrentOperationCount, 1);
+    XCTAssertEqual(scheduler.maintenanceQueue.maxConcurrentOperationCount, 4);
+}
+
+- (void)testMaintenanceGetsAtLeastOneOperation
+{
+    self.options.maintenanceConcurrencyShare = 0.0;
+
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    XCTAssertEqual(scheduler.maintenanceQueue.maxConcurrentOperationCount, 1);
+}
+
+- (void)testAdaptiveConcurrencyStartsHalfwayBetweenBounds
+{
+    self.options.useAdaptiveConcurrency = YES;
+    self.options.minConcurrentOperations = 2;
+    self.options.maxConcurrentWriteOperations = 4;
+
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    // The bounds are the split of the 6 operations left after maintenance, 4 for reads and 2 for writes
+    XCTAssertEqual(scheduler.readQueue.maxConcurrentOperationCount, 3);
+    XCTAssertEqual(scheduler.writeQueue.maxConcurrentOperationCount, 2);
+    XCTAssertEqual(scheduler.maintenanceQueue.maxConcurrentOperationCount, 2);
+}
+
+- (void)testOnlyForegroundLatencyIsMeasuredWithAdaptiveConcurrency
+{
+    dispatch_block_t const block = ^{};
+
+    SPTPersistentCacheScheduler *scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+    XCTAssertEqual([scheduler blockMeasuringLatencyOfBlock:block lane:SPTPersistentCacheSchedulerLaneRead], block);
+
+    self.options.useAdaptiveConcurrency = YES;
+    scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+    XCTAssertNotEqual([scheduler blockMeasuringLatencyOfBlock:block lane:SPTPersistentCacheSchedulerLaneRead], block);
+    XCTAssertEqual([scheduler blockMeasuringLatencyOfBlock:block lane:SPTPersistentCacheSchedulerLaneMaintenance], block);
+}
+
+- (void)testOperationsRunOnTheirLane
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    __weak XCTestExpectation * const readExpectation = [self expectationWithDescription:@"read"];
+    [scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{
+        XCTAssertEqual([NSOperationQueue currentQueue], scheduler.readQueue);
+        [readExpectation fulfill];
+    }] lane:SPTPersistentCacheSchedulerLaneRead];
+
+    __weak XCTestExpectation * const maintenanceExpectation = [self expectationWithDescription:@"maintenance"];
+    [scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{
+        XCTAssertEqual([NSOperationQueue currentQueue], scheduler.maintenanceQueue);
+        [maintenanceExpectation fulfill];
+    }] lane:SPTPersistentCacheSchedulerLaneMaintenance];
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testQueuedOperationIsAged
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+    scheduler.suspended = YES;
+
+    NSOperation * const operation = [NSBlockOperation blockOperationWithBlock:^{}];
+    operation.queuePriority = NSOperationQueuePriorityVeryLow;
+    [scheduler addOperation:operation lane:SPTPersistentCacheSchedulerLaneWrite];
+
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:SPTPersistentCacheSchedulerAgingInterval * 2.5]];
+
+    XCTAssertGreaterThan(operation.queuePriority, NSOperationQueuePriorityVeryLow);
+
+    scheduler.suspended = NO;
+    [scheduler waitUntilAllOperationsAreFinished];
+}
+
+- (void)testYieldReturnsImmediatelyWithoutForegroundWork
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    NSDate * const start = [NSDate date];
+    [scheduler yieldToForegroundWork];
+
+    XCTAssertLessThan(-start.timeIntervalSinceNow, SPTPersistentCacheSchedulerMaintenanceMaxYield);
+}
+
+- (void)testYieldWaitsForForegroundWork
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    __block BOOL didFinishRead = NO;
+    [scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{
+        [NSThread sleepForTimeInterval:0.1];
+        didFinishRead = YES;
+    }] lane:SPTPersistentCacheSchedulerLaneRead];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"maintenance"];
+    [scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{
+        [scheduler yieldToForegroundWork];
+        XCTAssertTrue(didFinishRead);
+        [expectation fulfill];
+    }] lane:SPTPersistentCacheSchedulerLaneMaintenance];
+
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testForegroundWorkIsReported
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+    XCTAssertFalse(scheduler.hasForegroundWork);
+
+    scheduler.suspended = YES;
+    [scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{}] lane:SPTPersistentCacheSchedulerLaneMaintenance];
+    XCTAssertFalse(scheduler.hasForegroundWork);
+    [scheduler addOperation:[NSBlockOperation blockOperationWithBlock:^{}] lane:SPTPersistentCacheSchedulerLaneRead];
+    XCTAssertTrue(scheduler.hasForegroundWork);
+
+    scheduler.suspended = NO;
+    [scheduler waitUntilAllOperationsAreFinished];
+}
+
+- (void)testForegroundBlockRunsInlineAsForegroundWork
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+
+    __block BOOL ran = NO;
+    [scheduler performForegroundBlock:^{
+        XCTAssertTrue(scheduler.hasForegroundWork);
+        ran = YES;
+    } lane:SPTPersistentCacheSchedulerLaneWrite];
+
+    XCTAssertTrue(ran);
+    XCTAssertFalse(scheduler.hasForegroundWork);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheScheduler * const scheduler = [[SPTPersistentCacheScheduler alloc] initWithOptions:self.options];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:scheduler.description], @"The description string should follow our style.");
+}
+
+@end
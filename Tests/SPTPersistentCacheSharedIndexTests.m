@@ -0,0 +1,152 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheSharedIndex.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheSharedIndexTests : XCTestCase
+@property (nonatomic, copy) NSString *indexPath;
+@end
+
+@implementation SPTPersistentCacheSharedIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.indexPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.indexPath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[self.indexPath stringByAppendingString:@"-members"] error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCacheSharedIndex *)openIndexWithCapacity:(NSUInteger)capacity
+{
+    return [[SPTPersistentCacheSharedIndex alloc] initWithPath:self.indexPath capacity:capacity debugOutput:nil];
+}
+
+- (SPTPersistentCacheSharedIndex *)openPopulatedIndex
+{
+    SPTPersistentCacheSharedIndex * const index = [self openIndexWithCapacity:100];
+    XCTAssertTrue([index beginPopulating]);
+    [index finishPopulating];
+    return index;
+}
+
+- (void)testUnpopulatedIndexAnswersUnknown
+{
+    SPTPersistentCacheSharedIndex * const index = [self openIndexWithCapacity:100];
+
+    XCTAssertNotNil(index);
+    XCTAssertFalse(index.isReady);
+    XCTAssertEqual([index lookupKey:@"AA-key" header:NULL], SPTPersistentCacheSharedIndexLookupResultUnknown);
+}
+
+- (void)testCapacityIsRoundedUpToLoadFactor
+{
+    XCTAssertEqual([self openIndexWithCapacity:100].capacity, 256u);
+}
+
+- (void)testHeadersAreStoredAndRemoved
+{
+    SPTPersistentCacheSharedIndex * const index = [self openPopulatedIndex];
+    SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(60, 128, 1488, YES);
+
+    [index setHeader:&header forKey:@"AA-key"];
+
+    SPTPersistentCacheRecordHeader found;
+    XCTAssertEqual([index lookupKey:@"AA-key" header:&found], SPTPersistentCacheSharedIndexLookupResultPresent);
+    XCTAssertEqual(found.ttl, 60u);
+    XCTAssertEqual(found.payloadSizeBytes, 128u);
+    XCTAssertEqual(found.updateTimeSec, 1488u);
+    XCTAssertEqual(found.refCount, 1u);
+    XCTAssertEqual([index lookupKey:@"BB-key" header:NULL], SPTPersistentCacheSharedIndexLookupResultAbsent);
+
+    [index removeKey:@"AA-key"];
+
+    XCTAssertEqual([index lookupKey:@"AA-key" header:NULL], SPTPersistentCacheSharedIndexLookupResultAbsent);
+}
+
+- (void)testIndexIsSharedBetweenInstances
+{
+    // Advisory locks are held per open file, so a second instance behaves like another process
+    SPTPersistentCacheSharedIndex * const index = [self openPopulatedIndex];
+    SPTPersistentCacheSharedIndex * const otherIndex = [self openIndexWithCapacity:100];
+    XCTAssertTrue(otherIndex.isReady);
+    XCTAssertFalse([otherIndex beginPopulating]);
+
+    SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 4, 1488, NO);
+    [otherIndex setHeader:&header forKey:@"AA-key"];
+
+    XCTAssertEqual([index lookupKey:@"AA-key" header:NULL], SPTPersistentCacheSharedIndexLookupResultPresent);
+}
+
+- (void)testPopulatingKeepsHeadersSetMeanwhile
+{
+    SPTPersistentCacheSharedIndex * const index = [self openIndexWithCapacity:100];
+    XCTAssertTrue([index beginPopulating]);
+    XCTAssertFalse([index beginPopulating]);
+
+    SPTPersistentCacheRecordHeader newHeader = SPTPersistentCacheRecordHeaderMake(0, 8, 1500, NO);
+    [index setHeader:&newHeader forKey:@"AA-key"];
+    SPTPersistentCacheRecordHeader diskHeader = SPTPersistentCacheRecordHeaderMake(0, 4, 1488, NO);
+    [index addPopulatedHeader:&diskHeader forKey:@"AA-key"];
+    [index finishPopulating];
+
+    SPTPersistentCacheRecordHeader found;
+    XCTAssertTrue(index.isReady);
+    XCTAssertEqual([index lookupKey:@"AA-key" header:&found], SPTPersistentCacheSharedIndexLookupResultPresent);
+    XCTAssertEqual(found.payloadSizeBytes, 8u);
+}
+
+- (void)testFirstInstanceToOpenIndexRequiresPopulating
+{
+    SPTPersistentCacheSharedIndex *index = [self openPopulatedIndex];
+    index = nil;
+
+    // Records may have changed while nobody had the index open
+    index = [self openIndexWithCapacity:100];
+
+    XCTAssertFalse(index.isReady);
+    XCTAssertTrue(index.needsPopulating);
+    XCTAssertTrue([index beginPopulating]);
+    XCTAssertFalse(index.needsPopulating);
+}
+
+- (void)testFullIndexStopsAnswering
+{
+    SPTPersistentCacheSharedIndex * const index = [self openPopulatedIndex];
+    SPTPersistentCacheRecordHeader header = SPTPersistentCacheRecordHeaderMake(0, 4, 1488, NO);
+
+    for (NSUInteger i = 0; i < index.capacity; ++i) {
+        [index setHeader:&header forKey:[NSString stringWithFormat:@"AA-key-%@", @(i)]];
+    }
+
+    XCTAssertFalse(index.isReady);
+    XCTAssertEqual([index lookupKey:@"AA-key-0" header:NULL], SPTPersistentCacheSharedIndexLookupResultUnknown);
+}
+
+- (void)testUnopenableIndexFails
+{
+    NSString * const path = [self.indexPath stringByAppendingPathComponent:@"missing-dir/.shared-index"];
+
+    XCTAssertNil([[SPTPersistentCacheSharedIndex alloc] initWithPath:path capacity:100 debugOutput:nil]);
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheSharedIndex * const index = [self openIndexWithCapacity:100];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:index.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:index.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
@@ -0,0 +1,61 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCacheCancellationToken.h>
+#import <SPTPersistentCache/SPTPersistentCacheStoreOptions.h>
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheStoreOptionsTests : XCTestCase
+@property (nonatomic, strong) SPTPersistentCacheStoreOptions *options;
+@end
+
+@implementation SPTPersistentCacheStoreOptionsTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.options = [SPTPersistentCacheStoreOptions new];
+}
+
+- (void)testDefaultValues
+{
+    XCTAssertEqual(self.options.ttl, 0u);
+    XCTAssertFalse(self.options.isLocked);
+    XCTAssertNil(self.options.tags);
+    XCTAssertEqual(self.options.priority, SPTPersistentCacheRecordPriorityNormal);
+    XCTAssertEqual(self.options.refetchCost, 0u);
+    XCTAssertNil(self.options.cancellationToken);
+}
+
+- (void)testCopying
+{
+    self.options.ttl = 60;
+    self.options.locked = YES;
+    self.options.tags = [NSSet setWithObject:@"album-1"];
+    self.options.priority = SPTPersistentCacheRecordPriorityHigh;
+    self.options.refetchCost = 12345;
+    self.options.cancellationToken = [SPTPersistentCacheCancellationToken new];
+
+    SPTPersistentCacheStoreOptions * const copy = [self.options copy];
+
+    XCTAssertNotEqual(self.options, copy, @"The original and copy shouldn’t be the same object");
+    XCTAssertEqual(self.options.ttl, copy.ttl);
+    XCTAssertEqual(self.options.isLocked, copy.isLocked);
+    XCTAssertEqualObjects(self.options.tags, copy.tags);
+    XCTAssertEqual(self.options.priority, copy.priority);
+    XCTAssertEqual(self.options.refetchCost, copy.refetchCost);
+    XCTAssertEqual(self.options.cancellationToken, copy.cancellationToken, @"The copy should be cancelled with the original");
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.options.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:self.options.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
@@ -0,0 +1,118 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheTagIndex.h"
+#import "SPTPersistentCacheObjectDescriptionStyleValidator.h"
+
+@interface SPTPersistentCacheTagIndexTests : XCTestCase
+@property (nonatomic, copy) NSString *indexPath;
+@end
+
+@implementation SPTPersistentCacheTagIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.indexPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.indexPath error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCacheTagIndex *)openIndex
+{
+    return [[SPTPersistentCacheTagIndex alloc] initWithPath:self.indexPath debugOutput:nil];
+}
+
+- (unsigned long long)indexFileSize
+{
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath:self.indexPath error:nil] fileSize];
+}
+
+- (void)testTagsResolveToKeys
+{
+    SPTPersistentCacheTagIndex * const index = [self openIndex];
+
+    XCTAssertTrue([index setTags:[NSSet setWithObjects:@"album-1", @"artwork", nil] forKey:@"BB-key"]);
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"AA-key"]);
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-2"] forKey:@"CC-key"]);
+
+    XCTAssertEqualObjects([index keysForTag:@"album-1"], (@[@"AA-key", @"BB-key"]));
+    XCTAssertEqualObjects([index keysForTag:@"artwork"], (@[@"BB-key"]));
+    XCTAssertEqualObjects([index keysForTag:@"album-3"], (@[]));
+    XCTAssertEqual(index.keyCount, 3u);
+}
+
+- (void)testReplacedAndRemovedKeysLeaveTheirTags
+{
+    SPTPersistentCacheTagIndex * const index = [self openIndex];
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"AA-key"]);
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"BB-key"]);
+
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-2"] forKey:@"AA-key"]);
+    XCTAssertTrue([index removeKeys:@[@"BB-key", @"ZZ-missing-key"]]);
+
+    XCTAssertEqualObjects([index keysForTag:@"album-1"], (@[]));
+    XCTAssertEqualObjects([index keysForTag:@"album-2"], (@[@"AA-key"]));
+    XCTAssertEqualObjects([index tagsForKey:@"BB-key"], [NSSet set]);
+    XCTAssertEqual(index.keyCount, 1u);
+}
+
+- (void)testTagsAreReplayedWhenOpenedAgain
+{
+    SPTPersistentCacheTagIndex *index = [self openIndex];
+    XCTAssertTrue([index setTags:[NSSet setWithObjects:@"album-1", @"artwork", nil] forKey:@"AA-key"]);
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"BB-key"]);
+    XCTAssertTrue([index setTags:[NSSet set] forKey:@"BB-key"]);
+    index = nil;
+
+    index = [self openIndex];
+
+    XCTAssertEqualObjects([index tagsForKey:@"AA-key"], ([NSSet setWithObjects:@"album-1", @"artwork", nil]));
+    XCTAssertEqualObjects([index keysForTag:@"album-1"], (@[@"AA-key"]));
+    XCTAssertEqual(index.keyCount, 1u);
+}
+
+- (void)testUnchangedTagsAreNotWritten
+{
+    SPTPersistentCacheTagIndex * const index = [self openIndex];
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"AA-key"]);
+    const unsigned long long size = [self indexFileSize];
+
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"AA-key"]);
+    XCTAssertTrue([index setTags:[NSSet set] forKey:@"BB-key"]);
+    XCTAssertTrue([index removeKeys:@[@"CC-key"]]);
+
+    XCTAssertEqual([self indexFileSize], size);
+}
+
+- (void)testRemoveAllKeysExceptKeys
+{
+    SPTPersistentCacheTagIndex *index = [self openIndex];
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"AA-key"]);
+    XCTAssertTrue([index setTags:[NSSet setWithObject:@"album-1"] forKey:@"BB-key"]);
+
+    XCTAssertTrue([index removeAllKeysExceptKeys:[NSSet setWithObject:@"BB-key"]]);
+    index = nil;
+    index = [self openIndex];
+
+    XCTAssertEqualObjects([index keysForTag:@"album-1"], (@[@"BB-key"]));
+}
+
+- (void)testDescriptionAdheresToStyle
+{
+    SPTPersistentCacheTagIndex * const index = [self openIndex];
+    SPTPersistentCacheObjectDescriptionStyleValidator *styleValidator = [SPTPersistentCacheObjectDescriptionStyleValidator new];
+
+    XCTAssertTrue([styleValidator isValidStyleDescription:index.description], @"The description string should follow our style.");
+    XCTAssertTrue([styleValidator isValidStyleDescription:index.debugDescription], @"The debugDescription string should follow our style.");
+}
+
+@end
@@ -19,10 +19,19 @@
 #import "SPTPersistentCacheGarbageCollector.h"
 #import "SPTPersistentCache+Private.h"
 #import "SPTPersistentCacheFileManager.h"
+#import "SPTPersistentCacheKeyIndex.h"
+#import "SPTPersistentCacheJournal.h"
+#import "SPTPersistentCacheLockJournal.h"
+#import "SPTPersistentCacheSharedIndex.h"
+#import "SPTPersistentCacheAccessHistory.h"
+#import "SPTPersistentCacheTagIndex.h"
+#import "SPTPersistentCacheBlobStore.h"
+#import "SPTPersistentCacheUpdateJournal.h"
 #import "NSFileManagerMock.h"
 #import "SPTPersistentCachePosixWrapperMock.h"
 #import "SPTTestBundle.h"
 
+#include <sys/file.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -65,6 +74,7 @@ static const NSUInteger kTTL4 = 86400;
 static const NSUInteger kCorruptedFileSize = 15;
 static const NSUInteger kTestEpochTime = 1488;
 static const NSTimeInterval kDefaultWaitTime = 6.0; //sec
+static const NSUInteger kPartitionTestPayloadSize = 1000;
 
 static const StoreParamsType kParams[] = {
     {0,     YES, NO, -1},
@@ -99,7 +109,6 @@ typedef NSTimeInterval (^SPTPersistentCacheCurrentTimeSecCallback)(void);
 @interface SPTPersistentCacheForUnitTests : SPTPersistentCache
 @property (nonatomic, copy) SPTPersistentCacheCurrentTimeSecCallback timeIntervalCallback;
 
-@property (nonatomic, strong, readwrite) NSOperationQueue *test_workQueue;
 @property (nonatomic, strong, readwrite) NSFileManager *test_fileManager;
 @property (nonatomic, strong, readwrite) SPTPersistentCachePosixWrapper *test_posixWrapper;
 @property (nonatomic, copy, readwrite) SPTPersistentCacheDebugCallback test_debugOutput;
@@ -109,11 +118,6 @@ typedef NSTimeInterval (^SPTPersistentCacheCurrentTimeSecCallback)(void);
 
 @implementation SPTPersistentCacheForUnitTests
 
-- (NSOperationQueue *)workQueue
-{
-    return self.test_workQueue ?: super.workQueue;
-}
-
 - (NSFileManager *)fileManager
 {
     return self.test_fileManager ?: super.fileManager;
@@ -138,14 +142,56 @@ typedef NSTimeInterval (^SPTPersistentCacheCurrentTimeSecCallback)(void);
     }
 }
 
-- (void)doWork:(void (^)(void))block priority:(NSOperationQueuePriority)priority qos:(NSQualityOfService)qos
+- (void)doWork:(void (^)(void))block
+          lane:(SPTPersistentCacheSchedulerLane)lane
+      priority:(NSOperationQueuePriority)priority
+           qos:(NSQualityOfService)qos
+cancellationToken:(SPTPersistentCacheCancellationToken *)cancellationToken
 {
-    [super doWork:block priority:priority qos:qos];
+    [super doWork:block lane:lane priority:priority qos:qos cancellationToken:cancellationToken];
     self.test_didWork = YES;
 }
 
 @end
 
+/// Fails every fsync after the first few, with everything else going to the system
+@interface SPTPersistentCacheFailingFsyncPosixWrapper : SPTPersistentCachePosixWrapper
+@property (nonatomic, assign) NSUInteger succeedingFsyncCount;
+@end
+
+@implementation SPTPersistentCacheFailingFsyncPosixWrapper
+
+- (int)fsync:(int)descriptor
+{
+    if (self.succeedingFsyncCount == 0) {
+        errno = EIO;
+        return -1;
+    }
+    self.succeedingFsyncCount -= 1;
+    return [super fsync:descriptor];
+}
+
+@end
+
+/// Runs a block before the first exclusive lock is taken, with everything going to the system
+@interface SPTPersistentCacheExclusiveLockPosixWrapper : SPTPersistentCachePosixWrapper
+@property (nonatomic, copy, nullable) dispatch_block_t beforeExclusiveLock;
+@end
+
+@implementation SPTPersistentCacheExclusiveLockPosixWrapper
+
+- (int)flock:(int)descriptor operation:(int)operation
+{
+    if (operation == LOCK_EX && self.beforeExclusiveLock != nil) {
+        dispatch_block_t block = self.beforeExclusiveLock;
+        self.beforeExclusiveLock = nil;
+        block();
+    }
+    return [super flock:descriptor operation:operation];
+}
+
+@end
+
 
 @interface SPTPersistentCacheTests : XCTestCase
 @property (nonatomic, strong) SPTPersistentCacheForUnitTests *cache;
@@ -1805,156 +1851,2124 @@ typedef NSTimeInterval (^SPTPersistentCacheCurrentTimeSecCallback)(void);
     [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
 }
 
-#pragma mark - Internal methods
+#pragma mark Test Cancellation
 
-- (void)putFile:(NSString *)file
-        inCache:(SPTPersistentCache *)cache
-        withKey:(NSString *)key
-            ttl:(NSUInteger)ttl
-         locked:(BOOL)locked
-    expectation:(__weak XCTestExpectation *)expectation
+- (void)testCancelledLoadDoesNotCallBack
 {
-    NSData *data = [NSData dataWithContentsOfFile:file];
-    XCTAssertNotNil(data, @"Unable to get data from file:%@", file);
-    XCTAssertNotNil(key, @"Key must be specified");
-    SPTPersistentCacheResponseCallback callback = ^(SPTPersistentCacheResponse *response) {
-        if (response.result == SPTPersistentCacheResponseCodeOperationSucceeded) {
-            XCTAssertNil(response.record, @"record expected to be nil");
-            XCTAssertNil(response.error, @"error xpected to be nil");
-        } else if (response.result == SPTPersistentCacheResponseCodeOperationError) {
-            XCTAssertNil(response.record, @"record expected to be nil");
-            XCTAssertNotNil(response.error, @"error must exist for when STORE failed");
-        } else {
-            XCTAssert(NO, @"This is not expected result code for STORE operation");
-        }
+    self.cache.scheduler.suspended = YES;
+
+    SPTPersistentCacheCancellationToken * const token = [SPTPersistentCacheCancellationToken new];
+    BOOL result = [self.cache loadDataForKey:self.imageNames[0]
+                           cancellationToken:token
+                                withCallback:^(SPTPersistentCacheResponse *response) {
+                                    XCTFail(@"The callback of a cancelled load mustn’t be called");
+                                } onQueue:dispatch_get_main_queue()];
+    XCTAssertTrue(result);
+
+    [token cancel];
+    XCTAssertTrue(token.isCancelled);
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"following load"];
+    [self.cache loadDataForKey:self.imageNames[0] withCallback:^(SPTPersistentCacheResponse *response) {
         [expectation fulfill];
-    };
+    } onQueue:dispatch_get_main_queue()];
 
-    if (ttl == 0) {
-        [cache storeData:data forKey:key locked:locked withCallback:callback onQueue:dispatch_get_main_queue()];
-    } else {
-        [cache storeData:data forKey:key ttl:ttl locked:locked withCallback:callback onQueue:dispatch_get_main_queue()];
-    }
+    self.cache.scheduler.suspended = NO;
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
 }
 
-/*
-SPTPersistentCacheLoadingErrorMagicMismatch,
-SPTPersistentCacheLoadingErrorWrongHeaderSize,
-SPTPersistentCacheLoadingErrorWrongPayloadSize,
-SPTPersistentCacheLoadingErrorInvalidHeaderCRC,
-SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader,
-*/
+- (void)testCancelledStoreIsNotWritten
+{
+    self.cache.scheduler.suspended = YES;
 
-- (void)corruptFile:(NSString *)filePath
-           pdcError:(int)pdcError
+    SPTPersistentCacheCancellationToken * const token = [SPTPersistentCacheCancellationToken new];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.cancellationToken = token;
+    NSData * const data = [@"TEST" dataUsingEncoding:NSUTF8StringEncoding];
+    [self.cache storeData:data
+                   forKey:@"cancelled-key"
+                  options:options
+             withCallback:^(SPTPersistentCacheResponse *response) {
+                 XCTFail(@"The callback of a cancelled store mustn’t be called");
+             } onQueue:dispatch_get_main_queue()];
+    [token cancel];
+
+    self.cache.scheduler.suspended = NO;
+    [self.cache.scheduler waitUntilAllOperationsAreFinished];
+
+    SPTPersistentCacheFileManager * const fileManager = [[SPTPersistentCacheFileManager alloc] initWithOptions:self.cache.options];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[fileManager pathForKey:@"cancelled-key"]]);
+}
+
+- (void)testCancelledFileStoreIsNotWritten
 {
-    int flags = O_RDWR;
-    if (pdcError == SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader) {
-        flags |= O_TRUNC;
-    }
+    NSString * const sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    XCTAssertTrue([[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:sourcePath atomically:YES]);
+    self.cache.scheduler.suspended = YES;
 
-    int fd = open([filePath UTF8String], flags);
-    if (fd == -1) {
-        XCTAssert(fd != -1, @"Could not open file while trying to simulate corruption");
-        return;
-    }
+    SPTPersistentCacheCancellationToken * const token = [SPTPersistentCacheCancellationToken new];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.cancellationToken = token;
+    [self.cache storeFileAtPath:sourcePath
+                         forKey:@"cancelled-key"
+                        options:options
+                   withCallback:^(SPTPersistentCacheResponse *response) {
+                       XCTFail(@"The callback of a cancelled store mustn’t be called");
+                   } onQueue:dispatch_get_main_queue()];
+    [token cancel];
 
-    SPTPersistentCacheRecordHeader header;
-    memset(&header, 0, (size_t)SPTPersistentCacheRecordHeaderSize);
+    self.cache.scheduler.suspended = NO;
+    [self.cache.scheduler waitUntilAllOperationsAreFinished];
 
-    if (pdcError != SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader) {
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self.cache.dataCacheFileManager pathForKey:@"cancelled-key"]]);
+    [[NSFileManager defaultManager] removeItemAtPath:sourcePath error:nil];
+}
 
-        ssize_t readSize = read(fd, &header, (size_t)SPTPersistentCacheRecordHeaderSize);
-        if (readSize != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
-            XCTAssert(readSize == (ssize_t)SPTPersistentCacheRecordHeaderSize, @"Header not read");
-            close(fd);
-            return;
-        }
-    }
+- (void)testOperationWithCancelledTokenIsCancelledImmediately
+{
+    SPTPersistentCacheCancellationToken * const token = [SPTPersistentCacheCancellationToken new];
+    [token cancel];
 
-    NSUInteger headerSize = (NSUInteger)SPTPersistentCacheRecordHeaderSize;
+    __block BOOL didCallBack = NO;
+    [self.cache loadDataForKey:self.imageNames[0]
+             cancellationToken:token
+                  withCallback:^(SPTPersistentCacheResponse *response) {
+                      didCallBack = YES;
+                  } onQueue:dispatch_get_main_queue()];
 
-    switch (pdcError) {
-        case SPTPersistentCacheLoadingErrorMagicMismatch: {
-            header.magic = 0xFFFF5454;
-            break;
-        }
-        case SPTPersistentCacheLoadingErrorWrongHeaderSize: {
-            header.headerSize = (uint32_t)SPTPersistentCacheRecordHeaderSize + 1u + arc4random_uniform(106);
-            header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
-            break;
-        }
-        case SPTPersistentCacheLoadingErrorWrongPayloadSize: {
-            header.payloadSizeBytes += (1 + (arc4random_uniform((uint32_t)header.payloadSizeBytes) - (header.payloadSizeBytes-1)/2));
-            header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
-            break;
-        }
-        case SPTPersistentCacheLoadingErrorInvalidHeaderCRC: {
-            header.crc = header.crc + 5;
-            break;
-        }
-        case SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader: {
-            headerSize = kCorruptedFileSize;
-            break;
-        }
-        default:
-            NSAssert(NO, @"Gotcha!");
-            break;
-    }
+    [self.cache.scheduler waitUntilAllOperationsAreFinished];
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertFalse(didCallBack);
+}
 
-    off_t ret = lseek(fd, SEEK_SET, 0);
-    XCTAssert(ret != -1);
+#pragma mark Test Key Filter
 
-    ssize_t written = write(fd, &header, headerSize);
-    XCTAssert(written == (ssize_t)headerSize, @"header was not written");
-    fsync(fd);
-    close(fd);
+- (void)testKeyFilterAnswersMissWithoutQueueingWork
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.keyFilterCapacity = 1000;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertTrue(cache.keyFilter.isReady);
+    cache.test_didWork = NO;
+
+    __weak XCTestExpectation * const missExpectation = [self expectationWithDescription:@"miss"];
+    [cache loadDataForKey:@"ZZ-missing-key" withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        [missExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertFalse(cache.test_didWork);
+
+    // Records stored before the cache was created are found through the filter
+    __weak XCTestExpectation * const hitExpectation = [self expectationWithDescription:@"hit"];
+    [cache loadDataForKey:self.imageNames[0] withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertNotEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        [hitExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
 }
 
-- (void)alterUpdateTime:(uint64_t)updateTime forFileAtPath:(NSString *)filePath
+- (void)testKeyFilterFollowsStoreAndRemove
 {
-    int fd = open([filePath UTF8String], O_RDWR);
-    if (fd == -1) {
-        XCTAssert(fd != -1, @"Could open file for altering");
-        return;
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.keyFilterCapacity = 1000;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    NSString * const key = @"ZZ-new-key";
+    XCTAssertFalse([cache.keyFilter mightContainKey:key]);
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeData:[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertTrue([cache.keyFilter mightContainKey:key]);
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    [cache removeDataForKeys:@[key] callback:^(SPTPersistentCacheResponse *response) {
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertFalse([cache.keyFilter mightContainKey:key]);
+}
+
+- (void)testKeyFilterKeepsKeyStoredOverConcurrentRemove
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.keyFilterCapacity = 1000;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    NSString * const key = @"ZZ-new-key";
+    NSData * const payload = [@"TEST" dataUsingEncoding:NSUTF8StringEncoding];
+    XCTAssertEqual([cache synchronouslyStoreData:payload forKey:key ttl:0 locked:NO].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+    XCTAssertEqual([cache synchronouslyStoreData:payload forKey:key ttl:0 locked:NO].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    // A remove of the first record taking the key out of the filter only after the second store
+    [cache.keyFilter removeKey:key];
+
+    XCTAssertTrue([cache.keyFilter mightContainKey:key]);
+}
+
+#pragma mark Test Key Index
+
+- (void)testKeyIndexAnswersPrefixQueriesWithoutListingDirectory
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useKeyIndex = YES;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertTrue(cache.keyIndex.isReady);
+
+    // Listing the directory would fail the queries
+    NSFileManagerMock * const fileManager = [NSFileManagerMock new];
+    fileManager.mock_contentsOfDirectoryAtPaths = @{};
+    cache.test_fileManager = fileManager;
+
+    __weak XCTestExpectation * const metadataExpectation = [self expectationWithDescription:@"metadata"];
+    [cache loadMetadataForKeysWithPrefix:@"f" callback:^(SPTPersistentCacheResponse *response, NSArray<SPTPersistentCacheRecordMetadata *> *metadata) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        NSArray<NSString *> * const expectedKeys = @[self.imageNames[11], self.imageNames[9], self.imageNames[5], self.imageNames[2]];
+        XCTAssertEqualObjects([metadata valueForKey:@"key"], expectedKeys);
+        XCTAssertEqual(metadata[2].refCount, 1u);
+        XCTAssertEqual(metadata[2].ttl, kParams[5].ttl);
+        XCTAssertGreaterThan(metadata[2].payloadSize, 0u);
+        [metadataExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [cache loadDataForKeysWithPrefix:@"f" chooseKeyCallback:^NSString *(NSArray<NSString *> *keys) {
+        XCTAssertEqual(keys.count, 4u);
+        return keys.lastObject;
+    } withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertEqualObjects(response.record.key, self.imageNames[2]);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testKeyIndexDropsRemovedAndExpiredKeys
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useKeyIndex = YES;
+    }];
+    __block NSTimeInterval currentTime = kTestEpochTime;
+    cache.timeIntervalCallback = ^NSTimeInterval{
+        return currentTime;
+    };
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    [cache removeDataForKeys:@[self.imageNames[9]] callback:^(SPTPersistentCacheResponse *response) {
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertNil([cache.keyIndex metadataForKey:self.imageNames[9]]);
+
+    // Only the locked record outlives the default expiration period
+    currentTime = kTestEpochTime + options.defaultExpirationPeriod + 1;
+
+    __weak XCTestExpectation * const metadataExpectation = [self expectationWithDescription:@"metadata"];
+    [cache loadMetadataForKeysWithPrefix:@"f" callback:^(SPTPersistentCacheResponse *response, NSArray<SPTPersistentCacheRecordMetadata *> *metadata) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        NSArray<NSString *> * const expectedKeys = @[self.imageNames[5]];
+        XCTAssertEqualObjects([metadata valueForKey:@"key"], expectedKeys);
+        [metadataExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const missExpectation = [self expectationWithDescription:@"miss"];
+    [cache loadMetadataForKeysWithPrefix:@"ee6b" callback:^(SPTPersistentCacheResponse *response, NSArray<SPTPersistentCacheRecordMetadata *> *metadata) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        XCTAssertEqual(metadata.count, 0u);
+        [missExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+#pragma mark Test Storing Files
+
+- (void)testStoreFileAtPath
+{
+    // Larger than one copy chunk
+    NSMutableData * const data = [NSMutableData dataWithLength:600 * 1024];
+    for (NSUInteger i = 0; i < data.length; ++i) {
+        ((uint8_t *)data.mutableBytes)[i] = (uint8_t)(i * 31);
     }
+    NSString * const sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    XCTAssertTrue([data writeToFile:sourcePath atomically:YES]);
+
+    NSString * const key = @"ZZ-file-key";
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    BOOL result = [self.cache storeFileAtPath:sourcePath forKey:key ttl:20 locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    XCTAssertTrue(result);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    // The source is left alone and no temporary file is left behind
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:sourcePath]);
+    NSString * const subDirectory = [self.cache.dataCacheFileManager subDirectoryPathForKey:key];
+    NSArray<NSString *> * const contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:subDirectory error:nil];
+    XCTAssertEqualObjects(contents, @[key]);
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [self.cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertEqualObjects(response.record.data, data);
+        XCTAssertEqual(response.record.ttl, 20u);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    [[NSFileManager defaultManager] removeItemAtPath:sourcePath error:nil];
+}
+
+- (void)testStoreFileAtPathPersistsEvictionHints
+{
+    NSString * const sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    XCTAssertTrue([[@"HINTED" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:sourcePath atomically:YES]);
+
+    NSString * const key = @"ZZ-file-hint-key";
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.priority = SPTPersistentCacheRecordPriorityLow;
+    options.refetchCost = 54321;
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"store"];
+    XCTAssertTrue([self.cache storeFileAtPath:sourcePath forKey:key options:options withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
 
     SPTPersistentCacheRecordHeader header;
-    memset(&header, 0, (size_t)SPTPersistentCacheRecordHeaderSize);
+    XCTAssertTrue(spt_test_ReadHeaderForFile([self.cache.dataCacheFileManager pathForKey:key].fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.priority, (uint32_t)SPTPersistentCacheRecordPriorityLow);
+    XCTAssertEqual(header.refetchCost, 54321u);
 
-    ssize_t readSize = read(fd, &header, (size_t)SPTPersistentCacheRecordHeaderSize);
-    if (readSize != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
-        close(fd);
-        return;
-    }
+    [[NSFileManager defaultManager] removeItemAtPath:sourcePath error:nil];
+}
 
-    header.updateTimeSec = updateTime;
-    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+- (void)testStoreMissingFileFails
+{
+    NSString * const sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
 
-    off_t ret = lseek(fd, SEEK_SET, 0);
-    XCTAssert(ret != -1);
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"store"];
+    [self.cache storeFileAtPath:sourcePath forKey:@"ZZ-missing-file" ttl:0 locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationError);
+        XCTAssertEqualObjects(response.error.domain, NSPOSIXErrorDomain);
+        XCTAssertEqual(response.error.code, ENOENT);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
 
-    ssize_t written = write(fd, &header, (size_t)SPTPersistentCacheRecordHeaderSize);
-    XCTAssert(written == (ssize_t)SPTPersistentCacheRecordHeaderSize, @"header was not written");
-    fsync(fd);
-    close(fd);
+- (void)testStoreFileWriteFailureLeavesNoRecord
+{
+    NSString * const sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    XCTAssertTrue([[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:sourcePath atomically:YES]);
+
+    SPTPersistentCachePosixWrapperMock *posixWrapperMock = [SPTPersistentCachePosixWrapperMock new];
+    posixWrapperMock.writeValue = 0;
+    self.cache.test_posixWrapper = posixWrapperMock;
+
+    NSString * const key = @"ZZ-failed-file";
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"store"];
+    [self.cache storeFileAtPath:sourcePath forKey:key ttl:0 locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationError);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    NSString * const subDirectory = [self.cache.dataCacheFileManager subDirectoryPathForKey:key];
+    XCTAssertEqual([[NSFileManager defaultManager] contentsOfDirectoryAtPath:subDirectory error:nil].count, 0u);
+
+    [[NSFileManager defaultManager] removeItemAtPath:sourcePath error:nil];
 }
 
-- (SPTPersistentCacheForUnitTests *)createCacheWithTimeCallback:(SPTPersistentCacheCurrentTimeSecCallback)currentTime
-                                                 expirationTime:(NSTimeInterval)expirationTimeSec
+#pragma mark Test Trash
+
+- (void)testPruneMovesDataToTrashAndReapsIt
 {
-    SPTPersistentCacheOptions *options = [SPTPersistentCacheOptions new];
-    options.cachePath = self.cachePath;
-    options.cacheIdentifier = @"Test";
-    options.defaultExpirationPeriod = (NSUInteger)expirationTimeSec;
-    options.debugOutput = ^(NSString *message) {
-        NSLog(@"%@", message);
-    };
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"prune"];
+    [self.cache pruneWithCallback:^(SPTPersistentCacheResponse *response) {
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
 
-    SPTPersistentCacheForUnitTests *cache = [[SPTPersistentCacheForUnitTests alloc] initWithOptions:options];
-    cache.timeIntervalCallback = currentTime;
-    
-    return cache;
+    XCTAssertEqual([self getFilesNumberAtPath:self.cachePath], 0u);
+
+    [self.cache.scheduler waitUntilAllOperationsAreFinished];
+    NSArray<NSString *> * const trashContents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.cache.dataCacheFileManager.trashPath error:nil];
+    XCTAssertEqual(trashContents.count, 0u);
+}
+
+- (void)testLeftoverTrashIsReapedOnInit
+{
+    NSString * const trashPath = self.cache.dataCacheFileManager.trashPath;
+    NSString * const leftoverPath = [trashPath stringByAppendingPathComponent:@"leftover"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:trashPath withIntermediateDirectories:YES attributes:nil error:nil];
+    XCTAssertTrue([[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:leftoverPath atomically:YES]);
+
+    SPTPersistentCacheForUnitTests * const cache = [self createCacheWithTimeCallback:^NSTimeInterval{
+        return kTestEpochTime;
+    } expirationTime:SPTPersistentCacheDefaultExpirationTimeSec];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:leftoverPath]);
+}
+
+#pragma mark Test File Handles
+
+- (void)testOpenFileHandleGivesPayload
+{
+    NSString * const key = @"ZZ-handle-key";
+    NSData * const data = [@"PAYLOAD" dataUsingEncoding:NSUTF8StringEncoding];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [self.cache storeData:data forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __block SPTPersistentCacheFileHandle *fileHandle = nil;
+    __weak XCTestExpectation * const openExpectation = [self expectationWithDescription:@"open"];
+    BOOL result = [self.cache openFileHandleForKey:key withCallback:^(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle *handle) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        fileHandle = handle;
+        [openExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    XCTAssertTrue(result);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    XCTAssertNotNil(fileHandle);
+    XCTAssertEqual(fileHandle.payloadOffset, (off_t)SPTPersistentCacheRecordHeaderSize);
+    XCTAssertEqual(fileHandle.payloadLength, (uint64_t)data.length);
+    NSMutableData * const payload = [NSMutableData dataWithLength:data.length];
+    XCTAssertEqual(pread(fileHandle.fileDescriptor, payload.mutableBytes, payload.length, fileHandle.payloadOffset), (ssize_t)data.length);
+    XCTAssertEqualObjects(payload, data);
+
+    [fileHandle close];
+}
+
+- (void)testOpenFileHandleRefreshesAccessTimeWithoutSyncing
+{
+    __block NSTimeInterval currentTime = kTestEpochTime;
+    SPTPersistentCacheForUnitTests * const cache = [self createCacheWithTimeCallback:^NSTimeInterval{
+        return currentTime;
+    } expirationTime:SPTPersistentCacheDefaultExpirationTimeSec];
+    NSString * const key = @"ZZ-handle-key";
+    XCTAssertEqual([cache synchronouslyStoreData:[@"PAYLOAD" dataUsingEncoding:NSUTF8StringEncoding] forKey:key ttl:0 locked:NO].result,
+                   SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    SPTPersistentCacheFailingFsyncPosixWrapper * const posixWrapper = [SPTPersistentCacheFailingFsyncPosixWrapper new];
+    posixWrapper.succeedingFsyncCount = 1;
+    cache.test_posixWrapper = posixWrapper;
+    currentTime += 100.0;
+
+    __block SPTPersistentCacheFileHandle *fileHandle = nil;
+    __weak XCTestExpectation * const openExpectation = [self expectationWithDescription:@"open"];
+    [cache openFileHandleForKey:key withCallback:^(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle *handle) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        fileHandle = handle;
+        [openExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    [fileHandle close];
+
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([cache.dataCacheFileManager pathForKey:key].fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.updateTimeSec, (uint64_t)(kTestEpochTime + 100));
+    XCTAssertEqual(posixWrapper.succeedingFsyncCount, 1u);
+}
+
+- (void)testOpenFileHandleForMissingKey
+{
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"open"];
+    [self.cache openFileHandleForKey:@"ZZ-missing-handle" withCallback:^(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle *fileHandle) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        XCTAssertNil(fileHandle);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    XCTAssertFalse([self.cache openFileHandleForKey:@"ZZ-missing-handle" withCallback:nil onQueue:dispatch_get_main_queue()]);
+}
+
+- (void)testRemovalIsDeferredWhileFileHandleIsOpen
+{
+    NSString * const key = @"ZZ-pinned-key";
+    NSString * const path = [self.cache.dataCacheFileManager pathForKey:key];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [self.cache storeData:[@"PINNED" dataUsingEncoding:NSUTF8StringEncoding] forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __block SPTPersistentCacheFileHandle *fileHandle = nil;
+    __weak XCTestExpectation * const openExpectation = [self expectationWithDescription:@"open"];
+    [self.cache openFileHandleForKey:key withCallback:^(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle *handle) {
+        fileHandle = handle;
+        [openExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    [self.cache removeDataForKeys:@[key] callback:^(SPTPersistentCacheResponse *response) {
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:path]);
+
+    [fileHandle close];
+    [self.cache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+}
+
+#pragma mark Test Read-Through Loading
+
+- (void)testLoaderRunsOnceForConcurrentMisses
+{
+    NSString * const key = @"ZZ-loaded-key";
+    NSData * const data = [@"LOADED" dataUsingEncoding:NSUTF8StringEncoding];
+    __block NSUInteger loaderCalls = 0;
+    SPTPersistentCacheLoader const loader = ^(NSString *loaderKey, SPTPersistentCacheLoaderCompletion completion) {
+        XCTAssertEqualObjects(loaderKey, key);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            loaderCalls += 1;
+        });
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.1 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            completion(data, nil);
+        });
+    };
+
+    for (NSUInteger i = 0; i < 3; ++i) {
+        __weak XCTestExpectation * const expectation = [self expectationWithDescription:[NSString stringWithFormat:@"load %@", @(i)]];
+        BOOL result = [self.cache loadDataForKey:key loader:loader ttl:0 serveStale:NO withCallback:^(SPTPersistentCacheResponse *response) {
+            XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+            XCTAssertEqualObjects(response.record.data, data);
+            XCTAssertFalse(response.isStale);
+            [expectation fulfill];
+        } onQueue:dispatch_get_main_queue()];
+        XCTAssertTrue(result);
+    }
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertEqual(loaderCalls, 1u);
+
+    // The loaded data was stored
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load stored"];
+    [self.cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertEqualObjects(response.record.data, data);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testLoaderIsNotRunOnHit
+{
+    NSString * const key = @"ZZ-stored-key";
+    NSData * const data = [@"STORED" dataUsingEncoding:NSUTF8StringEncoding];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [self.cache storeData:data forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [self.cache loadDataForKey:key loader:^(NSString *loaderKey, SPTPersistentCacheLoaderCompletion completion) {
+        XCTFail(@"The loader shouldn’t run for cached data");
+        completion(nil, nil);
+    } ttl:0 serveStale:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertEqualObjects(response.record.data, data);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testLoaderErrorIsPassedToCallback
+{
+    NSError * const error = [NSError errorWithDomain:@"test" code:42 userInfo:nil];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"load"];
+    [self.cache loadDataForKey:@"ZZ-failing-key" loader:^(NSString *loaderKey, SPTPersistentCacheLoaderCompletion completion) {
+        completion(nil, error);
+    } ttl:0 serveStale:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationError);
+        XCTAssertEqualObjects(response.error, error);
+        XCTAssertNil(response.record);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    XCTAssertFalse([self.cache loadDataForKey:@"ZZ-failing-key" loader:nil ttl:0 serveStale:NO withCallback:^(SPTPersistentCacheResponse *response) {} onQueue:dispatch_get_main_queue()]);
+}
+
+- (void)testServeStaleReturnsExpiredRecordAndRefreshes
+{
+    __block NSTimeInterval currentTime = kTestEpochTime;
+    SPTPersistentCacheForUnitTests * const cache = [self createCacheWithTimeCallback:^NSTimeInterval{
+        return currentTime;
+    } expirationTime:SPTPersistentCacheDefaultExpirationTimeSec];
+
+    NSString * const key = @"ZZ-stale-key";
+    NSData * const staleData = [@"STALE" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData * const freshData = [@"FRESH" dataUsingEncoding:NSUTF8StringEncoding];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeData:staleData forKey:key ttl:10 locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    currentTime += 100;
+
+    __weak XCTestExpectation * const refreshExpectation = [self expectationWithDescription:@"refresh"];
+    __weak XCTestExpectation * const staleExpectation = [self expectationWithDescription:@"stale"];
+    [cache loadDataForKey:key loader:^(NSString *loaderKey, SPTPersistentCacheLoaderCompletion completion) {
+        completion(freshData, nil);
+        [refreshExpectation fulfill];
+    } ttl:10 serveStale:YES withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertTrue(response.isStale);
+        XCTAssertEqualObjects(response.record.data, staleData);
+        [staleExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load fresh"];
+    [cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertFalse(response.isStale);
+        XCTAssertEqualObjects(response.record.data, freshData);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+#pragma mark Test Lock Journal
+
+- (void)testLockJournalIsFilledFromHeaders
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = YES;
+    }];
+
+    XCTAssertNotNil(cache.lockJournal);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:cache.dataCacheFileManager.lockJournalPath]);
+    XCTAssertEqual([cache.lockJournal refCountForKey:self.imageNames[0]], 1u);
+    XCTAssertEqual(cache.lockJournal.allRefCounts.count, params_GetFilesNumber(YES));
+}
+
+- (void)testLockAndUnlockThroughJournal
+{
+    SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = YES;
+    }];
+    NSString * const key = @"ZZ-journal-key";
+    NSString * const path = [cache.dataCacheFileManager pathForKey:key];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeData:[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __block NSUInteger lockCallbacks = 0;
+    __weak XCTestExpectation * const lockExpectation = [self expectationWithDescription:@"lock"];
+    [cache lockDataForKeys:@[key, key, @"ZZ-missing-key"] callback:^(SPTPersistentCacheResponse *response) {
+        if (++lockCallbacks == 3) {
+            [lockExpectation fulfill];
+        }
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    XCTAssertEqual([cache.lockJournal refCountForKey:key], 2u);
+    XCTAssertEqual([cache.lockJournal refCountForKey:@"ZZ-missing-key"], 0u);
+
+    // Locking leaves the record untouched
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile(path.UTF8String, YES, &header));
+    XCTAssertEqual(header.refCount, 0u);
+
+    __weak XCTestExpectation * const unlockExpectation = [self expectationWithDescription:@"unlock"];
+    [cache unlockDataForKeys:@[key] callback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [unlockExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    // Locks survive the cache being created again
+    cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = YES;
+    }];
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertEqual(response.record.refCount, 1u);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testGarbageCollectionKeepsRecordsLockedInJournal
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = YES;
+    }];
+    NSString * const key = @"ZZ-journal-locked-key";
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeData:[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] forKey:key ttl:10 locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const lockExpectation = [self expectationWithDescription:@"lock"];
+    [cache lockDataForKeys:@[key] callback:^(SPTPersistentCacheResponse *response) {
+        [lockExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    cache.timeIntervalCallback = ^NSTimeInterval{
+        return kTestEpochTime + 100;
+    };
+    [cache runRegularGC];
+
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[cache.dataCacheFileManager pathForKey:key]]);
+}
+
+- (void)testRemovingLockedKeysCommitsOneJournalBatch
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = YES;
+    }];
+    NSArray<NSString *> * const keys = @[@"ZZ-journal-remove-a", @"ZZ-journal-remove-b", @"ZZ-journal-remove-c"];
+    NSString * const journalPath = cache.dataCacheFileManager.lockJournalPath;
+
+    for (NSString *key in keys) {
+        XCTAssertEqual([cache synchronouslyStoreData:[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] forKey:key ttl:0 locked:YES].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+    }
+    const unsigned long long sizeBeforeRemoval = [[NSFileManager defaultManager] attributesOfItemAtPath:journalPath error:nil].fileSize;
+
+    XCTAssertEqualObjects([cache removeDataForKeysSync:keys], keys);
+
+    // One batch header followed by an absolute refCount and the key for each removed record
+    unsigned long long expectedGrowth = sizeof(SPTPersistentCacheJournalBatchHeader);
+    for (NSString *key in keys) {
+        XCTAssertEqual([cache.lockJournal refCountForKey:key], 0u);
+        expectedGrowth += sizeof(uint32_t) + sizeof(uint16_t) + [key lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    }
+    const unsigned long long sizeAfterRemoval = [[NSFileManager defaultManager] attributesOfItemAtPath:journalPath error:nil].fileSize;
+    XCTAssertEqual(sizeAfterRemoval - sizeBeforeRemoval, expectedGrowth);
+}
+
+- (void)testLockJournalIsWrittenBackWhenDisabled
+{
+    SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = YES;
+    }];
+    NSString * const lockedKey = self.imageNames[0];
+    NSString * const journalPath = cache.dataCacheFileManager.lockJournalPath;
+
+    __weak XCTestExpectation * const unlockExpectation = [self expectationWithDescription:@"unlock"];
+    [cache unlockDataForKeys:@[lockedKey] callback:^(SPTPersistentCacheResponse *response) {
+        [unlockExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([cache.dataCacheFileManager pathForKey:lockedKey].UTF8String, YES, &header));
+    XCTAssertEqual(header.refCount, 1u);
+
+    cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useLockJournal = NO;
+    }];
+
+    XCTAssertNil(cache.lockJournal);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:journalPath]);
+    XCTAssertTrue(spt_test_ReadHeaderForFile([cache.dataCacheFileManager pathForKey:lockedKey].UTF8String, YES, &header));
+    XCTAssertEqual(header.refCount, 0u);
+}
+
+#pragma mark Test Directory Sharding
+
+- (void)testRecordsAreMigratedToHashedLayout
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.directoryShardingDepth = 2;
+    }];
+    NSString * const key = self.imageNames[0];
+
+    // Found wherever the migration has got to
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    XCTAssertFalse(cache.dataCacheFileManager.isMigratingLayout);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:cache.dataCacheFileManager.layoutPath]);
+    for (NSString *imageName in self.imageNames) {
+        XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[cache.dataCacheFileManager pathForStoringKey:imageName]]);
+    }
+
+    // Keys with a prefix are spread over all directories now
+    __weak XCTestExpectation * const prefixExpectation = [self expectationWithDescription:@"prefix"];
+    [cache loadDataForKeysWithPrefix:key chooseKeyCallback:^NSString *(NSArray *keys) {
+        XCTAssertTrue([keys containsObject:key]);
+        return key;
+    } withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [prefixExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+#pragma mark Test Partitions
+
+- (void)testPartitionExpiresRecordsAfterItsOwnPeriod
+{
+    SPTPersistentCachePartition * const partition = [[SPTPersistentCachePartition alloc] initWithName:@"short" keyPrefix:@"short:"];
+    partition.defaultExpirationPeriod = SPTPersistentCacheMinimumExpirationLimit;
+    __block NSTimeInterval currentTime = kTestEpochTime;
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.cachePath = [self.cachePath stringByAppendingPathComponent:@"partitions"];
+        options.cacheIdentifier = @"partitions";
+        options.partitions = @[partition];
+    }];
+    cache.timeIntervalCallback = ^NSTimeInterval{
+        return currentTime;
+    };
+    [self storeData:nil forKeys:@[@"short:record", @"long:record"] options:nil inCache:cache];
+
+    currentTime = kTestEpochTime + SPTPersistentCacheMinimumExpirationLimit + 1;
+
+    for (NSString *key in @[@"short:record", @"long:record"]) {
+        __weak XCTestExpectation * const expectation = [self expectationWithDescription:key];
+        [cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+            XCTAssertEqual(response.result, ([key isEqualToString:@"short:record"] ?
+                                             SPTPersistentCacheResponseCodeNotFound :
+                                             SPTPersistentCacheResponseCodeOperationSucceeded));
+            [expectation fulfill];
+        } onQueue:dispatch_get_main_queue()];
+    }
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testPartitionIsPrunedToItsOwnSizeConstraint
+{
+    SPTPersistentCachePartition * const partition = [[SPTPersistentCachePartition alloc] initWithName:@"small" keyPrefix:@"small:"];
+    partition.sizeConstraintBytes = 2 * (kPartitionTestPayloadSize + (NSUInteger)SPTPersistentCacheRecordHeaderSize);
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.cachePath = [self.cachePath stringByAppendingPathComponent:@"partitions"];
+        options.cacheIdentifier = @"partitions";
+        options.partitions = @[partition];
+    }];
+    NSArray<NSString *> * const keys = @[@"other:1", @"small:1", @"small:2", @"small:3"];
+    [self storeData:[NSMutableData dataWithLength:kPartitionTestPayloadSize] forKeys:keys options:nil inCache:cache];
+    [self ageRecordsForKeys:keys inCache:cache];
+
+    XCTAssertTrue([cache pruneBySize]);
+
+    // Only the oldest record of the partition is evicted, records of other partitions aren’t touched
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"other:1"]]);
+    XCTAssertFalse([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"small:1"]]);
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"small:2"]]);
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"small:3"]]);
+}
+
+- (void)testCacheSizeConstraintEvictsByPartitionWeight
+{
+    SPTPersistentCachePartition * const expendable = [[SPTPersistentCachePartition alloc] initWithName:@"expendable" keyPrefix:@"a:"];
+    expendable.evictionWeight = 1.0;
+    SPTPersistentCachePartition * const valuable = [[SPTPersistentCachePartition alloc] initWithName:@"valuable" keyPrefix:@"b:"];
+    valuable.evictionWeight = 3.0;
+    const NSUInteger recordSize = kPartitionTestPayloadSize + (NSUInteger)SPTPersistentCacheRecordHeaderSize;
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.cachePath = [self.cachePath stringByAppendingPathComponent:@"partitions"];
+        options.cacheIdentifier = @"partitions";
+        options.partitions = @[expendable, valuable];
+        options.sizeConstraintBytes = 4 * recordSize;
+    }];
+    // The records of the valuable partition are older than the others
+    NSArray<NSString *> * const keys = @[@"b:1", @"b:2", @"b:3", @"a:1", @"a:2", @"a:3"];
+    [self storeData:[NSMutableData dataWithLength:kPartitionTestPayloadSize] forKeys:keys options:nil inCache:cache];
+    [self ageRecordsForKeys:keys inCache:cache];
+
+    XCTAssertTrue([cache pruneBySize]);
+
+    // The partitions split the budget 1:3, so only the newest record of the expendable one is kept
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    for (NSString *key in keys) {
+        const BOOL kept = ([key hasPrefix:@"b:"] || [key isEqualToString:@"a:3"]);
+        XCTAssertEqual([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:key]], kept, @"%@", key);
+    }
+    XCTAssertLessThanOrEqual(cache.totalUsedSizeInBytes, 4 * recordSize);
+}
+
+/// Sets the modification times of the records so the first key is the oldest.
+- (void)ageRecordsForKeys:(NSArray<NSString *> *)keys inCache:(SPTPersistentCacheForUnitTests *)cache
+{
+    for (NSUInteger i = 0; i < keys.count; ++i) {
+        struct timeval t[2];
+        t[0].tv_sec = (__darwin_time_t)(kTestEpochTime - 5 * (keys.count - i));
+        t[0].tv_usec = 0;
+        t[1] = t[0];
+        XCTAssertNotEqual(utimes([cache.dataCacheFileManager pathForKey:keys[i]].UTF8String, t), -1, @"Failed to set file modification time");
+    }
+}
+
+#pragma mark Test Batched Header Reads
+
+- (void)testGarbageCollectionReadsHeadersInOneBatch
+{
+    SPTPersistentCachePosixWrapperMock * const posixWrapperMock = [SPTPersistentCachePosixWrapperMock new];
+    self.cache.test_posixWrapper = posixWrapperMock;
+    const NSUInteger files = [self getFilesNumberAtPath:self.cachePath];
+
+    [self.cache collectGarbageForceExpire:YES forceLocked:YES];
+
+    // All records of the test fit into one batch, corrupted ones are kept
+    XCTAssertEqual(posixWrapperMock.readBatchCount, 1u);
+    XCTAssertLessThan([self getFilesNumberAtPath:self.cachePath], files);
+}
+
+- (void)testGarbageCollectionKeepsRecordsWithUnreadableHeaders
+{
+    SPTPersistentCachePosixWrapperMock * const posixWrapperMock = [SPTPersistentCachePosixWrapperMock new];
+    posixWrapperMock.readValue = -1;
+    posixWrapperMock.readOverridden = YES;
+    self.cache.test_posixWrapper = posixWrapperMock;
+    const NSUInteger files = [self getFilesNumberAtPath:self.cachePath];
+    __block BOOL called = NO;
+    self.cache.test_debugOutput = ^(NSString *output) {
+        called = called || [output containsString:@"Error not enough data to read the header"];
+    };
+
+    [self.cache collectGarbageForceExpire:YES forceLocked:YES];
+
+    XCTAssertTrue(called);
+    XCTAssertEqual([self getFilesNumberAtPath:self.cachePath], files);
+}
+
+#pragma mark Test Multi-Process Coordination
+
+- (void)testSharedIndexAnswersMissesForRecordsRemovedByAnotherCache
+{
+    // Advisory locks are held per open file, so two caches on one path coordinate like two processes
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useMultiProcessCoordination = YES;
+        options.keyFilterCapacity = 1000;
+    }];
+    SPTPersistentCacheForUnitTests * const otherCache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useMultiProcessCoordination = YES;
+        options.keyFilterCapacity = 1000;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    [otherCache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertNil(cache.keyFilter);
+    XCTAssertTrue(cache.sharedIndex.isReady);
+    XCTAssertTrue(otherCache.sharedIndex.isReady);
+
+    NSString * const key = @"ZZ-shared-key";
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeData:[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const hitExpectation = [self expectationWithDescription:@"hit"];
+    [otherCache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [hitExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    [cache removeDataForKeys:@[key] callback:^(SPTPersistentCacheResponse *response) {
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    otherCache.test_didWork = NO;
+    __weak XCTestExpectation * const missExpectation = [self expectationWithDescription:@"miss"];
+    [otherCache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        [missExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertFalse(otherCache.test_didWork);
+}
+
+- (void)testSharedIndexLeftUnpopulatedByDeadWriterIsPopulatedAgain
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useMultiProcessCoordination = YES;
+        options.keyFilterCapacity = 1000;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertTrue(cache.sharedIndex.isReady);
+
+    // A writer that died while changing the table left its sequence number odd
+    const int fd = open(cache.dataCacheFileManager.sharedIndexPath.fileSystemRepresentation, O_RDWR);
+    uint64_t sequence = 0;
+    const off_t sequenceOffset = 32;
+    XCTAssertEqual(pread(fd, &sequence, sizeof(sequence), sequenceOffset), (ssize_t)sizeof(sequence));
+    sequence |= 1;
+    XCTAssertEqual(pwrite(fd, &sequence, sizeof(sequence), sequenceOffset), (ssize_t)sizeof(sequence));
+    close(fd);
+
+    NSString * const key = @"ZZ-shared-key";
+    XCTAssertEqual([cache synchronouslyStoreData:[@"TEST" dataUsingEncoding:NSUTF8StringEncoding] forKey:key ttl:0 locked:NO].result,
+                   SPTPersistentCacheResponseCodeOperationSucceeded);
+    XCTAssertTrue(cache.sharedIndex.needsPopulating);
+
+    XCTAssertEqual([cache synchronouslyLoadDataForKey:key].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    XCTAssertTrue(cache.sharedIndex.isReady);
+    XCTAssertEqual([cache.sharedIndex lookupKey:key header:NULL], SPTPersistentCacheSharedIndexLookupResultPresent);
+}
+
+- (void)testOnlyOneCacheLeadsGarbageCollection
+{
+    SPTPersistentCacheForUnitTests * const otherCache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useMultiProcessCoordination = YES;
+        options.keyFilterCapacity = 1000;
+    }];
+    @autoreleasepool {
+        SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+            options.useMultiProcessCoordination = YES;
+            options.keyFilterCapacity = 1000;
+        }];
+        XCTAssertTrue(cache.garbageCollector.isGarbageCollectionLeader);
+        XCTAssertFalse(otherCache.garbageCollector.isGarbageCollectionLeader);
+        [cache.scheduler waitUntilAllOperationsAreFinished];
+        cache = nil;
+    }
+
+    // The leadership is released with the leader
+    XCTAssertTrue(otherCache.garbageCollector.isGarbageCollectionLeader);
+}
+
+#pragma mark Test Warm-Up
+
+- (void)testLoadHitsAreRecordedAcrossRuns
+{
+    SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.accessHistoryCapacity = 10;
+    }];
+    [self storeData:nil forKeys:@[@"ZZ-warm-1", @"ZZ-warm-2", @"ZZ-warm-2"] options:nil inCache:cache];
+    [self loadKeys:@[@"ZZ-warm-1", @"ZZ-warm-2", @"ZZ-warm-2"] inCache:cache];
+    XCTAssertEqualObjects(cache.accessHistory.hottestKeys, (@[@"ZZ-warm-2", @"ZZ-warm-1"]));
+
+    [cache runRegularGC];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.accessHistoryCapacity = 10;
+    }];
+
+    XCTAssertEqualObjects(cache.accessHistory.hottestKeys, (@[@"ZZ-warm-2", @"ZZ-warm-1"]));
+}
+
+- (void)testWarmUpPrefetchesRecordsOfHistory
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.accessHistoryCapacity = 10;
+    }];
+    [self storeData:nil forKeys:@[@"ZZ-warm-1", @"ZZ-warm-2"] options:nil inCache:cache];
+    [self loadKeys:@[@"ZZ-warm-1", @"ZZ-warm-2"] inCache:cache];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"warm-up"];
+    XCTAssertTrue([cache warmUpWithCallback:^(NSUInteger prefetchedRecordCount, BOOL completed) {
+        XCTAssertEqual(prefetchedRecordCount, 2u);
+        XCTAssertTrue(completed);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testWarmUpStopsForForegroundWork
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.accessHistoryCapacity = 10;
+    }];
+    [self storeData:nil forKeys:@[@"ZZ-warm-1"] options:nil inCache:cache];
+    [self loadKeys:@[@"ZZ-warm-1"] inCache:cache];
+
+    cache.scheduler.suspended = YES;
+    [cache doWork:^{} lane:SPTPersistentCacheSchedulerLaneRead priority:NSOperationQueuePriorityNormal qos:NSQualityOfServiceDefault];
+    NSUInteger prefetchedCount = 0;
+
+    XCTAssertFalse([cache prefetchRecordsForKeys:cache.accessHistory.hottestKeys prefetchedCount:&prefetchedCount]);
+    XCTAssertEqual(prefetchedCount, 0u);
+
+    cache.scheduler.suspended = NO;
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+}
+
+- (void)testWarmUpRequiresAccessHistory
+{
+    XCTAssertNil(self.cache.accessHistory);
+    XCTAssertFalse([self.cache warmUpWithCallback:nil onQueue:nil]);
+}
+
+- (void)loadKeys:(NSArray<NSString *> *)keys inCache:(SPTPersistentCache *)cache
+{
+    for (NSString *key in keys) {
+        __weak XCTestExpectation * const expectation = [self expectationWithDescription:key];
+        [cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+            XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+            [expectation fulfill];
+        } onQueue:dispatch_get_main_queue()];
+        [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    }
+}
+
+#pragma mark Test Metadata Enumeration
+
+- (void)testEnumerationPassesMetadataInBatches
+{
+    NSArray<NSString *> * const keys = @[@"ZZ-enum-1", @"ZZ-enum-2", @"ZZ-enum-3", @"ZZ-enum-4", @"ZZ-enum-5"];
+    [self storeData:nil forKeys:keys options:nil inCache:self.cache];
+
+    NSArray<NSArray<SPTPersistentCacheRecordMetadata *> *> * const batches = [self enumerateMetadataInCache:self.cache
+                                                                                                  predicate:nil
+                                                                                          cancellationToken:nil];
+
+    XCTAssertEqualObjects([batches valueForKey:@"count"], (@[@2, @2, @1]));
+    NSArray<SPTPersistentCacheRecordMetadata *> * const metadata = [batches valueForKeyPath:@"@unionOfArrays.self"];
+    XCTAssertEqualObjects([[metadata valueForKey:@"key"] sortedArrayUsingSelector:@selector(compare:)], keys);
+    XCTAssertEqual(metadata.firstObject.payloadSize, [@"ZZ-enum-1" lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testEnumerationPassesRecordsChosenByPredicate
+{
+    [self storeData:nil forKeys:@[@"ZZ-enum-1", @"ZZ-enum-2", @"ZZ-enum-3"] options:nil inCache:self.cache];
+
+    NSArray<NSArray<SPTPersistentCacheRecordMetadata *> *> * const batches = [self enumerateMetadataInCache:self.cache
+                                                                                                  predicate:^BOOL(SPTPersistentCacheRecordMetadata *metadata) {
+        return [metadata.key isEqualToString:@"ZZ-enum-2"];
+    } cancellationToken:nil];
+
+    XCTAssertEqual(batches.count, 1u);
+    XCTAssertEqualObjects([batches.firstObject valueForKey:@"key"], (@[@"ZZ-enum-2"]));
+}
+
+- (void)testCancelledEnumerationStopsCallingBack
+{
+    [self storeData:nil forKeys:@[@"ZZ-enum-1", @"ZZ-enum-2", @"ZZ-enum-3"] options:nil inCache:self.cache];
+    SPTPersistentCacheCancellationToken * const token = [SPTPersistentCacheCancellationToken new];
+
+    __block NSUInteger calls = 0;
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"first batch"];
+    XCTAssertTrue([self.cache enumerateMetadataForKeysWithPrefix:@"ZZ-enum-" predicate:nil batchSize:2 cancellationToken:token callback:^(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished) {
+        calls += 1;
+        [token cancel];
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    [self.cache.scheduler waitUntilAllOperationsAreFinished];
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+
+    XCTAssertEqual(calls, 1u);
+}
+
+- (void)testEnumerationWaitingForItsCallerLeavesMaintenanceLaneFree
+{
+    [self storeData:nil forKeys:@[@"ZZ-enum-1", @"ZZ-enum-2", @"ZZ-enum-3"] options:nil inCache:self.cache];
+    dispatch_queue_t const callbackQueue = dispatch_queue_create("com.spotify.persistent.cache.test.enumeration", DISPATCH_QUEUE_SERIAL);
+    dispatch_semaphore_t const callerBusy = dispatch_semaphore_create(0);
+
+    XCTestExpectation * const firstBatchExpectation = [self expectationWithDescription:@"first batch"];
+    XCTestExpectation * const finishedExpectation = [self expectationWithDescription:@"finished"];
+    __block NSUInteger calls = 0;
+    [self.cache enumerateMetadataForKeysWithPrefix:@"ZZ-enum-" predicate:nil batchSize:1 cancellationToken:nil callback:^(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished) {
+        if (++calls == 1) {
+            [firstBatchExpectation fulfill];
+            dispatch_semaphore_wait(callerBusy, DISPATCH_TIME_FOREVER);
+        }
+        if (finished) {
+            [finishedExpectation fulfill];
+        }
+    } onQueue:callbackQueue];
+    [self waitForExpectations:@[firstBatchExpectation] timeout:kDefaultWaitTime];
+
+    // The next batch isn’t read, nor waited for on any lane, until the first callback returned
+    XCTAssertEqual(self.cache.scheduler.maintenanceQueue.operationCount, 0u);
+    XCTestExpectation * const maintenanceExpectation = [self expectationWithDescription:@"maintenance"];
+    [self.cache doWork:^{
+        [maintenanceExpectation fulfill];
+    } lane:SPTPersistentCacheSchedulerLaneMaintenance priority:NSOperationQueuePriorityNormal qos:NSQualityOfServiceDefault];
+    [self waitForExpectations:@[maintenanceExpectation] timeout:kDefaultWaitTime];
+
+    dispatch_semaphore_signal(callerBusy);
+    [self waitForExpectations:@[finishedExpectation] timeout:kDefaultWaitTime];
+    XCTAssertEqual(calls, 4u, @"Three batches of one record and the empty last one");
+}
+
+- (void)testEnumerationIsAnsweredFromKeyIndex
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useKeyIndex = YES;
+    }];
+    [self storeData:nil forKeys:@[@"ZZ-enum-1", @"ZZ-enum-2"] options:nil inCache:cache];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertTrue(cache.keyIndex.isReady);
+
+    // Reading any header would go through the wrapper
+    SPTPersistentCachePosixWrapperMock * const posixWrapperMock = [SPTPersistentCachePosixWrapperMock new];
+    cache.test_posixWrapper = posixWrapperMock;
+
+    NSArray<NSArray<SPTPersistentCacheRecordMetadata *> *> * const batches = [self enumerateMetadataInCache:cache
+                                                                                                  predicate:nil
+                                                                                          cancellationToken:nil];
+
+    XCTAssertEqualObjects([batches.firstObject valueForKey:@"key"], (@[@"ZZ-enum-1", @"ZZ-enum-2"]));
+    XCTAssertEqual(posixWrapperMock.readBatchCount, 0u);
+}
+
+- (void)testEnumerationFromKeyIndexFillsBatchesAcrossPages
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useKeyIndex = YES;
+    }];
+    [self storeData:nil forKeys:@[@"ZZ-enum-1", @"ZZ-enum-2", @"ZZ-enum-3", @"ZZ-enum-4", @"ZZ-enum-5"] options:nil inCache:cache];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    XCTAssertTrue(cache.keyIndex.isReady);
+
+    NSArray<NSArray<SPTPersistentCacheRecordMetadata *> *> * const batches = [self enumerateMetadataInCache:cache
+                                                                                                  predicate:^BOOL(SPTPersistentCacheRecordMetadata *metadata) {
+        return ![metadata.key isEqualToString:@"ZZ-enum-2"];
+    } cancellationToken:nil];
+
+    XCTAssertEqualObjects([batches.firstObject valueForKey:@"key"], (@[@"ZZ-enum-1", @"ZZ-enum-3"]));
+    XCTAssertEqualObjects([batches.lastObject valueForKey:@"key"], (@[@"ZZ-enum-4", @"ZZ-enum-5"]));
+    XCTAssertEqual(batches.count, 2u);
+}
+
+- (void)testEnumerationRequiresCallbackAndQueue
+{
+    XCTAssertFalse([self.cache enumerateMetadataForKeysWithPrefix:nil predicate:nil batchSize:1 cancellationToken:nil callback:nil onQueue:dispatch_get_main_queue()]);
+    XCTAssertFalse([self.cache enumerateMetadataForKeysWithPrefix:nil predicate:nil batchSize:1 cancellationToken:nil callback:^(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished) {
+        XCTFail(@"The callback shouldn’t be called");
+    } onQueue:nil]);
+}
+
+/**
+ Enumerates the records with the prefix "ZZ-enum-" in batches of 2 and returns the non-empty batches.
+ */
+- (NSArray<NSArray<SPTPersistentCacheRecordMetadata *> *> *)enumerateMetadataInCache:(SPTPersistentCache *)cache
+                                                                            predicate:(SPTPersistentCacheMetadataPredicate)predicate
+                                                                    cancellationToken:(SPTPersistentCacheCancellationToken *)cancellationToken
+{
+    NSMutableArray<NSArray<SPTPersistentCacheRecordMetadata *> *> * const batches = [NSMutableArray array];
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"enumeration"];
+    XCTAssertTrue([cache enumerateMetadataForKeysWithPrefix:@"ZZ-enum-" predicate:predicate batchSize:2 cancellationToken:cancellationToken callback:^(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished) {
+        XCTAssertLessThanOrEqual(metadata.count, 2u);
+        if (metadata.count > 0) {
+            [batches addObject:metadata];
+        }
+        if (finished) {
+            [expectation fulfill];
+        }
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    return batches;
+}
+
+#pragma mark Test Tags
+
+- (void)testRemoveDataForTagRemovesTaggedRecords
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useTagIndex = YES;
+    }];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.tags = [NSSet setWithObject:@"album-1"];
+    [self storeData:nil forKeys:@[@"ZZ-tag-small"] options:options inCache:cache];
+    options.tags = [NSSet setWithObjects:@"album-1", @"large", nil];
+    [self storeData:nil forKeys:@[@"ZZ-tag-large"] options:options inCache:cache];
+    options.tags = [NSSet setWithObject:@"album-2"];
+    [self storeData:nil forKeys:@[@"ZZ-tag-other"] options:options inCache:cache];
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    XCTAssertTrue([cache removeDataForTag:@"album-1" callback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    XCTAssertFalse([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-tag-small"]]);
+    XCTAssertFalse([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-tag-large"]]);
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-tag-other"]]);
+    // Removed records leave all of their tags
+    XCTAssertEqualObjects([cache.tagIndex keysForTag:@"large"], (@[]));
+
+    __weak XCTestExpectation * const missExpectation = [self expectationWithDescription:@"miss"];
+    XCTAssertTrue([cache removeDataForTag:@"album-1" callback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        [missExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testLockDataForTagLocksTaggedRecords
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useTagIndex = YES;
+    }];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.tags = [NSSet setWithObject:@"album-1"];
+    [self storeData:nil forKeys:@[@"ZZ-tag-small", @"ZZ-tag-large"] options:options inCache:cache];
+
+    __block NSUInteger calls = 0;
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"lock"];
+    XCTAssertTrue([cache lockDataForTag:@"album-1" callback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        if (++calls == 2) {
+            [expectation fulfill];
+        }
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    // Locked records survive garbage collection long after they expired
+    const NSTimeInterval expiredTime = kTestEpochTime + cache.options.defaultExpirationPeriod + 1;
+    cache.timeIntervalCallback = ^NSTimeInterval{
+        return expiredTime;
+    };
+    [cache collectGarbageForceExpire:NO forceLocked:NO];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-tag-small"]]);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-tag-large"]]);
+}
+
+- (void)testStoringAgainReplacesTags
+{
+    SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useTagIndex = YES;
+    }];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.tags = [NSSet setWithObject:@"album-1"];
+    [self storeData:nil forKeys:@[@"ZZ-tag-small"] options:options inCache:cache];
+    options.tags = [NSSet setWithObject:@"album-2"];
+    [self storeData:nil forKeys:@[@"ZZ-tag-small", @"ZZ-tag-large"] options:options inCache:cache];
+    [self storeData:nil forKeys:@[@"ZZ-tag-large"] options:nil inCache:cache];
+
+    // The tags are kept across instances
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.useTagIndex = YES;
+    }];
+
+    XCTAssertEqualObjects([cache.tagIndex keysForTag:@"album-1"], (@[]));
+    XCTAssertEqualObjects([cache.tagIndex keysForTag:@"album-2"], (@[@"ZZ-tag-small"]));
+}
+
+- (void)testTagsRequireTagIndex
+{
+    XCTAssertNil(self.cache.tagIndex);
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.tags = [NSSet setWithObject:@"album-1"];
+    XCTAssertFalse([self.cache storeData:[NSData data] forKey:@"ZZ-tag-small" options:options withCallback:nil onQueue:nil]);
+    XCTAssertFalse([self.cache storeFileAtPath:NSTemporaryDirectory() forKey:@"ZZ-tag-small" options:options withCallback:nil onQueue:nil]);
+    XCTAssertFalse([self.cache removeDataForTag:@"album-1" callback:nil onQueue:nil]);
+    XCTAssertFalse([self.cache lockDataForTag:@"album-1" callback:nil onQueue:nil]);
+}
+
+#pragma mark Test Deduplication
+
+- (void)testEqualPayloadsShareOneBlob
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    NSData * const payload = [self deduplicationPayload];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-1"] options:nil inCache:cache];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-2"] options:nil inCache:cache];
+
+    // The records hold only the digest of the payload
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    const unsigned long long recordSize = SPTPersistentCacheRecordHeaderSize + SPTPersistentCacheBlobStoreDigestLength;
+    XCTAssertEqual([[fileManager attributesOfItemAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-dedup-1"] error:nil] fileSize], recordSize);
+    XCTAssertEqual([[fileManager attributesOfItemAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-dedup-2"] error:nil] fileSize], recordSize);
+    XCTAssertEqual(cache.blobStore.usedSizeInBytes, payload.length);
+    XCTAssertEqual([cache.blobStore sizeShareForKey:@"ZZ-dedup-1"], payload.length / 2);
+
+    for (NSString *key in @[@"ZZ-dedup-1", @"ZZ-dedup-2"]) {
+        __weak XCTestExpectation * const expectation = [self expectationWithDescription:key];
+        XCTAssertTrue([cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+            XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+            XCTAssertEqualObjects(response.record.data, payload);
+            [expectation fulfill];
+        } onQueue:dispatch_get_main_queue()]);
+    }
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testBlobIsRemovedWithLastRecord
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    NSData * const payload = [self deduplicationPayload];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-1"] options:nil inCache:cache];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-2"] options:nil inCache:cache];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"remove"];
+    [cache removeDataForKeys:@[@"ZZ-dedup-1"] callback:^(SPTPersistentCacheResponse *response) {
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    XCTAssertEqual(cache.blobStore.usedSizeInBytes, payload.length);
+    XCTAssertEqual([cache.blobStore sizeShareForKey:@"ZZ-dedup-2"], payload.length);
+
+    // Storing a different payload releases the blob as well
+    [self storeData:[NSData dataWithBytes:"ZZ-dedup" length:8] forKeys:@[@"ZZ-dedup-2"] options:nil inCache:cache];
+    XCTAssertEqual(cache.blobStore.usedSizeInBytes, 0u);
+}
+
+- (void)testSmallPayloadsAreStoredInRecords
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    NSData * const payload = [NSData dataWithBytes:"ZZ-dedup" length:8];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-1"] options:nil inCache:cache];
+
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([cache.dataCacheFileManager pathForKey:@"ZZ-dedup-1"].fileSystemRepresentation, YES, &header));
+    XCTAssertFalse((header.flags & SPTPersistentCacheRecordHeaderFlagsDeduplicated) != 0);
+    XCTAssertEqual(header.payloadSizeBytes, payload.length);
+    XCTAssertEqual(cache.blobStore.usedSizeInBytes, 0u);
+}
+
+- (void)testRecordWithoutBlobIsNotFound
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    NSData * const payload = [self deduplicationPayload];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-1"] options:nil inCache:cache];
+    [[NSFileManager defaultManager] removeItemAtPath:cache.dataCacheFileManager.blobsPath error:nil];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"load"];
+    XCTAssertTrue([cache loadDataForKey:@"ZZ-dedup-1" withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testReferencesArePopulatedOnStart
+{
+    SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+    NSData * const payload = [self deduplicationPayload];
+    [self storeData:payload forKeys:@[@"ZZ-dedup-1"] options:nil inCache:cache];
+    [self storeData:[payload subdataWithRange:NSMakeRange(1, payload.length - 1)] forKeys:@[@"ZZ-dedup-2"] options:nil inCache:cache];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    // The record of one blob went missing, e.g. in a crash
+    [[NSFileManager defaultManager] removeItemAtPath:[cache.dataCacheFileManager pathForKey:@"ZZ-dedup-2"] error:nil];
+    cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+    }];
+    [cache.scheduler waitUntilAllOperationsAreFinished];
+
+    XCTAssertTrue(cache.blobStore.isReady);
+    XCTAssertEqual(cache.blobStore.usedSizeInBytes, payload.length);
+    XCTAssertEqual([cache.blobStore sizeShareForKey:@"ZZ-dedup-1"], payload.length);
+}
+
+- (void)testDeduplicationIsNotUsedByMultipleProcesses
+{
+    SPTPersistentCache * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.deduplicationThresholdBytes = 16;
+        options.useMultiProcessCoordination = YES;
+    }];
+
+    XCTAssertNil(cache.blobStore);
+}
+
+- (NSData *)deduplicationPayload
+{
+    return [[@"ZZ-dedup-" stringByPaddingToLength:100 withString:@"x" startingAtIndex:0] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+#pragma mark Test In-Place Updates
+
+- (void)testAppendDataToRecord
+{
+    NSString * const key = @"ZZ-update-append";
+    [self storeData:[@"HEAD" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[key] options:nil inCache:self.cache];
+
+    SPTPersistentCacheResponse * const response = [self replaceRange:NSMakeRange(NSNotFound, 0)
+                                                            withData:[@"-TAIL" dataUsingEncoding:NSUTF8StringEncoding]
+                                                              forKey:key];
+    XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    XCTAssertEqualObjects([self loadDataForKey:key], [@"HEAD-TAIL" dataUsingEncoding:NSUTF8StringEncoding]);
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([self.cache.dataCacheFileManager pathForKey:key].fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.payloadSizeBytes, 9u);
+    XCTAssertFalse((header.flags & SPTPersistentCacheRecordHeaderFlagsUpdatePending) != 0);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self updateJournalPathForKey:key]]);
+}
+
+- (void)testReplaceRangeOfRecord
+{
+    NSString * const key = @"ZZ-update-replace";
+    [self storeData:[@"0123456789" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[key] options:nil inCache:self.cache];
+
+    [self replaceRange:NSMakeRange(2, 3) withData:[@"abc" dataUsingEncoding:NSUTF8StringEncoding] forKey:key];
+    XCTAssertEqualObjects([self loadDataForKey:key], [@"01abc56789" dataUsingEncoding:NSUTF8StringEncoding]);
+
+    // The rest of the payload moves with a change of length
+    [self replaceRange:NSMakeRange(2, 3) withData:[@"X" dataUsingEncoding:NSUTF8StringEncoding] forKey:key];
+    XCTAssertEqualObjects([self loadDataForKey:key], [@"01X56789" dataUsingEncoding:NSUTF8StringEncoding]);
+
+    [self replaceRange:NSMakeRange(0, 1) withData:[@"ABCD" dataUsingEncoding:NSUTF8StringEncoding] forKey:key];
+    XCTAssertEqualObjects([self loadDataForKey:key], [@"ABCD1X56789" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testUpdateOfMissingRecordIsNotFound
+{
+    SPTPersistentCacheResponse * const response = [self replaceRange:NSMakeRange(NSNotFound, 0)
+                                                            withData:[@"TAIL" dataUsingEncoding:NSUTF8StringEncoding]
+                                                              forKey:@"ZZ-update-missing"];
+    XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+    XCTAssertFalse([self.cache appendData:[NSData data] toKey:@"ZZ-update-missing" callback:^(SPTPersistentCacheResponse *r) {} onQueue:nil]);
+}
+
+- (void)testUpdateOutsidePayloadFails
+{
+    NSString * const key = @"ZZ-update-range";
+    NSData * const payload = [@"0123" dataUsingEncoding:NSUTF8StringEncoding];
+    [self storeData:payload forKeys:@[key] options:nil inCache:self.cache];
+
+    SPTPersistentCacheResponse * const response = [self replaceRange:NSMakeRange(3, 2) withData:payload forKey:key];
+    XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationError);
+    XCTAssertEqual(response.error.code, EINVAL);
+    XCTAssertEqualObjects([self loadDataForKey:key], payload);
+}
+
+- (void)testUpdateOfRecordOpenAsFileHandleFails
+{
+    NSString * const key = @"ZZ-update-pinned";
+    NSData * const payload = [@"PINNED" dataUsingEncoding:NSUTF8StringEncoding];
+    [self storeData:payload forKeys:@[key] options:nil inCache:self.cache];
+
+    __block SPTPersistentCacheFileHandle *fileHandle = nil;
+    __weak XCTestExpectation * const openExpectation = [self expectationWithDescription:@"open"];
+    [self.cache openFileHandleForKey:key withCallback:^(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle *handle) {
+        fileHandle = handle;
+        [openExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    SPTPersistentCacheResponse * const response = [self replaceRange:NSMakeRange(0, 1) withData:payload forKey:key];
+    XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationError);
+    XCTAssertEqual(response.error.code, SPTPersistentCacheLoadingErrorRecordIsStreamAndBusy);
+
+    [fileHandle close];
+    XCTAssertEqualObjects([self loadDataForKey:key], payload);
+}
+
+- (void)testInterruptedUpdateIsFinishedOnLoad
+{
+    NSString * const key = @"ZZ-update-interrupted";
+    [self storeData:[@"0123456789" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[key] options:nil inCache:self.cache];
+
+    // The update got as far as flagging the header, the payload is untouched
+    SPTPersistentCacheRecordHeader updatedHeader = [self flagUpdatePendingOfRecordForKey:key];
+    updatedHeader.payloadSizeBytes = 12;
+    NSData * const journal = SPTPersistentCacheUpdateJournalEncode(&updatedHeader, 8, [@"89AB" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertTrue([journal writeToFile:[self updateJournalPathForKey:key] atomically:YES]);
+
+    XCTAssertEqualObjects([self loadDataForKey:key], [@"0123456789AB" dataUsingEncoding:NSUTF8StringEncoding]);
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([self.cache.dataCacheFileManager pathForKey:key].fileSystemRepresentation, YES, &header));
+    XCTAssertFalse((header.flags & SPTPersistentCacheRecordHeaderFlagsUpdatePending) != 0);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self updateJournalPathForKey:key]]);
+}
+
+- (void)testInterruptedUpdateWithoutJournalIsNotFound
+{
+    NSString * const key = @"ZZ-update-lost";
+    [self storeData:[@"0123456789" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[key] options:nil inCache:self.cache];
+    [self flagUpdatePendingOfRecordForKey:key];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"load"];
+    [self.cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeNotFound);
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self.cache.dataCacheFileManager pathForKey:key]]);
+}
+
+- (void)testUpdateThatCannotFlagItsRecordLeavesNoJournal
+{
+    NSString * const key = @"ZZ-update-unflagged";
+    [self storeData:[@"0123456789" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[key] options:nil inCache:self.cache];
+
+    // The journal is synced, syncing the flagged header fails
+    SPTPersistentCacheFailingFsyncPosixWrapper * const posixWrapper = [SPTPersistentCacheFailingFsyncPosixWrapper new];
+    posixWrapper.succeedingFsyncCount = 1;
+    self.cache.test_posixWrapper = posixWrapper;
+    XCTAssertEqual([self replaceRange:NSMakeRange(0, 2) withData:[@"AB" dataUsingEncoding:NSUTF8StringEncoding] forKey:key].result,
+                   SPTPersistentCacheResponseCodeOperationError);
+    self.cache.test_posixWrapper = nil;
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self updateJournalPathForKey:key]]);
+    XCTAssertEqualObjects([self loadDataForKey:key], [@"0123456789" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testRemovingRecordRemovesItsUpdateJournal
+{
+    NSString * const key = @"ZZ-update-removed";
+    [self storeData:[@"0123456789" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[key] options:nil inCache:self.cache];
+    [self flagUpdatePendingOfRecordForKey:key];
+    XCTAssertTrue([[NSData data] writeToFile:[self updateJournalPathForKey:key] atomically:YES]);
+
+    XCTAssertTrue([self.cache removeDataForKeySync:key]);
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self updateJournalPathForKey:key]]);
+}
+
+- (SPTPersistentCacheResponse *)replaceRange:(NSRange)range withData:(NSData *)data forKey:(NSString *)key
+{
+    __block SPTPersistentCacheResponse *updateResponse = nil;
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"update"];
+    XCTAssertTrue([self.cache replaceRange:range withData:data forKey:key callback:^(SPTPersistentCacheResponse *response) {
+        updateResponse = response;
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    return updateResponse;
+}
+
+- (NSData *)loadDataForKey:(NSString *)key
+{
+    __block NSData *data = nil;
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"load"];
+    [self.cache loadDataForKey:key withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        data = response.record.data;
+        [expectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    return data;
+}
+
+- (NSString *)updateJournalPathForKey:(NSString *)key
+{
+    NSString * const recordPath = [self.cache.dataCacheFileManager pathForKey:key];
+    return [[recordPath stringByDeletingLastPathComponent] stringByAppendingPathComponent:[NSString stringWithFormat:@".%@.update", key]];
+}
+
+- (SPTPersistentCacheRecordHeader)flagUpdatePendingOfRecordForKey:(NSString *)key
+{
+    NSString * const path = [self.cache.dataCacheFileManager pathForKey:key];
+    NSMutableData * const record = [NSMutableData dataWithContentsOfFile:path];
+    SPTPersistentCacheRecordHeader * const header = record.mutableBytes;
+    const SPTPersistentCacheRecordHeader originalHeader = *header;
+    header->flags |= SPTPersistentCacheRecordHeaderFlagsUpdatePending;
+    header->crc = SPTPersistentCacheCalculateHeaderCRC(header);
+    XCTAssertTrue([record writeToFile:path atomically:YES]);
+    return originalHeader;
+}
+
+#pragma mark Test Synchronous Calls
+
+- (void)testSynchronousStoreLoadAndRemove
+{
+    NSString * const key = @"ZZ-sync-key";
+    NSData * const payload = [@"SYNC" dataUsingEncoding:NSUTF8StringEncoding];
+
+    XCTAssertEqual([self.cache synchronouslyStoreData:payload forKey:key ttl:0 locked:NO].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    SPTPersistentCacheResponse * const response = [self.cache synchronouslyLoadDataForKey:key];
+    XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+    XCTAssertEqualObjects(response.record.data, payload);
+    // The queued path sees the same record
+    XCTAssertEqualObjects([self loadDataForKey:key], payload);
+
+    XCTAssertEqual([self.cache synchronouslyTouchDataForKey:key].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    XCTAssertEqual([self.cache synchronouslyRemoveDataForKeys:@[key]].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+    XCTAssertEqual([self.cache synchronouslyLoadDataForKey:key].result, SPTPersistentCacheResponseCodeNotFound);
+    XCTAssertEqual([self.cache synchronouslyTouchDataForKey:key].result, SPTPersistentCacheResponseCodeNotFound);
+}
+
+- (void)testSynchronousStoreRejectsInvalidArguments
+{
+    NSData *payload = nil;
+    SPTPersistentCacheResponse * const response = [self.cache synchronouslyStoreData:payload forKey:@"ZZ-sync-key" ttl:0 locked:NO];
+
+    XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationError);
+    XCTAssertEqual(response.error.code, EINVAL);
+}
+
+- (void)testAccessTimeIsNotWrittenToRecordStoredOverTheLoadedOne
+{
+    __block NSTimeInterval currentTime = kTestEpochTime;
+    SPTPersistentCacheForUnitTests * const cache = [self createCacheWithTimeCallback:^NSTimeInterval{
+        return currentTime;
+    } expirationTime:SPTPersistentCacheDefaultExpirationTimeSec];
+    NSString * const key = @"ZZ-access-time-key";
+    NSString * const path = [cache.dataCacheFileManager pathForKey:key];
+    XCTAssertEqual([cache synchronouslyStoreData:[@"OLD" dataUsingEncoding:NSUTF8StringEncoding] forKey:key ttl:0 locked:NO].result,
+                   SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    // A store renames its record over the one being loaded before the access time is written back
+    SPTPersistentCacheExclusiveLockPosixWrapper * const posixWrapper = [SPTPersistentCacheExclusiveLockPosixWrapper new];
+    posixWrapper.beforeExclusiveLock = ^{
+        NSString * const copyPath = [path stringByAppendingString:@".copy"];
+        XCTAssertTrue([[NSFileManager defaultManager] copyItemAtPath:path toPath:copyPath error:nil]);
+        XCTAssertEqual(rename(copyPath.fileSystemRepresentation, path.fileSystemRepresentation), 0);
+    };
+    cache.test_posixWrapper = posixWrapper;
+    currentTime += 100.0;
+
+    XCTAssertEqual([cache synchronouslyLoadDataForKey:key].result, SPTPersistentCacheResponseCodeOperationSucceeded);
+
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile(path.fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.updateTimeSec, (uint64_t)kTestEpochTime);
+}
+
+#pragma mark Test Large Records
+
+- (void)testLargeRecordIsStoredPageAligned
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.largeRecordThresholdBytes = 16;
+    }];
+    NSData * const payload = [self largeRecordPayload];
+    [self storeData:payload forKeys:@[@"ZZ-large-key"] options:nil inCache:cache];
+
+    NSString * const path = [cache.dataCacheFileManager pathForKey:@"ZZ-large-key"];
+    const unsigned long long recordSize = SPTPersistentCacheRecordAlignedHeaderSize + payload.length;
+    XCTAssertEqual([[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize], recordSize);
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile(path.fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.headerSize, (uint32_t)SPTPersistentCacheRecordAlignedHeaderSize);
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [cache loadDataForKey:@"ZZ-large-key" withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        XCTAssertEqualObjects(response.record.data, payload);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    // The payload of a file handle starts after the padding
+    __block SPTPersistentCacheFileHandle *fileHandle = nil;
+    __weak XCTestExpectation * const openExpectation = [self expectationWithDescription:@"open"];
+    [cache openFileHandleForKey:@"ZZ-large-key" withCallback:^(SPTPersistentCacheResponse *response, SPTPersistentCacheFileHandle *handle) {
+        fileHandle = handle;
+        [openExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    XCTAssertEqual(fileHandle.payloadOffset, (off_t)SPTPersistentCacheRecordAlignedHeaderSize);
+    NSMutableData * const read = [NSMutableData dataWithLength:payload.length];
+    XCTAssertEqual(pread(fileHandle.fileDescriptor, read.mutableBytes, read.length, fileHandle.payloadOffset), (ssize_t)payload.length);
+    XCTAssertEqualObjects(read, payload);
+    [fileHandle close];
+}
+
+- (void)testLargeRecordIsUpdatedInPlace
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.largeRecordThresholdBytes = 16;
+    }];
+    NSData * const tail = [@"-TAIL" dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData * const payload = [[self largeRecordPayload] mutableCopy];
+    [self storeData:payload forKeys:@[@"ZZ-large-key"] options:nil inCache:cache];
+
+    __weak XCTestExpectation * const updateExpectation = [self expectationWithDescription:@"update"];
+    [cache appendData:tail toKey:@"ZZ-large-key" callback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [updateExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    // The update lands after the padding of the header
+    [payload appendData:tail];
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [cache loadDataForKey:@"ZZ-large-key" withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqualObjects(response.record.data, payload);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+}
+
+- (void)testLargeFileIsStoredPageAligned
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.largeRecordThresholdBytes = 16;
+    }];
+    NSData * const payload = [self largeRecordPayload];
+    NSString * const sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    XCTAssertTrue([payload writeToFile:sourcePath atomically:YES]);
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeFileAtPath:sourcePath forKey:@"ZZ-large-file" ttl:0 locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    NSString * const path = [cache.dataCacheFileManager pathForKey:@"ZZ-large-file"];
+    const unsigned long long recordSize = SPTPersistentCacheRecordAlignedHeaderSize + payload.length;
+    XCTAssertEqual([[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize], recordSize);
+
+    __weak XCTestExpectation * const loadExpectation = [self expectationWithDescription:@"load"];
+    [cache loadDataForKey:@"ZZ-large-file" withCallback:^(SPTPersistentCacheResponse *response) {
+        XCTAssertEqualObjects(response.record.data, payload);
+        [loadExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:sourcePath error:nil];
+}
+
+- (void)testSmallRecordKeepsPackedHeader
+{
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.largeRecordThresholdBytes = 16;
+    }];
+    [self storeData:[@"SMALL" dataUsingEncoding:NSUTF8StringEncoding] forKeys:@[@"ZZ-small-key"] options:nil inCache:cache];
+
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([cache.dataCacheFileManager pathForKey:@"ZZ-small-key"].fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.headerSize, (uint32_t)SPTPersistentCacheRecordHeaderSize);
+}
+
+- (NSData *)largeRecordPayload
+{
+    return [[@"ZZ-large-" stringByPaddingToLength:100 withString:@"x" startingAtIndex:0] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+#pragma mark Test Eviction Hints
+
+- (void)testEvictionHintsArePersistedInHeader
+{
+    NSString * const key = @"ZZ-hint-key";
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.priority = SPTPersistentCacheRecordPriorityHigh;
+    options.refetchCost = 12345;
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"store"];
+    XCTAssertTrue([self.cache storeData:[@"HINTED" dataUsingEncoding:NSUTF8StringEncoding]
+                                 forKey:key
+                                options:options
+                           withCallback:^(SPTPersistentCacheResponse *response) {
+                               XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+                               [expectation fulfill];
+                           } onQueue:dispatch_get_main_queue()]);
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    SPTPersistentCacheRecordHeader header;
+    XCTAssertTrue(spt_test_ReadHeaderForFile([self.cache.dataCacheFileManager pathForKey:key].fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.priority, (uint32_t)SPTPersistentCacheRecordPriorityHigh);
+    XCTAssertEqual(header.refetchCost, 12345u);
+
+    // An in-place update keeps the hints
+    [self replaceRange:NSMakeRange(NSNotFound, 0) withData:[@"-TAIL" dataUsingEncoding:NSUTF8StringEncoding] forKey:key];
+    XCTAssertTrue(spt_test_ReadHeaderForFile([self.cache.dataCacheFileManager pathForKey:key].fileSystemRepresentation, YES, &header));
+    XCTAssertEqual(header.priority, (uint32_t)SPTPersistentCacheRecordPriorityHigh);
+    XCTAssertEqual(header.refetchCost, 12345u);
+}
+
+- (void)testHighPriorityRecordOutlivesNewerRecords
+{
+    const NSUInteger recordSize = kPartitionTestPayloadSize + (NSUInteger)SPTPersistentCacheRecordHeaderSize;
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.cachePath = [self.cachePath stringByAppendingPathComponent:@"partitions"];
+        options.cacheIdentifier = @"partitions";
+        options.sizeConstraintBytes = 2 * recordSize;
+    }];
+    NSArray<NSString *> * const keys = @[@"hint:1", @"hint:2", @"hint:3"];
+    NSMutableData * const data = [NSMutableData dataWithLength:kPartitionTestPayloadSize];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    options.priority = SPTPersistentCacheRecordPriorityHigh;
+    [self storeData:data forKeys:@[@"hint:1"] options:options inCache:cache];
+    [self storeData:data forKeys:@[@"hint:2", @"hint:3"] options:nil inCache:cache];
+    [self ageRecordsForKeys:keys inCache:cache];
+
+    XCTAssertTrue([cache pruneBySize]);
+
+    // The oldest record is worth four times as much per byte, so the next oldest goes instead
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:1"]]);
+    XCTAssertFalse([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:2"]]);
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:3"]]);
+}
+
+- (void)testCostlyRecordOutlivesCheaperRecords
+{
+    const NSUInteger recordSize = kPartitionTestPayloadSize + (NSUInteger)SPTPersistentCacheRecordHeaderSize;
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.cachePath = [self.cachePath stringByAppendingPathComponent:@"partitions"];
+        options.cacheIdentifier = @"partitions";
+        options.sizeConstraintBytes = 2 * recordSize;
+    }];
+    NSArray<NSString *> * const keys = @[@"hint:1", @"hint:2", @"hint:3"];
+    // The newest record is cheap to fetch again, e.g. it was served from a nearby edge
+    const uint64_t refetchCosts[] = { 10 * recordSize, recordSize, recordSize / 10 };
+    NSMutableData * const data = [NSMutableData dataWithLength:kPartitionTestPayloadSize];
+    SPTPersistentCacheStoreOptions * const options = [SPTPersistentCacheStoreOptions new];
+    for (NSUInteger i = 0; i < keys.count; ++i) {
+        options.refetchCost = refetchCosts[i];
+        [self storeData:data forKeys:@[keys[i]] options:options inCache:cache];
+    }
+    [self ageRecordsForKeys:keys inCache:cache];
+
+    XCTAssertTrue([cache pruneBySize]);
+
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:1"]]);
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:2"]]);
+    XCTAssertFalse([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:3"]]);
+}
+
+- (void)testEvictionSkipsRecordsLockedInJournalAndRemovesUpdateJournals
+{
+    const NSUInteger recordSize = kPartitionTestPayloadSize + (NSUInteger)SPTPersistentCacheRecordHeaderSize;
+    SPTPersistentCacheForUnitTests * const cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.cachePath = [self.cachePath stringByAppendingPathComponent:@"partitions"];
+        options.cacheIdentifier = @"partitions";
+        options.sizeConstraintBytes = 2 * recordSize;
+        options.useLockJournal = YES;
+    }];
+    NSArray<NSString *> * const keys = @[@"hint:1", @"hint:2", @"hint:3"];
+    [self storeData:[NSMutableData dataWithLength:kPartitionTestPayloadSize] forKeys:keys options:nil inCache:cache];
+    [self ageRecordsForKeys:keys inCache:cache];
+
+    // Locking through the journal leaves the refCount in the header at 0
+    __weak XCTestExpectation * const lockExpectation = [self expectationWithDescription:@"lock"];
+    [cache lockDataForKeys:@[@"hint:1"] callback:^(SPTPersistentCacheResponse *response) {
+        [lockExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+
+    NSString * const recordPath = [cache.dataCacheFileManager pathForKey:@"hint:2"];
+    NSString * const updateJournalPath = [[recordPath stringByDeletingLastPathComponent] stringByAppendingPathComponent:@".hint:2.update"];
+    XCTAssertTrue([[NSData data] writeToFile:updateJournalPath atomically:YES]);
+
+    XCTAssertTrue([cache pruneBySize]);
+
+    NSFileManager * const fileManager = [NSFileManager defaultManager];
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:1"]]);
+    XCTAssertFalse([fileManager fileExistsAtPath:recordPath]);
+    XCTAssertFalse([fileManager fileExistsAtPath:updateJournalPath]);
+    XCTAssertTrue([fileManager fileExistsAtPath:[cache.dataCacheFileManager pathForKey:@"hint:3"]]);
+}
+
+#pragma mark - Internal methods
+
+- (void)putFile:(NSString *)file
+        inCache:(SPTPersistentCache *)cache
+        withKey:(NSString *)key
+            ttl:(NSUInteger)ttl
+         locked:(BOOL)locked
+    expectation:(__weak XCTestExpectation *)expectation
+{
+    NSData *data = [NSData dataWithContentsOfFile:file];
+    XCTAssertNotNil(data, @"Unable to get data from file:%@", file);
+    XCTAssertNotNil(key, @"Key must be specified");
+    SPTPersistentCacheResponseCallback callback = ^(SPTPersistentCacheResponse *response) {
+        if (response.result == SPTPersistentCacheResponseCodeOperationSucceeded) {
+            XCTAssertNil(response.record, @"record expected to be nil");
+            XCTAssertNil(response.error, @"error xpected to be nil");
+        } else if (response.result == SPTPersistentCacheResponseCodeOperationError) {
+            XCTAssertNil(response.record, @"record expected to be nil");
+            XCTAssertNotNil(response.error, @"error must exist for when STORE failed");
+        } else {
+            XCTAssert(NO, @"This is not expected result code for STORE operation");
+        }
+        [expectation fulfill];
+    };
+
+    if (ttl == 0) {
+        [cache storeData:data forKey:key locked:locked withCallback:callback onQueue:dispatch_get_main_queue()];
+    } else {
+        [cache storeData:data forKey:key ttl:ttl locked:locked withCallback:callback onQueue:dispatch_get_main_queue()];
+    }
+}
+
+/*
+SPTPersistentCacheLoadingErrorMagicMismatch,
+SPTPersistentCacheLoadingErrorWrongHeaderSize,
+SPTPersistentCacheLoadingErrorWrongPayloadSize,
+SPTPersistentCacheLoadingErrorInvalidHeaderCRC,
+SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader,
+*/
+
+- (void)corruptFile:(NSString *)filePath
+           pdcError:(int)pdcError
+{
+    int flags = O_RDWR;
+    if (pdcError == SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader) {
+        flags |= O_TRUNC;
+    }
+
+    int fd = open([filePath UTF8String], flags);
+    if (fd == -1) {
+        XCTAssert(fd != -1, @"Could not open file while trying to simulate corruption");
+        return;
+    }
+
+    SPTPersistentCacheRecordHeader header;
+    memset(&header, 0, (size_t)SPTPersistentCacheRecordHeaderSize);
+
+    if (pdcError != SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader) {
+
+        ssize_t readSize = read(fd, &header, (size_t)SPTPersistentCacheRecordHeaderSize);
+        if (readSize != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+            XCTAssert(readSize == (ssize_t)SPTPersistentCacheRecordHeaderSize, @"Header not read");
+            close(fd);
+            return;
+        }
+    }
+
+    NSUInteger headerSize = (NSUInteger)SPTPersistentCacheRecordHeaderSize;
+
+    switch (pdcError) {
+        case SPTPersistentCacheLoadingErrorMagicMismatch: {
+            header.magic = 0xFFFF5454;
+            break;
+        }
+        case SPTPersistentCacheLoadingErrorWrongHeaderSize: {
+            header.headerSize = (uint32_t)SPTPersistentCacheRecordHeaderSize + 1u + arc4random_uniform(106);
+            header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+            break;
+        }
+        case SPTPersistentCacheLoadingErrorWrongPayloadSize: {
+            header.payloadSizeBytes += (1 + (arc4random_uniform((uint32_t)header.payloadSizeBytes) - (header.payloadSizeBytes-1)/2));
+            header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+            break;
+        }
+        case SPTPersistentCacheLoadingErrorInvalidHeaderCRC: {
+            header.crc = header.crc + 5;
+            break;
+        }
+        case SPTPersistentCacheLoadingErrorNotEnoughDataToGetHeader: {
+            headerSize = kCorruptedFileSize;
+            break;
+        }
+        default:
+            NSAssert(NO, @"Gotcha!");
+            break;
+    }
+
+    off_t ret = lseek(fd, SEEK_SET, 0);
+    XCTAssert(ret != -1);
+
+    ssize_t written = write(fd, &header, headerSize);
+    XCTAssert(written == (ssize_t)headerSize, @"header was not written");
+    fsync(fd);
+    close(fd);
+}
+
+- (void)alterUpdateTime:(uint64_t)updateTime forFileAtPath:(NSString *)filePath
+{
+    int fd = open([filePath UTF8String], O_RDWR);
+    if (fd == -1) {
+        XCTAssert(fd != -1, @"Could open file for altering");
+        return;
+    }
+
+    SPTPersistentCacheRecordHeader header;
+    memset(&header, 0, (size_t)SPTPersistentCacheRecordHeaderSize);
+
+    ssize_t readSize = read(fd, &header, (size_t)SPTPersistentCacheRecordHeaderSize);
+    if (readSize != (ssize_t)SPTPersistentCacheRecordHeaderSize) {
+        close(fd);
+        return;
+    }
+
+    header.updateTimeSec = updateTime;
+    header.crc = SPTPersistentCacheCalculateHeaderCRC(&header);
+
+    off_t ret = lseek(fd, SEEK_SET, 0);
+    XCTAssert(ret != -1);
+
+    ssize_t written = write(fd, &header, (size_t)SPTPersistentCacheRecordHeaderSize);
+    XCTAssert(written == (ssize_t)SPTPersistentCacheRecordHeaderSize, @"header was not written");
+    fsync(fd);
+    close(fd);
+}
+
+- (SPTPersistentCacheForUnitTests *)createCacheWithTimeCallback:(SPTPersistentCacheCurrentTimeSecCallback)currentTime
+                                                 expirationTime:(NSTimeInterval)expirationTimeSec
+{
+    SPTPersistentCacheForUnitTests *cache = [self cacheWithOptionsBlock:^(SPTPersistentCacheOptions *options) {
+        options.defaultExpirationPeriod = (NSUInteger)expirationTimeSec;
+    }];
+    cache.timeIntervalCallback = currentTime;
+    
+    return cache;
+}
+
+/// Creates a cache in the test directory whose time is kTestEpochTime, with the options changed by the block
+- (SPTPersistentCacheForUnitTests *)cacheWithOptionsBlock:(void (^)(SPTPersistentCacheOptions *options))optionsBlock
+{
+    SPTPersistentCacheOptions *options = [SPTPersistentCacheOptions new];
+    options.cachePath = self.cachePath;
+    options.cacheIdentifier = @"Test";
+    options.debugOutput = ^(NSString *message) {
+        NSLog(@"%@", message);
+    };
+    optionsBlock(options);
+
+    SPTPersistentCacheForUnitTests *cache = [[SPTPersistentCacheForUnitTests alloc] initWithOptions:options];
+    cache.timeIntervalCallback = ^NSTimeInterval{
+        return kTestEpochTime;
+    };
+    return cache;
+}
+
+/// Stores data for each key, or the key itself if data is nil, and waits for each store to finish.
+- (void)storeData:(NSData *)data
+          forKeys:(NSArray<NSString *> *)keys
+          options:(SPTPersistentCacheStoreOptions *)options
+          inCache:(SPTPersistentCache *)cache
+{
+    for (NSString *key in keys) {
+        __weak XCTestExpectation * const expectation = [self expectationWithDescription:key];
+        XCTAssertTrue([cache storeData:data ?: [key dataUsingEncoding:NSUTF8StringEncoding]
+                                forKey:key
+                               options:options
+                          withCallback:^(SPTPersistentCacheResponse *response) {
+            XCTAssertEqual(response.result, SPTPersistentCacheResponseCodeOperationSucceeded);
+            [expectation fulfill];
+        } onQueue:dispatch_get_main_queue()]);
+        [self waitForExpectationsWithTimeout:kDefaultWaitTime handler:nil];
+    }
 }
 
 - (NSUInteger)getFilesNumberAtPath:(NSString *)path
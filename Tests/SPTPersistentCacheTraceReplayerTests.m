@@ -0,0 +1,329 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import <SPTPersistentCache/SPTPersistentCache.h>
+
+#import "SPTPersistentCache+Private.h"
+#import "SPTPersistentCacheTraceRecorder.h"
+
+static const NSTimeInterval SPTPersistentCacheTraceReplayerTestsTimeout = 5.0;
+
+@interface SPTPersistentCacheTraceReplayerTests : XCTestCase
+@property (nonatomic, copy) NSString *cachePath;
+@property (nonatomic, copy) NSString *tracePath;
+@end
+
+@implementation SPTPersistentCacheTraceReplayerTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    NSString * const uniqueString = [[NSProcessInfo processInfo] globallyUniqueString];
+    self.cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"pdc-trace-%@.tmp", uniqueString]];
+    self.tracePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"pdc-trace-%@.trace", uniqueString]];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.cachePath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:self.tracePath error:nil];
+
+    [super tearDown];
+}
+
+- (SPTPersistentCache *)cacheAtPath:(NSString *)path tracePath:(NSString *)tracePath
+{
+    SPTPersistentCacheOptions * const options = [SPTPersistentCacheOptions new];
+    options.cachePath = path;
+    options.cacheIdentifier = @"Test";
+    options.traceFilePath = tracePath;
+    return [[SPTPersistentCache alloc] initWithOptions:options];
+}
+
+- (void)recordTraceWithStoreLoadAndMiss
+{
+    SPTPersistentCache * const cache = [self cacheAtPath:self.cachePath tracePath:self.tracePath];
+    XCTAssertNotNil(cache.traceRecorder);
+
+    NSData * const data = [@"TEST" dataUsingEncoding:NSUTF8StringEncoding];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    [cache storeData:data forKey:@"AA-key" locked:YES withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const hitExpectation = [self expectationWithDescription:@"hit"];
+    [cache loadDataForKey:@"AA-key" withCallback:^(SPTPersistentCacheResponse *response) {
+        [hitExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const missExpectation = [self expectationWithDescription:@"miss"];
+    [cache loadDataForKey:@"BB-key" withCallback:^(SPTPersistentCacheResponse *response) {
+        [missExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    [cache.traceRecorder flush];
+}
+
+- (void)testTraceFileContainsOneRecordPerCall
+{
+    [self recordTraceWithStoreLoadAndMiss];
+
+    NSData * const trace = [NSData dataWithContentsOfFile:self.tracePath];
+    XCTAssertEqual(trace.length, sizeof(SPTPersistentCacheTraceFileHeader) + 3 * sizeof(SPTPersistentCacheTraceRecord));
+
+    SPTPersistentCacheTraceRecord record;
+    [trace getBytes:&record range:NSMakeRange(sizeof(SPTPersistentCacheTraceFileHeader), sizeof(record))];
+    XCTAssertEqual(record.operation, SPTPersistentCacheTraceOperationStore);
+    XCTAssertEqual(record.payloadSize, 4u);
+    XCTAssertEqual(record.keyHash, SPTPersistentCacheTraceKeyHash(@"AA-key"));
+    XCTAssertTrue(record.flags & SPTPersistentCacheTraceRecordFlagsLocked);
+}
+
+- (void)testTraceRecordsFetchesUpdatesAndTags
+{
+    SPTPersistentCacheOptions * const options = [SPTPersistentCacheOptions new];
+    options.cachePath = self.cachePath;
+    options.cacheIdentifier = @"Test";
+    options.traceFilePath = self.tracePath;
+    options.useTagIndex = YES;
+    SPTPersistentCache * const cache = [[SPTPersistentCache alloc] initWithOptions:options];
+    NSData * const data = [@"TEST" dataUsingEncoding:NSUTF8StringEncoding];
+
+    __weak XCTestExpectation * const fetchExpectation = [self expectationWithDescription:@"fetch"];
+    [cache loadDataForKey:@"AA-key" loader:^(NSString *key, SPTPersistentCacheLoaderCompletion completion) {
+        completion(data, nil);
+    } ttl:0 serveStale:NO withCallback:^(SPTPersistentCacheResponse *response) {
+        [fetchExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:@"store"];
+    SPTPersistentCacheStoreOptions * const storeOptions = [SPTPersistentCacheStoreOptions new];
+    storeOptions.tags = [NSSet setWithObject:@"tag"];
+    [cache storeData:data forKey:@"BB-key" options:storeOptions withCallback:^(SPTPersistentCacheResponse *response) {
+        [storeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const appendExpectation = [self expectationWithDescription:@"append"];
+    [cache appendData:data toKey:@"BB-key" callback:^(SPTPersistentCacheResponse *response) {
+        [appendExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    [cache removeDataForTag:@"tag" callback:^(SPTPersistentCacheResponse *response) {
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+    [cache.traceRecorder flush];
+
+    // The fetched data is recorded as a store, a tag ahead of the store of its record
+    NSData * const trace = [NSData dataWithContentsOfFile:self.tracePath];
+    const SPTPersistentCacheTraceOperation expectedOperations[] = {
+        SPTPersistentCacheTraceOperationFetch,
+        SPTPersistentCacheTraceOperationStore,
+        SPTPersistentCacheTraceOperationTag,
+        SPTPersistentCacheTraceOperationStore,
+        SPTPersistentCacheTraceOperationAppend,
+        SPTPersistentCacheTraceOperationRemoveTag,
+    };
+    const size_t recordCount = sizeof(expectedOperations) / sizeof(expectedOperations[0]);
+    const size_t traceLength = sizeof(SPTPersistentCacheTraceFileHeader) + recordCount * sizeof(SPTPersistentCacheTraceRecord);
+    XCTAssertEqual(trace.length, traceLength);
+    if (trace.length != traceLength) {
+        return;
+    }
+
+    const SPTPersistentCacheTraceRecord * const records = (const SPTPersistentCacheTraceRecord *)((const uint8_t *)trace.bytes + sizeof(SPTPersistentCacheTraceFileHeader));
+    for (size_t i = 0; i < recordCount; ++i) {
+        XCTAssertEqual(records[i].operation, expectedOperations[i], @"record %zu", i);
+    }
+    XCTAssertEqual(records[2].keyHash, SPTPersistentCacheTraceKeyHash(@"tag"));
+    XCTAssertEqual(records[2].recordKeyHash, SPTPersistentCacheTraceKeyHash(@"BB-key"));
+    XCTAssertEqual(records[4].payloadSize, 4u);
+}
+
+- (void)testReplayReportsHitRatioAndLatencies
+{
+    [self recordTraceWithStoreLoadAndMiss];
+
+    NSString * const replayCachePath = [self.cachePath stringByAppendingString:@"-replay"];
+    SPTPersistentCache * const replayCache = [self cacheAtPath:replayCachePath tracePath:nil];
+    SPTPersistentCacheTraceReplayer * const replayer = [[SPTPersistentCacheTraceReplayer alloc] initWithTracePath:self.tracePath];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"replay"];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSError *error = nil;
+        SPTPersistentCacheTraceReplayReport * const report = [replayer replayAgainstCache:replayCache
+                                                                                  timing:SPTPersistentCacheTraceReplayTimingAsFastAsPossible
+                                                                                   error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqual(report.recordCount, 3u);
+        XCTAssertEqual(report.skippedRecordCount, 0u);
+        XCTAssertEqual(report.loadCount, 2u);
+        XCTAssertEqual(report.hitCount, 1u);
+        XCTAssertEqualWithAccuracy(report.hitRatio, 0.5, DBL_EPSILON);
+        XCTAssertEqual(report.operationStatistics[@(SPTPersistentCacheTraceOperationLoad)].count, 2u);
+        XCTAssertEqual(report.operationStatistics[@(SPTPersistentCacheTraceOperationStore)].count, 1u);
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    [[NSFileManager defaultManager] removeItemAtPath:replayCachePath error:nil];
+}
+
+- (void)recordTraceWithBatchedCallsAndPrefixLoad
+{
+    SPTPersistentCache * const cache = [self cacheAtPath:self.cachePath tracePath:self.tracePath];
+    NSData * const data = [@"TEST" dataUsingEncoding:NSUTF8StringEncoding];
+    NSArray<NSString *> * const keys = @[@"AA-key", @"BB-key"];
+
+    for (NSString *key in keys) {
+        __weak XCTestExpectation * const storeExpectation = [self expectationWithDescription:key];
+        [cache storeData:data forKey:key locked:NO withCallback:^(SPTPersistentCacheResponse *response) {
+            [storeExpectation fulfill];
+        } onQueue:dispatch_get_main_queue()];
+    }
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    XCTestExpectation * const lockExpectation = [self expectationWithDescription:@"lock"];
+    lockExpectation.expectedFulfillmentCount = keys.count;
+    [cache lockDataForKeys:keys callback:^(SPTPersistentCacheResponse *response) {
+        [lockExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const replaceExpectation = [self expectationWithDescription:@"replace"];
+    [cache replaceRange:NSMakeRange(0, 2) withData:[@"XY" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"AA-key" callback:^(SPTPersistentCacheResponse *response) {
+        [replaceExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const enumerationExpectation = [self expectationWithDescription:@"enumeration"];
+    [cache enumerateMetadataForKeysWithPrefix:nil predicate:nil batchSize:3 cancellationToken:nil callback:^(NSArray<SPTPersistentCacheRecordMetadata *> *metadata, BOOL finished) {
+        if (finished) {
+            [enumerationExpectation fulfill];
+        }
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const prefixExpectation = [self expectationWithDescription:@"prefix"];
+    [cache loadDataForKeysWithPrefix:@"AA" chooseKeyCallback:^NSString *(NSArray<NSString *> *keysToConsider) {
+        return keysToConsider.firstObject;
+    } withCallback:^(SPTPersistentCacheResponse *response) {
+        [prefixExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    __weak XCTestExpectation * const removeExpectation = [self expectationWithDescription:@"remove"];
+    [cache removeDataForKeys:keys callback:^(SPTPersistentCacheResponse *response) {
+        [removeExpectation fulfill];
+    } onQueue:dispatch_get_main_queue()];
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    [cache.traceRecorder flush];
+}
+
+- (void)testBatchedCallsAreRecordedOnceWithTheirKeys
+{
+    [self recordTraceWithBatchedCallsAndPrefixLoad];
+
+    NSData * const trace = [NSData dataWithContentsOfFile:self.tracePath];
+    const size_t recordSize = sizeof(SPTPersistentCacheTraceRecord);
+    const size_t keysSize = 2 * sizeof(uint64_t);
+    // Two stores, the lock and its keys, the replaced range, the enumeration, the prefix load, the remove and its keys
+    const size_t traceLength = sizeof(SPTPersistentCacheTraceFileHeader) + 7 * recordSize + 2 * keysSize;
+    XCTAssertEqual(trace.length, traceLength);
+    if (trace.length != traceLength) {
+        return;
+    }
+
+    const uint8_t *bytes = (const uint8_t *)trace.bytes + sizeof(SPTPersistentCacheTraceFileHeader) + 2 * recordSize;
+    SPTPersistentCacheTraceRecord record;
+    memcpy(&record, bytes, recordSize);
+    XCTAssertEqual(record.operation, SPTPersistentCacheTraceOperationLock);
+    XCTAssertEqual(record.keyCount, 2u);
+    XCTAssertEqual(record.keyHash, 0u);
+    uint64_t keyHashes[2];
+    memcpy(keyHashes, bytes + recordSize, keysSize);
+    XCTAssertEqual(keyHashes[0], SPTPersistentCacheTraceKeyHash(@"AA-key"));
+    XCTAssertEqual(keyHashes[1], SPTPersistentCacheTraceKeyHash(@"BB-key"));
+    bytes += recordSize + keysSize;
+
+    memcpy(&record, bytes, recordSize);
+    XCTAssertEqual(record.operation, SPTPersistentCacheTraceOperationReplaceRange);
+    XCTAssertEqual(record.rangeLength, 2u);
+    XCTAssertEqual(record.payloadSize, 2u);
+    XCTAssertEqual(record.ttl, 0u);
+    bytes += recordSize;
+
+    memcpy(&record, bytes, recordSize);
+    XCTAssertEqual(record.operation, SPTPersistentCacheTraceOperationEnumerateMetadata);
+    XCTAssertEqual(record.batchSize, 3u);
+    XCTAssertEqual(record.payloadSize, 0u);
+    bytes += recordSize;
+
+    memcpy(&record, bytes, recordSize);
+    XCTAssertEqual(record.operation, SPTPersistentCacheTraceOperationLoadWithPrefix);
+    XCTAssertEqual(record.keyHash, SPTPersistentCacheTraceKeyHash(@"AA"));
+    XCTAssertEqual(record.recordKeyHash, SPTPersistentCacheTraceKeyHash(@"AA-key"));
+    bytes += recordSize;
+
+    memcpy(&record, bytes, recordSize);
+    XCTAssertEqual(record.operation, SPTPersistentCacheTraceOperationRemove);
+    XCTAssertEqual(record.keyCount, 2u);
+}
+
+- (void)testReplayIssuesBatchedCallsAndPrefixLoadsAtTheirOffsets
+{
+    [self recordTraceWithBatchedCallsAndPrefixLoad];
+
+    NSString * const replayCachePath = [self.cachePath stringByAppendingString:@"-replay"];
+    SPTPersistentCache * const replayCache = [self cacheAtPath:replayCachePath tracePath:nil];
+    SPTPersistentCacheTraceReplayer * const replayer = [[SPTPersistentCacheTraceReplayer alloc] initWithTracePath:self.tracePath];
+
+    __weak XCTestExpectation * const expectation = [self expectationWithDescription:@"replay"];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSError *error = nil;
+        SPTPersistentCacheTraceReplayReport * const report = [replayer replayAgainstCache:replayCache
+                                                                                  timing:SPTPersistentCacheTraceReplayTimingOriginal
+                                                                                   error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqual(report.recordCount, 7u);
+        XCTAssertEqual(report.skippedRecordCount, 0u);
+        XCTAssertEqual(report.operationStatistics[@(SPTPersistentCacheTraceOperationLock)].count, 1u);
+        XCTAssertEqual(report.operationStatistics[@(SPTPersistentCacheTraceOperationRemove)].count, 1u);
+        XCTAssertEqual(report.operationStatistics[@(SPTPersistentCacheTraceOperationEnumerateMetadata)].count, 1u);
+        XCTAssertEqual(report.loadCount, 1u);
+        XCTAssertEqual(report.hitCount, 1u, @"The prefix load should open the record it opened when recorded");
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:SPTPersistentCacheTraceReplayerTestsTimeout handler:nil];
+
+    [[NSFileManager defaultManager] removeItemAtPath:replayCachePath error:nil];
+}
+
+- (void)testReplayFailsForInvalidTrace
+{
+    [[@"not a trace" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:self.tracePath atomically:YES];
+
+    SPTPersistentCache * const cache = [self cacheAtPath:self.cachePath tracePath:nil];
+    SPTPersistentCacheTraceReplayer * const replayer = [[SPTPersistentCacheTraceReplayer alloc] initWithTracePath:self.tracePath];
+
+    NSError *error = nil;
+    SPTPersistentCacheTraceReplayReport * const report = [replayer replayAgainstCache:cache
+                                                                              timing:SPTPersistentCacheTraceReplayTimingOriginal
+                                                                               error:&error];
+    XCTAssertNil(report);
+    XCTAssertEqualObjects(error.domain, SPTPersistentCacheErrorDomain);
+}
+
+@end
@@ -0,0 +1,54 @@
+// Copyright Spotify AB.
+// SPDX-License-Identifier: Apache-2.0
+
+#import <XCTest/XCTest.h>
+
+#import "SPTPersistentCacheUpdateJournal.h"
+
+@interface SPTPersistentCacheUpdateJournalTests : XCTestCase
+@end
+
+@implementation SPTPersistentCacheUpdateJournalTests
+
+- (NSData *)journal
+{
+    const SPTPersistentCacheRecordHeader recordHeader = SPTPersistentCacheRecordHeaderMake(0, 12, 1000, NO);
+    return SPTPersistentCacheUpdateJournalEncode(&recordHeader, 8, [@"89AB" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testDecodeGivesEncodedUpdate
+{
+    SPTPersistentCacheUpdateJournalHeader header;
+    NSData * const bytes = SPTPersistentCacheUpdateJournalDecode(self.journal, &header);
+
+    XCTAssertEqualObjects(bytes, [@"89AB" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertEqual(header.magic, SPTPersistentCacheUpdateJournalMagicValue);
+    XCTAssertEqual(header.offset, 8u);
+    XCTAssertEqual(header.length, 4u);
+    XCTAssertEqual(header.recordHeader.payloadSizeBytes, 12u);
+    XCTAssertNil(SPTPersistentCacheCheckValidHeader(&header.recordHeader));
+}
+
+- (void)testTornJournalIsRejected
+{
+    SPTPersistentCacheUpdateJournalHeader header;
+    NSData * const journal = self.journal;
+
+    XCTAssertNil(SPTPersistentCacheUpdateJournalDecode([journal subdataWithRange:NSMakeRange(0, journal.length - 1)], &header));
+    XCTAssertNil(SPTPersistentCacheUpdateJournalDecode([journal subdataWithRange:NSMakeRange(0, 10)], &header));
+
+    NSMutableData * const corrupted = [journal mutableCopy];
+    ((uint8_t *)corrupted.mutableBytes)[corrupted.length - 1] ^= 0xFF;
+    XCTAssertNil(SPTPersistentCacheUpdateJournalDecode(corrupted, &header));
+}
+
+- (void)testJournalWithWrongMagicIsRejected
+{
+    SPTPersistentCacheUpdateJournalHeader header;
+    NSMutableData * const journal = [self.journal mutableCopy];
+    ((SPTPersistentCacheUpdateJournalHeader *)journal.mutableBytes)->magic = 0;
+
+    XCTAssertNil(SPTPersistentCacheUpdateJournalDecode(journal, &header));
+}
+
+@end